@@ -0,0 +1,35 @@
+#pragma once
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <mutex>
+#endif
+
+
+/*!
+Mutex that serializes access to an I2C bus shared by several tasks, such as the M5StickC's internal bus,
+on which the MPU6886 is read by the motion task and the AXP192 power management by the control loop.
+
+An I2C transaction waits on the bus interrupt, so it cannot be made inside a critical section.
+On the ESP32 this is a FreeRTOS mutex, which blocks the waiting task and has priority inheritance,
+so the control loop holding the bus is raised to the motion task's priority until it releases it.
+On host builds it is a std::mutex.
+*/
+class BusMutex {
+public:
+    BusMutex();
+    BusMutex(const BusMutex&) = delete;
+    BusMutex& operator=(const BusMutex&) = delete;
+public:
+    void lock(void);
+    void unlock(void);
+private:
+#if defined(ESP_PLATFORM)
+    StaticSemaphore_t _mutexBuffer {};
+    SemaphoreHandle_t _mutex;
+#else
+    std::mutex _mutex;
+#endif
+};
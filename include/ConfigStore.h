@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Persistent store for the pairing and the stick calibration, so the rover reconnects to its joystick after a power cycle without a binding round.
+
+The configuration is stored as a single record, with a version and a checksum. A record with a different version or a bad checksum
+is ignored, so the defaults are used after a firmware update changes `config_t`, rather than misinterpreting the old record.
+
+On the device the record is stored in NVS, using the Preferences library. On the host it is stored in a file, so the store can be exercised without flash.
+*/
+class ConfigStore {
+public:
+    enum { VERSION = 1 };
+    enum { MAC_ADDRESS_LENGTH = 6 };
+    enum { THROTTLE = 0, ROLL = 1, PITCH = 2, YAW = 3, AXIS_COUNT = 4 };
+    struct config_t {
+        uint8_t peerMacAddress[MAC_ADDRESS_LENGTH];
+        uint8_t isPeerSet;
+        uint8_t channel;
+        uint8_t isBiasSet;
+        uint8_t reserved[3]; //!< explicit padding, always zero, since the checksum and the unchanged check cover every byte
+        float deadZone;
+        float bias[AXIS_COUNT];
+    };
+    static_assert(sizeof(config_t) == 32, "config_t must have no implicit padding");
+    enum load_result_t { LOADED, NOT_FOUND, WRONG_VERSION, BAD_CHECKSUM };
+public:
+    //! `name` is the NVS namespace on the device, and the file name on the host.
+    explicit ConfigStore(const char* name);
+    static config_t defaultConfig(uint8_t channel, float deadZone);
+public:
+    load_result_t load(config_t& config);
+    bool save(const config_t& config);
+    bool erase(void);
+    inline uint32_t getWriteCount(void) const { return _writeCount; }
+private:
+    struct record_t {
+        uint16_t version;
+        uint16_t size; //!< size of config_t, as a second check that the layout has not changed
+        config_t config;
+        uint32_t checksum;
+    };
+    static_assert(sizeof(record_t) == 2 * sizeof(uint16_t) + sizeof(config_t) + sizeof(uint32_t), "record_t must have no implicit padding");
+    static uint32_t checksum(const record_t& record);
+    bool readRecord(record_t& record) const;
+    bool writeRecord(const record_t& record) const;
+private:
+    const char* _name;
+    record_t _saved {}; //!< the last record loaded or saved, so that unchanged configurations are not rewritten
+    bool _isSavedValid {false};
+    uint32_t _writeCount {0};
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <M5Unified.h>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+
+
+/*!
+Display of the Rover's state on the M5Stick LCD.
+
+The control loop publishes a snapshot of its state, which is a short copy inside a critical section.
+The snapshot is rendered at a capped frame rate into an off-screen sprite by a low priority task,
+which by default runs on core 0, away from the control loop on core 1.
+Only fields whose text has changed are redrawn and pushed to the LCD.
+*/
+class Display {
+public:
+    struct controls_t {
+        float throttle;
+        float roll;
+        float pitch;
+        float yaw;
+        float speed;
+        float angle;
+        uint8_t mode;
+        uint8_t altMode;
+        uint8_t flipButton;
+    };
+    struct statistics_t {
+        uint32_t frameCount;
+        uint32_t fieldsDrawnCount;
+        uint32_t renderTimeUs; //!< render time of the last frame
+        uint32_t renderTimeMaxUs;
+    };
+    enum { SCREEN_HEIGHT_M5_STICK_C = 80, SCREEN_HEIGHT_M5_STICK_C_PLUS = 135 };
+    enum { DEFAULT_FRAMES_PER_SECOND = 10, DEFAULT_TASK_PRIORITY = 1, DEFAULT_TASK_CORE = 0, TASK_STACK_SIZE = 4096 };
+    enum { MAX_FRAMES_PER_SECOND = 1000 };
+public:
+    Display(int screenHeight, const uint8_t* myMacAddress);
+    void begin(uint32_t framesPerSecond=DEFAULT_FRAMES_PER_SECOND, UBaseType_t priority=DEFAULT_TASK_PRIORITY, BaseType_t core=DEFAULT_TASK_CORE);
+public:
+    // called from the control loop
+    void setControls(const controls_t& controls);
+    void setJoyStickMacAddress(const uint8_t* joyStickMacAddress);
+    void setButton(char button);
+    // called from the render task, or directly if the render task has not been started
+    void renderFrame(void);
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+    inline uint32_t getFramePeriodMs(void) const { return _framePeriodMs; }
+private:
+    enum field_t {
+        FIELD_MY_MAC_1, FIELD_MY_MAC_2, FIELD_JOYSTICK_MAC_1, FIELD_JOYSTICK_MAC_2,
+        FIELD_THROTTLE, FIELD_ROLL, FIELD_PITCH, FIELD_YAW, FIELD_MODES,
+        FIELD_SPEED, FIELD_ANGLE, FIELD_BUTTON,
+        FIELD_COUNT
+    };
+    enum { FIELD_TEXT_SIZE = 16, MAC_ADDRESS_LEN = 6 };
+    struct field_position_t {
+        int16_t x;
+        int16_t y;
+        int16_t width;
+    };
+    struct snapshot_t {
+        controls_t controls;
+        uint8_t joyStickMacAddress[MAC_ADDRESS_LEN];
+        bool joyStickMacAddressSet;
+        char button;
+    };
+    static const field_position_t fieldPositions80x160[FIELD_COUNT];
+    static const field_position_t fieldPositions135x240[FIELD_COUNT];
+    static void renderTask(void* arg);
+    void formatField(const snapshot_t& snapshot, field_t field, char* text) const;
+private:
+    const int _screenHeight;
+    const field_position_t* _fieldPositions;
+    int _lineHeight;
+    uint32_t _framePeriodMs {1000 / DEFAULT_FRAMES_PER_SECOND};
+    uint8_t _myMacAddress[MAC_ADDRESS_LEN];
+    portMUX_TYPE _snapshotLock = portMUX_INITIALIZER_UNLOCKED;
+    snapshot_t _snapshot {}; //!< written by the control loop, guarded by _snapshotLock
+    M5Canvas _canvas;
+    bool _canvasCreated {false};
+    char _fieldText[FIELD_COUNT][FIELD_TEXT_SIZE] {}; //!< text currently on the LCD
+    statistics_t _statistics {0, 0, 0, 0};
+};
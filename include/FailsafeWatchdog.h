@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Failsafe watchdog driven by a monotonic millisecond clock.
+
+If `feed()` is not called for longer than the timeout then the watchdog responds in stages:
+1. HOLD: the last command is held for `holdMs`
+2. RAMP_DOWN: the speed scale is ramped linearly down to zero over `rampDownMs`
+3. STOPPED: the rover should be stopped
+
+The clock is injectable, so the stop timing can be checked on a host with a simulated clock.
+*/
+class FailsafeWatchdog {
+public:
+    typedef uint32_t (*clock_ms_t)(void);
+    enum stage_t { ACTIVE, HOLD, RAMP_DOWN, STOPPED };
+    struct config_t {
+        uint32_t timeoutMs;
+        uint32_t holdMs;
+        uint32_t rampDownMs;
+    };
+    enum { DEFAULT_TIMEOUT_MS = 100, DEFAULT_HOLD_MS = 100, DEFAULT_RAMP_DOWN_MS = 300 };
+public:
+    explicit FailsafeWatchdog(clock_ms_t clock);
+    FailsafeWatchdog(clock_ms_t clock, const config_t& config);
+public:
+    void feed(void);
+    stage_t update(void);
+    inline stage_t getStage(void) const { return _stage; }
+    inline float getSpeedScale(void) const { return _speedScale; }
+    inline const config_t& getConfig(void) const { return _config; }
+    inline void setConfig(const config_t& config) { _config = config; }
+    inline uint32_t getStopCount(void) const { return _stopCount; }
+    inline uint32_t getTimeSinceFedMs(void) const { return _clock() - _lastFedMs; }
+private:
+    clock_ms_t _clock;
+    config_t _config;
+    uint32_t _lastFedMs;
+    stage_t _stage {ACTIVE};
+    float _speedScale {1.0F};
+    uint32_t _stopCount {0}; //!< number of times the watchdog has reached the STOPPED stage
+};
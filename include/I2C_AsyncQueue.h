@@ -0,0 +1,92 @@
+#pragma once
+
+#include "BusMutex.h"
+#include "I2C_Interface.h"
+
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+
+#if !defined(ESP_PLATFORM)
+#include <mutex>
+#endif
+
+
+/*!
+Asynchronous I2C bus, which queues register writes and performs them on another bus in a worker task.
+
+`writeRegisters()` posts the values into a table of pending registers and returns at once, so the caller is not blocked
+for the duration of the bus transaction. If a register is written again before the worker has sent it, then only the
+latest value is sent. The worker sends each run of consecutive pending registers in a single transaction, retrying on error.
+
+If the table has no room for all the registers of a write, then the whole write is performed synchronously instead,
+and any older values still pending for those registers are discarded. The bus mutex is held by the worker from taking
+a batch until it has written or requeued it, and by the synchronous write, so the synchronous write waits for a batch
+in flight, and a failed batch can not be requeued over the newer values once they have been written.
+Posts do not take the bus mutex, so only a synchronous write ever waits for the worker.
+
+Since writes are performed later, `writeRegisters()` always returns 0; bus errors are counted in the statistics.
+All the counters are updated under the lock, since `resetStatistics()` is called from another task.
+
+The worker is woken by a task notification when values are posted. Until `begin()` has started it, or in tests
+that do not run the fake scheduler, `process()` is called directly.
+*/
+class I2C_AsyncQueue : public I2C_Interface {
+public:
+    typedef uint32_t (*clock_us_t)(void);
+    struct statistics_t {
+        uint32_t postCount; //!< register values posted
+        uint32_t coalescedCount; //!< register values overwritten by a later value before they were sent
+        uint32_t overflowCount; //!< writes performed synchronously, in full, because the register table had no room for them
+        uint32_t transactionCount;
+        uint32_t errorCount; //!< transactions that failed
+        uint32_t retryCount;
+        uint32_t failedCount; //!< transactions that failed on every retry, their registers are requeued
+        uint32_t depthMax; //!< the most registers pending at once
+        uint32_t blockedMaxUs; //!< the longest time spent in `writeRegisters()`
+        uint32_t latencyCount;
+        uint32_t latencyMaxUs; //!< the longest time from a value being posted to it being sent
+        uint64_t latencySumUs;
+    };
+    enum { MAX_REGISTER_COUNT = 16, MAX_RETRY_COUNT = 2 };
+    enum { DEFAULT_TASK_PRIORITY = 4, DEFAULT_TASK_CORE = 0, TASK_STACK_SIZE = 4096, IDLE_TIMEOUT_MS = 100 };
+public:
+    I2C_AsyncQueue(I2C_Interface& bus, clock_us_t clock);
+    I2C_AsyncQueue(const I2C_AsyncQueue&) = delete;
+    I2C_AsyncQueue& operator=(const I2C_AsyncQueue&) = delete;
+    void begin(uint32_t priority=DEFAULT_TASK_PRIORITY, int core=DEFAULT_TASK_CORE);
+public:
+    uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override;
+    // called from the worker task, or from a test
+    void process(void);
+    uint32_t getDepth(void);
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+    void resetStatistics(void);
+private:
+    struct entry_t {
+        uint8_t address;
+        uint8_t reg;
+        uint8_t value;
+        bool pending;
+        uint32_t postTimeUs;
+    };
+    static void workerTask(void* arg);
+    void lock(void);
+    void unlock(void);
+    void writeSynchronously(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len);
+    void writeRun(const entry_t* run, int count);
+private:
+    I2C_Interface& _bus;
+    clock_us_t _clock;
+    TaskHandle_t _workerTask {nullptr};
+    BusMutex _busMutex; //!< held by the worker from taking a batch until it is written or requeued, and during a synchronous write
+#if defined(ESP_PLATFORM)
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+#else
+    std::mutex _mutex;
+#endif
+    // guarded by the lock
+    entry_t _entries[MAX_REGISTER_COUNT] {};
+    int _entryCount {0};
+    uint32_t _pendingCount {0};
+    statistics_t _statistics {};
+};
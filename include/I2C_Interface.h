@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*!
+Interface to an I2C bus.
+
+The RoverC accesses the bus only through this interface, so that on a host build the bus can be replaced
+by a fake that records transactions.
+*/
+class I2C_Interface {
+public:
+    virtual ~I2C_Interface() = default;
+    /*!
+    Write `len` bytes to consecutive registers of the device at `address`, starting at `firstRegister`, in a single transaction.
+
+    Returns 0 on success, otherwise an error code as returned by Arduino's `TwoWire::endTransmission()`.
+    */
+    virtual uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) = 0;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "I2C_Interface.h"
+
+
+/*!
+I2C bus implemented using the Arduino Wire library.
+*/
+class I2C_Wire : public I2C_Interface {
+public:
+    I2C_Wire(int sdaPin, int sclPin);
+public:
+    uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override;
+};
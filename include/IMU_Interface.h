@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Interface to an IMU that buffers its samples, so they can be read in batches.
+
+The yaw rate controller reads the IMU only through this interface, so that on a host build the IMU can be replaced
+by a fake that replays recorded or simulated samples.
+*/
+class IMU_Interface {
+public:
+    //! Acceleration in g, angular rate in degrees per second.
+    struct sample_t {
+        float accX;
+        float accY;
+        float accZ;
+        float gyroX;
+        float gyroY;
+        float gyroZ;
+    };
+public:
+    virtual ~IMU_Interface() = default;
+    /*!
+    Read up to `maxCount` of the samples that have accumulated since the last read, oldest first.
+
+    Returns the number of samples read.
+    */
+    virtual int readSamples(sample_t* samples, int maxCount) = 0;
+    virtual uint32_t getSampleRateHz(void) const = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "IMU_Interface.h"
+
+class BusMutex;
+
+
+/*!
+The M5StickC's built-in MPU6886, read through its FIFO.
+
+The MPU6886 writes each accelerometer, temperature and gyro sample into its 1KB FIFO,
+so a whole batch of samples is read in one burst, rather than polling the data registers once per sample.
+
+The internal I2C bus is shared with the AXP192 power management, which the control loop reads through M5Unified,
+so each read holds the bus mutex, which the control loop must also hold while it uses the bus.
+*/
+class IMU_MPU6886 : public IMU_Interface {
+public:
+    enum { DEFAULT_SAMPLE_RATE_HZ = 500 };
+    struct statistics_t {
+        uint32_t sampleCount;
+        uint32_t readCount; //!< number of FIFO count reads, each followed by zero or more bursts
+        uint32_t overflowCount; //!< number of times the FIFO was reset because it had filled up or lost alignment
+    };
+public:
+    explicit IMU_MPU6886(BusMutex& busMutex, uint32_t sampleRateHz=DEFAULT_SAMPLE_RATE_HZ);
+    bool init(void);
+public:
+    int readSamples(sample_t* samples, int maxCount) override;
+    inline uint32_t getSampleRateHz(void) const override { return _sampleRateHz; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+private:
+    enum : uint8_t { I2C_ADDRESS = 0x68 };
+    enum : uint8_t {
+        REGISTER_SMPLRT_DIV = 0x19,
+        REGISTER_CONFIG = 0x1A,
+        REGISTER_GYRO_CONFIG = 0x1B,
+        REGISTER_ACCEL_CONFIG = 0x1C,
+        REGISTER_FIFO_EN = 0x23,
+        REGISTER_USER_CTRL = 0x6A,
+        REGISTER_PWR_MGMT_1 = 0x6B,
+        REGISTER_FIFO_COUNTH = 0x72,
+        REGISTER_FIFO_R_W = 0x74,
+    };
+    enum : uint8_t { CONFIG_FIFO_MODE_STOP_WHEN_FULL = 0x40, CONFIG_DLPF_176HZ = 0x01 };
+    enum : uint8_t { GYRO_CONFIG_2000DPS = 0x18, ACCEL_CONFIG_8G = 0x10 };
+    enum : uint8_t { FIFO_EN_GYRO = 0x10, FIFO_EN_ACCEL = 0x08 };
+    enum : uint8_t { USER_CTRL_FIFO_EN = 0x40, USER_CTRL_FIFO_RST = 0x04 };
+    enum { I2C_FREQUENCY = 400000 };
+    enum { FIFO_SIZE = 1024 };
+    enum { SAMPLE_SIZE = 14 }; //!< accelerometer, temperature, and gyro, each as big-endian int16_t
+    enum { MAX_BURST_SAMPLE_COUNT = 8 }; //!< keeps each burst within the I2C driver's buffer
+    static constexpr float ACC_SCALE = 1.0F / 4096.0F; //!< g per LSB at +/-8g
+    static constexpr float GYRO_SCALE = 1.0F / 16.4F; //!< degrees per second per LSB at +/-2000dps
+private:
+    bool writeRegister(uint8_t reg, uint8_t value);
+    void resetFIFO(void);
+    int readFIFO(sample_t* samples, int maxCount);
+    static int16_t toInt16(const uint8_t* data) { return static_cast<int16_t>((data[0] << 8) | data[1]); }
+private:
+    BusMutex& _busMutex;
+    uint32_t _sampleRateHz;
+    statistics_t _statistics {0, 0, 0};
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Wheel geometries for the kinematic mixer.
+
+Each geometry defines the matrix that maps the input axes onto the wheel outputs.
+*/
+
+/*!
+Mecanum wheels, used by both the RoverC and the RoverC Pro.
+
+ motor numbers:
+1 ------ 2
+|        |
+|        |
+|   M5   |
+3 ------ 4
+*/
+struct MecanumGeometry {
+    enum { INPUT_X = 0, INPUT_Y = 1, INPUT_ROTATION = 2, INPUT_COUNT = 3 };
+    enum { FRONT_LEFT = 0, FRONT_RIGHT = 1, BACK_LEFT = 2, BACK_RIGHT = 3, OUTPUT_COUNT = 4 };
+    static constexpr float matrix[OUTPUT_COUNT][INPUT_COUNT] {
+        {  1.0F, 1.0F,  1.0F }, // FRONT_LEFT  = y + x + rotation
+        { -1.0F, 1.0F, -1.0F }, // FRONT_RIGHT = y - x - rotation
+        { -1.0F, 1.0F,  1.0F }, // BACK_LEFT   = y - x + rotation
+        {  1.0F, 1.0F, -1.0F }, // BACK_RIGHT  = y + x - rotation
+    };
+};
+
+/*!
+Tank (skid) steering on a four wheel base: the left and right inputs drive the wheels on each side directly.
+*/
+struct TankGeometry {
+    enum { INPUT_LEFT = 0, INPUT_RIGHT = 1, INPUT_COUNT = 2 };
+    enum { FRONT_LEFT = 0, FRONT_RIGHT = 1, BACK_LEFT = 2, BACK_RIGHT = 3, OUTPUT_COUNT = 4 };
+    static constexpr float matrix[OUTPUT_COUNT][INPUT_COUNT] {
+        { 1.0F, 0.0F }, // FRONT_LEFT
+        { 0.0F, 1.0F }, // FRONT_RIGHT
+        { 1.0F, 0.0F }, // BACK_LEFT
+        { 0.0F, 1.0F }, // BACK_RIGHT
+    };
+};
+
+/*!
+Three omni wheels at 120 degree spacing, with wheel 1 at the front.
+Each wheel's contribution is -sin(theta)*x + cos(theta)*y + rotation, where theta is the angle of the wheel's axle.
+*/
+struct Omni3Geometry {
+    enum { INPUT_X = 0, INPUT_Y = 1, INPUT_ROTATION = 2, INPUT_COUNT = 3 };
+    enum { WHEEL_1 = 0, WHEEL_2 = 1, WHEEL_3 = 2, OUTPUT_COUNT = 3 };
+    static constexpr float matrix[OUTPUT_COUNT][INPUT_COUNT] {
+        {  0.0F,        1.0F, 1.0F }, // theta = 0
+        { -0.8660254F, -0.5F, 1.0F }, // theta = 120 degrees
+        {  0.8660254F, -0.5F, 1.0F }, // theta = 240 degrees
+    };
+};
+
+/*!
+Kinematic mixer, with the wheel geometry as a template parameter.
+
+The inputs and outputs are normalized to the range [-1, 1].
+If any output would exceed this range, then all the outputs are scaled down by the same factor,
+so that the ratios between the wheels, and hence the direction of travel, are preserved.
+*/
+template <typename GEOMETRY>
+class Mixer {
+public:
+    enum { INPUT_COUNT = GEOMETRY::INPUT_COUNT, OUTPUT_COUNT = GEOMETRY::OUTPUT_COUNT };
+public:
+    static constexpr float absolute(float value) { return value < 0.0F ? -value : value; }
+    static constexpr int roundToInt(float value) { return static_cast<int>(value < 0.0F ? value - 0.5F : value + 0.5F); }
+
+    static constexpr void mix(const float (&inputs)[INPUT_COUNT], float (&outputs)[OUTPUT_COUNT]) {
+        float maxMagnitude = 1.0F;
+        for (int ii = 0; ii < OUTPUT_COUNT; ++ii) {
+            float output = 0.0F;
+            for (int jj = 0; jj < INPUT_COUNT; ++jj) {
+                output += GEOMETRY::matrix[ii][jj] * inputs[jj];
+            }
+            outputs[ii] = output;
+            if (absolute(output) > maxMagnitude) {
+                maxMagnitude = absolute(output);
+            }
+        }
+        if (maxMagnitude > 1.0F) {
+            // desaturate, preserving the ratios between the outputs
+            const float scale = 1.0F / maxMagnitude;
+            for (auto& output : outputs) {
+                output *= scale;
+            }
+        }
+    }
+
+    //! Mix the inputs and convert the outputs to integer speeds in the range [-maxSpeed, maxSpeed].
+    static constexpr void mix(const float (&inputs)[INPUT_COUNT], int8_t (&speeds)[OUTPUT_COUNT], float maxSpeed) {
+        float outputs[OUTPUT_COUNT] {};
+        mix(inputs, outputs);
+        for (int ii = 0; ii < OUTPUT_COUNT; ++ii) {
+            speeds[ii] = static_cast<int8_t>(roundToInt(outputs[ii] * maxSpeed));
+        }
+    }
+};
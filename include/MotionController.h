@@ -0,0 +1,113 @@
+#pragma once
+
+#include "RoverC.h"
+#include "YawRateController.h"
+
+#include <PacketRing.h>
+#include <atomic>
+#include <cstdint>
+
+
+/*!
+Fixed-rate motion control executive, which owns the RoverC.
+
+The control loop publishes setpoints as packets arrive, and `update()` is run at a fixed rate, by default 200Hz.
+Each update:
+1. takes the latest setpoint, if a new one has been published
+2. interpolates from the previous setpoint towards it, over the measured interval between setpoints
+3. if a yaw rate controller has been set, corrects the rotation term using the gyro
+4. mixes the result into motor speeds and limits the rate of change of each wheel's speed
+5. writes the motor speeds to the RoverC, and records the latency from the setpoint's packet being received
+
+So the wheels are updated at a steady rate, independent of radio jitter, and step changes in the sticks are smoothed.
+
+`update()` takes its time from an injectable clock and has no other dependency on the scheduler,
+so it can be stepped on a host with a simulated clock. `begin()` runs it in a FreeRTOS task, which on the host
+is run by the fake scheduler in test/fakes.
+
+The control loop does not write to the controller's state: `stop()` and `resetStatistics()` post requests,
+which the control task acts on at its next update.
+*/
+class MotionController {
+public:
+    typedef uint32_t (*clock_us_t)(void);
+    struct setpoint_t {
+        float throttle;
+        float roll;
+        float pitch;
+        float yaw;
+        float speedScale; //!< applied to the motor speeds, used by the failsafe to ramp the speed down
+        RoverC::control_mode_t controlMode;
+        uint32_t receiveTimeUs; //!< when the packet the setpoint was taken from was received, zero if the setpoint is not from a packet
+    };
+    struct config_t {
+        uint32_t periodUs;
+        uint32_t maxInterpolationUs; //!< the longest time over which a new setpoint is interpolated, zero to disable interpolation
+        float maxAcceleration[RoverC::MOTOR_COUNT]; //!< the maximum rate of change of each wheel's speed, in speed units per second
+    };
+    //! Timing of the updates, jitter is the difference between the actual and the configured period.
+    struct statistics_t {
+        uint32_t updateCount;
+        uint32_t setpointCount;
+        uint32_t periodCount; //!< number of periods measured, the divisor for the mean jitter
+        uint32_t periodMinUs;
+        uint32_t periodMaxUs;
+        uint32_t jitterMaxUs;
+        uint64_t jitterSumUs;
+        uint32_t updateTimeMaxUs; //!< the longest time taken by `update()`, including the I2C write
+        uint32_t overrunCount; //!< updates that took longer than the period, and so delayed the next update
+        uint32_t slewLimitedCount; //!< number of wheel updates that were limited by the maximum acceleration
+        // latency from a packet being received to its setpoint's first actuator frame being written to the RoverC
+        uint32_t latencyCount;
+        uint32_t latencyMinUs;
+        uint32_t latencyMaxUs;
+        uint64_t latencySumUs;
+    };
+    enum { DEFAULT_PERIOD_US = 5000, DEFAULT_MAX_INTERPOLATION_US = 50000 };
+    static constexpr float DEFAULT_MAX_ACCELERATION = 1000.0F; //!< zero to full speed in 100ms
+    enum { DEFAULT_TASK_PRIORITY = 5, DEFAULT_TASK_CORE = 1, TASK_STACK_SIZE = 4096 };
+public:
+    MotionController(RoverC& rover, clock_us_t clock);
+    MotionController(RoverC& rover, clock_us_t clock, const config_t& config);
+    static config_t defaultConfig(void);
+    void begin(uint32_t priority=DEFAULT_TASK_PRIORITY, int core=DEFAULT_TASK_CORE);
+public:
+    // called from the control loop
+    inline void setSetpoint(const setpoint_t& setpoint) { _setpoints.push(reinterpret_cast<const uint8_t*>(&setpoint), sizeof(setpoint), _clock()); } // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    //! Stop the motors at the next update, without limiting the deceleration. The next setpoint is interpolated from rest.
+    inline void stop(void) { _stopRequested = true; }
+    // called at the configured rate, from the control task or from a test
+    void update(void);
+    inline void setYawRateController(YawRateController* yawRateController) { _yawRateController = yawRateController; }
+    inline const config_t& getConfig(void) const { return _config; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+    //! The statistics are reset at the next update, so that they are not reset while the control task is updating them.
+    inline void resetStatistics(void) { _resetStatisticsRequested = true; }
+private:
+    static void controlTask(void* arg);
+    void clearStatistics(void);
+    void stopWheels(void);
+    uint32_t consumeSetpoint(uint32_t timeUs);
+    void interpolate(uint32_t timeUs, setpoint_t& setpoint) const;
+    void limitSlew(RoverC::actuator_frame_t& frame, uint32_t elapsedUs);
+    void recordTiming(uint32_t timeUs);
+    void recordLatency(uint32_t receiveTimeUs);
+private:
+    RoverC& _rover;
+    clock_us_t _clock;
+    config_t _config;
+    PacketRing<2, sizeof(setpoint_t)> _setpoints;
+    YawRateController* _yawRateController {nullptr};
+    setpoint_t _from {0.0F, 0.0F, 0.0F, 0.0F, 0.0F, RoverC::MECANUM_MODE, 0}; //!< start of the current interpolation
+    setpoint_t _to {0.0F, 0.0F, 0.0F, 0.0F, 0.0F, RoverC::MECANUM_MODE, 0}; //!< latest setpoint, the end of the current interpolation
+    uint32_t _interpolationStartUs {0};
+    uint32_t _interpolationUs {0};
+    uint32_t _previousSetpointUs {0};
+    uint32_t _previousUpdateUs {0};
+    bool _hasPreviousUpdate {false};
+    bool _hasSetpoint {false};
+    std::atomic<bool> _stopRequested {false};
+    std::atomic<bool> _resetStatisticsRequested {false};
+    float _wheelSpeeds[RoverC::MOTOR_COUNT] {}; //!< slew limited wheel speeds
+    statistics_t _statistics {};
+};
@@ -1,34 +1,91 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+class I2C_Interface;
+
 class RoverC {
 public:
     enum { MIN_SPEED = -100, MAX_SPEED = 100 };
     enum control_mode_t { MECANUM_MODE, TANK_MODE };
-public:
-    RoverC(void);
-private:
+    enum { MOTOR_COUNT = 4, SERVO_COUNT = 2 };
+    enum { MIN_SERVO_ANGLE = 0, MAX_SERVO_ANGLE = 90 };
+    enum { MIN_SERVO_PULSE_US = 500, MAX_SERVO_PULSE_US = 2500 };
+    //! Values for all the actuator registers, written to the RoverC in at most two I2C transactions.
+    struct actuator_frame_t {
+        int8_t motorSpeeds[MOTOR_COUNT];
+        uint8_t servoAngles[SERVO_COUNT];
+    };
+    enum write_servos_t { WRITE_SERVOS, DONT_WRITE_SERVOS };
+    /*!
+    Writes requested of the I2C interface, bytes include the address and register bytes of each.
+    On a synchronous bus each request is a transaction, but through the I2C_AsyncQueue it is a post,
+    and the queue counts the transactions actually sent.
+    */
+    struct bus_statistics_t {
+        uint32_t requestCount;
+        uint32_t requestByteCount;
+    };
+    //! Register writes sent and suppressed by the shadow register cache.
+    struct write_statistics_t {
+        uint32_t registerWriteCount;
+        uint32_t registerSuppressedCount;
+        uint32_t refreshCount;
+    };
+    enum { DEFAULT_REFRESH_INTERVAL_MS = 500 };
     enum { SDA_PIN = 0, SCL_PIN = 26 }; //!< Extended IO port: Pin 0 and 26
     enum { GROVE_SDA_PIN = 32, GROVE_SCL_PIN = 33 }; //!< // Grove-Connector: Pin 32 and 33
+public:
+    explicit RoverC(I2C_Interface& bus);
+private:
     enum : uint8_t { I2C_ADDRESS = 0x38 };
-    enum : uint8_t { REGISTER_MOTOR_1 = 0x00, REGISTER_MOTOR_2 = 0x01, REGISTER_MOTOR_3 = 0x02, REGISTER_MOTOR_4 = 0x03 }; 
+    enum : uint8_t { REGISTER_MOTOR_1 = 0x00, REGISTER_MOTOR_2 = 0x01, REGISTER_MOTOR_3 = 0x02, REGISTER_MOTOR_4 = 0x03 };
+    enum : uint8_t { REGISTER_SERVO_ANGLE_1 = 0x10, REGISTER_SERVO_ANGLE_2 = 0x11 };
+    enum : uint8_t { REGISTER_SERVO_PULSE_1 = 0x20, REGISTER_SERVO_PULSE_2 = 0x22 }; //!< 16-bit, most significant byte first
 public:
     void stop(void);
     void move(float throttle, float roll, float pitch, float yaw, control_mode_t control_mode = MECANUM_MODE);
+    void mix(float throttle, float roll, float pitch, float yaw, control_mode_t control_mode, actuator_frame_t& frame);
     float getSpeed(void) const { return _speed; }
     float getAngle(void) const { return _angle; }
+    //! The speed last written to the motor, from the shadow registers.
+    int8_t getMotorSpeed(int motor) const { return static_cast<int8_t>(_shadowRegisters[SHADOW_MOTOR_INDEX + motor]); }
+    //! Scale applied to the motor speeds, but not the servos, by `move()`. Used by the failsafe to ramp the speed down.
+    void setSpeedScale(float speedScale) { _speedScale = speedScale; }
     void setServoAngle(uint8_t servoChannel, int angle);
+    void setServoPulse(uint8_t servoChannel, uint16_t pulseWidth);
+    void writeActuatorFrame(const actuator_frame_t& frame, write_servos_t writeServos = WRITE_SERVOS);
+    inline const bus_statistics_t& getBusStatistics(void) const { return _busStatistics; }
+    inline void resetBusStatistics(void) { _busStatistics = {0, 0}; }
+    inline const write_statistics_t& getWriteStatistics(void) const { return _writeStatistics; }
+    inline void resetWriteStatistics(void) { _writeStatistics = {0, 0, 0}; }
+    inline void setRefreshIntervalMs(uint32_t refreshIntervalMs) { _refreshIntervalMs = refreshIntervalMs; }
+    inline void invalidateShadowRegisters(void) { _shadowValidMask = 0; }
 private:
-    void moveMecanumMode(float throttle, float roll, float pitch, float yaw);
-    void moveTankMode(float throttle, float roll, float pitch, float yaw);
+    void mixMecanumMode(float throttle, float roll, float pitch, float yaw, actuator_frame_t& frame);
+    void mixTankMode(float throttle, float roll, float pitch, float yaw, actuator_frame_t& frame);
     void setMotorSpeeds(int speedM1, int speedM2, int speedM3, int speedM4);
     void setMotorSpeed(uint8_t motor, int speed);
-    void setServoPulse(uint8_t servoChannel, uint16_t pulseWidth);
+    void writeRegisters(uint8_t firstRegister, const uint8_t* data, size_t len);
+    void writeChangedRegisters(uint8_t firstRegister, const uint8_t* data, size_t len, size_t shadowIndex);
+    void refreshIfDue(void);
+    static void setFrameServoAngles(actuator_frame_t& frame, int angle);
 protected:
     static int clip(int value, int min, int max) { return value < min ? min : value > max ? max : value; }
+    static int8_t clipSpeed(int speed) { return static_cast<int8_t>(clip(speed, MIN_SPEED, MAX_SPEED)); }
 private:
+    I2C_Interface& _bus;
     float _speed {0.0};
     float _angle {0.0};
+    float _speedScale {1.0};
+    bus_statistics_t _busStatistics {0, 0};
+    // shadow copy of the motor and servo registers, indexed in the same order as actuator_frame_t
+    enum { SHADOW_MOTOR_INDEX = 0, SHADOW_SERVO_INDEX = MOTOR_COUNT, SHADOW_REGISTER_COUNT = MOTOR_COUNT + SERVO_COUNT };
+    uint8_t _shadowRegisters[SHADOW_REGISTER_COUNT] {};
+    uint32_t _shadowValidMask {0}; //!< bit set if the corresponding shadow register holds the value last written to the RoverC
+    uint32_t _refreshIntervalMs {DEFAULT_REFRESH_INTERVAL_MS};
+    uint32_t _lastRefreshMs {0};
+    write_statistics_t _writeStatistics {0, 0, 0};
 };
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Short-horizon predictor of the stick values, used when packets are late.
+
+The recent packet history is used to estimate the trend of each axis.
+A packet is late once none has been received for `lateAfterMs`. Until then the packets are only jittered, and the
+last values are held. When a packet is late the last values are extrapolated along the trend for up to `horizonMs`,
+and then decayed smoothly to zero over `decayMs`, rather than the Rover holding the last command and then stopping dead.
+
+Each axis is tuned separately: for example yaw, which the driver changes quickly, can be given a short horizon and a fast decay.
+The extrapolation never crosses zero, nor moves away from it, so a stick that is being or has been released is not predicted to reverse.
+
+The predictor is a pure function of the timestamps it is given, so it can be run on a host against recorded loss patterns.
+*/
+class SetpointPredictor {
+public:
+    enum axis_t { THROTTLE, ROLL, PITCH, YAW, AXIS_COUNT };
+    struct axis_config_t {
+        float trendGain; //!< fraction of the measured trend to extrapolate, zero to hold the last value
+        float maxSlopePerSecond; //!< limit on the extrapolated rate of change
+        uint32_t horizonMs; //!< how long to extrapolate for
+        uint32_t decayMs; //!< how long to then take to decay to zero
+    };
+    struct config_t {
+        axis_config_t axes[AXIS_COUNT];
+        uint32_t historyWindowMs; //!< only samples this recent are used to estimate the trend
+        uint32_t lateAfterMs; //!< time since the last sample after which the next is late, and the values should be predicted
+    };
+    struct values_t {
+        float value[AXIS_COUNT];
+    };
+    enum { HISTORY_COUNT = 4 };
+    enum { DEFAULT_HORIZON_MS = 60, DEFAULT_DECAY_MS = 150, DEFAULT_HISTORY_WINDOW_MS = 100, DEFAULT_LATE_AFTER_MS = 25 };
+    static constexpr float DEFAULT_TREND_GAIN = 0.5F;
+    static constexpr float DEFAULT_MAX_SLOPE_PER_SECOND = 4.0F;
+public:
+    SetpointPredictor(void);
+    explicit SetpointPredictor(const config_t& config);
+    static config_t defaultConfig(void);
+public:
+    void reset(void);
+    void addSample(uint32_t timeUs, const values_t& values);
+    //! Predict the values at `timeUs`, which must not be earlier than the last sample. Returns false if there are no samples.
+    bool predict(uint32_t timeUs, values_t& values) const;
+    bool isLate(uint32_t timeUs) const;
+    inline bool hasSamples(void) const { return _sampleCount > 0; }
+    inline const config_t& getConfig(void) const { return _config; }
+    inline void setConfig(const config_t& config) { _config = config; }
+    inline void setAxisConfig(axis_t axis, const axis_config_t& axisConfig) { _config.axes[axis] = axisConfig; }
+private:
+    struct sample_t {
+        uint32_t timeUs;
+        values_t values;
+    };
+    float slope(int axis) const;
+private:
+    config_t _config;
+    sample_t _samples[HISTORY_COUNT] {};
+    uint32_t _sampleCount {0};
+};
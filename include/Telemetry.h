@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+Telemetry sent from the Rover back to the joystick: Rover state, battery, and link health.
+
+Frames are delta encoded: only the fields that have changed since the previous frame are sent,
+each as a zigzag varint of the difference from its previous value, so a typical frame is a few bytes.
+A keyframe, holding every field, is sent periodically so that a decoder can synchronize, or resynchronize after a lost frame.
+
+Frame layout:
+    [0]    magic 'T'
+    [1]    flags: KEYFRAME_FLAG
+    [2]    sequence number
+    [3..4] bitmask of the fields present, least significant byte first
+    [5..]  a varint for each field present, in field order
+    [last] checksum, the sum of all preceding bytes
+*/
+class Telemetry {
+public:
+    enum field_t {
+        FIELD_SPEED, FIELD_ANGLE,
+        FIELD_MOTOR_1, FIELD_MOTOR_2, FIELD_MOTOR_3, FIELD_MOTOR_4,
+        FIELD_BATTERY_MILLIVOLTS, FIELD_BATTERY_LEVEL,
+        FIELD_PACKETS_PER_SECOND, FIELD_GAP_COUNT, FIELD_LONGEST_GAP_MS, FIELD_CHECKSUM_FAILURE_COUNT,
+        FIELD_FAILSAFE_STOP_COUNT,
+        FIELD_WRONG_MAC_ADDRESS_COUNT, FIELD_WRONG_LENGTH_COUNT,
+        FIELD_COUNT
+    };
+    static_assert(FIELD_COUNT <= 16, "the field bitmask is 16 bits");
+    struct values_t {
+        int32_t value[FIELD_COUNT];
+    };
+    enum : uint8_t { MAGIC = 'T', KEYFRAME_FLAG = 0x01 };
+    enum { HEADER_SIZE = 5, CHECKSUM_SIZE = 1, MAX_VARINT_SIZE = 5 };
+    enum { MAX_FRAME_SIZE = HEADER_SIZE + FIELD_COUNT * MAX_VARINT_SIZE + CHECKSUM_SIZE };
+protected:
+    static inline uint32_t zigzagEncode(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+    static inline int32_t zigzagDecode(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+    static uint8_t checksum(const uint8_t* frame, int len);
+};
+
+/*!
+Telemetry encoder, on the Rover.
+
+The encoder rate limits itself: `isDue()` returns true once every `intervalMs`,
+and the caller sends a frame only when it is due, so telemetry uses a fixed, configurable share of the airtime.
+*/
+class TelemetryEncoder : public Telemetry {
+public:
+    struct statistics_t {
+        uint32_t frameCount;
+        uint32_t keyframeCount;
+        uint32_t byteCount;
+        uint32_t bytesPerSecond; //!< measured over the last complete one second window
+    };
+    enum { DEFAULT_INTERVAL_MS = 100, DEFAULT_KEYFRAME_INTERVAL = 10 };
+public:
+    explicit TelemetryEncoder(uint32_t intervalMs=DEFAULT_INTERVAL_MS, uint32_t keyframeInterval=DEFAULT_KEYFRAME_INTERVAL);
+public:
+    bool isDue(uint32_t timeMs) const;
+    int encode(const values_t& values, uint8_t* frame, uint32_t timeMs);
+    inline void requestKeyframe(void) { _keyframeRequested = true; }
+    inline void setIntervalMs(uint32_t intervalMs) { _intervalMs = intervalMs; }
+    inline uint32_t getIntervalMs(void) const { return _intervalMs; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+private:
+    static uint8_t* writeVarint(uint8_t* out, uint32_t value);
+private:
+    uint32_t _intervalMs;
+    uint32_t _keyframeInterval; //!< send a keyframe every this many frames
+    uint32_t _lastFrameMs {0};
+    bool _keyframeRequested {true};
+    uint8_t _sequence {0};
+    values_t _previous {};
+    uint32_t _windowStartMs {0};
+    uint32_t _windowByteCount {0};
+    statistics_t _statistics {0, 0, 0, 0};
+};
+
+/*!
+Telemetry decoder, on the joystick.
+
+Delta frames are applied only if they follow on from the previous frame,
+after a lost or corrupt frame the decoder waits for the next keyframe.
+*/
+class TelemetryDecoder : public Telemetry {
+public:
+    struct statistics_t {
+        uint32_t frameCount;
+        uint32_t rejectedCount; //!< frames that were malformed or had a bad checksum
+        uint32_t unsynchronizedCount; //!< delta frames dropped while waiting for a keyframe
+    };
+public:
+    bool decode(const uint8_t* frame, int len);
+    inline bool isSynchronized(void) const { return _synchronized; }
+    inline const values_t& getValues(void) const { return _values; }
+    inline int32_t getValue(field_t field) const { return _values.value[field]; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+private:
+    static const uint8_t* readVarint(const uint8_t* in, const uint8_t* end, uint32_t& value);
+private:
+    values_t _values {};
+    bool _synchronized {false};
+    uint8_t _sequence {0};
+    statistics_t _statistics {0, 0, 0};
+};
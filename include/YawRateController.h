@@ -0,0 +1,74 @@
+#pragma once
+
+#include "IMU_Interface.h"
+
+#include <cstdint>
+
+
+/*!
+Closed loop yaw rate controller, using the gyro to correct the rotation term of the mecanum mixer.
+
+The yaw stick commands a yaw rate, and a PI controller adds a correction to the rotation term so that the measured
+yaw rate follows it. So when one wheel slips, or the motors are mismatched, the Rover still drives straight.
+
+The controller is run at a fixed rate, from the motion controller. Each update reads the batch of gyro samples
+that the IMU has buffered since the previous update and uses their mean, so no samples are missed and their noise is averaged.
+The time taken by each update is measured against a cycle budget.
+
+The IMU and clock are injectable, so the controller can be run on a host with a simulated IMU.
+*/
+class YawRateController {
+public:
+    typedef uint32_t (*clock_us_t)(void);
+    struct config_t {
+        float maxYawRateDPS; //!< yaw rate commanded by full yaw stick
+        float kp;
+        float ki;
+        float integralLimit; //!< limit on the integral term, in units of full rotation
+        float rateSign; //!< -1 if positive rotation gives a negative gyro z reading, otherwise 1
+        uint32_t calibrationSampleCount; //!< number of samples averaged to find the gyro bias, the Rover must be stationary
+    };
+    struct statistics_t {
+        uint32_t updateCount;
+        uint32_t sampleCount;
+        uint32_t emptyBatchCount; //!< updates for which the IMU had no new samples
+        uint32_t cycleTimeUs; //!< time taken by the last update, including reading the IMU
+        uint32_t cycleTimeMaxUs;
+        uint32_t overBudgetCount; //!< updates that took longer than the cycle budget
+    };
+    enum { MAX_BATCH_SIZE = 16 };
+    enum { DEFAULT_CYCLE_BUDGET_US = 1000 };
+public:
+    YawRateController(IMU_Interface& imu, clock_us_t clock);
+    YawRateController(IMU_Interface& imu, clock_us_t clock, const config_t& config);
+    static config_t defaultConfig(void);
+public:
+    /*!
+    Read the IMU and return the rotation term, corrected so that the measured yaw rate follows `yawCommand`.
+
+    The IMU is read even when `closedLoop` is false, so that its buffer does not overflow and the bias calibration can complete.
+    */
+    float update(float yawCommand, float deltaT, bool closedLoop);
+    inline void resetIntegral(void) { _integral = 0.0F; }
+    inline bool isCalibrated(void) const { return _calibrationCount >= _config.calibrationSampleCount; }
+    inline float getYawRateDPS(void) const { return _yawRateDPS; }
+    inline float getGyroBiasDPS(void) const { return _gyroBiasDPS; }
+    inline void setConfig(const config_t& config) { _config = config; }
+    inline void setCycleBudgetUs(uint32_t cycleBudgetUs) { _cycleBudgetUs = cycleBudgetUs; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+    void resetStatistics(void);
+private:
+    void readIMU(void);
+private:
+    IMU_Interface& _imu;
+    clock_us_t _clock;
+    config_t _config;
+    uint32_t _cycleBudgetUs {DEFAULT_CYCLE_BUDGET_US};
+    uint32_t _calibrationCount {0};
+    float _calibrationSum {0.0F};
+    float _gyroBiasDPS {0.0F};
+    float _gyroZ_DPS {0.0F}; //!< mean of the last non-empty batch, before bias correction
+    float _yawRateDPS {0.0F};
+    float _integral {0.0F};
+    statistics_t _statistics {0, 0, 0, 0, 0, 0};
+};
@@ -1,153 +1,261 @@
 #include <AtomJoyStickReceiver.h>
+#include <FleetCodec.h>
 #include <HardwareSerial.h>
 
+static_assert(static_cast<int>(AtomJoyStickCodec::MAX_PACKET_SIZE) <= static_cast<int>(AtomJoyStickReceiver::MAX_PACKET_SIZE), "AtomJoyStick packets must fit the packet slots");
+static_assert(static_cast<int>(FleetCodec<>::MAX_PACKET_SIZE) <= static_cast<int>(AtomJoyStickReceiver::MAX_PACKET_SIZE), "full fleet frames must fit the packet slots");
 
 // cppcheck-suppress uninitMemberVar
-AtomJoyStickReceiver::AtomJoyStickReceiver(const uint8_t* myMacAddress) : // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+AtomJoyStickReceiver::AtomJoyStickReceiver(const uint8_t* myMacAddress, const packet_codec_t& codec) : // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
     _transceiver(myMacAddress),
-    _received_data(_packet, sizeof(_packet))
-    {}
+    _codec(codec),
+    _binding([]() -> uint32_t { return millis(); }, broadcastMyMacAddressForBinding, isBound, this)
+{
+    for (auto& parameters : _shapingParameters) {
+        parameters = shaping_parameters_t { 0.0F, DEFAULT_DEAD_ZONE, 0.0F, 0.0F, 0.0F };
+    }
+    configureShapers();
+}
 
 esp_err_t AtomJoyStickReceiver::init(uint8_t channel, const uint8_t* transmitMacAddress)
 {
-    return _transceiver.init(_received_data, channel, transmitMacAddress);
+    _receiveFilter.clearStages();
+    _receiveFilter.addStage(checkLength, this);
+    _receiveFilter.addStage(checkChecksum, this);
+    _receiveFilter.addStage(checkAddress, this);
+    _transceiver.setReceiveFilter(&_receiveFilter);
+    _transceiver.setReceiveSignal(&_packetSignal);
+    return _transceiver.init(_receivedPackets, channel, transmitMacAddress);
+}
+
+ReceiveFilter::reason_t AtomJoyStickReceiver::checkLength(const void* context, [[maybe_unused]] const uint8_t* macAddress, [[maybe_unused]] const uint8_t* data, int len)
+{
+    const auto receiver = static_cast<const AtomJoyStickReceiver*>(context);
+    return (len < receiver->_codec.packetSize || len > MAX_PACKET_SIZE) ? ReceiveFilter::REJECTED_LENGTH : ReceiveFilter::ACCEPTED;
+}
+
+ReceiveFilter::reason_t AtomJoyStickReceiver::checkChecksum(const void* context, [[maybe_unused]] const uint8_t* macAddress, const uint8_t* data, int len)
+{
+    const auto receiver = static_cast<const AtomJoyStickReceiver*>(context);
+    return receiver->_codec.isChecksumValid(data, len) ? ReceiveFilter::ACCEPTED : ReceiveFilter::REJECTED_CHECKSUM;
 }
 
-esp_err_t AtomJoyStickReceiver::broadcastMyMacAddressForBinding(int broadcastCount, int broadcastDelayMs) const
+ReceiveFilter::reason_t AtomJoyStickReceiver::checkAddress(const void* context, [[maybe_unused]] const uint8_t* macAddress, const uint8_t* data, int len)
 {
+    const auto receiver = static_cast<const AtomJoyStickReceiver*>(context);
+    return receiver->_codec.isAddressedTo(data, len, receiver->myMacAddress()) ? ReceiveFilter::ACCEPTED : ReceiveFilter::REJECTED_ADDRESS;
+}
+
+/*!
+Block until a packet has been received, or until `timeoutMs` has elapsed.
+
+Returns true if there is a packet ready to unpack.
+*/
+bool AtomJoyStickReceiver::waitForPacket(uint32_t timeoutMs)
+{
+    if (!isPacketEmpty()) {
+        return true;
+    }
+    // a signal may be left over from a packet that has already been unpacked, so wait again if the ring is still empty
+    while (_packetSignal.wait(timeoutMs)) {
+        if (!isPacketEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+Start broadcasting my MAC address, so the transmitter can bind to this receiver.
+Binding completes when a packet is received from the primary peer, which is acquired from the first packet received if it is not already set.
+*/
+void AtomJoyStickReceiver::startBinding(int broadcastCount, uint32_t broadcastIntervalMs)
+{
+    _bindingStartPacketCount = _transceiver.getReceivedPacketCount();
+    _binding.start(broadcastCount, broadcastIntervalMs);
+}
+
+bool AtomJoyStickReceiver::broadcastMyMacAddressForBinding(const void* context)
+{
+    const auto receiver = static_cast<const AtomJoyStickReceiver*>(context);
     // peer command as used by the StampFlyController, see: https://github.com/m5stack/Atom-JoyStick/blob/main/examples/StampFlyController/src/main.cpp#L117
     static const uint8_t peerCommand[4] { 0xaa, 0x55, 0x16, 0x88 };
     uint8_t data[16];
     static_assert(sizeof(data) > sizeof(peerCommand) + ESP_NOW_ETH_ALEN + 2);
 
-    data[0] = _transceiver.getBroadcastChannel();
-    memcpy(&data[1], _transceiver.myMacAddress(), ESP_NOW_ETH_ALEN);
+    data[0] = receiver->_transceiver.getBroadcastChannel();
+    memcpy(&data[1], receiver->_transceiver.myMacAddress(), ESP_NOW_ETH_ALEN);
     memcpy(&data[1 + ESP_NOW_ETH_ALEN], peerCommand, sizeof(peerCommand));
 
-    for (int ii = 0; ii < broadcastCount; ++ii) {
-        if (esp_err_t err = _transceiver.broadcastData(data, sizeof(data)) != ESP_OK) {
-            Serial.printf("broadcastMyMacAddressForBinding failed: %X\r\n", err);
-            return err;
-        }
-        delay(broadcastDelayMs); // Arduino delay() function has units of milliseconds
+    const esp_err_t err = receiver->_transceiver.broadcastData(data, sizeof(data));
+    if (err != ESP_OK) {
+        Serial.printf("broadcastMyMacAddressForBinding failed: %X\r\n", err);
+        return false;
     }
-    return ESP_OK;
+    return true;
+}
+
+/*!
+Bound once the primary peer is set and a packet has been received from it since binding started.
+The primary peer may already be set, from the config store or at compile time, but the transmitter may not yet know this receiver.
+*/
+bool AtomJoyStickReceiver::isBound(const void* context)
+{
+    const auto receiver = static_cast<const AtomJoyStickReceiver*>(context);
+    return receiver->_transceiver.isPrimaryPeerMacAddressSet() && receiver->_transceiver.getReceivedPacketCount() != receiver->_bindingStartPacketCount;
 }
 
 /*!
-Check the packet if `checkPacket` set. If the packet is valid then unpack it into the member data and set the packet to empty.
+Take a packet from the received packet ring, using the current read mode, and check it if `checkPacket` set.
+If the packet is valid then decode it, using the codec, into the member data.
 
 Returns true if a valid packet received, false otherwise.
 */
 bool AtomJoyStickReceiver::unpackPacket(checkPacket_t checkPacket)
 {
-    // see https://github.com/M5Fly-kanazawa/AtomJoy2024June/blob/main/src/main.cpp#L560 for packet format
-    if (isPacketEmpty()) {
+    const int len = _receivedPackets.pop(_packet, sizeof(_packet), _packetTimeUs, _readMode);
+    if (len < _codec.packetSize) {
         return false;
     }
 
-    uint8_t checksum = 0;
-    for (int ii = 0; ii < PACKET_SIZE - 1; ++ii) {
-        checksum += _packet[ii];
-    }
-    if ((checkPacket == CHECK_PACKET) && checksum != _packet[PACKET_SIZE - 1]) {
-        //Serial.printf("checksum:%d, packet[24]:%d, packet[0]:%d, len:%d\r\n", checksum, _packet[24], _packet[0], receivedDataLen());
-        setPacketEmpty();
+    // bad packets are rejected, and counted in the link statistics, by the receive filter before they reach the ring,
+    // so these checks are not counted again here
+    if ((checkPacket == CHECK_PACKET) && !_codec.isChecksumValid(_packet, len)) {
+        //Serial.printf("packet[0]:%d, len:%d\r\n", _packet[0], len);
         return false;
     }
 
     const uint8_t *macAddress = myMacAddress();
     if (checkPacket == DONT_CHECK_PACKET) {
         Serial.printf("packet: %02X:%02X:%02X\r\n", _packet[0], _packet[1], _packet[2]);
-        //Serial.printf("peer:   %02X:%02X:%02X\r\n", _primaryPeerInfo.peer_addr[3], _primaryPeerInfo.peer_addr[4], _primaryPeerInfo.peer_addr[5]);
         //Serial.printf("my:     %02X:%02X:%02X\r\n", macAddress[3], macAddress[4], macAddress[5]);
     }
-    if ((checkPacket == CHECK_PACKET) && (_packet[0] != macAddress[3] || _packet[1] != macAddress[4] || _packet[2] != macAddress[5])) {
+    if ((checkPacket == CHECK_PACKET) && !_codec.isAddressedTo(_packet, len, macAddress)) {
         //Serial.printf("packet: %02X:%02X:%02X\r\n", _packet[0], _packet[1], _packet[2]);
         //Serial.printf("my:     %02X:%02X:%02X\r\n", macAddress[3], macAddress[4], macAddress[5]);
-        setPacketEmpty();
         return false;
     }
 
-    // cppcheck-suppress invalidPointerCast
-    _controls[YAW].raw = *reinterpret_cast<float*>(&_packet[3]);
-    // cppcheck-suppress invalidPointerCast
-    _controls[THROTTLE].raw = *reinterpret_cast<float*>(&_packet[7]);
-    // cppcheck-suppress invalidPointerCast
-    _controls[ROLL].raw = *reinterpret_cast<float*>(&_packet[11]);
-    // cppcheck-suppress invalidPointerCast
-    _controls[PITCH].raw = -*reinterpret_cast<float*>(&_packet[15]);
+    joystick_frame_t frame {};
+    if (!_codec.decode(_packet, len, macAddress, frame)) {
+        return false;
+    }
+
+    _controls[YAW].raw = frame.yaw;
+    _controls[THROTTLE].raw = frame.throttle;
+    _controls[ROLL].raw = frame.roll;
+    _controls[PITCH].raw = frame.pitch;
 
-    _armButton = _packet[19];
-    _flipButton = _packet[20];
-    _mode = _packet[21];  // _mode: stable or sport
-    _altMode = _packet[22];
-    _proactiveFlag = _packet[23];
+    if (_biasEstimating) {
+        addBiasSample();
+    }
+    for (int ii = 0; ii < CONTROL_COUNT; ++ii) {
+        _controls[ii].shaped = _shapers[ii].apply(_controls[ii].raw);
+    }
+
+    _armButton = frame.armButton;
+    _flipButton = frame.flipButton;
+    _mode = frame.mode;  // _mode: stable or sport
+    _altMode = frame.altMode;
+    _proactiveFlag = frame.proactiveFlag;
 
-    setPacketEmpty();
     return true;
 }
 
+/*!
+Start estimating the bias from the current readings and those of the following packets.
+Once MAX_BIAS_COUNT readings have been taken the bias is set, and the getters return the shaped values.
+*/
 void AtomJoyStickReceiver::setCurrentReadingsToBias(void)
 {
-    _biasIsSet = true;
-    for (auto &control : _controls) {
-        control.bias = control.raw;
+    _biasIsSet = false;
+    _biasEstimating = true;
+    _biasCount = 0;
+    for (auto& biasEstimator : _biasEstimators) {
+        biasEstimator.reset();
     }
+    addBiasSample();
 }
 
-float AtomJoyStickReceiver::normalizedControl(const Control& control, bool raw)
+/*!
+Set the bias to previously measured values, for example restored from persistent storage, so the getters return shaped values immediately.
+*/
+void AtomJoyStickReceiver::setBias(float throttle, float roll, float pitch, float yaw)
 {
-    if (raw) {
-        return control.raw;
-    }
-    const float ret = control.raw - control.bias;
-    constexpr float max {1.0};
-    constexpr float min {-1.0};
+    _shapingParameters[THROTTLE].bias = throttle;
+    _shapingParameters[ROLL].bias = roll;
+    _shapingParameters[PITCH].bias = pitch;
+    _shapingParameters[YAW].bias = yaw;
+    _biasEstimating = false;
+    _biasIsSet = true;
+    configureShapers();
+}
 
-    if (ret < -control.deadZone) {
-        return -(-control.deadZone - ret) / (control.bias -control.deadZone/2 - min);
+void AtomJoyStickReceiver::addBiasSample(void)
+{
+    ++_biasCount;
+    for (int ii = 0; ii < CONTROL_COUNT; ++ii) {
+        _biasEstimators[ii].addSample(_controls[ii].raw);
     }
-    if (ret > control.deadZone) {
-        return (ret - control.deadZone) / (max - control.bias - control.deadZone/2);
+    if (_biasCount >= MAX_BIAS_COUNT) {
+        for (int ii = 0; ii < CONTROL_COUNT; ++ii) {
+            _shapingParameters[ii].bias = _biasEstimators[ii].estimate();
+        }
+        _biasEstimating = false;
+        _biasIsSet = true;
+        configureShapers();
+    }
+}
+
+/*!
+Configure the shaping chains from the shaping parameters, and reset the state of any filters.
+This is where the divisions are done, so that shaping a packet needs only multiplications.
+*/
+void AtomJoyStickReceiver::configureShapers(void)
+{
+    for (int ii = 0; ii < CONTROL_COUNT; ++ii) {
+        _shapers[ii] = axis_shaper_t();
+        _shapers[ii].configure(_shapingParameters[ii]);
     }
-    return 0.0F;
 }
 
 void AtomJoyStickReceiver::resetControls(void)
 {
     _biasIsSet = false;
+    _biasEstimating = false;
     _biasCount = 0;
-    for (auto &control : _controls) {
-        control.bias = 0.0F;
-        control.deadZone = 0.0F;
+    for (auto& parameters : _shapingParameters) {
+        parameters.bias = 0.0F;
+        parameters.deadZone = 0.0F;
     }
+    configureShapers();
 }
 
 void AtomJoyStickReceiver::setDeadZones(float deadZone)
 {
-    for (auto &control : _controls) {
-        control.deadZone = deadZone;
+    for (auto& parameters : _shapingParameters) {
+        parameters.deadZone = deadZone;
     }
+    configureShapers();
 }
 
-float AtomJoyStickReceiver::getThrottle(void) const
-{
-    return normalizedControl(_controls[THROTTLE], !isBiasSet());
-}
-
-float AtomJoyStickReceiver::getRoll(void) const
+void AtomJoyStickReceiver::setExpo(float expo)
 {
-    return normalizedControl(_controls[ROLL], !isBiasSet());
-}
-
-float AtomJoyStickReceiver::getPitch(void) const
-{
-    return normalizedControl(_controls[PITCH], !isBiasSet());
+    for (auto& parameters : _shapingParameters) {
+        parameters.expo = expo;
+    }
+    configureShapers();
 }
 
-float AtomJoyStickReceiver::getYaw(void) const
+/*!
+Set the cutoff of the low-pass filter, which is run once per packet, so `packetRateHz` is the rate at which packets are received.
+A cutoff of zero disables the filter.
+*/
+void AtomJoyStickReceiver::setLowPassFilter(float cutoffHz, float packetRateHz)
 {
-    return normalizedControl(_controls[YAW], !isBiasSet());
+    for (auto& parameters : _shapingParameters) {
+        parameters.lowPassCutoffHz = cutoffHz;
+        parameters.sampleRateHz = packetRateHz;
+    }
+    configureShapers();
 }
-
@@ -1,67 +1,115 @@
 # pragma once
 
+#include <BindingStateMachine.h>
 #include <ESPNOW_Transceiver.h>
+#include <InputShaping.h>
+#include <PacketCodec.h>
 
 
 /*!
 Receiver compatible with the M5Stack Atom JoyStick.
+
+Packets are decoded by a codec, so other transmitters can be supported by providing a codec for their packet format.
+
+Each stick axis is shaped by an `axis_shaper_t` chain, run once per packet, so the getters just return the shaped values.
 */
 class AtomJoyStickReceiver {
 public:
-    explicit AtomJoyStickReceiver(const uint8_t* myMacAddress);
+    explicit AtomJoyStickReceiver(const uint8_t* myMacAddress, const packet_codec_t& codec=makePacketCodec<AtomJoyStickCodec>());
     esp_err_t init(uint8_t channel, const uint8_t* transmitMacAddress);
 public:
-    enum { DEFAULT_BROADCAST_COUNT = 20, DEFAULT_BROADCAST_DELAY_MS = 50 };
+    enum { DEFAULT_BROADCAST_COUNT = 20, DEFAULT_BROADCAST_INTERVAL_MS = 50 };
 public:
     enum { MODE_STABLE = 0, MODE_SPORT = 1 };
-    enum { ALT_MODE_AUTO = 4, ALT_MODE_MANUAL = 5};
+    enum { ALT_MODE_AUTO = joystick_frame_t::ALT_MODE_AUTO, ALT_MODE_MANUAL = joystick_frame_t::ALT_MODE_MANUAL };
+    enum { EXPO_LUT_SIZE = 32 };
+    static constexpr float DEFAULT_DEAD_ZONE = 0.01F;
+    //! The shaping stages applied to each axis, for a second order filter replace OnePoleLowPassStage with BiquadLowPassStage.
+    typedef ShapingChain<BiasStage, DeadZoneStage, ExpoStage<EXPO_LUT_SIZE>, OnePoleLowPassStage> axis_shaper_t;
+    //! The largest packet the packet slots hold, longer packets are rejected. A codec's MAX_PACKET_SIZE must not exceed it.
+    enum { MAX_PACKET_SIZE = 128 };
 private:
-    enum { PACKET_SIZE = 25 };
+    enum { PACKET_SLOT_COUNT = 4 };
     enum { THROTTLE = 0, ROLL = 1, PITCH = 2, YAW = 3, CONTROL_COUNT = 4 };
 public:
     inline ESPNOW_Transceiver& getTransceiver(void) { return _transceiver; }
-    inline esp_err_t sendData(uint8_t *data, uint16_t len) const {return _transceiver.sendData(data, len);}
+    inline const LinkStatistics& getLinkStatistics(void) const { return _transceiver.getLinkStatistics(); }
+    inline const ReceiveFilter& getReceiveFilter(void) const { return _receiveFilter; }
+    inline esp_err_t sendData(const uint8_t *data, uint16_t len, SendQueue::priority_t priority=SendQueue::PRIORITY_CONTROL, uint32_t retryDeadlineUs=0) {
+        return _transceiver.sendData(data, len, priority, retryDeadlineUs);
+    }
     inline bool isPrimaryPeerMacAddressSet(void) const { return _transceiver.isPrimaryPeerMacAddressSet(); }
     inline const uint8_t *getPrimaryPeerMacAddress(void) const { return _transceiver.getPrimaryPeerMacAddress(); }
-    inline bool isPacketEmpty(void) const { return _received_data.len == 0 ? true : false;  }
-    inline void setPacketEmpty(void) { _received_data.len = 0; }
+    inline bool isPacketEmpty(void) const { return _receivedPackets.isEmpty(); }
+    inline void setPacketEmpty(void) { _receivedPackets.clear(); }
+    inline void setReadMode(PacketRingBase::read_mode_t readMode) { _readMode = readMode; }
+    bool waitForPacket(uint32_t timeoutMs);
+    inline const PacketRingBase& getReceivedPackets(void) const { return _receivedPackets; }
+    inline uint32_t getPacketTimeUs(void) const { return _packetTimeUs; } //!< time the last unpacked packet was received
     inline const uint8_t *myMacAddress(void) const {return _transceiver.myMacAddress();}
-    esp_err_t broadcastMyMacAddressForBinding(int broadcastCount=DEFAULT_BROADCAST_COUNT, int broadcastDelayMs=DEFAULT_BROADCAST_DELAY_MS) const;
+    // binding is non-blocking, `updateBinding()` should be called from the main loop until binding is no longer in progress
+    void startBinding(int broadcastCount=DEFAULT_BROADCAST_COUNT, uint32_t broadcastIntervalMs=DEFAULT_BROADCAST_INTERVAL_MS);
+    inline BindingStateMachine::state_t updateBinding(void) { return _binding.update(); }
+    inline const BindingStateMachine& getBinding(void) const { return _binding; }
 public:
     enum checkPacket_t { CHECK_PACKET, DONT_CHECK_PACKET };
     bool unpackPacket(checkPacket_t checkPacket);
     inline bool unpackPacket(void) { return unpackPacket(CHECK_PACKET); }
     void resetControls(void);
     void setDeadZones(float deadZone);
+    void setExpo(float expo);
+    void setLowPassFilter(float cutoffHz, float packetRateHz);
     void setCurrentReadingsToBias(void);
+    void setBias(float throttle, float roll, float pitch, float yaw);
     inline bool isBiasSet(void) const { return _biasIsSet; }
+    inline float getThrottleBias(void) const { return _shapingParameters[THROTTLE].bias; }
+    inline float getRollBias(void) const { return _shapingParameters[ROLL].bias; }
+    inline float getPitchBias(void) const { return _shapingParameters[PITCH].bias; }
+    inline float getYawBias(void) const { return _shapingParameters[YAW].bias; }
     inline float getThrottleRaw(void) const { return _controls[THROTTLE].raw; }
     inline float getRollRaw(void) const { return _controls[ROLL].raw; }
     inline float getPitchRaw(void) const { return _controls[PITCH].raw; }
     inline float getYawRaw(void) const { return _controls[YAW].raw; }
-    float getThrottle (void) const;
-    float getRoll (void) const;
-    float getPitch(void) const;
-    float getYaw(void) const;
+    inline float getThrottle(void) const { return _biasIsSet ? _controls[THROTTLE].shaped : _controls[THROTTLE].raw; }
+    inline float getRoll(void) const { return _biasIsSet ? _controls[ROLL].shaped : _controls[ROLL].raw; }
+    inline float getPitch(void) const { return _biasIsSet ? _controls[PITCH].shaped : _controls[PITCH].raw; }
+    inline float getYaw(void) const { return _biasIsSet ? _controls[YAW].shaped : _controls[YAW].raw; }
     inline uint8_t getMode(void) const { return _mode; }
     inline uint8_t getAltMode(void) const { return _altMode; }
     inline uint8_t getArmButton(void) const { return _armButton; }
     inline uint8_t getFlipButton(void) const { return _flipButton; }
     inline uint8_t getProactiveFlag(void) const { return _proactiveFlag; }
 private:
-    enum { MAX_BIAS_COUNT = 5 };
+    enum { MAX_BIAS_COUNT = 8 }; //!< number of packets averaged to estimate the bias
     struct Control {
         float raw {0.0};
-        float bias {0.0};
-        float deadZone {0.01};
+        float shaped {0.0};
     };
-    static float normalizedControl(const Control& control, bool raw);
+    void addBiasSample(void);
+    void configureShapers(void);
+    // binding callbacks, these run in the caller of `updateBinding()`
+    static bool broadcastMyMacAddressForBinding(const void* context);
+    static bool isBound(const void* context);
+    // receive filter stages, these run in the WiFi task
+    static ReceiveFilter::reason_t checkLength(const void* context, const uint8_t* macAddress, const uint8_t* data, int len);
+    static ReceiveFilter::reason_t checkChecksum(const void* context, const uint8_t* macAddress, const uint8_t* data, int len);
+    static ReceiveFilter::reason_t checkAddress(const void* context, const uint8_t* macAddress, const uint8_t* data, int len);
 private:
     ESPNOW_Transceiver _transceiver;
-    ESPNOW_Transceiver::received_data_t _received_data;
-    uint8_t _packet[PACKET_SIZE];
-    uint8_t _filler[28 - PACKET_SIZE];
+    packet_codec_t _codec;
+    BindingStateMachine _binding;
+    uint32_t _bindingStartPacketCount {0};
+    ReceiveFilter _receiveFilter;
+    PacketRing<PACKET_SLOT_COUNT, MAX_PACKET_SIZE> _receivedPackets;
+    PacketRingBase::read_mode_t _readMode {PacketRingBase::LATEST_WINS};
+    PacketSignal _packetSignal;
+    uint32_t _packetTimeUs {0};
+    uint8_t _packet[MAX_PACKET_SIZE];
     Control _controls[CONTROL_COUNT];
+    shaping_parameters_t _shapingParameters[CONTROL_COUNT];
+    axis_shaper_t _shapers[CONTROL_COUNT];
+    BiasEstimator<MAX_BIAS_COUNT> _biasEstimators[CONTROL_COUNT];
+    bool _biasEstimating {false};
     int _biasIsSet {false}; //NOTE: if `bool` type is used here then `getMode()` sometimes returns incorrect value
     int _biasCount {0};
     uint8_t _mode {0};
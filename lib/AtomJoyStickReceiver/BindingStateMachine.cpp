@@ -0,0 +1,65 @@
+#include <BindingStateMachine.h>
+
+
+BindingStateMachine::BindingStateMachine(clock_ms_t clock, broadcast_t broadcast, is_bound_t isBound, const void* context) :
+    _clock(clock),
+    _broadcast(broadcast),
+    _isBound(isBound),
+    _context(context)
+    {}
+
+/*!
+Start binding, and send the first broadcast. Restarting while binding is in progress starts the broadcasts again.
+*/
+void BindingStateMachine::start(int broadcastCount, uint32_t broadcastIntervalMs)
+{
+    _broadcastCount = broadcastCount;
+    _broadcastIntervalMs = broadcastIntervalMs;
+    _broadcastsSent = 0;
+    _startMs = _clock();
+    _state = BROADCASTING;
+    ++_statistics.startCount;
+    update();
+}
+
+/*!
+Step the binding: check if the transmitter has responded, and if not send the next broadcast when it is due.
+Once all the broadcasts have been sent, binding times out one interval after the last of them, to give the transmitter time to respond.
+
+Returns the new state.
+*/
+BindingStateMachine::state_t BindingStateMachine::update()
+{
+    if (_state != BROADCASTING) {
+        return _state;
+    }
+
+    const uint32_t timeMs = _clock();
+    if (_isBound(_context)) {
+        _state = BOUND;
+        _statistics.timeToBindMs = timeMs - _startMs;
+        if (_statistics.timeToBindMs > _statistics.timeToBindMaxMs) {
+            _statistics.timeToBindMaxMs = _statistics.timeToBindMs;
+        }
+        ++_statistics.boundCount;
+        return _state;
+    }
+    // unsigned subtraction, so correct when the clock wraps around
+    if (_broadcastsSent > 0 && timeMs - _lastBroadcastMs < _broadcastIntervalMs) {
+        return _state;
+    }
+    if (_broadcastsSent >= _broadcastCount) {
+        _state = TIMED_OUT;
+        ++_statistics.timedOutCount;
+        return _state;
+    }
+    if (!_broadcast(_context)) {
+        _state = FAILED;
+        ++_statistics.failedCount;
+        return _state;
+    }
+    ++_broadcastsSent;
+    ++_statistics.broadcastCount;
+    _lastBroadcastMs = timeMs;
+    return _state;
+}
@@ -0,0 +1,52 @@
+# pragma once
+
+#include <cstdint>
+
+
+/*!
+Incremental binding: broadcasts this receiver's MAC address at intervals until the transmitter responds, or until the broadcasts run out.
+
+`update()` does at most one broadcast and never blocks, so it can be stepped from the main loop or a timer while the failsafe and display keep running.
+Binding completes as soon as `isBound` returns true, so no further broadcasts are sent once the primary peer has been acquired.
+
+The clock, the broadcast, and the bound check are injected as function pointers with a context pointer,
+so the whole sequence can be stepped on a host with a simulated clock and a fake radio.
+*/
+class BindingStateMachine {
+public:
+    typedef uint32_t (*clock_ms_t)(void);
+    typedef bool (*broadcast_t)(const void* context); //!< returns false if the broadcast could not be sent
+    typedef bool (*is_bound_t)(const void* context);
+    enum state_t { IDLE, BROADCASTING, BOUND, TIMED_OUT, FAILED };
+    struct statistics_t {
+        uint32_t startCount;
+        uint32_t boundCount;
+        uint32_t timedOutCount;
+        uint32_t failedCount;
+        uint32_t broadcastCount; //!< total broadcasts sent, over all binding attempts
+        uint32_t timeToBindMs; //!< time from the start of the last successful binding to it completing
+        uint32_t timeToBindMaxMs;
+    };
+public:
+    BindingStateMachine(clock_ms_t clock, broadcast_t broadcast, is_bound_t isBound, const void* context);
+public:
+    void start(int broadcastCount, uint32_t broadcastIntervalMs);
+    inline void cancel(void) { if (_state == BROADCASTING) { _state = IDLE; } }
+    state_t update(void);
+    inline state_t getState(void) const { return _state; }
+    inline bool isBinding(void) const { return _state == BROADCASTING; }
+    inline int getBroadcastsSent(void) const { return _broadcastsSent; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+private:
+    clock_ms_t _clock;
+    broadcast_t _broadcast;
+    is_bound_t _isBound;
+    const void* _context;
+    state_t _state {IDLE};
+    int _broadcastCount {0};
+    int _broadcastsSent {0};
+    uint32_t _broadcastIntervalMs {0};
+    uint32_t _startMs {0};
+    uint32_t _lastBroadcastMs {0};
+    statistics_t _statistics {};
+};
@@ -0,0 +1,238 @@
+#include <ChannelManager.h>
+
+
+ChannelManager::ChannelManager(Radio_Interface& radio, clock_ms_t clock) :
+    ChannelManager(radio, clock, defaultConfig())
+    {}
+
+ChannelManager::ChannelManager(Radio_Interface& radio, clock_ms_t clock, const config_t& config) :
+    _radio(radio),
+    _clock(clock),
+    _config(config)
+    {}
+
+ChannelManager::config_t ChannelManager::defaultConfig()
+{
+    return config_t {
+        DEFAULT_DWELL_MS,
+        DEFAULT_SETTLE_MS,
+        DEFAULT_EXPECTED_INTERVAL_US,
+        DEFAULT_SWITCH_TIMEOUT_MS,
+        DEFAULT_JITTER_WEIGHT,
+        DEFAULT_HYSTERESIS
+    };
+}
+
+/*!
+Score a channel from the packets received while it was measured: the fraction of the expected packets received, less a penalty for jitter.
+
+Returns a score in the range [-jitterWeight, 1].
+*/
+float ChannelManager::score(uint32_t packetCount, uint32_t expectedCount, uint32_t jitterUs, const config_t& config)
+{
+    if (expectedCount == 0 || packetCount == 0) {
+        return 0.0F;
+    }
+    const float received = packetCount >= expectedCount ? 1.0F : static_cast<float>(packetCount) / static_cast<float>(expectedCount);
+    const float jitter = jitterUs >= config.expectedIntervalUs ? 1.0F : static_cast<float>(jitterUs) / static_cast<float>(config.expectedIntervalUs);
+    return received - config.jitterWeight * jitter;
+}
+
+/*!
+Encode a handshake frame. `dwellMs` is the time the transmitter should stay on `channel` before returning to the current channel,
+and is zero for a switch, which is permanent.
+
+Returns the length of the frame.
+*/
+int ChannelManager::encodeHandshake(handshake_type_t type, uint8_t channel, uint16_t dwellMs, uint8_t sequence, uint8_t* frame)
+{
+    frame[0] = HANDSHAKE_MAGIC_0;
+    frame[1] = HANDSHAKE_MAGIC_1;
+    frame[2] = static_cast<uint8_t>(type);
+    frame[3] = channel;
+    frame[4] = static_cast<uint8_t>(dwellMs & 0xFFU);
+    frame[5] = static_cast<uint8_t>(dwellMs >> 8U);
+    frame[6] = sequence;
+    uint8_t checksum = 0;
+    for (int ii = 0; ii < HANDSHAKE_FRAME_SIZE - 1; ++ii) {
+        checksum += frame[ii];
+    }
+    frame[HANDSHAKE_FRAME_SIZE - 1] = checksum;
+    return HANDSHAKE_FRAME_SIZE;
+}
+
+bool ChannelManager::sendHandshake(handshake_type_t type, uint8_t channel)
+{
+    // the transmitter starts its dwell when it receives the handshake, so it dwells for the settle time as well as the measurement time
+    const uint32_t dwellMs = type == HANDSHAKE_SURVEY ? _config.settleMs + _config.dwellMs : 0;
+    uint8_t frame[HANDSHAKE_FRAME_SIZE];
+    const int len = encodeHandshake(type, channel, static_cast<uint16_t>(dwellMs < UINT16_MAX ? dwellMs : UINT16_MAX), _sequence, frame);
+    ++_sequence;
+    return _radio.sendToPrimaryPeer(frame, len);
+}
+
+/*!
+Start a survey of `channels`, which may include the current channel. The current channel becomes the home channel.
+
+Returns false if a survey or switch is already in progress.
+*/
+bool ChannelManager::startSurvey(const uint8_t* channels, int channelCount)
+{
+    if (isBusy()) {
+        return false;
+    }
+    _homeChannel = _radio.getChannel();
+    _candidateCount = channelCount < MAX_CANDIDATE_COUNT ? channelCount : MAX_CANDIDATE_COUNT;
+    for (int ii = 0; ii < _candidateCount; ++ii) {
+        _scores[ii] = channel_score_t { channels[ii], 0, 0, 0.0F };
+    }
+    _candidateIndex = 0;
+    if (_candidateCount == 0) {
+        _state = KEPT_HOME_CHANNEL;
+        return true;
+    }
+    startCandidate();
+    return true;
+}
+
+void ChannelManager::startCandidate()
+{
+    const uint8_t channel = _scores[_candidateIndex].channel;
+    _stateStartMs = _clock();
+    if (channel == _homeChannel) {
+        // the transmitter is already here, so there is nothing to agree
+        startMeasuring(_stateStartMs);
+        return;
+    }
+    // if the handshake is not sent then the transmitter stays on the home channel, and the candidate scores zero
+    sendHandshake(HANDSHAKE_SURVEY, channel);
+    _state = SURVEY_SETTLING;
+}
+
+void ChannelManager::startMeasuring(uint32_t timeMs)
+{
+    _startPacketCount = _radio.getLinkStatistics().getPacketCount();
+    _isJitterStarted = false;
+    _stateStartMs = timeMs;
+    _state = SURVEY_MEASURING;
+}
+
+/*!
+The first interval on the channel spans the retune, so the first change measured on the channel compares it with an interval
+on the previous channel. Snapshot the link's interval changes once two packets have been received, so that the changes after
+the snapshot compare intervals within the dwell.
+*/
+void ChannelManager::updateJitterStart()
+{
+    const LinkStatistics& linkStatistics = _radio.getLinkStatistics();
+    if (!_isJitterStarted && linkStatistics.getPacketCount() - _startPacketCount >= 2) {
+        _jitterStartSumUs = linkStatistics.getIntervalChangeSumUs();
+        _jitterStartCount = linkStatistics.getIntervalChangeCount();
+        _isJitterStarted = true;
+    }
+}
+
+void ChannelManager::finishCandidate(uint32_t timeMs)
+{
+    channel_score_t& candidate = _scores[_candidateIndex];
+    const LinkStatistics& linkStatistics = _radio.getLinkStatistics();
+    const uint32_t expectedCount = _config.expectedIntervalUs == 0 ? 0 : _config.dwellMs * 1000 / _config.expectedIntervalUs;
+    candidate.packetCount = linkStatistics.getPacketCount() - _startPacketCount;
+    const uint32_t changeCount = _isJitterStarted ? linkStatistics.getIntervalChangeCount() - _jitterStartCount : 0;
+    candidate.jitterUs = changeCount == 0 ? 0 : (linkStatistics.getIntervalChangeSumUs() - _jitterStartSumUs) / changeCount;
+    candidate.score = score(candidate.packetCount, expectedCount, candidate.jitterUs, _config);
+    if (candidate.channel != _homeChannel) {
+        _radio.setChannel(_homeChannel);
+    }
+
+    ++_candidateIndex;
+    if (_candidateIndex < _candidateCount) {
+        startCandidate();
+    } else {
+        selectChannel(timeMs);
+    }
+}
+
+/*!
+Switch to the best channel, if it beats the home channel by more than the hysteresis, so that the channel is not changed for a marginal gain.
+*/
+void ChannelManager::selectChannel(uint32_t timeMs)
+{
+    int best = 0;
+    float homeScore = 0.0F;
+    for (int ii = 0; ii < _candidateCount; ++ii) {
+        if (_scores[ii].score > _scores[best].score) {
+            best = ii;
+        }
+        if (_scores[ii].channel == _homeChannel) {
+            homeScore = _scores[ii].score;
+        }
+    }
+    const channel_score_t& candidate = _scores[best];
+    if (candidate.channel == _homeChannel || candidate.score <= homeScore + _config.hysteresis) {
+        _state = KEPT_HOME_CHANNEL;
+        return;
+    }
+    if (!sendHandshake(HANDSHAKE_SWITCH, candidate.channel)) {
+        _state = FAILED;
+        return;
+    }
+    // stay on the home channel until the handshake has been sent, as for the survey
+    _switchIndex = best;
+    _stateStartMs = timeMs;
+    _state = SWITCH_PENDING;
+}
+
+void ChannelManager::startSwitching(uint32_t timeMs)
+{
+    if (!_radio.setChannel(_scores[_switchIndex].channel)) {
+        _radio.setChannel(_homeChannel);
+        _state = FAILED;
+        return;
+    }
+    _startPacketCount = _radio.getLinkStatistics().getPacketCount();
+    _stateStartMs = timeMs;
+    _state = SWITCHING;
+}
+
+/*!
+Step the survey or the switch. Returns the new state.
+*/
+ChannelManager::state_t ChannelManager::update()
+{
+    const uint32_t timeMs = _clock();
+    // unsigned subtraction, so correct when the clock wraps around
+    const uint32_t elapsedMs = timeMs - _stateStartMs;
+
+    switch (_state) {
+    case SURVEY_SETTLING:
+        if (elapsedMs >= _config.settleMs) {
+            _radio.setChannel(_scores[_candidateIndex].channel);
+            startMeasuring(timeMs);
+        }
+        break;
+    case SURVEY_MEASURING:
+        updateJitterStart();
+        if (elapsedMs >= _config.dwellMs) {
+            finishCandidate(timeMs);
+        }
+        break;
+    case SWITCH_PENDING:
+        if (elapsedMs >= _config.settleMs) {
+            startSwitching(timeMs);
+        }
+        break;
+    case SWITCHING:
+        if (_radio.getLinkStatistics().getPacketCount() != _startPacketCount) {
+            _state = SWITCHED;
+        } else if (elapsedMs >= _config.switchTimeoutMs) {
+            // the transmitter has not followed, so go back to where it is
+            _radio.setChannel(_homeChannel);
+            _state = FAILED;
+        }
+        break;
+    default:
+        break;
+    }
+    return _state;
+}
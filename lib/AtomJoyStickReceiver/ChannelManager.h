@@ -0,0 +1,92 @@
+# pragma once
+
+#include <Radio_Interface.h>
+#include <cstdint>
+
+
+/*!
+Channel survey and selection, agreed with the transmitter using handshake frames.
+
+The survey measures each candidate channel in turn:
+1. on the home channel a SURVEY frame tells the transmitter to move to the candidate channel for `dwellMs`
+2. after `settleMs` the receiver moves to the candidate channel, and measures the packets received from the transmitter
+3. after `dwellMs` both return to the home channel
+
+Each channel is scored from the fraction of the expected packets received, less a penalty for inter-arrival jitter.
+The jitter is the mean change in the inter-arrival interval over the dwell alone: it is measured from the second packet
+received on the channel, so neither the previous channel nor the gap while retuning count against it.
+If the best channel beats the home channel by more than the hysteresis, a SWITCH frame is sent on the home channel, and after `settleMs`
+the receiver moves to the new channel. The frame is only queued when it is sent, so retuning at once could send it, or its retransmissions,
+on the new channel, where the transmitter is not listening.
+The switch is confirmed by a packet arriving on the new channel; if none arrives within `switchTimeoutMs` the receiver returns to the home channel.
+
+A transmitter that does not understand the handshake stays on the home channel, so the other channels score zero and the home channel is kept.
+
+`update()` never blocks, and is stepped from the main loop. The clock is injected and the radio is accessed through Radio_Interface,
+so the selection can be run on a host against simulated channels.
+*/
+class ChannelManager {
+public:
+    typedef uint32_t (*clock_ms_t)(void);
+    enum state_t { IDLE, SURVEY_SETTLING, SURVEY_MEASURING, SWITCH_PENDING, SWITCHING, SWITCHED, KEPT_HOME_CHANNEL, FAILED };
+    enum { MAX_CANDIDATE_COUNT = 13 }; // the 2.4GHz band has channels 1 to 13
+    struct config_t {
+        uint32_t dwellMs;
+        uint32_t settleMs; //!< time allowed for the transmitter to receive the handshake, including its retransmissions, and retune
+        uint32_t expectedIntervalUs; //!< the transmitter's packet interval, used to find the expected packet count
+        uint32_t switchTimeoutMs;
+        float jitterWeight; //!< penalty for jitter equal to the expected interval
+        float hysteresis; //!< margin by which a channel must beat the home channel
+    };
+    struct channel_score_t {
+        uint8_t channel;
+        uint32_t packetCount;
+        uint32_t jitterUs; //!< mean change in the inter-arrival interval during the dwell
+        float score;
+    };
+    //! Handshake frame, sent from the receiver to the transmitter on the current channel.
+    enum handshake_type_t { HANDSHAKE_SURVEY = 1, HANDSHAKE_SWITCH = 2 };
+    enum { HANDSHAKE_MAGIC_0 = 'C', HANDSHAKE_MAGIC_1 = 'H', HANDSHAKE_FRAME_SIZE = 8 };
+    enum { DEFAULT_DWELL_MS = 500, DEFAULT_SETTLE_MS = 20, DEFAULT_EXPECTED_INTERVAL_US = 10000, DEFAULT_SWITCH_TIMEOUT_MS = 200 };
+    static constexpr float DEFAULT_JITTER_WEIGHT = 0.25F;
+    static constexpr float DEFAULT_HYSTERESIS = 0.1F;
+public:
+    ChannelManager(Radio_Interface& radio, clock_ms_t clock);
+    ChannelManager(Radio_Interface& radio, clock_ms_t clock, const config_t& config);
+    static config_t defaultConfig(void);
+public:
+    bool startSurvey(const uint8_t* channels, int channelCount);
+    state_t update(void);
+    inline state_t getState(void) const { return _state; }
+    inline bool isBusy(void) const { return _state == SURVEY_SETTLING || _state == SURVEY_MEASURING || _state == SWITCH_PENDING || _state == SWITCHING; }
+    inline uint8_t getHomeChannel(void) const { return _homeChannel; }
+    inline int getCandidateCount(void) const { return _candidateCount; }
+    inline const channel_score_t& getScore(int index) const { return _scores[index]; }
+    static float score(uint32_t packetCount, uint32_t expectedCount, uint32_t jitterUs, const config_t& config);
+    static int encodeHandshake(handshake_type_t type, uint8_t channel, uint16_t dwellMs, uint8_t sequence, uint8_t* frame);
+private:
+    bool sendHandshake(handshake_type_t type, uint8_t channel);
+    void startCandidate(void);
+    void startMeasuring(uint32_t timeMs);
+    void updateJitterStart(void);
+    void finishCandidate(uint32_t timeMs);
+    void selectChannel(uint32_t timeMs);
+    void startSwitching(uint32_t timeMs);
+private:
+    Radio_Interface& _radio;
+    clock_ms_t _clock;
+    config_t _config;
+    state_t _state {IDLE};
+    uint8_t _homeChannel {0};
+    uint8_t _sequence {0};
+    int _candidateCount {0};
+    int _candidateIndex {0};
+    int _switchIndex {0}; //!< index of the candidate being switched to
+    channel_score_t _scores[MAX_CANDIDATE_COUNT] {};
+    uint32_t _stateStartMs {0};
+    uint32_t _startPacketCount {0};
+    // snapshot of the link's interval changes, taken once two packets have been received on the channel being measured
+    bool _isJitterStarted {false};
+    uint32_t _jitterStartSumUs {0};
+    uint32_t _jitterStartCount {0};
+};
@@ -23,7 +23,7 @@ Callback when data is sent.
 void onDataSent(const uint8_t *macAddress, esp_now_send_status_t status)
 {
     // status can be ESP_NOW_SEND_SUCCESS or ESP_NOW_SEND_FAIL
-    transceiver->setSendStatus(status);
+    transceiver->handleSendComplete(macAddress, status);
 }
 
 /*!
@@ -33,18 +33,14 @@ This runs in the high priority WiFi task, and so should not perform any lengthy
 */
 void onDataReceived(const uint8_t *macAddress, const uint8_t *data, int len)
 {
-    if (!transceiver->isPrimaryPeerMacAddressSet()) {
-        // If data is received when the primary peer MAC address is not yet set, it means we are in the binding process
-        // So if check if this data comes from a MAC address that has not already been added
-        if (!transceiver->macAddressAlreadyAdded(macAddress)) {
-            transceiver->setPrimaryPeerMacAddress(macAddress);
-        }
-    }
-    transceiver->copyReceivedDataToBuffer(macAddress, data, len);
+    transceiver->handleReceivedData(macAddress, data, len);
 }
 
-ESPNOW_Transceiver::ESPNOW_Transceiver(const uint8_t* myMacAddress)
+ESPNOW_Transceiver::ESPNOW_Transceiver(const uint8_t* myMacAddress) :
+    _sendQueue([]() -> uint32_t { return micros(); }, sendFrame, this)
 {
+    static_assert(static_cast<int>(SendQueue::MAX_PEER_COUNT) >= static_cast<int>(MAX_PEER_COUNT));
+    static_assert(SendQueue::MAX_FRAME_SIZE >= ESP_NOW_MAX_DATA_LEN);
     transceiver = this;
     memcpy(_myMacAddress, myMacAddress, ESP_NOW_ETH_ALEN);
 }
@@ -78,19 +74,17 @@ esp_err_t ESPNOW_Transceiver::init(uint8_t channel)
     return ESP_OK;
 }
 
-esp_err_t ESPNOW_Transceiver::init(received_data_t& received_data, uint8_t channel, const uint8_t* primaryMacAddress)
+esp_err_t ESPNOW_Transceiver::init(PacketRingBase& receivedPackets, uint8_t channel, const uint8_t* primaryMacAddress)
 {
-    //Serial.printf("ESPNOW_Transceiver::init received data: %x, %d\r\n", received_data.bufferPtr, received_data.bufferSize);
     const esp_err_t err = init(channel);
     if (err != ESP_OK) {
         return err;
     }
 
-    received_data.len = 0;
-    _peerData[PRIMARY_PEER].receivedDataPtr = &received_data;
+    receivedPackets.clear();
+    _peerData[PRIMARY_PEER].receivedPackets = &receivedPackets;
     _peerData[PRIMARY_PEER].peer_info.channel = channel;
     _peerData[PRIMARY_PEER].peer_info.encrypt = false;
-    _peerCount = 2; // since we have already added the broadcast peer
 
     // Set the primary MAC address now, if it is provided
     // Otherwise it will be set from `onDataReceived` as part of the binding process
@@ -103,8 +97,8 @@ esp_err_t ESPNOW_Transceiver::init(received_data_t& received_data, uint8_t chann
 
 esp_err_t ESPNOW_Transceiver::addBroadcastPeer(int channel)
 {
-    // set receivedDataPtr to nullptr so no broadcast data is copied
-    _peerData[BROADCAST_PEER].receivedDataPtr = nullptr;
+    // set receivedPackets to nullptr so no broadcast data is copied
+    _peerData[BROADCAST_PEER].receivedPackets = nullptr;
     memcpy(_peerData[BROADCAST_PEER].peer_info.peer_addr, broadcastMacAddress, ESP_NOW_ETH_ALEN);
     _peerData[BROADCAST_PEER].peer_info.channel = channel;
     _peerData[BROADCAST_PEER].peer_info.encrypt = false;
@@ -115,30 +109,58 @@ esp_err_t ESPNOW_Transceiver::addBroadcastPeer(int channel)
         return err;
     }
 
-    // don't inadvertently erase an already set primary or secondary peer
-    if (_peerCount < 1) {
-        _peerCount = 1;
-    }
+    _peerData[BROADCAST_PEER].isAdded = true;
+    _peerRegistry.add(broadcastMacAddress, BROADCAST_PEER);
     return ESP_OK;
 }
 
-esp_err_t ESPNOW_Transceiver::addSecondaryPeer(received_data_t& received_data, const uint8_t* macAddress)
+esp_err_t ESPNOW_Transceiver::addSecondaryPeer(PacketRingBase& receivedPackets, const uint8_t* macAddress)
 {
-    received_data.len = 0;
-    _peerData[PEER_2].receivedDataPtr = &received_data;
-    _peerData[PEER_2].peer_info.channel = _peerData[PRIMARY_PEER].peer_info.channel;
-    _peerData[PEER_2].peer_info.encrypt = false;
+    receivedPackets.clear();
+    _peerData[SECONDARY_PEER].receivedPackets = &receivedPackets;
+    _peerData[SECONDARY_PEER].peer_info.channel = _peerData[PRIMARY_PEER].peer_info.channel;
+    _peerData[SECONDARY_PEER].peer_info.encrypt = false;
     if (macAddress != nullptr) {
-        memcpy(_peerData[PEER_2].peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
+        memcpy(_peerData[SECONDARY_PEER].peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
     }
 
-    const esp_err_t err = esp_now_add_peer(&_peerData[PEER_2].peer_info);
+    const esp_err_t err = esp_now_add_peer(&_peerData[SECONDARY_PEER].peer_info);
     if (err != ESP_OK) {
         Serial.printf("addSecondaryPeer esp_now_add_peer failed: 0x%X (0x%X)\r\n", err, err - ESP_ERR_ESPNOW_BASE);
         return err;
     }
 
-    _peerCount = 3; // includes the primary peer and the broadcast peer
+    _peerData[SECONDARY_PEER].isAdded = true;
+    _peerRegistry.add(_peerData[SECONDARY_PEER].peer_info.peer_addr, SECONDARY_PEER);
+    return ESP_OK;
+}
+
+esp_err_t ESPNOW_Transceiver::addPeer(PacketRingBase& receivedPackets, const uint8_t* macAddress)
+{
+    const int peerIndex = FIRST_ADDITIONAL_PEER + _additionalPeerCount;
+    if (peerIndex >= MAX_PEER_COUNT) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    if (_peerRegistry.find(macAddress) != PeerRegistry::NOT_FOUND) {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+
+    peer_data_t& peerData = _peerData[peerIndex];
+    receivedPackets.clear();
+    peerData.receivedPackets = &receivedPackets;
+    peerData.peer_info.channel = _peerData[PRIMARY_PEER].peer_info.channel;
+    peerData.peer_info.encrypt = false;
+    memcpy(peerData.peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
+
+    const esp_err_t err = esp_now_add_peer(&peerData.peer_info);
+    if (err != ESP_OK) {
+        Serial.printf("addPeer esp_now_add_peer failed: 0x%X (0x%X)\r\n", err, err - ESP_ERR_ESPNOW_BASE);
+        return err;
+    }
+
+    peerData.isAdded = true;
+    _peerRegistry.add(macAddress, peerIndex);
+    ++_additionalPeerCount;
     return ESP_OK;
 }
 
@@ -149,30 +171,23 @@ bool ESPNOW_Transceiver::isPrimaryPeerMacAddressSet(void) const
 
 bool ESPNOW_Transceiver::macAddressAlreadyAdded(const uint8_t *macAddress) const
 {
-    if (_peerCount > 0) {
-        // check this is not the broadcast MAC address
-        if (memcmp(macAddress, broadcastMacAddress, ESP_NOW_ETH_ALEN) == 0) {
-            return true;
-        }
-    }
-    if (_peerCount > 2) {
-        // the secondary peer has been set, so compare the MAC address with that of the secondary peer.
-        if (memcmp(macAddress, _peerData[SECONDARY_PEER].peer_info.peer_addr, ESP_NOW_ETH_ALEN) == 0) {
-            return true;
-        }
-    }
-    return false;
+    // this includes the broadcast MAC address
+    return _peerRegistry.find(macAddress) != PeerRegistry::NOT_FOUND;
 }
 
 esp_err_t ESPNOW_Transceiver::setPrimaryPeerMacAddress(const uint8_t* macAddress)
 {
-    memcpy(_peerData[PRIMARY_PEER].peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
-
     if (_isPrimaryPeerMacAddressSet) {
+        _peerRegistry.remove(_peerData[PRIMARY_PEER].peer_info.peer_addr);
+        memcpy(_peerData[PRIMARY_PEER].peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
+        _peerRegistry.add(macAddress, PRIMARY_PEER);
         return ESP_OK;
     }
 
+    memcpy(_peerData[PRIMARY_PEER].peer_info.peer_addr, macAddress, ESP_NOW_ETH_ALEN);
     _isPrimaryPeerMacAddressSet = true;
+    _peerData[PRIMARY_PEER].isAdded = true;
+    _peerRegistry.add(macAddress, PRIMARY_PEER);
 
     const esp_err_t err = esp_now_add_peer(&_peerData[PRIMARY_PEER].peer_info);
     if (err != ESP_OK) {
@@ -181,6 +196,75 @@ esp_err_t ESPNOW_Transceiver::setPrimaryPeerMacAddress(const uint8_t* macAddress
     return ESP_OK;
 }
 
+/*!
+Retune to `channel`, and update the peers' channels to match, so that sends go out on the new channel.
+*/
+bool ESPNOW_Transceiver::setChannel(uint8_t channel)
+{
+    const esp_err_t err = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    if (err != ESP_OK) {
+        Serial.printf("setChannel esp_wifi_set_channel failed: 0x%X\r\n", err);
+        return false;
+    }
+    for (auto& peerData : _peerData) {
+        peerData.peer_info.channel = channel;
+        if (peerData.isAdded) {
+            esp_now_mod_peer(&peerData.peer_info);
+        }
+    }
+    return true;
+}
+
+bool ESPNOW_Transceiver::sendToPrimaryPeer(const uint8_t* data, int len)
+{
+    return sendData(data, len, SendQueue::PRIORITY_CONTROL, CONTROL_RETRY_DEADLINE_US) == ESP_OK;
+}
+
+void ESPNOW_Transceiver::handleReceivedData(const uint8_t *macAddress, const uint8_t *data, int len)
+{
+    if (_packetCapture != nullptr) {
+        _packetCapture->append(macAddress, data, len, micros());
+    }
+    // filter before binding, so that we don't bind to a transmitter that is addressing another receiver
+    if (_receiveFilter != nullptr && (!isPrimaryPeerMacAddressSet() || _peerRegistry.find(macAddress) == PRIMARY_PEER)) {
+        const ReceiveFilter::reason_t reason = _receiveFilter->check(macAddress, data, len);
+        if (reason != ReceiveFilter::ACCEPTED) {
+            recordRejectedPacket(reason);
+            return;
+        }
+    }
+    if (!isPrimaryPeerMacAddressSet()) {
+        // If data is received when the primary peer MAC address is not yet set, it means we are in the binding process
+        // So if check if this data comes from a MAC address that has not already been added
+        if (!macAddressAlreadyAdded(macAddress)) {
+            setPrimaryPeerMacAddress(macAddress);
+        }
+    }
+    if (copyReceivedDataToBuffer(macAddress, data, len) && _receiveSignal != nullptr) {
+        _receiveSignal->signal();
+    }
+}
+
+/*!
+Record a packet rejected by the receive filter in the link statistics, so that rejects are reported even though the packet never reaches the packet ring.
+*/
+void ESPNOW_Transceiver::recordRejectedPacket(ReceiveFilter::reason_t reason)
+{
+    switch (reason) {
+    case ReceiveFilter::REJECTED_LENGTH:
+        _linkStatistics.recordWrongLength();
+        break;
+    case ReceiveFilter::REJECTED_CHECKSUM:
+        _linkStatistics.recordChecksumFailure();
+        break;
+    case ReceiveFilter::REJECTED_ADDRESS:
+        _linkStatistics.recordWrongMacAddress();
+        break;
+    default:
+        break;
+    }
+}
+
 bool ESPNOW_Transceiver::copyReceivedDataToBuffer(const uint8_t *macAddress, const uint8_t *data, int len) // NOLINT(readability-make-member-function-const) false positive
 {
 #if defined(USE_INSTRUMENTATION)
@@ -189,64 +273,72 @@ bool ESPNOW_Transceiver::copyReceivedDataToBuffer(const uint8_t *macAddress, con
     _tickCountPrevious = tickCount;
 #endif
 
-    esp_now_peer_info_t peerInfo;
-    const esp_err_t err = esp_now_get_peer(macAddress, &peerInfo);
-    if (err != ESP_OK) {
-        Serial.printf("copyReceivedDataToBuffer esp_now_get_peer failed: 0x%X (0x%X)\r\n", err, err - ESP_ERR_ESPNOW_BASE);
+    // look up the peer in the registry, rather than with esp_now_get_peer(), which takes an internal lock
+    const int peerIndex = _peerRegistry.find(macAddress);
+    if (peerIndex == PeerRegistry::NOT_FOUND || peerIndex == BROADCAST_PEER) {
+        // don't copy the data of unknown peers or of the broadcast peer
         return false;
     }
-
-    for (int ii = PRIMARY_PEER; ii < _peerCount; ++ii) {
-        auto &peerData = _peerData[ii];
-        if (memcmp(macAddress, peerData.peer_info.peer_addr, ESP_NOW_ETH_ALEN) == 0) {
-            if (ii == PRIMARY_PEER) {
-                ++_receivedPacketCount; // only count packets being sent to the primary peer
-            }
-            // copy the received data into the _peerData buffer
-            const int copyLength = std::min(len, peerData.receivedDataPtr->bufferSize); // so don't overwrite buffer
-            memcpy(peerData.receivedDataPtr->bufferPtr, data, copyLength);
-            // and set the _peerData length
-            peerData.receivedDataPtr->len = copyLength;
-            return true;
-        }
+    peer_data_t& peerData = _peerData[peerIndex];
+    if (peerData.receivedPackets == nullptr) {
+        return false;
     }
 
-    // don't copy the data of the broadcast peer
-    /*if (memcmp(macAddress, _peerData[BROADCAST_PEER].peer_info.peer_addr, ESP_NOW_ETH_ALEN) == 0) {
-        const int copyLength = std::min(len, _peerData[BROADCAST_PEER].receivedDataPtr->bufferSize); // so don't overwrite buffer
-        memcpy(_peerData[BROADCAST_PEER].receivedDataPtr->bufferPtr, data, copyLength);
-        // and set the _peerData length
-        _peerData[BROADCAST_PEER].receivedDataPtr->len = copyLength;
-        return true;
-    }*/
-    return false;
+    const uint32_t timeUs = micros();
+    if (peerIndex == PRIMARY_PEER) {
+        ++_receivedPacketCount; // only count packets being sent to the primary peer
+        _linkStatistics.recordPacket(timeUs);
+    }
+    // push the received data onto the peer's packet ring, the ring truncates the data to its slot size
+    peerData.receivedPackets->push(data, len, timeUs);
+    return true;
 }
 
-esp_err_t ESPNOW_Transceiver::sendData(uint8_t *data, int len) const
+esp_err_t ESPNOW_Transceiver::sendData(const uint8_t *data, int len, SendQueue::priority_t priority, uint32_t retryDeadlineUs)
 {
     //const uint8_t *ma = _transmitMacAddress;
     //Serial.printf("sendData MAC: %02X:%02X:%02X:%02X:%02X:%02X\r\n", ma[0], ma[1], ma[2], ma[3], ma[4], ma[5]);
     //Serial.printf("sendData len:%d\r\n", len);
-    assert(len < ESP_NOW_MAX_DATA_LEN); // 250
+    if (len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
     if (!isPrimaryPeerMacAddressSet() || data == nullptr || len==0) {
         return ESP_FAIL;
     }
-    const esp_err_t err = esp_now_send(_peerData[PRIMARY_PEER].peer_info.peer_addr, data, len);
-    //if (err != ESP_OK) { Serial.printf("sendData err:0x%X (0x%X)\r\n", err, err - ESP_ERR_ESPNOW_BASE); }
-    return err;
+    // the length has been checked, so the frame is only refused if the queue is full
+    return _sendQueue.enqueue(PRIMARY_PEER, data, len, priority, retryDeadlineUs) ? ESP_OK : ESP_ERR_ESPNOW_NO_MEM;
 }
 
-esp_err_t ESPNOW_Transceiver::sendDataSecondary(uint8_t *data, int len) const
+esp_err_t ESPNOW_Transceiver::sendDataSecondary(const uint8_t *data, int len, SendQueue::priority_t priority, uint32_t retryDeadlineUs)
 {
     //const uint8_t *ma = _peerData[SECONDARY_PEER].peer_info.peer_addr;
     //Serial.printf("sendDataSecondary MAC: %02X:%02X:%02X:%02X:%02X:%02X\r\n", ma[0], ma[1], ma[2], ma[3], ma[4], ma[5]);
     //Serial.printf("sendDataSecondary len:%d\r\n", len);
-    assert(len < ESP_NOW_MAX_DATA_LEN); // 250
-    if (_peerCount < SECONDARY_PEER + 1 || data == nullptr || len==0) {
+    if (len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!_peerData[SECONDARY_PEER].isAdded || data == nullptr || len==0) {
         return ESP_FAIL;
     }
-    const esp_err_t err = esp_now_send(_peerData[SECONDARY_PEER].peer_info.peer_addr, data, len);
-    //if (err != ESP_OK) { Serial.printf("sendDataSecondary err:0x%X (0x%x)\r\n", err, err - ESP_ERR_ESPNOW_BASE); }
-    return err;
+    // the length has been checked, so the frame is only refused if the queue is full
+    return _sendQueue.enqueue(SECONDARY_PEER, data, len, priority, retryDeadlineUs) ? ESP_OK : ESP_ERR_ESPNOW_NO_MEM;
 }
 
+/*!
+Called by the send queue to hand a frame to ESP-NOW.
+*/
+SendQueue::send_result_t ESPNOW_Transceiver::sendFrame(const void* context, int peerIndex, const uint8_t* data, int len)
+{
+    const auto self = static_cast<const ESPNOW_Transceiver*>(context);
+    const esp_err_t err = esp_now_send(self->_peerData[peerIndex].peer_info.peer_addr, data, len);
+    //if (err != ESP_OK) { Serial.printf("sendFrame err:0x%X (0x%X)\r\n", err, err - ESP_ERR_ESPNOW_BASE); }
+    return err == ESP_OK ? SendQueue::SEND_OK : err == ESP_ERR_ESPNOW_NO_MEM ? SendQueue::SEND_NO_MEM : SendQueue::SEND_ERROR;
+}
+
+/*!
+Called by the ESP-NOW send callback, in the WiFi task. The completion is matched to the peer by its MAC address.
+*/
+void ESPNOW_Transceiver::handleSendComplete(const uint8_t *macAddress, esp_now_send_status_t status)
+{
+    _sendQueue.onSendComplete(_peerRegistry.find(macAddress), status == ESP_NOW_SEND_SUCCESS);
+}
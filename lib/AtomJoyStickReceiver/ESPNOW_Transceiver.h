@@ -1,46 +1,72 @@
 # pragma once
 
+#include <LinkStatistics.h>
+#include <PacketCapture.h>
+#include <PacketRing.h>
+#include <PacketSignal.h>
+#include <PeerRegistry.h>
+#include <Radio_Interface.h>
+#include <ReceiveFilter.h>
+#include <SendQueue.h>
 #include <esp_now.h>
 
 
-class ESPNOW_Transceiver {
+class ESPNOW_Transceiver : public Radio_Interface {
 public:
-    enum { BROADCAST_PEER=0, PRIMARY_PEER=1, SECONDARY_PEER=2, PEER_2=2, PEER_3=4, MAX_PEER_COUNT=4 };
-    struct received_data_t {
-        inline received_data_t(uint8_t *aBufferPtr, int aBufferSize)
-            : bufferPtr(aBufferPtr), bufferSize(aBufferSize), len(0) {}
-        uint8_t *bufferPtr;
-        int bufferSize;
-        int len;
-    };
+    enum { BROADCAST_PEER=0, PRIMARY_PEER=1, SECONDARY_PEER=2, FIRST_ADDITIONAL_PEER=3, MAX_PEER_COUNT=ESP_NOW_MAX_TOTAL_PEER_NUM };
     struct peer_data_t {
         esp_now_peer_info_t peer_info { .peer_addr{0,0,0,0,0,0}, .lmk{0}, .channel=0, .ifidx=WIFI_IF_STA, .encrypt=false,.priv=nullptr};
-        received_data_t *receivedDataPtr {nullptr};
+        PacketRingBase *receivedPackets {nullptr};
+        bool isAdded {false};
     };
+    enum { CONTROL_RETRY_DEADLINE_US = 20000 }; //!< retry deadline for the channel handshake
 public:
     explicit ESPNOW_Transceiver(const uint8_t* myMacAddress);
-    // !!NOTE: all references passed to init() and addSecondaryPeer() must be static or allocated, ie they must not be local variables on the stack
-    esp_err_t init(received_data_t& received_data, uint8_t channel, const uint8_t* transmitMacAddress);
-    esp_err_t addSecondaryPeer(received_data_t& received_data, const uint8_t* macAddress);
+    // !!NOTE: all references passed to init(), addSecondaryPeer() and addPeer() must be static or allocated, ie they must not be local variables on the stack
+    esp_err_t init(PacketRingBase& receivedPackets, uint8_t channel, const uint8_t* transmitMacAddress);
+    esp_err_t addSecondaryPeer(PacketRingBase& receivedPackets, const uint8_t* macAddress);
+    // adds a further peer, each peer has its own packet ring, up to the ESP-NOW limit of MAX_PEER_COUNT peers in total
+    esp_err_t addPeer(PacketRingBase& receivedPackets, const uint8_t* macAddress);
+    inline int getPeerCount(void) const { return _peerRegistry.getCount(); }
     inline const uint8_t *myMacAddress(void) const { return _myMacAddress; }
-    // sends data to the primary peer,
-    esp_err_t sendData(uint8_t *data, int len) const;
-    // sends data to the secondary peer,
-    esp_err_t sendDataSecondary(uint8_t *data, int len) const;
+    // queues data to be sent to the primary peer, a failed send is retried for `retryDeadlineUs`, or not at all if it is zero
+    esp_err_t sendData(const uint8_t *data, int len, SendQueue::priority_t priority=SendQueue::PRIORITY_CONTROL, uint32_t retryDeadlineUs=0);
+    // queues data to be sent to the secondary peer
+    esp_err_t sendDataSecondary(const uint8_t *data, int len, SendQueue::priority_t priority=SendQueue::PRIORITY_CONTROL, uint32_t retryDeadlineUs=0);
+    // sends any queued data that was held back by a full window or by the radio running out of buffers, called from the main loop
+    inline void processSendQueue(void) { _sendQueue.process(); }
+    inline SendQueue& getSendQueue(void) { return _sendQueue; }
+    inline const SendQueue& getSendQueue(void) const { return _sendQueue; }
     bool isPrimaryPeerMacAddressSet(void) const;
     const uint8_t *getPrimaryPeerMacAddress(void) const { return _peerData[PRIMARY_PEER].peer_info.peer_addr; }
     inline uint8_t getBroadcastChannel(void) const { return _peerData[BROADCAST_PEER].peer_info.channel; }
+    // Radio_Interface functions, used for channel management
+    uint8_t getChannel(void) const override { return getBroadcastChannel(); }
+    bool setChannel(uint8_t channel) override;
+    bool sendToPrimaryPeer(const uint8_t* data, int len) override;
     esp_err_t broadcastData(const uint8_t *data, int len) const { return esp_now_send(_peerData[BROADCAST_PEER].peer_info.peer_addr, data, len); }
+    // called by the ESP-NOW receive callback, and by PacketReplay to feed in captured packets
+    void handleReceivedData(const uint8_t *macAddress, const uint8_t *data, int len);
+    // the packet capture, if set, records every packet received, before it is filtered
+    inline void setPacketCapture(PacketCapture* packetCapture) { _packetCapture = packetCapture; }
+    // the receive filter, if set, is applied to packets from the primary peer, and to all packets while binding
+    inline void setReceiveFilter(ReceiveFilter* receiveFilter) { _receiveFilter = receiveFilter; }
+    // the receive signal, if set, is signalled whenever a packet is copied into a peer's packet ring
+    inline void setReceiveSignal(PacketSignal* receiveSignal) { _receiveSignal = receiveSignal; }
     inline uint32_t getReceivedPacketCount(void) const { return _receivedPacketCount; }
     inline uint32_t getTickCountDelta(void) const { return _tickCountDelta; }
+    inline LinkStatistics& getLinkStatistics(void) { return _linkStatistics; }
+    inline const LinkStatistics& getLinkStatistics(void) const override { return _linkStatistics; }
 private:
     esp_err_t init(uint8_t channel);
     esp_err_t addBroadcastPeer(int channel);
-    // when data is received the copy function is called to copy the received data into the client's buffer
+    // when data is received the copy function is called to copy the received data into the client's packet ring
     bool copyReceivedDataToBuffer(const uint8_t *macAddress, const uint8_t *data, int len);
     bool macAddressAlreadyAdded(const uint8_t *macAddress) const;
+    void recordRejectedPacket(ReceiveFilter::reason_t reason);
     esp_err_t setPrimaryPeerMacAddress(const uint8_t* macAddress);
-    inline void setSendStatus(esp_now_send_status_t status) { _sendStatus = status; }
+    void handleSendComplete(const uint8_t *macAddress, esp_now_send_status_t status);
+    static SendQueue::send_result_t sendFrame(const void* context, int peerIndex, const uint8_t* data, int len);
 private:
     friend void onDataSent(const uint8_t *macAddress, esp_now_send_status_t status);
     friend void onDataReceived(const uint8_t *macAddress, const uint8_t *data, int len);
@@ -50,11 +76,16 @@ private:
     uint32_t _tickCountPrevious {0};
     uint32_t _tickCountDelta {0};
     uint32_t _receivedPacketCount {0}; //!< used to check for dropped packets
+    LinkStatistics _linkStatistics; //!< statistics for packets received from the primary peer
     // by default the transceiver has two peers, the broadcast peer and the primary peer
     int _isPrimaryPeerMacAddressSet {false};
-    int _peerCount {0};
+    int _additionalPeerCount {0};
     peer_data_t _peerData[MAX_PEER_COUNT];
-    esp_now_send_status_t _sendStatus {ESP_NOW_SEND_SUCCESS};
+    PeerRegistry _peerRegistry; //!< maps MAC addresses to indices into _peerData
+    SendQueue _sendQueue;
+    PacketSignal* _receiveSignal {nullptr};
+    PacketCapture* _packetCapture {nullptr};
+    ReceiveFilter* _receiveFilter {nullptr};
     uint8_t _myMacAddress[ESP_NOW_ETH_ALEN + 2]  {0, 0, 0, 0, 0, 0, 0, 0};
 };
 
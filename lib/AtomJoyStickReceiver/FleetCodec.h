@@ -0,0 +1,158 @@
+# pragma once
+
+#include <PacketCodec.h>
+
+
+/*!
+Codec for fleet frames: a single broadcast frame carrying a command slot for each rover in the fleet.
+
+One transmitter broadcasts a frame at a fixed rate, and each rover extracts its own slot, so the airtime used
+stays constant as the fleet grows, rather than increasing with one joystick per rover.
+
+Frame layout:
+    [0..1] magic 'F', 'L'
+    [2]    fleet id
+    [3]    slot count
+    [4]    sequence number
+    [5..]  slot count slots of SLOT_SIZE bytes
+    [last] checksum, the sum of all preceding bytes
+
+Slot layout:
+    [0..2] last three bytes of the MAC address of the rover the slot is for
+    [3..6] yaw, throttle, roll, pitch as int8_t, scaled so that 127 is full deflection
+    [7]    flags: MODE_FLAG, ALT_MODE_FLAG, FLIP_FLAG, ARM_FLAG
+
+With SLOT_INDEX set to ANY_SLOT the rover finds its slot by its MAC address,
+otherwise it uses the slot at SLOT_INDEX and the MAC bytes are ignored.
+Frames with a fleet id other than FLEET_ID are from another fleet, and are not addressed to this rover.
+*/
+template <int SLOT_INDEX = -1, uint8_t FLEET_ID = 0>
+struct FleetCodec {
+    enum { ANY_SLOT = -1 };
+    enum : uint8_t { MAGIC_0 = 'F', MAGIC_1 = 'L' };
+    enum { HEADER_SIZE = 5, SLOT_SIZE = 8, CHECKSUM_SIZE = 1 };
+    enum { PACKET_SIZE = HEADER_SIZE + SLOT_SIZE + CHECKSUM_SIZE }; //!< the minimum packet size, a frame with one slot
+    enum { MAX_SLOT_COUNT = 15 };
+    enum { MAX_PACKET_SIZE = HEADER_SIZE + MAX_SLOT_COUNT * SLOT_SIZE + CHECKSUM_SIZE }; //!< a full frame, which the receiver's packet slots hold
+    enum : uint8_t { MODE_FLAG = 0x01, ALT_MODE_FLAG = 0x02, FLIP_FLAG = 0x04, ARM_FLAG = 0x08 };
+    typedef PacketField<uint8_t, 0> Magic0;
+    typedef PacketField<uint8_t, 1> Magic1;
+    typedef PacketField<uint8_t, 2> FleetId;
+    typedef PacketField<uint8_t, 3> SlotCount;
+    typedef PacketField<uint8_t, 4> Sequence;
+    // fields within a slot, offsets are from the start of the slot
+    typedef PacketField<uint8_t, 0> SlotMacAddress3;
+    typedef PacketField<uint8_t, 1> SlotMacAddress4;
+    typedef PacketField<uint8_t, 2> SlotMacAddress5;
+    typedef PacketField<int8_t, 3> SlotYaw;
+    typedef PacketField<int8_t, 4> SlotThrottle;
+    typedef PacketField<int8_t, 5> SlotRoll;
+    typedef PacketField<int8_t, 6> SlotPitch;
+    typedef PacketField<uint8_t, 7> SlotFlags;
+
+    struct slot_command_t {
+        uint8_t macAddressSuffix[3];
+        joystick_frame_t frame;
+    };
+
+    static constexpr int frameSize(int slotCount) { return HEADER_SIZE + slotCount * SLOT_SIZE + CHECKSUM_SIZE; }
+    static constexpr float STICK_SCALE = 127.0F;
+
+    static bool isChecksumValid(const uint8_t* packet, int len) {
+        if (len < PACKET_SIZE || Magic0::load(packet) != MAGIC_0 || Magic1::load(packet) != MAGIC_1) {
+            return false;
+        }
+        const int size = frameSize(SlotCount::load(packet));
+        if (len < size) {
+            return false;
+        }
+        uint8_t checksum = 0;
+        for (int ii = 0; ii < size - CHECKSUM_SIZE; ++ii) {
+            checksum += packet[ii];
+        }
+        return checksum == packet[size - CHECKSUM_SIZE];
+    }
+
+    //! Returns a pointer to this rover's slot, or nullptr if the frame is for another fleet or there is no slot for this rover.
+    static const uint8_t* findSlot(const uint8_t* packet, int len, const uint8_t* myMacAddress) {
+        if (len < PACKET_SIZE || FleetId::load(packet) != FLEET_ID) {
+            return nullptr;
+        }
+        const int slotCount = SlotCount::load(packet);
+        if (len < frameSize(slotCount)) {
+            return nullptr;
+        }
+        if (SLOT_INDEX != ANY_SLOT) {
+            return SLOT_INDEX < slotCount ? packet + HEADER_SIZE + SLOT_INDEX * SLOT_SIZE : nullptr;
+        }
+        for (int ii = 0; ii < slotCount; ++ii) {
+            const uint8_t* slot = packet + HEADER_SIZE + ii * SLOT_SIZE;
+            if (SlotMacAddress3::load(slot) == myMacAddress[3] && SlotMacAddress4::load(slot) == myMacAddress[4] && SlotMacAddress5::load(slot) == myMacAddress[5]) {
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool isAddressedTo(const uint8_t* packet, int len, const uint8_t* myMacAddress) {
+        return findSlot(packet, len, myMacAddress) != nullptr;
+    }
+
+    static bool decode(const uint8_t* packet, int len, const uint8_t* myMacAddress, joystick_frame_t& frame) {
+        const uint8_t* slot = findSlot(packet, len, myMacAddress);
+        if (slot == nullptr) {
+            return false;
+        }
+        constexpr float scale = 1.0F / STICK_SCALE;
+        frame.yaw = static_cast<float>(SlotYaw::load(slot)) * scale;
+        frame.throttle = static_cast<float>(SlotThrottle::load(slot)) * scale;
+        frame.roll = static_cast<float>(SlotRoll::load(slot)) * scale;
+        frame.pitch = static_cast<float>(SlotPitch::load(slot)) * scale;
+        const uint8_t flags = SlotFlags::load(slot);
+        frame.mode = (flags & MODE_FLAG) ? 1 : 0;
+        frame.altMode = (flags & ALT_MODE_FLAG) ? joystick_frame_t::ALT_MODE_MANUAL : joystick_frame_t::ALT_MODE_AUTO;
+        frame.flipButton = (flags & FLIP_FLAG) ? 1 : 0;
+        frame.armButton = (flags & ARM_FLAG) ? 1 : 0;
+        frame.proactiveFlag = 0;
+        return true;
+    }
+
+    static int8_t encodeStick(float value) {
+        const float clipped = value < -1.0F ? -1.0F : value > 1.0F ? 1.0F : value;
+        return static_cast<int8_t>(clipped * STICK_SCALE + (clipped < 0.0F ? -0.5F : 0.5F));
+    }
+
+    /*!
+    Encode a fleet frame, for use by the transmitter. `packet` must be at least `frameSize(slotCount)` bytes long.
+
+    The slot has a single altitude mode flag, so any `altMode` other than ALT_MODE_MANUAL is sent as ALT_MODE_AUTO.
+    This includes the zero of a frame that has not yet been set from a joystick packet, so that a rover defaults to auto.
+
+    Returns the length of the frame.
+    */
+    static int encode(uint8_t* packet, uint8_t fleetId, uint8_t sequence, const slot_command_t* commands, int slotCount) {
+        packet[Magic0::offset] = MAGIC_0;
+        packet[Magic1::offset] = MAGIC_1;
+        packet[FleetId::offset] = fleetId;
+        packet[SlotCount::offset] = static_cast<uint8_t>(slotCount);
+        packet[Sequence::offset] = sequence;
+        for (int ii = 0; ii < slotCount; ++ii) {
+            uint8_t* slot = packet + HEADER_SIZE + ii * SLOT_SIZE;
+            const slot_command_t& command = commands[ii];
+            memcpy(slot, command.macAddressSuffix, sizeof(command.macAddressSuffix));
+            slot[SlotYaw::offset] = static_cast<uint8_t>(encodeStick(command.frame.yaw));
+            slot[SlotThrottle::offset] = static_cast<uint8_t>(encodeStick(command.frame.throttle));
+            slot[SlotRoll::offset] = static_cast<uint8_t>(encodeStick(command.frame.roll));
+            slot[SlotPitch::offset] = static_cast<uint8_t>(encodeStick(command.frame.pitch));
+            slot[SlotFlags::offset] = static_cast<uint8_t>((command.frame.mode ? MODE_FLAG : 0) | (command.frame.altMode == joystick_frame_t::ALT_MODE_MANUAL ? ALT_MODE_FLAG : 0)
+                | (command.frame.flipButton ? FLIP_FLAG : 0) | (command.frame.armButton ? ARM_FLAG : 0));
+        }
+        const int size = frameSize(slotCount);
+        uint8_t checksum = 0;
+        for (int ii = 0; ii < size - CHECKSUM_SIZE; ++ii) {
+            checksum += packet[ii];
+        }
+        packet[size - CHECKSUM_SIZE] = checksum;
+        return size;
+    }
+};
@@ -0,0 +1,232 @@
+# pragma once
+
+#include <cmath>
+#include <cstdint>
+
+
+/*!
+Per-axis input shaping, composed at compile time from a chain of stages.
+
+Each stage has:
+    void configure(const shaping_parameters_t& parameters); // called when the parameters change, does any divisions
+    float apply(float value);                               // called once per packet, multiplications only
+
+`ShapingChain<STAGES...>` applies the stages in order. The calls are resolved at compile time,
+so there is no virtual dispatch and the compiler can inline the whole chain.
+*/
+struct shaping_parameters_t {
+    float bias;
+    float deadZone;
+    float expo; //!< 0 for linear, 1 for fully cubic
+    float lowPassCutoffHz; //!< 0 to disable the low-pass filter
+    float sampleRateHz; //!< rate at which `apply()` is called, ie the packet rate
+};
+
+/*!
+Subtract the stick's center reading, so that the stick reads zero when centered.
+*/
+class BiasStage {
+public:
+    inline void configure(const shaping_parameters_t& parameters) { _bias = parameters.bias; }
+    inline float apply(float value) const { return value - _bias; }
+private:
+    float _bias {0.0F};
+};
+
+/*!
+Dead zone around the center, with the remaining travel rescaled so full deflection still gives +/-1.
+
+The bias moves the center, so the travel available on each side differs, and each side has its own scale factor.
+*/
+class DeadZoneStage {
+public:
+    inline void configure(const shaping_parameters_t& parameters) {
+        _deadZone = parameters.deadZone;
+        // after the bias is subtracted the stick's range is [-1 - bias, 1 - bias]
+        const float positiveTravel = 1.0F - parameters.bias - _deadZone;
+        const float negativeTravel = 1.0F + parameters.bias - _deadZone;
+        _positiveScale = positiveTravel > 0.0F ? 1.0F / positiveTravel : 0.0F;
+        _negativeScale = negativeTravel > 0.0F ? 1.0F / negativeTravel : 0.0F;
+    }
+    inline float apply(float value) const {
+        if (value > _deadZone) {
+            return clip((value - _deadZone) * _positiveScale);
+        }
+        if (value < -_deadZone) {
+            return clip((value + _deadZone) * _negativeScale);
+        }
+        return 0.0F;
+    }
+private:
+    static inline float clip(float value) { return value > 1.0F ? 1.0F : value < -1.0F ? -1.0F : value; }
+private:
+    float _deadZone {0.0F};
+    float _positiveScale {1.0F};
+    float _negativeScale {1.0F};
+};
+
+/*!
+Expo curve, `(1 - expo)*x + expo*x^3`, looked up in a table of LUT_SIZE segments with linear interpolation.
+The curve is odd, so the table only covers [0, 1].
+*/
+template <int LUT_SIZE>
+class ExpoStage {
+public:
+    inline void configure(const shaping_parameters_t& parameters) {
+        const float expo = parameters.expo;
+        for (int ii = 0; ii <= LUT_SIZE; ++ii) {
+            const float x = static_cast<float>(ii) / static_cast<float>(LUT_SIZE);
+            _table[ii] = (1.0F - expo) * x + expo * x * x * x;
+        }
+    }
+    inline float apply(float value) const {
+        const float magnitude = value < 0.0F ? -value : value;
+        const float position = (magnitude < 1.0F ? magnitude : 1.0F) * static_cast<float>(LUT_SIZE);
+        int index = static_cast<int>(position);
+        if (index >= LUT_SIZE) {
+            index = LUT_SIZE - 1;
+        }
+        const float fraction = position - static_cast<float>(index);
+        const float shaped = _table[index] + (_table[index + 1] - _table[index]) * fraction;
+        return value < 0.0F ? -shaped : shaped;
+    }
+private:
+    float _table[LUT_SIZE + 1] {};
+};
+
+/*!
+First order low-pass filter, `y += alpha*(x - y)`.
+*/
+class OnePoleLowPassStage {
+public:
+    inline void configure(const shaping_parameters_t& parameters) {
+        if (parameters.lowPassCutoffHz <= 0.0F || parameters.sampleRateHz <= 0.0F) {
+            _alpha = 1.0F;
+            return;
+        }
+        const float rc = 1.0F / (2.0F * static_cast<float>(M_PI) * parameters.lowPassCutoffHz);
+        const float dt = 1.0F / parameters.sampleRateHz;
+        _alpha = dt / (rc + dt);
+    }
+    inline float apply(float value) {
+        _state += _alpha * (value - _state);
+        return _state;
+    }
+private:
+    float _alpha {1.0F};
+    float _state {0.0F};
+};
+
+/*!
+Second order Butterworth low-pass filter, in transposed direct form II.
+*/
+class BiquadLowPassStage {
+public:
+    inline void configure(const shaping_parameters_t& parameters) {
+        if (parameters.lowPassCutoffHz <= 0.0F || parameters.sampleRateHz <= 0.0F || parameters.lowPassCutoffHz >= parameters.sampleRateHz / 2.0F) {
+            _b0 = 1.0F; _b1 = 0.0F; _b2 = 0.0F; _a1 = 0.0F; _a2 = 0.0F;
+            return;
+        }
+        constexpr float Q = 0.70710678F;
+        const float omega = 2.0F * static_cast<float>(M_PI) * parameters.lowPassCutoffHz / parameters.sampleRateHz;
+        const float alpha = std::sin(omega) / (2.0F * Q);
+        const float cosOmega = std::cos(omega);
+        const float a0Reciprocal = 1.0F / (1.0F + alpha);
+        _b1 = (1.0F - cosOmega) * a0Reciprocal;
+        _b0 = _b1 / 2.0F;
+        _b2 = _b0;
+        _a1 = -2.0F * cosOmega * a0Reciprocal;
+        _a2 = (1.0F - alpha) * a0Reciprocal;
+    }
+    inline float apply(float value) {
+        const float output = _b0 * value + _state1;
+        _state1 = _b1 * value - _a1 * output + _state2;
+        _state2 = _b2 * value - _a2 * output;
+        return output;
+    }
+private:
+    float _b0 {1.0F};
+    float _b1 {0.0F};
+    float _b2 {0.0F};
+    float _a1 {0.0F};
+    float _a2 {0.0F};
+    float _state1 {0.0F};
+    float _state2 {0.0F};
+};
+
+/*!
+Chain of shaping stages, applied in the order they are listed.
+*/
+template <typename... STAGES>
+class ShapingChain;
+
+template <>
+class ShapingChain<> {
+public:
+    inline void configure([[maybe_unused]] const shaping_parameters_t& parameters) {}
+    inline float apply(float value) { return value; }
+};
+
+template <typename STAGE, typename... REST>
+class ShapingChain<STAGE, REST...> {
+public:
+    inline void configure(const shaping_parameters_t& parameters) {
+        _stage.configure(parameters);
+        _rest.configure(parameters);
+    }
+    inline float apply(float value) { return _rest.apply(_stage.apply(value)); }
+private:
+    STAGE _stage;
+    ShapingChain<REST...> _rest;
+};
+
+/*!
+Estimate of a stick's center reading from several samples, rejecting outliers, such as a sample taken as the stick is knocked.
+
+The median is found, samples further than OUTLIER_THRESHOLD from it are discarded, and the remainder are averaged.
+*/
+template <int COUNT>
+class BiasEstimator {
+public:
+    static constexpr float OUTLIER_THRESHOLD = 0.05F;
+public:
+    inline void reset(void) { _count = 0; }
+    inline bool isComplete(void) const { return _count >= COUNT; }
+    inline int getCount(void) const { return _count; }
+    //! Returns true once COUNT samples have been added.
+    inline bool addSample(float sample) {
+        if (_count < COUNT) {
+            _samples[_count] = sample;
+            ++_count;
+        }
+        return isComplete();
+    }
+    float estimate(void) const {
+        if (_count == 0) {
+            return 0.0F;
+        }
+        float sorted[COUNT];
+        for (int ii = 0; ii < _count; ++ii) {
+            // insertion sort, COUNT is small
+            int jj = ii;
+            while (jj > 0 && sorted[jj - 1] > _samples[ii]) {
+                sorted[jj] = sorted[jj - 1];
+                --jj;
+            }
+            sorted[jj] = _samples[ii];
+        }
+        const float median = sorted[_count / 2];
+        float sum = 0.0F;
+        int inliers = 0;
+        for (int ii = 0; ii < _count; ++ii) {
+            if (std::fabs(sorted[ii] - median) <= OUTLIER_THRESHOLD) {
+                sum += sorted[ii];
+                ++inliers;
+            }
+        }
+        return sum / static_cast<float>(inliers); // the median itself is always an inlier
+    }
+private:
+    float _samples[COUNT] {};
+    int _count {0};
+};
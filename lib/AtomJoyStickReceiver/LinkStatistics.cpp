@@ -0,0 +1,67 @@
+#include <HardwareSerial.h>
+#include <LinkStatistics.h>
+
+
+void LinkStatistics::reset()
+{
+    *this = LinkStatistics();
+}
+
+/*!
+Record the arrival of a packet at `timeUs`.
+*/
+void LinkStatistics::recordPacket(uint32_t timeUs)
+{
+    ++_packetCount;
+    if (_packetCount == 1) {
+        _previousTimeUs = timeUs;
+        _windowStartUs = timeUs;
+        _windowPacketCount = 0; // the window counts the packets after its start, up to and including the one that closes it
+        return;
+    }
+
+    const uint32_t intervalUs = timeUs - _previousTimeUs;
+    _previousTimeUs = timeUs;
+    if (_packetCount > 2) {
+        // interarrival jitter as in RFC 3550, smoothed with a gain of 1/16, the change is limited so a long gap cannot overflow the sum
+        uint32_t changeUs = intervalUs > _lastIntervalUs ? intervalUs - _lastIntervalUs : _lastIntervalUs - intervalUs;
+        changeUs = changeUs < ONE_SECOND_US ? changeUs : static_cast<uint32_t>(ONE_SECOND_US);
+        _jitterX16 += changeUs - (_jitterX16 >> 4U);
+        _intervalChangeSumUs += changeUs;
+        ++_intervalChangeCount;
+    }
+    _lastIntervalUs = intervalUs;
+
+    // the bucket is the number of significant bits in the interval
+    const int bucket = intervalUs == 0 ? 0 : 32 - __builtin_clz(intervalUs);
+    ++_histogram[bucket < HISTOGRAM_BUCKET_COUNT ? bucket : HISTOGRAM_BUCKET_COUNT - 1];
+
+    if (intervalUs > _gapThresholdUs) {
+        ++_gapCount;
+        if (intervalUs > _longestGapUs) {
+            _longestGapUs = intervalUs;
+        }
+    }
+
+    ++_windowPacketCount;
+    const uint32_t windowUs = timeUs - _windowStartUs;
+    if (windowUs >= ONE_SECOND_US) {
+        _packetsPerSecond = static_cast<uint32_t>(static_cast<uint64_t>(_windowPacketCount) * ONE_SECOND_US / windowUs);
+        _windowStartUs = timeUs;
+        _windowPacketCount = 0;
+    }
+}
+
+/*!
+Print the statistics to the serial port. Only non-empty histogram buckets are printed.
+*/
+void LinkStatistics::print() const
+{
+    Serial.printf("LINK packets:%u pps:%u jitter:%uus gaps:%u longest gap:%uus checksum failures:%u wrong MAC:%u wrong length:%u\r\n",
+        _packetCount, _packetsPerSecond, getJitterUs(), _gapCount, _longestGapUs, _checksumFailureCount, _wrongMacAddressCount, _wrongLengthCount);
+    for (int ii = 0; ii < HISTOGRAM_BUCKET_COUNT; ++ii) {
+        if (_histogram[ii] != 0) {
+            Serial.printf("  <=%7uus:%u\r\n", bucketUpperBoundUs(ii), _histogram[ii]);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+# pragma once
+
+#include <cstdint>
+
+
+/*!
+Radio link quality statistics: packet inter-arrival histogram, jitter, gaps, packets per second, and rejected packets.
+
+Recording a packet is a handful of integer operations, so the statistics can be left on in production builds.
+Packet arrivals, and packets rejected by the receive filter, are recorded in the WiFi task, so each counter has a single writer.
+*/
+class LinkStatistics {
+public:
+    // bucket n holds intervals in the range [2^(n-1), 2^n) microseconds, bucket 0 holds intervals of 0us
+    enum { HISTOGRAM_BUCKET_COUNT = 24 };
+    enum { DEFAULT_GAP_THRESHOLD_US = 100000 };
+    enum { ONE_SECOND_US = 1000000 };
+public:
+    void reset(void);
+    void recordPacket(uint32_t timeUs);
+    inline void recordChecksumFailure(void) { ++_checksumFailureCount; }
+    inline void recordWrongMacAddress(void) { ++_wrongMacAddressCount; }
+    inline void recordWrongLength(void) { ++_wrongLengthCount; }
+    inline void setGapThresholdUs(uint32_t gapThresholdUs) { _gapThresholdUs = gapThresholdUs; }
+    inline uint32_t getPacketCount(void) const { return _packetCount; }
+    inline uint32_t getChecksumFailureCount(void) const { return _checksumFailureCount; }
+    inline uint32_t getWrongMacAddressCount(void) const { return _wrongMacAddressCount; }
+    inline uint32_t getWrongLengthCount(void) const { return _wrongLengthCount; }
+    inline uint32_t getGapCount(void) const { return _gapCount; }
+    inline uint32_t getLongestGapUs(void) const { return _longestGapUs; }
+    inline uint32_t getLastIntervalUs(void) const { return _lastIntervalUs; }
+    inline uint32_t getPacketsPerSecond(void) const { return _packetsPerSecond; }
+    inline uint32_t getJitterUs(void) const { return _jitterX16 >> 4U; } //!< smoothed change in the inter-arrival interval
+    /*!
+    Running total, and count, of the changes in the inter-arrival interval. Unlike the smoothed jitter these have no memory,
+    so the mean jitter over a window is the difference of two snapshots. The total wraps, but the difference is still correct.
+    */
+    inline uint32_t getIntervalChangeSumUs(void) const { return _intervalChangeSumUs; }
+    inline uint32_t getIntervalChangeCount(void) const { return _intervalChangeCount; }
+    inline uint32_t getHistogramBucket(int bucket) const { return _histogram[bucket]; }
+    static uint32_t bucketUpperBoundUs(int bucket) { return bucket == 0 ? 0 : (1U << bucket) - 1; }
+    void print(void) const;
+private:
+    uint32_t _histogram[HISTOGRAM_BUCKET_COUNT] {};
+    uint32_t _packetCount {0};
+    uint32_t _previousTimeUs {0};
+    uint32_t _lastIntervalUs {0};
+    uint32_t _jitterX16 {0}; //!< jitter scaled by 16, so it can be smoothed in integer arithmetic
+    uint32_t _intervalChangeSumUs {0};
+    uint32_t _intervalChangeCount {0};
+    uint32_t _gapThresholdUs {DEFAULT_GAP_THRESHOLD_US};
+    uint32_t _gapCount {0};
+    uint32_t _longestGapUs {0};
+    uint32_t _windowStartUs {0};
+    uint32_t _windowPacketCount {0};
+    uint32_t _packetsPerSecond {0};
+    uint32_t _checksumFailureCount {0};
+    uint32_t _wrongMacAddressCount {0};
+    uint32_t _wrongLengthCount {0};
+};
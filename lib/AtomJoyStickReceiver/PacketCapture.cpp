@@ -0,0 +1,118 @@
+#include <ESPNOW_Transceiver.h>
+#include <HardwareSerial.h>
+#include <PacketCapture.h>
+#include <cstddef>
+#include <cstring>
+
+// the fields before the data, which are at the same offsets for every DATA_SIZE
+typedef packet_record_t<1> record_layout_t;
+
+
+/*!
+Append a packet to the capture, overwriting the oldest record if the capture is full.
+Called from the WiFi task.
+*/
+void PacketCapture::append(const uint8_t* macAddress, const uint8_t* data, int len, uint32_t timeUs)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    const uint32_t appendCount = _appendCount.load(std::memory_order_relaxed);
+    uint8_t* record = &_records[(appendCount % _recordCapacity) * _recordSize];
+
+    memcpy(&record[offsetof(record_layout_t, timeUs)], &timeUs, sizeof(timeUs));
+    memcpy(&record[offsetof(record_layout_t, macAddress)], macAddress, MAC_ADDRESS_LEN);
+    record[offsetof(record_layout_t, len)] = static_cast<uint8_t>(len);
+    const int copyLength = len < static_cast<int>(_dataSize) ? len : static_cast<int>(_dataSize);
+    memcpy(&record[offsetof(record_layout_t, data)], data, copyLength);
+    memset(&record[offsetof(record_layout_t, data) + copyLength], 0, _dataSize - copyLength);
+
+    _appendCount.store(appendCount + 1, std::memory_order_release);
+}
+
+uint32_t PacketCapture::getRecordCount() const
+{
+    const uint32_t appendCount = _appendCount.load(std::memory_order_acquire);
+    return appendCount < _recordCapacity ? appendCount : _recordCapacity;
+}
+
+/*!
+Return the position in the ring of the record at `index`, where index 0 is the oldest record in the capture.
+*/
+uint32_t PacketCapture::getRingIndex(uint32_t index) const
+{
+    const uint32_t appendCount = _appendCount.load(std::memory_order_acquire);
+    const uint32_t oldest = appendCount < _recordCapacity ? 0 : appendCount - _recordCapacity;
+    return (oldest + index) % _recordCapacity;
+}
+
+/*!
+Write the capture to the serial port in binary. The capture is disabled while it is being written.
+*/
+void PacketCapture::dump()
+{
+    const bool enabled = isEnabled();
+    setEnabled(false);
+
+    const dump_header_t header { .magic = DUMP_MAGIC, .version = DUMP_VERSION, .recordSize = _recordSize, .recordCount = getRecordCount(), .dataSize = _dataSize, .reserved = 0 };
+    Serial.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    for (uint32_t ii = 0; ii < header.recordCount; ++ii) {
+        Serial.write(&_records[getRingIndex(ii) * _recordSize], _recordSize);
+    }
+
+    setEnabled(enabled);
+}
+
+PacketReplay::PacketReplay(ESPNOW_Transceiver& transceiver, const uint8_t* records, uint32_t recordCount, uint16_t recordSize, uint16_t dataSize) :
+    _transceiver(transceiver),
+    _records(records),
+    _recordCount(recordCount),
+    _recordSize(recordSize),
+    _dataSize(dataSize)
+    {}
+
+uint32_t PacketReplay::getRecordTimeUs(uint32_t index) const
+{
+    uint32_t timeUs = 0;
+    memcpy(&timeUs, &getRecord(index)[offsetof(record_layout_t, timeUs)], sizeof(timeUs));
+    return timeUs;
+}
+
+/*!
+Start the replay at `timeUs`. A `speedFactor` of 2.0 replays at twice the original speed.
+*/
+void PacketReplay::begin(uint32_t timeUs, float speedFactor)
+{
+    _nextRecord = 0;
+    _startTimeUs = timeUs;
+    _speedFactor = speedFactor;
+}
+
+uint32_t PacketReplay::getNextDueTimeUs() const
+{
+    if (isFinished()) {
+        return _startTimeUs;
+    }
+    const uint32_t offsetUs = getRecordTimeUs(_nextRecord) - getRecordTimeUs(0);
+    return _startTimeUs + static_cast<uint32_t>(static_cast<float>(offsetUs) / _speedFactor);
+}
+
+/*!
+Feed all the packets that are due by `timeUs` into the transceiver's receive path.
+
+Returns the number of packets fed.
+*/
+uint32_t PacketReplay::update(uint32_t timeUs)
+{
+    uint32_t count = 0;
+    // signed comparison, so correct when the time wraps around
+    while (!isFinished() && static_cast<int32_t>(timeUs - getNextDueTimeUs()) >= 0) {
+        const uint8_t* record = getRecord(_nextRecord);
+        const int recordLen = record[offsetof(record_layout_t, len)];
+        const int len = recordLen < static_cast<int>(_dataSize) ? recordLen : static_cast<int>(_dataSize);
+        _transceiver.handleReceivedData(&record[offsetof(record_layout_t, macAddress)], &record[offsetof(record_layout_t, data)], len);
+        ++_nextRecord;
+        ++count;
+    }
+    return count;
+}
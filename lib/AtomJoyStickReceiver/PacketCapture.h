@@ -0,0 +1,118 @@
+# pragma once
+
+#include <PacketCodec.h>
+
+#include <atomic>
+#include <cstdint>
+
+class ESPNOW_Transceiver;
+
+
+/*!
+A captured packet: the receive time, the sender's MAC address and the first DATA_SIZE bytes of the packet.
+The fields before the data are laid out the same for every DATA_SIZE.
+*/
+template <int DATA_SIZE>
+struct packet_record_t {
+    enum { MAC_ADDRESS_LEN = 6 };
+    uint32_t timeUs;
+    uint8_t macAddress[MAC_ADDRESS_LEN];
+    uint8_t len; //!< length of the packet as received, may be larger than DATA_SIZE
+    uint8_t data[DATA_SIZE];
+};
+
+/*!
+Binary capture of received packets, for later replay.
+
+Each record holds as much of a packet as the largest packet of the codec in use, so that a capture of AtomJoyStick packets
+stays compact while a capture of fleet frames holds a full frame. The data size is chosen by the `PacketCaptureBuffer` template below,
+which also provides the record storage.
+Records are appended, in the WiFi task, to a ring that overwrites the oldest record when full.
+
+The dump format is a dump_header_t followed by `recordCount` records of `recordSize` bytes, oldest first, all little-endian.
+*/
+class PacketCapture {
+public:
+    enum { MAC_ADDRESS_LEN = packet_record_t<1>::MAC_ADDRESS_LEN };
+    enum : uint32_t { DUMP_MAGIC = 0x50414352 }; // "RCAP"
+    enum : uint16_t { DUMP_VERSION = 3 }; // version 1 records held 25 bytes of data, version 2 records 128 bytes
+    struct dump_header_t {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t recordCount;
+        uint16_t dataSize; //!< the DATA_SIZE of the records
+        uint16_t reserved;
+    };
+    static_assert(sizeof(dump_header_t) == 16);
+protected:
+    PacketCapture(uint8_t* records, uint32_t recordCapacity, uint16_t recordSize, uint16_t dataSize) :
+        _records(records), _recordCapacity(recordCapacity), _recordSize(recordSize), _dataSize(dataSize) {}
+public:
+    void append(const uint8_t* macAddress, const uint8_t* data, int len, uint32_t timeUs);
+    inline void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_release); }
+    inline bool isEnabled(void) const { return _enabled.load(std::memory_order_acquire); }
+    inline void clear(void) { _appendCount.store(0, std::memory_order_release); }
+    uint32_t getRecordCount(void) const;
+    inline uint16_t getRecordSize(void) const { return _recordSize; }
+    inline uint16_t getDataSize(void) const { return _dataSize; }
+    void dump(void);
+protected:
+    // the capture should be disabled while records are being read
+    uint32_t getRingIndex(uint32_t index) const;
+private:
+    uint8_t* _records;
+    const uint32_t _recordCapacity;
+    const uint16_t _recordSize;
+    const uint16_t _dataSize;
+    std::atomic<uint32_t> _appendCount {0};
+    std::atomic<bool> _enabled {true};
+};
+
+template <int RECORD_COUNT, int DATA_SIZE=AtomJoyStickCodec::MAX_PACKET_SIZE>
+class PacketCaptureBuffer : public PacketCapture {
+public:
+    typedef packet_record_t<DATA_SIZE> record_t;
+    static_assert(DATA_SIZE <= UINT8_MAX, "the record's length field is 8 bits");
+public:
+    PacketCaptureBuffer() : PacketCapture(reinterpret_cast<uint8_t*>(&_recordBuffer[0]), RECORD_COUNT, sizeof(record_t), DATA_SIZE) {} // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    PacketCaptureBuffer(const PacketCaptureBuffer&) = delete;
+    PacketCaptureBuffer& operator=(const PacketCaptureBuffer&) = delete;
+public:
+    //! Return the record at `index`, where index 0 is the oldest record in the capture.
+    inline const record_t& getRecord(uint32_t index) const { return _recordBuffer[getRingIndex(index)]; }
+private:
+    record_t _recordBuffer[RECORD_COUNT] {};
+};
+
+/*!
+Replay of captured packets through the transceiver's receive path, at the original speed or accelerated.
+
+`update()` is called repeatedly with the current time, and feeds in all packets that are due by that time.
+*/
+class PacketReplay {
+public:
+    template <int DATA_SIZE>
+    PacketReplay(ESPNOW_Transceiver& transceiver, const packet_record_t<DATA_SIZE>* records, uint32_t recordCount) :
+        PacketReplay(transceiver, reinterpret_cast<const uint8_t*>(records), recordCount, sizeof(packet_record_t<DATA_SIZE>), DATA_SIZE) {} // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+private:
+    PacketReplay(ESPNOW_Transceiver& transceiver, const uint8_t* records, uint32_t recordCount, uint16_t recordSize, uint16_t dataSize);
+    inline const uint8_t* getRecord(uint32_t index) const { return &_records[index * _recordSize]; }
+    uint32_t getRecordTimeUs(uint32_t index) const;
+public:
+    void begin(uint32_t timeUs, float speedFactor=1.0F);
+    uint32_t update(uint32_t timeUs);
+    inline bool isFinished(void) const { return _nextRecord >= _recordCount; }
+    inline uint32_t getReplayedCount(void) const { return _nextRecord; }
+    //! the time at which the next packet is due, so the caller can sleep until then
+    uint32_t getNextDueTimeUs(void) const;
+private:
+    ESPNOW_Transceiver& _transceiver;
+    const uint8_t* _records;
+    const uint32_t _recordCount;
+    const uint16_t _recordSize;
+    const uint16_t _dataSize;
+    uint32_t _nextRecord {0};
+    uint32_t _startTimeUs {0};
+    float _speedFactor {1.0F};
+};
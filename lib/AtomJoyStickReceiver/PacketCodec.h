@@ -0,0 +1,124 @@
+# pragma once
+
+#include <cstdint>
+#include <cstring>
+
+
+/*!
+Field of a packet, described at compile time by its type and byte offset.
+
+Fields are loaded with memcpy, so unaligned fields are safe, and the compiler reduces the memcpy to plain loads.
+*/
+template <typename T, int OFFSET>
+struct PacketField {
+    typedef T type;
+    enum { offset = OFFSET, size = sizeof(T) };
+    static inline T load(const uint8_t* packet) {
+        T value;
+        memcpy(&value, packet + OFFSET, sizeof(T));
+        return value;
+    }
+};
+
+/*!
+View of a packet laid out according to CODEC. Nothing is copied, each field is loaded from the packet when it is read.
+*/
+template <typename CODEC>
+class PacketView {
+public:
+    explicit PacketView(const uint8_t* packet) : _packet(packet) {}
+    template <typename FIELD>
+    inline typename FIELD::type get(void) const { return FIELD::load(_packet); }
+    inline const uint8_t* data(void) const { return _packet; }
+private:
+    const uint8_t* _packet;
+};
+
+/*!
+Joystick values, in the common form that all codecs decode to.
+*/
+struct joystick_frame_t {
+    enum : uint8_t { ALT_MODE_AUTO = 4, ALT_MODE_MANUAL = 5 }; //!< the AtomJoyStick's altitude modes
+    float yaw;
+    float throttle;
+    float roll;
+    float pitch;
+    uint8_t armButton;
+    uint8_t flipButton;
+    uint8_t mode;
+    uint8_t altMode; //!< ALT_MODE_AUTO or ALT_MODE_MANUAL
+    uint8_t proactiveFlag;
+};
+
+/*!
+Runtime handle to a codec, so that the receiver can be given a codec without being a template.
+Use `makePacketCodec<CODEC>()` to create one.
+*/
+struct packet_codec_t {
+    int packetSize;
+    bool (*isChecksumValid)(const uint8_t* packet, int len);
+    bool (*isAddressedTo)(const uint8_t* packet, int len, const uint8_t* myMacAddress);
+    bool (*decode)(const uint8_t* packet, int len, const uint8_t* myMacAddress, joystick_frame_t& frame);
+};
+
+template <typename CODEC>
+constexpr packet_codec_t makePacketCodec(void)
+{
+    return packet_codec_t { CODEC::PACKET_SIZE, &CODEC::isChecksumValid, &CODEC::isAddressedTo, &CODEC::decode };
+}
+
+/*!
+Codec for the frame sent by the M5Stack Atom JoyStick, running the StampFly controller firmware.
+See https://github.com/M5Fly-kanazawa/AtomJoy2024June/blob/main/src/main.cpp#L560 for packet format.
+*/
+struct AtomJoyStickCodec {
+    enum { PACKET_SIZE = 25 };
+    enum { MAX_PACKET_SIZE = PACKET_SIZE }; //!< the largest packet, so the most that need be captured
+    // the last three bytes of the MAC address of the receiver the packet is addressed to
+    typedef PacketField<uint8_t, 0> MacAddress3;
+    typedef PacketField<uint8_t, 1> MacAddress4;
+    typedef PacketField<uint8_t, 2> MacAddress5;
+    typedef PacketField<float, 3> Yaw;
+    typedef PacketField<float, 7> Throttle;
+    typedef PacketField<float, 11> Roll;
+    typedef PacketField<float, 15> Pitch;
+    typedef PacketField<uint8_t, 19> ArmButton;
+    typedef PacketField<uint8_t, 20> FlipButton;
+    typedef PacketField<uint8_t, 21> Mode; // stable or sport
+    typedef PacketField<uint8_t, 22> AltMode;
+    typedef PacketField<uint8_t, 23> ProactiveFlag;
+    typedef PacketField<uint8_t, 24> Checksum;
+    typedef PacketView<AtomJoyStickCodec> View;
+
+    static bool isChecksumValid(const uint8_t* packet, int len) {
+        if (len < PACKET_SIZE) {
+            return false;
+        }
+        uint8_t checksum = 0;
+        for (int ii = 0; ii < Checksum::offset; ++ii) {
+            checksum += packet[ii];
+        }
+        return checksum == Checksum::load(packet);
+    }
+    static bool isAddressedTo(const uint8_t* packet, int len, const uint8_t* myMacAddress) {
+        const View view(packet);
+        return len >= PACKET_SIZE
+            && view.get<MacAddress3>() == myMacAddress[3] && view.get<MacAddress4>() == myMacAddress[4] && view.get<MacAddress5>() == myMacAddress[5];
+    }
+    static bool decode(const uint8_t* packet, int len, [[maybe_unused]] const uint8_t* myMacAddress, joystick_frame_t& frame) {
+        if (len < PACKET_SIZE) {
+            return false;
+        }
+        const View view(packet);
+        frame.yaw = view.get<Yaw>();
+        frame.throttle = view.get<Throttle>();
+        frame.roll = view.get<Roll>();
+        frame.pitch = -view.get<Pitch>();
+        frame.armButton = view.get<ArmButton>();
+        frame.flipButton = view.get<FlipButton>();
+        frame.mode = view.get<Mode>();
+        frame.altMode = view.get<AltMode>();
+        frame.proactiveFlag = view.get<ProactiveFlag>();
+        return true;
+    }
+};
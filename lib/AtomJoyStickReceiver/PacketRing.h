@@ -0,0 +1,137 @@
+# pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+
+/*!
+Lock-free single producer, single consumer ring of timestamped packets.
+
+The producer (the ESP-NOW receive callback, running in the WiFi task) never blocks: when the ring is full the oldest packet is overwritten.
+Each slot is guarded by a sequence lock, so if the producer overwrites a slot while the consumer is copying it,
+the consumer detects this and retries, rather than returning a torn packet.
+
+The slot storage is provided by the `PacketRing` template below, so that the transceiver can handle rings of any size.
+*/
+class PacketRingBase {
+public:
+    enum read_mode_t { LATEST_WINS, DRAIN_ALL };
+    struct slot_header_t {
+        std::atomic<uint32_t> sequence {0}; //!< 2*n+1 while packet n is being written, 2*n+2 once it is complete
+        uint32_t timeUs {0};
+        int len {0};
+    };
+protected:
+    PacketRingBase(slot_header_t* headers, uint8_t* data, int slotCount, int slotSize)
+        : _headers(headers), _data(data), _slotCount(slotCount), _slotSize(slotSize) {}
+public:
+    // producer side, called from the WiFi task
+    inline void push(const uint8_t* data, int len, uint32_t timeUs);
+    // consumer side, called from the main loop
+    inline int pop(uint8_t* data, int bufferSize, uint32_t& timeUs, read_mode_t readMode);
+    inline bool isEmpty(void) const { return _writeCount.load(std::memory_order_acquire) == _readCount; }
+    inline void clear(void) { _readCount = _writeCount.load(std::memory_order_acquire); }
+    inline int getSlotSize(void) const { return _slotSize; }
+    inline uint32_t getPushCount(void) const { return _writeCount.load(std::memory_order_relaxed); }
+    inline uint32_t getOverwriteCount(void) const { return _overwriteCount; } //!< packets overwritten before they could be read
+    inline uint32_t getSkipCount(void) const { return _skipCount; } //!< packets deliberately discarded in LATEST_WINS mode
+    inline uint32_t getTearCount(void) const { return _tearCount; } //!< reads that collided with a write and were retried
+private:
+    inline static uint32_t completeSequence(uint32_t packetNumber) { return 2*packetNumber + 2; }
+private:
+    slot_header_t* _headers;
+    uint8_t* _data;
+    const int _slotCount;
+    const int _slotSize;
+    std::atomic<uint32_t> _writeCount {0};
+    // the following are only accessed by the consumer
+    uint32_t _readCount {0};
+    uint32_t _overwriteCount {0};
+    uint32_t _skipCount {0};
+    uint32_t _tearCount {0};
+};
+
+/*!
+Copy the packet into the next slot, overwriting the oldest packet if the ring is full.
+*/
+inline void PacketRingBase::push(const uint8_t* data, int len, uint32_t timeUs)
+{
+    const uint32_t packetNumber = _writeCount.load(std::memory_order_relaxed);
+    const int slot = static_cast<int>(packetNumber % static_cast<uint32_t>(_slotCount));
+    slot_header_t& header = _headers[slot];
+
+    header.sequence.store(completeSequence(packetNumber) - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const int copyLength = len < _slotSize ? len : _slotSize; // so don't overwrite slot
+    memcpy(&_data[slot * _slotSize], data, copyLength);
+    header.len = copyLength;
+    header.timeUs = timeUs;
+
+    header.sequence.store(completeSequence(packetNumber), std::memory_order_release);
+    _writeCount.store(packetNumber + 1, std::memory_order_release);
+}
+
+/*!
+Copy a packet out of the ring: either the oldest unread packet (DRAIN_ALL) or the most recent packet (LATEST_WINS).
+
+Returns the length of the packet copied, or 0 if the ring is empty.
+*/
+inline int PacketRingBase::pop(uint8_t* data, int bufferSize, uint32_t& timeUs, read_mode_t readMode)
+{
+    while (true) {
+        const uint32_t writeCount = _writeCount.load(std::memory_order_acquire);
+        const uint32_t unreadCount = writeCount - _readCount;
+        if (unreadCount == 0) {
+            return 0;
+        }
+        if (readMode == LATEST_WINS) {
+            _skipCount += unreadCount - 1;
+            _readCount = writeCount - 1;
+        } else if (unreadCount > static_cast<uint32_t>(_slotCount)) {
+            _overwriteCount += unreadCount - _slotCount;
+            _readCount = writeCount - _slotCount;
+        }
+
+        const uint32_t packetNumber = _readCount;
+        const int slot = static_cast<int>(packetNumber % static_cast<uint32_t>(_slotCount));
+        const slot_header_t& header = _headers[slot];
+
+        const uint32_t sequence = header.sequence.load(std::memory_order_acquire);
+        if (sequence != completeSequence(packetNumber)) {
+            // the producer has already started writing a newer packet into this slot
+            ++_overwriteCount;
+            ++_readCount;
+            continue;
+        }
+        const int len = header.len;
+        const int copyLength = len < bufferSize ? (len < _slotSize ? len : _slotSize) : bufferSize;
+        memcpy(data, &_data[slot * _slotSize], copyLength);
+        const uint32_t packetTimeUs = header.timeUs;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) != sequence) {
+            // the slot was overwritten while we were copying it, so discard what we read and try again
+            ++_tearCount;
+            continue;
+        }
+        ++_readCount;
+        timeUs = packetTimeUs;
+        return copyLength;
+    }
+}
+
+/*!
+Ring of SLOT_COUNT packets each of up to SLOT_SIZE bytes.
+*/
+template <int SLOT_COUNT, int SLOT_SIZE>
+class PacketRing : public PacketRingBase {
+public:
+    PacketRing() : PacketRingBase(&_slotHeaders[0], &_slotData[0], SLOT_COUNT, SLOT_SIZE) {}
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+private:
+    slot_header_t _slotHeaders[SLOT_COUNT];
+    uint8_t _slotData[SLOT_COUNT * SLOT_SIZE] {};
+};
@@ -0,0 +1,53 @@
+#include <PacketSignal.h>
+
+#if !defined(ESP_PLATFORM)
+#include <chrono>
+#endif
+
+
+#if defined(ESP_PLATFORM)
+
+PacketSignal::PacketSignal() :
+    _semaphore(xSemaphoreCreateBinaryStatic(&_semaphoreBuffer))
+    {}
+
+/*!
+Wake the waiting task. Called from the WiFi task, so does not block.
+*/
+void PacketSignal::signal()
+{
+    xSemaphoreGive(_semaphore);
+}
+
+/*!
+Block until signalled or until `timeoutMs` has elapsed.
+
+Returns true if signalled, false on timeout.
+*/
+bool PacketSignal::wait(uint32_t timeoutMs)
+{
+    return xSemaphoreTake(_semaphore, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+#else
+
+PacketSignal::PacketSignal() = default;
+
+void PacketSignal::signal()
+{
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        _signalled = true;
+    }
+    _conditionVariable.notify_one();
+}
+
+bool PacketSignal::wait(uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    const bool signalled = _conditionVariable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return _signalled; });
+    _signalled = false;
+    return signalled;
+}
+
+#endif
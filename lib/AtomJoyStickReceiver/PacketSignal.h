@@ -0,0 +1,36 @@
+# pragma once
+
+#include <cstdint>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+
+/*!
+Signal used by the receive callback to wake the task that is waiting for a packet.
+
+On the ESP32 this is a FreeRTOS binary semaphore, on host builds it is a std::condition_variable.
+*/
+class PacketSignal {
+public:
+    PacketSignal();
+    PacketSignal(const PacketSignal&) = delete;
+    PacketSignal& operator=(const PacketSignal&) = delete;
+public:
+    void signal(void);
+    bool wait(uint32_t timeoutMs);
+private:
+#if defined(ESP_PLATFORM)
+    StaticSemaphore_t _semaphoreBuffer {};
+    SemaphoreHandle_t _semaphore;
+#else
+    std::mutex _mutex;
+    std::condition_variable _conditionVariable;
+    bool _signalled {false};
+#endif
+};
@@ -0,0 +1,99 @@
+#include <PeerRegistry.h>
+
+
+#if defined(ESP_PLATFORM)
+void PeerRegistry::lock() { portENTER_CRITICAL(&_lock); }
+void PeerRegistry::unlock() { portEXIT_CRITICAL(&_lock); }
+#else
+void PeerRegistry::lock() { _mutex.lock(); }
+void PeerRegistry::unlock() { _mutex.unlock(); }
+#endif
+
+/*!
+Add a peer. Returns false if the MAC address is already registered, or the table is full.
+*/
+bool PeerRegistry::add(const uint8_t* macAddress, int peerIndex)
+{
+    lock();
+    const bool added = insert(macAddress, peerIndex);
+    unlock();
+    return added;
+}
+
+/*!
+Remove a peer. Returns false if the MAC address is not registered.
+*/
+bool PeerRegistry::remove(const uint8_t* macAddress)
+{
+    lock();
+    const bool removed = erase(macAddress);
+    unlock();
+    return removed;
+}
+
+bool PeerRegistry::insert(const uint8_t* macAddress, int peerIndex)
+{
+    if (find(macAddress) != NOT_FOUND) {
+        return false;
+    }
+    const uint32_t low = keyLow(macAddress);
+    const uint16_t high = keyHigh(macAddress);
+    const uint32_t start = hash(low, high);
+    for (uint32_t probe = 0; probe < TABLE_SIZE; ++probe) {
+        slot_t& slot = _slots[(start + probe) & TABLE_MASK];
+        const int8_t index = slot.peerIndex.load(std::memory_order_relaxed);
+        if (index == EMPTY || index == TOMBSTONE) {
+            slot.keyLow = low;
+            slot.keyHigh = high;
+            // publish the peer index only once the key has been written
+            slot.peerIndex.store(static_cast<int8_t>(peerIndex), std::memory_order_release);
+            ++_count;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+Remove a peer, leaving a tombstone so that the probe sequences of other peers are not broken.
+*/
+bool PeerRegistry::erase(const uint8_t* macAddress)
+{
+    const uint32_t low = keyLow(macAddress);
+    const uint16_t high = keyHigh(macAddress);
+    const uint32_t start = hash(low, high);
+    for (uint32_t probe = 0; probe < TABLE_SIZE; ++probe) {
+        slot_t& slot = _slots[(start + probe) & TABLE_MASK];
+        const int8_t index = slot.peerIndex.load(std::memory_order_relaxed);
+        if (index == EMPTY) {
+            return false;
+        }
+        if (index != TOMBSTONE && slot.keyLow == low && slot.keyHigh == high) {
+            slot.peerIndex.store(TOMBSTONE, std::memory_order_release);
+            --_count;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+Returns the peer index of the MAC address, or NOT_FOUND.
+*/
+int PeerRegistry::find(const uint8_t* macAddress) const
+{
+    const uint32_t low = keyLow(macAddress);
+    const uint16_t high = keyHigh(macAddress);
+    const uint32_t start = hash(low, high);
+    for (uint32_t probe = 0; probe < TABLE_SIZE; ++probe) {
+        const slot_t& slot = _slots[(start + probe) & TABLE_MASK];
+        const int8_t index = slot.peerIndex.load(std::memory_order_acquire);
+        if (index == EMPTY) {
+            return NOT_FOUND;
+        }
+        if (index != TOMBSTONE && slot.keyLow == low && slot.keyHigh == high) {
+            return index;
+        }
+    }
+    return NOT_FOUND;
+}
@@ -0,0 +1,58 @@
+# pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif
+
+
+/*!
+Hash table mapping a peer's 48-bit MAC address to its index in the transceiver's peer data.
+
+Open addressing with linear probing, in a table of more than three times the ESP-NOW peer limit, so probe sequences are short and lookups are O(1).
+Lookups are made in the WiFi task, and are lock-free: a slot's key is written before its peer index is published.
+Peers are added from the main task, and the primary peer is set from the WiFi task when binding,
+so adding and removing peers is serialized by a lock.
+*/
+class PeerRegistry {
+public:
+    enum { NOT_FOUND = -1 };
+    enum { TABLE_BITS = 6, TABLE_SIZE = 1 << TABLE_BITS, TABLE_MASK = TABLE_SIZE - 1 };
+public:
+    bool add(const uint8_t* macAddress, int peerIndex);
+    bool remove(const uint8_t* macAddress);
+    int find(const uint8_t* macAddress) const;
+    inline int getCount(void) const { return _count; }
+private:
+    void lock(void);
+    void unlock(void);
+    bool insert(const uint8_t* macAddress, int peerIndex);
+    bool erase(const uint8_t* macAddress);
+    enum : int8_t { EMPTY = -1, TOMBSTONE = -2 };
+    struct slot_t {
+        uint32_t keyLow {0};
+        uint16_t keyHigh {0};
+        std::atomic<int8_t> peerIndex {EMPTY};
+    };
+    static inline uint32_t keyLow(const uint8_t* macAddress) {
+        return (static_cast<uint32_t>(macAddress[2]) << 24U) | (static_cast<uint32_t>(macAddress[3]) << 16U) | (static_cast<uint32_t>(macAddress[4]) << 8U) | macAddress[5];
+    }
+    static inline uint16_t keyHigh(const uint8_t* macAddress) {
+        return static_cast<uint16_t>((macAddress[0] << 8U) | macAddress[1]);
+    }
+    // multiplicative hash, using 32-bit arithmetic since that is native on the ESP32
+    static inline uint32_t hash(uint32_t low, uint16_t high) { return ((low ^ (static_cast<uint32_t>(high) * 0x9E37U)) * 0x9E3779B1U) >> (32 - TABLE_BITS); }
+private:
+#if defined(ESP_PLATFORM)
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+#else
+    std::mutex _mutex;
+#endif
+    // written under the lock
+    slot_t _slots[TABLE_SIZE];
+    int _count {0};
+};
@@ -0,0 +1,23 @@
+# pragma once
+
+#include <LinkStatistics.h>
+#include <cstdint>
+
+
+/*!
+Interface to the radio, as used for channel management.
+
+The ChannelManager accesses the radio only through this interface, so that on a host build the radio can be replaced
+by a simulation of lossy channels, and the channel selection stepped with a simulated clock.
+*/
+class Radio_Interface {
+public:
+    virtual ~Radio_Interface() = default;
+    virtual uint8_t getChannel(void) const = 0;
+    //! Retune the radio, and the peers, to `channel`. Returns false if the channel could not be set.
+    virtual bool setChannel(uint8_t channel) = 0;
+    //! Send `len` bytes to the primary peer. Returns false if the data could not be queued for sending.
+    virtual bool sendToPrimaryPeer(const uint8_t* data, int len) = 0;
+    //! Statistics for the packets received from the primary peer.
+    virtual const LinkStatistics& getLinkStatistics(void) const = 0;
+};
@@ -0,0 +1,42 @@
+#include <HardwareSerial.h>
+#include <ReceiveFilter.h>
+
+
+/*!
+Add a stage to the end of the chain.
+
+Returns false if the chain is full.
+*/
+bool ReceiveFilter::addStage(stage_t stage, const void* context)
+{
+    if (_stageCount >= MAX_STAGE_COUNT) {
+        return false;
+    }
+    _stages[_stageCount] = { stage, context };
+    ++_stageCount;
+    return true;
+}
+
+/*!
+Run the packet through each stage in turn, stopping at the first stage that rejects it.
+Called from the WiFi task.
+*/
+ReceiveFilter::reason_t ReceiveFilter::check(const uint8_t* macAddress, const uint8_t* data, int len)
+{
+    for (int ii = 0; ii < _stageCount; ++ii) {
+        const reason_t reason = _stages[ii].stage(_stages[ii].context, macAddress, data, len);
+        if (reason != ACCEPTED) {
+            ++_counts[reason];
+            ++_rejectedCount;
+            return reason;
+        }
+    }
+    ++_counts[ACCEPTED];
+    return ACCEPTED;
+}
+
+void ReceiveFilter::print() const
+{
+    Serial.printf("FILTER accepted:%u rejected length:%u checksum:%u address:%u other:%u\r\n",
+        _counts[ACCEPTED], _counts[REJECTED_LENGTH], _counts[REJECTED_CHECKSUM], _counts[REJECTED_ADDRESS], _counts[REJECTED_OTHER]);
+}
@@ -0,0 +1,34 @@
+# pragma once
+
+#include <cstdint>
+
+
+/*!
+Chain of validation stages run in the ESP-NOW receive callback, before the packet is copied into the packet ring.
+
+Bad or misaddressed packets are dropped at the source, so they cost neither a copy nor a wakeup of the main loop.
+Stages are plain function pointers with a context pointer, held in a fixed size array, so there is no allocation.
+Each stage returns ACCEPTED or the reason for rejecting the packet, rejections are counted per reason.
+*/
+class ReceiveFilter {
+public:
+    enum reason_t { ACCEPTED = 0, REJECTED_LENGTH, REJECTED_CHECKSUM, REJECTED_ADDRESS, REJECTED_OTHER, REASON_COUNT };
+    typedef reason_t (*stage_t)(const void* context, const uint8_t* macAddress, const uint8_t* data, int len);
+    enum { MAX_STAGE_COUNT = 4 };
+public:
+    bool addStage(stage_t stage, const void* context);
+    inline void clearStages(void) { _stageCount = 0; }
+    reason_t check(const uint8_t* macAddress, const uint8_t* data, int len);
+    inline uint32_t getCount(reason_t reason) const { return _counts[reason]; }
+    inline uint32_t getRejectedCount(void) const { return _rejectedCount; }
+    void print(void) const;
+private:
+    struct stage_entry_t {
+        stage_t stage;
+        const void* context;
+    };
+    stage_entry_t _stages[MAX_STAGE_COUNT] {};
+    int _stageCount {0};
+    uint32_t _counts[REASON_COUNT] {};
+    uint32_t _rejectedCount {0};
+};
@@ -0,0 +1,264 @@
+#include <SendQueue.h>
+
+#include <cstring>
+
+
+SendQueue::SendQueue(clock_us_t clock, send_t send, const void* context) :
+    _clock(clock),
+    _send(send),
+    _context(context)
+    {}
+
+#if defined(ESP_PLATFORM)
+void SendQueue::lock() { portENTER_CRITICAL(&_lock); }
+void SendQueue::unlock() { portEXIT_CRITICAL(&_lock); }
+#else
+void SendQueue::lock() { _mutex.lock(); }
+void SendQueue::unlock() { _mutex.unlock(); }
+#endif
+
+int SendQueue::getQueuedCount()
+{
+    lock();
+    int count = 0;
+    for (const auto& slot : _slots) {
+        if (slot.state != FREE) {
+            ++count;
+        }
+    }
+    unlock();
+    return count;
+}
+
+void SendQueue::resetStatistics()
+{
+    lock();
+    for (auto& peerStatistics : _peerStatistics) {
+        peerStatistics = peer_statistics_t {};
+    }
+    _noMemCount = 0;
+    _unmatchedCount = 0;
+    unlock();
+}
+
+/*!
+Queue a frame to be sent to a peer. `retryDeadlineUs` is the time, from now, for which a failed send is retried, zero for no retry.
+
+If the queue is full a control frame evicts the oldest queued telemetry frame, otherwise the frame is dropped.
+
+Returns true if the frame was queued.
+*/
+bool SendQueue::enqueue(int peerIndex, const uint8_t* data, int len, priority_t priority, uint32_t retryDeadlineUs)
+{
+    if (peerIndex < 0 || peerIndex >= MAX_PEER_COUNT || data == nullptr || len <= 0 || len > MAX_FRAME_SIZE) {
+        return false;
+    }
+    const uint32_t timeUs = _clock();
+
+    lock();
+    int index = 0;
+    while (index < SLOT_COUNT && _slots[index].state != FREE) {
+        ++index;
+    }
+    if (index == SLOT_COUNT && priority == PRIORITY_CONTROL) {
+        int evict = -1;
+        for (int ii = 0; ii < SLOT_COUNT; ++ii) {
+            if (_slots[ii].state == QUEUED && _slots[ii].priority != PRIORITY_CONTROL
+                && (evict < 0 || _slots[ii].sequence - _slots[evict].sequence > UINT32_MAX / 2)) {
+                evict = ii;
+            }
+        }
+        if (evict >= 0) {
+            ++_peerStatistics[_slots[evict].peerIndex].droppedCount;
+            ++_peerStatistics[_slots[evict].peerIndex].lostCount;
+            _slots[evict].state = FREE;
+            index = evict;
+        }
+    }
+    if (index == SLOT_COUNT) {
+        ++_peerStatistics[peerIndex].droppedCount;
+        ++_peerStatistics[peerIndex].lostCount;
+        unlock();
+        return false;
+    }
+    slot_t& slot = _slots[index];
+    slot.state = QUEUED;
+    slot.priority = static_cast<uint8_t>(priority);
+    slot.peerIndex = static_cast<int8_t>(peerIndex);
+    slot.hasDeadline = retryDeadlineUs > 0;
+    slot.len = static_cast<uint16_t>(len);
+    slot.sequence = _sequence++;
+    slot.queuedUs = timeUs;
+    slot.deadlineUs = timeUs + retryDeadlineUs;
+    memcpy(slot.data, data, static_cast<size_t>(len));
+    ++_peerStatistics[peerIndex].queuedCount;
+    unlock();
+
+    process();
+    return true;
+}
+
+/*!
+The next slot to send: the highest priority, then the oldest, of the queued slots whose peer has room in its window,
+and that are not in the `heldSlots` bitmask.
+
+Returns -1 if there is nothing that can be sent.
+*/
+int SendQueue::nextSlot(uint32_t heldSlots) const
+{
+    int next = -1;
+    for (int ii = 0; ii < SLOT_COUNT; ++ii) {
+        const slot_t& slot = _slots[ii];
+        if (slot.state != QUEUED || _inFlight[slot.peerIndex].count >= _window || (heldSlots & (1U << ii)) != 0) {
+            continue;
+        }
+        if (next < 0 || slot.priority < _slots[next].priority
+            || (slot.priority == _slots[next].priority && slot.sequence - _slots[next].sequence > UINT32_MAX / 2)) {
+            next = ii;
+        }
+    }
+    return next;
+}
+
+/*!
+Drop queued frames whose retry deadline has passed, and fail frames that have been in flight for too long, since a lost completion would otherwise close the peer's window.
+
+A timed out frame keeps its place in the window, marked TIMED_OUT, so that its completion, if it arrives late, is matched to it.
+The place is released once the completion is assumed lost.
+*/
+void SendQueue::expire(uint32_t timeUs)
+{
+    for (auto& slot : _slots) {
+        if (slot.state == QUEUED && slot.hasDeadline && !isBefore(timeUs, slot.deadlineUs)) {
+            ++_peerStatistics[slot.peerIndex].expiredCount;
+            ++_peerStatistics[slot.peerIndex].lostCount;
+            slot.state = FREE;
+        }
+    }
+    for (auto& inFlight : _inFlight) {
+        for (int ii = 0; ii < inFlight.count; ++ii) {
+            const int position = (inFlight.head + ii) % MAX_WINDOW;
+            if (inFlight.slots[position] != TIMED_OUT && timeUs - inFlight.sentUs[position] > IN_FLIGHT_TIMEOUT_US) {
+                fail(_slots[inFlight.slots[position]], timeUs);
+                inFlight.slots[position] = TIMED_OUT;
+            }
+        }
+        while (inFlight.count > 0 && inFlight.slots[inFlight.head] == TIMED_OUT && timeUs - inFlight.sentUs[inFlight.head] > COMPLETION_TIMEOUT_US) {
+            inFlight.head = static_cast<uint8_t>((inFlight.head + 1) % MAX_WINDOW);
+            --inFlight.count;
+        }
+    }
+}
+
+/*!
+Record a failed send of `slot`, and requeue it if its retry deadline has not passed.
+*/
+void SendQueue::fail(slot_t& slot, uint32_t timeUs)
+{
+    peer_statistics_t& peerStatistics = _peerStatistics[slot.peerIndex];
+    ++peerStatistics.failedCount;
+    if (slot.hasDeadline && isBefore(timeUs, slot.deadlineUs)) {
+        // requeued with its original sequence, so it is resent ahead of newer frames of the same priority
+        ++peerStatistics.retryCount;
+        slot.state = QUEUED;
+    } else {
+        ++peerStatistics.lostCount;
+        slot.state = FREE;
+    }
+}
+
+/*!
+Send queued frames until the queue is empty, every peer with a queued frame has a full window, or the radio runs out of buffers.
+
+A frame the radio refuses is retried at the next call, not in this one, so that a persistent error does not hold the caller until the frame's deadline.
+*/
+void SendQueue::process()
+{
+    static_assert(SLOT_COUNT <= 32, "heldSlots is a 32 bit mask");
+    const uint32_t timeUs = _clock();
+    uint32_t heldSlots = 0;
+    lock();
+    expire(timeUs);
+    while (true) {
+        const int index = nextSlot(heldSlots);
+        if (index < 0) {
+            break;
+        }
+        slot_t& slot = _slots[index];
+        const int peerIndex = slot.peerIndex;
+        in_flight_t& inFlight = _inFlight[peerIndex];
+        // the frame is put in flight before it is sent, since its completion may arrive before the send returns
+        slot.state = IN_FLIGHT;
+        const int position = (inFlight.head + inFlight.count) % MAX_WINDOW;
+        inFlight.slots[position] = static_cast<int8_t>(index);
+        inFlight.sentUs[position] = timeUs;
+        ++inFlight.count;
+        unlock();
+
+        const send_result_t result = _send(_context, peerIndex, slot.data, slot.len);
+
+        lock();
+        peer_statistics_t& peerStatistics = _peerStatistics[peerIndex];
+        if (result == SEND_OK) {
+            ++peerStatistics.sentCount;
+            if (inFlight.count > peerStatistics.inFlightMax) {
+                peerStatistics.inFlightMax = inFlight.count;
+            }
+            continue;
+        }
+        // a failed send has no completion, so the frame is still the newest in flight
+        --inFlight.count;
+        if (result == SEND_NO_MEM) {
+            // backpressure: keep the frame, and wait for completions to free the radio's buffers
+            slot.state = QUEUED;
+            ++_noMemCount;
+            break;
+        }
+        heldSlots |= 1U << index;
+        fail(slot, timeUs);
+    }
+    unlock();
+}
+
+/*!
+Called when the radio reports that a send to `peerIndex` has completed. Sends to a peer complete in order, so this is the oldest send in flight.
+*/
+void SendQueue::onSendComplete(int peerIndex, bool success)
+{
+    const uint32_t timeUs = _clock();
+    lock();
+    if (peerIndex < 0 || peerIndex >= MAX_PEER_COUNT || _inFlight[peerIndex].count == 0) {
+        ++_unmatchedCount;
+    } else {
+        completeOldest(peerIndex, success, timeUs);
+    }
+    unlock();
+}
+
+void SendQueue::completeOldest(int peerIndex, bool success, uint32_t timeUs)
+{
+    in_flight_t& inFlight = _inFlight[peerIndex];
+    const int index = inFlight.slots[inFlight.head];
+    inFlight.head = static_cast<uint8_t>((inFlight.head + 1) % MAX_WINDOW);
+    --inFlight.count;
+
+    peer_statistics_t& peerStatistics = _peerStatistics[peerIndex];
+    if (index == TIMED_OUT) {
+        // the frame has already been failed, and may since have been resent or dropped
+        ++peerStatistics.lateCount;
+        return;
+    }
+    slot_t& slot = _slots[index];
+    if (!success) {
+        fail(slot, timeUs);
+        return;
+    }
+    ++peerStatistics.deliveredCount;
+    const uint32_t latencyUs = timeUs - slot.queuedUs;
+    ++peerStatistics.latencyCount;
+    peerStatistics.latencySumUs += latencyUs;
+    if (latencyUs > peerStatistics.latencyMaxUs) {
+        peerStatistics.latencyMaxUs = latencyUs;
+    }
+    slot.state = FREE;
+}
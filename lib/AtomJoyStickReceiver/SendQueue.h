@@ -0,0 +1,114 @@
+# pragma once
+
+#include <cstdint>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif
+
+
+/*!
+Send queue with a bounded in-flight window per peer.
+
+Frames are queued with a priority, and `process()` sends them, highest priority first and oldest first within a priority,
+as long as the peer has fewer than `window` frames in flight. ESP-NOW completes the sends to a peer in order,
+so a completion is matched to the oldest frame in flight to that peer. A frame in flight for longer than IN_FLIGHT_TIMEOUT_US
+is failed, but keeps its place in the peer's window until its completion arrives, so a late completion is not taken
+for the completion of the next frame. If the completion never arrives the place is released after a further timeout.
+
+If the radio has no buffer free (ESP_ERR_ESPNOW_NO_MEM) the frame stays queued and sending stops until `process()` is next called,
+rather than the frame being lost. A frame queued with a retry deadline is resent if its send fails, whether the radio
+refuses it or reports it as failed, until the deadline, after which it is dropped; a frame with no deadline is sent once.
+
+`onSendComplete()` is called from the WiFi task, and the other functions from the main loop, so the queue is guarded by a lock.
+The lock is not held while sending. The send function and the clock are injected, so the queue can be run on a host with a simulated
+send-completion callback.
+*/
+class SendQueue {
+public:
+    typedef uint32_t (*clock_us_t)(void);
+    enum send_result_t { SEND_OK, SEND_NO_MEM, SEND_ERROR };
+    typedef send_result_t (*send_t)(const void* context, int peerIndex, const uint8_t* data, int len);
+    enum priority_t { PRIORITY_CONTROL = 0, PRIORITY_TELEMETRY = 1, PRIORITY_COUNT = 2 };
+    enum { MAX_PEER_COUNT = 20, SLOT_COUNT = 8, MAX_FRAME_SIZE = 250, MAX_WINDOW = 4, DEFAULT_WINDOW = 2 }; // MAX_FRAME_SIZE is ESP_NOW_MAX_DATA_LEN
+    enum { IN_FLIGHT_TIMEOUT_US = 100000 }; //!< a frame in flight for longer than this is assumed to have failed
+    enum { COMPLETION_TIMEOUT_US = 2 * IN_FLIGHT_TIMEOUT_US }; //!< a completion not received by this time is assumed lost
+    struct peer_statistics_t {
+        uint32_t queuedCount;
+        uint32_t sentCount; //!< frames handed to the radio, including retries
+        uint32_t deliveredCount; //!< frames the radio reported as delivered
+        uint32_t failedCount; //!< sends the radio reported as failed, or that were not completed in time
+        uint32_t retryCount;
+        uint32_t expiredCount; //!< frames dropped because their retry deadline passed
+        uint32_t droppedCount; //!< frames dropped because the queue was full, or evicted by a control frame
+        uint32_t lostCount; //!< frames that will not be delivered: failed with no retry left, expired, or dropped
+        uint32_t lateCount; //!< completions that arrived after their frame had timed out
+        uint32_t inFlightMax;
+        uint32_t latencyCount;
+        uint32_t latencyMaxUs; //!< the longest time from a frame being queued to its delivery
+        uint64_t latencySumUs;
+    };
+public:
+    SendQueue(clock_us_t clock, send_t send, const void* context);
+    SendQueue(const SendQueue&) = delete;
+    SendQueue& operator=(const SendQueue&) = delete;
+public:
+    inline void setWindow(int window) { _window = window < 1 ? 1 : window > MAX_WINDOW ? MAX_WINDOW : window; }
+    inline int getWindow(void) const { return _window; }
+    bool enqueue(int peerIndex, const uint8_t* data, int len, priority_t priority, uint32_t retryDeadlineUs);
+    void process(void);
+    // called from the send callback, in the WiFi task
+    void onSendComplete(int peerIndex, bool success);
+    int getQueuedCount(void);
+    inline const peer_statistics_t& getPeerStatistics(int peerIndex) const { return _peerStatistics[peerIndex]; }
+    inline uint32_t getNoMemCount(void) const { return _noMemCount; }
+    inline uint32_t getUnmatchedCount(void) const { return _unmatchedCount; }
+    void resetStatistics(void);
+private:
+    enum slot_state_t : uint8_t { FREE, QUEUED, IN_FLIGHT };
+    struct slot_t {
+        slot_state_t state;
+        uint8_t priority;
+        int8_t peerIndex;
+        bool hasDeadline;
+        uint16_t len;
+        uint32_t sequence;
+        uint32_t queuedUs;
+        uint32_t deadlineUs;
+        uint8_t data[MAX_FRAME_SIZE];
+    };
+    enum { TIMED_OUT = -1 }; //!< in place of the slot index, for a frame that has timed out but whose completion is still due
+    //! Ring of the sends in flight to a peer, oldest first.
+    struct in_flight_t {
+        int8_t slots[MAX_WINDOW];
+        uint32_t sentUs[MAX_WINDOW];
+        uint8_t head;
+        uint8_t count;
+    };
+    void lock(void);
+    void unlock(void);
+    int nextSlot(uint32_t heldSlots) const;
+    void expire(uint32_t timeUs);
+    void fail(slot_t& slot, uint32_t timeUs);
+    void completeOldest(int peerIndex, bool success, uint32_t timeUs);
+    static inline bool isBefore(uint32_t timeUs, uint32_t deadlineUs) { return static_cast<int32_t>(timeUs - deadlineUs) < 0; }
+private:
+    clock_us_t _clock;
+    send_t _send;
+    const void* _context;
+    int _window {DEFAULT_WINDOW};
+#if defined(ESP_PLATFORM)
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+#else
+    std::mutex _mutex;
+#endif
+    // guarded by the lock
+    slot_t _slots[SLOT_COUNT] {};
+    in_flight_t _inFlight[MAX_PEER_COUNT] {};
+    uint32_t _sequence {0};
+    peer_statistics_t _peerStatistics[MAX_PEER_COUNT] {};
+    uint32_t _noMemCount {0}; //!< times sending was held back because the radio had no buffer free
+    uint32_t _unmatchedCount {0}; //!< completions with no frame in flight to the peer, for example of broadcasts sent directly
+};
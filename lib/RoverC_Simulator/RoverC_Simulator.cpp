@@ -0,0 +1,134 @@
+#include <RoverC_Simulator.h>
+
+#include <cmath>
+
+
+RoverC_Simulator::RoverC_Simulator() :
+    RoverC_Simulator(defaultConfig())
+    {}
+
+RoverC_Simulator::RoverC_Simulator(const config_t& config) :
+    _config(config)
+    {}
+
+/*!
+Nominal values for the RoverC: about 0.5m/s flat out, with a wheelbase and track of about 90mm.
+*/
+RoverC_Simulator::config_t RoverC_Simulator::defaultConfig()
+{
+    return config_t {
+        .maxWheelSpeedMPS = 0.5F,
+        .motorTimeConstantS = 0.08F,
+        .motorGain = { 1.0F, 1.0F, 1.0F, 1.0F },
+        .traction = { 1.0F, 1.0F, 1.0F, 1.0F },
+        .halfWheelbaseM = 0.045F,
+        .halfTrackM = 0.045F,
+        .stepUs = 1000,
+        .imuSampleRateHz = 500,
+        .gyroBiasDPS = 0.0F,
+        .gyroNoiseDPS = 0.0F,
+        .transactionTimeUs = 0
+    };
+}
+
+void RoverC_Simulator::reset()
+{
+    const config_t config = _config;
+    *this = RoverC_Simulator(config);
+}
+
+/*!
+Record writes to the motor registers, other registers, such as the servos, are accepted and ignored.
+*/
+uint8_t RoverC_Simulator::writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len)
+{
+    if (address != I2C_ADDRESS) {
+        return 2; // received NACK on transmit of address, as returned by TwoWire::endTransmission()
+    }
+    ++_statistics.transactionCount;
+    _statistics.busTimeUs += _config.transactionTimeUs;
+    for (size_t ii = 0; ii < len; ++ii) {
+        const size_t reg = firstRegister + ii;
+        if (reg >= REGISTER_MOTOR_1 && reg < REGISTER_MOTOR_1 + MOTOR_COUNT) {
+            _motorRegisters[reg - REGISTER_MOTOR_1] = static_cast<int8_t>(data[ii]);
+            ++_statistics.registerWriteCount;
+        }
+    }
+    return 0;
+}
+
+int RoverC_Simulator::readSamples(sample_t* samples, int maxCount)
+{
+    int count = 0;
+    while (count < maxCount && _imuFifoCount > 0) {
+        samples[count] = _imuFifo[(_imuFifoHead + IMU_FIFO_SIZE - _imuFifoCount) % IMU_FIFO_SIZE];
+        --_imuFifoCount;
+        ++count;
+    }
+    return count;
+}
+
+//! Uniform noise in the range [-1, 1], from a linear congruential generator, so runs are repeatable.
+float RoverC_Simulator::noise()
+{
+    _randomState = _randomState * 1664525U + 1013904223U;
+    return static_cast<float>(_randomState >> 8) / static_cast<float>(1U << 23) - 1.0F;
+}
+
+/*!
+Advance simulated time by `durationUs`, in steps of `stepUs`, generating IMU samples at the IMU sample rate.
+*/
+void RoverC_Simulator::advance(uint32_t durationUs)
+{
+    const uint32_t imuPeriodUs = 1000000 / _config.imuSampleRateHz;
+    while (durationUs > 0) {
+        const uint32_t stepUs = durationUs < _config.stepUs ? durationUs : _config.stepUs;
+        step(static_cast<float>(stepUs) * 1.0e-6F);
+        _timeUs += stepUs;
+        durationUs -= stepUs;
+
+        while (_timeUs - _imuTimeUs >= imuPeriodUs) {
+            _imuTimeUs += imuPeriodUs;
+            if (_imuFifoCount == IMU_FIFO_SIZE) {
+                ++_statistics.imuOverflowCount;
+                continue;
+            }
+            // z axis up, so the gyro reads counterclockwise rotation as positive
+            const sample_t sample { 0.0F, 0.0F, 1.0F, 0.0F, 0.0F, _yawRateDPS + _config.gyroBiasDPS + _config.gyroNoiseDPS * noise() };
+            _imuFifo[_imuFifoHead] = sample;
+            _imuFifoHead = (_imuFifoHead + 1) % IMU_FIFO_SIZE;
+            ++_imuFifoCount;
+        }
+    }
+}
+
+void RoverC_Simulator::step(float deltaT)
+{
+    // motor lag, then slip
+    float ground[MOTOR_COUNT];
+    const float alpha = deltaT / (_config.motorTimeConstantS + deltaT);
+    for (int ii = 0; ii < MOTOR_COUNT; ++ii) {
+        const float target = static_cast<float>(_motorRegisters[ii]) * _config.maxWheelSpeedMPS * _config.motorGain[ii] / 100.0F;
+        _wheelSpeedMPS[ii] += (target - _wheelSpeedMPS[ii]) * alpha;
+        ground[ii] = _wheelSpeedMPS[ii] * _config.traction[ii];
+    }
+
+    // mecanum forward kinematics, the inverse of the MecanumGeometry matrix in Mixer.h
+    const float forward = (ground[FRONT_LEFT] + ground[FRONT_RIGHT] + ground[BACK_LEFT] + ground[BACK_RIGHT]) / 4.0F;
+    const float sideways = (ground[FRONT_LEFT] - ground[FRONT_RIGHT] - ground[BACK_LEFT] + ground[BACK_RIGHT]) / 4.0F;
+    const float rotation = (ground[FRONT_LEFT] - ground[FRONT_RIGHT] + ground[BACK_LEFT] - ground[BACK_RIGHT]) / 4.0F;
+    // positive rotation drives the left wheels forwards and the right wheels backwards, which turns the Rover clockwise
+    const float yawRate = -rotation / (_config.halfWheelbaseM + _config.halfTrackM);
+
+    _forwardSpeedMPS = forward;
+    _sidewaysSpeedMPS = sideways;
+    _yawRateDPS = yawRate * 180.0F / static_cast<float>(M_PI);
+
+    // integrate the pose, using the heading at the middle of the step
+    const float heading = _pose.heading + yawRate * deltaT / 2.0F;
+    const float cosHeading = std::cos(heading);
+    const float sinHeading = std::sin(heading);
+    _pose.x += (sideways * cosHeading - forward * sinHeading) * deltaT;
+    _pose.y += (sideways * sinHeading + forward * cosHeading) * deltaT;
+    _pose.heading += yawRate * deltaT;
+}
@@ -0,0 +1,92 @@
+# pragma once
+
+#include <I2C_Interface.h>
+#include <IMU_Interface.h>
+#include <cstdint>
+
+
+/*!
+Physics-lite simulator of the RoverC chassis, for host builds.
+
+The simulator is an I2C bus: the RoverC writes its motor registers to it exactly as it would to the real RoverC.
+The commanded wheel speeds pass through a first order motor lag and a per-wheel gain, which models mismatched motors,
+and then a per-wheel traction factor, which models slip. The resulting wheel surface speeds are converted to a body velocity
+by the mecanum forward kinematics and integrated into a pose.
+
+The simulator is also an IMU, whose gyro reports the simulated yaw rate, with an optional bias and noise,
+so the yaw rate controller can be run closed loop.
+
+Time is simulated: `advance()` steps the physics, so runs are deterministic and much faster than real time.
+*/
+class RoverC_Simulator : public I2C_Interface, public IMU_Interface {
+public:
+    enum { MOTOR_COUNT = 4 };
+    enum { FRONT_LEFT = 0, FRONT_RIGHT = 1, BACK_LEFT = 2, BACK_RIGHT = 3 }; //!< same order as the motor registers
+    struct config_t {
+        float maxWheelSpeedMPS; //!< wheel surface speed at a register value of 100
+        float motorTimeConstantS;
+        float motorGain[MOTOR_COUNT];
+        float traction[MOTOR_COUNT]; //!< fraction of the wheel surface speed transmitted to the ground, 1 for no slip
+        float halfWheelbaseM; //!< distance from the center to the front axle
+        float halfTrackM; //!< distance from the center to the wheels' contact points
+        uint32_t stepUs; //!< physics time step
+        uint32_t imuSampleRateHz;
+        float gyroBiasDPS;
+        float gyroNoiseDPS; //!< peak amplitude of uniform noise
+        uint32_t transactionTimeUs; //!< simulated duration of each I2C transaction, accumulated in the statistics
+    };
+    struct pose_t {
+        float x; //!< meters, to the Rover's right at the start
+        float y; //!< meters, forwards at the start
+        float heading; //!< radians, counterclockwise positive
+    };
+    struct statistics_t {
+        uint32_t transactionCount;
+        uint32_t registerWriteCount;
+        uint64_t busTimeUs;
+        uint32_t imuOverflowCount;
+    };
+    enum : uint8_t { I2C_ADDRESS = 0x38, REGISTER_MOTOR_1 = 0x00 };
+    enum { IMU_FIFO_SIZE = 64 };
+public:
+    RoverC_Simulator(void);
+    explicit RoverC_Simulator(const config_t& config);
+    static config_t defaultConfig(void);
+    void reset(void);
+public:
+    // I2C_Interface
+    uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override;
+    // IMU_Interface
+    int readSamples(sample_t* samples, int maxCount) override;
+    inline uint32_t getSampleRateHz(void) const override { return _config.imuSampleRateHz; }
+public:
+    void advance(uint32_t durationUs);
+    inline uint32_t getTimeUs(void) const { return _timeUs; }
+    inline const pose_t& getPose(void) const { return _pose; }
+    inline float getYawRateDPS(void) const { return _yawRateDPS; }
+    inline float getForwardSpeedMPS(void) const { return _forwardSpeedMPS; }
+    inline float getSidewaysSpeedMPS(void) const { return _sidewaysSpeedMPS; }
+    inline float getWheelSpeedMPS(int wheel) const { return _wheelSpeedMPS[wheel]; }
+    inline int8_t getMotorRegister(int motor) const { return _motorRegisters[motor]; }
+    inline const statistics_t& getStatistics(void) const { return _statistics; }
+    inline const config_t& getConfig(void) const { return _config; }
+    inline void setConfig(const config_t& config) { _config = config; }
+private:
+    void step(float deltaT);
+    float noise(void);
+private:
+    config_t _config;
+    uint32_t _timeUs {0};
+    uint32_t _imuTimeUs {0}; //!< time of the last IMU sample
+    int8_t _motorRegisters[MOTOR_COUNT] {};
+    float _wheelSpeedMPS[MOTOR_COUNT] {};
+    pose_t _pose {0.0F, 0.0F, 0.0F};
+    float _forwardSpeedMPS {0.0F};
+    float _sidewaysSpeedMPS {0.0F};
+    float _yawRateDPS {0.0F};
+    uint32_t _randomState {1};
+    sample_t _imuFifo[IMU_FIFO_SIZE] {};
+    uint32_t _imuFifoHead {0};
+    uint32_t _imuFifoCount {0};
+    statistics_t _statistics {0, 0, 0, 0};
+};
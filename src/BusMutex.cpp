@@ -0,0 +1,34 @@
+#include "BusMutex.h"
+
+
+#if defined(ESP_PLATFORM)
+
+BusMutex::BusMutex() :
+    _mutex(xSemaphoreCreateMutexStatic(&_mutexBuffer))
+    {}
+
+void BusMutex::lock()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+}
+
+void BusMutex::unlock()
+{
+    xSemaphoreGive(_mutex);
+}
+
+#else
+
+BusMutex::BusMutex() = default;
+
+void BusMutex::lock()
+{
+    _mutex.lock();
+}
+
+void BusMutex::unlock()
+{
+    _mutex.unlock();
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "ConfigStore.h"
+
+#include <cstddef>
+#include <cstring>
+#if defined(ESP_PLATFORM)
+#include <Preferences.h>
+static const char* RECORD_KEY = "config";
+#else
+#include <cstdio>
+#endif
+
+
+ConfigStore::ConfigStore(const char* name) :
+    _name(name)
+    {}
+
+ConfigStore::config_t ConfigStore::defaultConfig(uint8_t channel, float deadZone)
+{
+    config_t config {};
+    config.channel = channel;
+    config.deadZone = deadZone;
+    return config;
+}
+
+/*!
+FNV-1a hash of the version, size, and configuration.
+*/
+uint32_t ConfigStore::checksum(const record_t& record)
+{
+    const auto data = reinterpret_cast<const uint8_t*>(&record); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    uint32_t hash = 2166136261U;
+    for (size_t ii = 0; ii < offsetof(record_t, checksum); ++ii) {
+        hash = (hash ^ data[ii]) * 16777619U;
+    }
+    return hash;
+}
+
+/*!
+Load the configuration. If there is no valid record then `config` is left unchanged, so it should be set to the defaults beforehand.
+*/
+ConfigStore::load_result_t ConfigStore::load(config_t& config)
+{
+    record_t record {};
+    if (!readRecord(record)) {
+        return NOT_FOUND;
+    }
+    if (record.version != VERSION || record.size != sizeof(config_t)) {
+        return WRONG_VERSION;
+    }
+    if (record.checksum != checksum(record)) {
+        return BAD_CHECKSUM;
+    }
+    config = record.config;
+    _saved = record;
+    _isSavedValid = true;
+    return LOADED;
+}
+
+/*!
+Save the configuration. Flash has limited write endurance, so if the configuration is unchanged nothing is written.
+
+Returns true if the configuration is stored.
+*/
+bool ConfigStore::save(const config_t& config)
+{
+    record_t record {};
+    record.version = VERSION;
+    record.size = sizeof(config_t);
+    record.config = config;
+    memset(record.config.reserved, 0, sizeof(record.config.reserved));
+    record.checksum = checksum(record);
+    if (_isSavedValid && memcmp(&record, &_saved, sizeof(record)) == 0) {
+        return true;
+    }
+    if (!writeRecord(record)) {
+        return false;
+    }
+    ++_writeCount;
+    _saved = record;
+    _isSavedValid = true;
+    return true;
+}
+
+bool ConfigStore::erase()
+{
+    _isSavedValid = false;
+#if defined(ESP_PLATFORM)
+    Preferences preferences;
+    if (!preferences.begin(_name, false)) {
+        return false;
+    }
+    const bool ret = preferences.remove(RECORD_KEY);
+    preferences.end();
+    return ret;
+#else
+    return std::remove(_name) == 0;
+#endif
+}
+
+bool ConfigStore::readRecord(record_t& record) const
+{
+#if defined(ESP_PLATFORM)
+    Preferences preferences;
+    if (!preferences.begin(_name, true)) {
+        return false;
+    }
+    const bool ret = preferences.getBytesLength(RECORD_KEY) == sizeof(record) && preferences.getBytes(RECORD_KEY, &record, sizeof(record)) == sizeof(record);
+    preferences.end();
+    return ret;
+#else
+    FILE* file = std::fopen(_name, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool ret = std::fread(&record, sizeof(record), 1, file) == 1;
+    std::fclose(file);
+    return ret;
+#endif
+}
+
+bool ConfigStore::writeRecord(const record_t& record) const
+{
+#if defined(ESP_PLATFORM)
+    Preferences preferences;
+    if (!preferences.begin(_name, false)) {
+        return false;
+    }
+    const bool ret = preferences.putBytes(RECORD_KEY, &record, sizeof(record)) == sizeof(record);
+    preferences.end();
+    return ret;
+#else
+    FILE* file = std::fopen(_name, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool ret = std::fwrite(&record, sizeof(record), 1, file) == 1;
+    return std::fclose(file) == 0 && ret;
+#endif
+}
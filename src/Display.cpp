@@ -0,0 +1,212 @@
+#include "Display.h"
+
+#include <cstdio>
+#include <cstring>
+#include <freertos/task.h>
+
+
+/*
+Field positions for the M5StickC, text size 1, and for the M5StickC PLUS, text size 2, with the screen in portrait orientation.
+*/
+const Display::field_position_t Display::fieldPositions80x160[FIELD_COUNT] {
+    { 5,   5, 75 }, // FIELD_MY_MAC_1
+    { 5,  15, 75 }, // FIELD_MY_MAC_2
+    { 5,  25, 75 }, // FIELD_JOYSTICK_MAC_1
+    { 5,  35, 75 }, // FIELD_JOYSTICK_MAC_2
+    { 5,  60, 75 }, // FIELD_THROTTLE
+    { 5,  70, 75 }, // FIELD_ROLL
+    { 5,  80, 75 }, // FIELD_PITCH
+    { 5,  90, 75 }, // FIELD_YAW
+    { 5, 100, 75 }, // FIELD_MODES
+    { 0, 125, 40 }, // FIELD_SPEED
+    { 40, 125, 40 }, // FIELD_ANGLE
+    { 70, 115, 10 }, // FIELD_BUTTON
+};
+
+const Display::field_position_t Display::fieldPositions135x240[FIELD_COUNT] {
+    { 5,   5, 130 }, // FIELD_MY_MAC_1
+    { 5,  25, 130 }, // FIELD_MY_MAC_2
+    { 5,  45, 130 }, // FIELD_JOYSTICK_MAC_1
+    { 5,  65, 130 }, // FIELD_JOYSTICK_MAC_2
+    { 5,  95, 130 }, // FIELD_THROTTLE
+    { 5, 115, 130 }, // FIELD_ROLL
+    { 5, 135, 130 }, // FIELD_PITCH
+    { 5, 155, 130 }, // FIELD_YAW
+    { 5, 175, 130 }, // FIELD_MODES
+    { 0, 220, 68 }, // FIELD_SPEED
+    { 68, 220, 67 }, // FIELD_ANGLE
+    { 120, 200, 15 }, // FIELD_BUTTON
+};
+
+Display::Display(int screenHeight, const uint8_t* myMacAddress) :
+    _screenHeight(screenHeight),
+    _fieldPositions(screenHeight == SCREEN_HEIGHT_M5_STICK_C ? &fieldPositions80x160[0] : &fieldPositions135x240[0]),
+    _lineHeight(screenHeight == SCREEN_HEIGHT_M5_STICK_C ? 8 : 16),
+    _canvas(&M5.Lcd)
+{
+    memcpy(_myMacAddress, myMacAddress, MAC_ADDRESS_LEN);
+    _snapshot.button = ' ';
+}
+
+/*!
+Create the off-screen sprite and start the render task.
+
+If there is not enough memory for the sprite, then fields are drawn directly to the LCD.
+The frame rate is clamped to between 1 and 1000 frames per second, so the frame period is at least 1ms.
+*/
+void Display::begin(uint32_t framesPerSecond, UBaseType_t priority, BaseType_t core)
+{
+    if (framesPerSecond < 1) {
+        framesPerSecond = 1;
+    } else if (framesPerSecond > MAX_FRAMES_PER_SECOND) {
+        framesPerSecond = MAX_FRAMES_PER_SECOND;
+    }
+    _framePeriodMs = 1000 / framesPerSecond;
+
+    // 8-bit color depth halves the size of the sprite, and is sufficient for text
+    _canvas.setColorDepth(8);
+    _canvasCreated = _canvas.createSprite(M5.Lcd.width(), M5.Lcd.height()) != nullptr;
+    if (_canvasCreated) {
+        _canvas.fillScreen(TFT_BLACK);
+        _canvas.setTextSize(_screenHeight == SCREEN_HEIGHT_M5_STICK_C ? 1 : 2);
+        _canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+    }
+
+    xTaskCreatePinnedToCore(renderTask, "Display", TASK_STACK_SIZE, this, priority, nullptr, core);
+}
+
+void Display::renderTask(void* arg)
+{
+    auto display = static_cast<Display*>(arg);
+
+    TickType_t previousWakeTime = xTaskGetTickCount();
+    while (true) {
+        display->renderFrame();
+        vTaskDelayUntil(&previousWakeTime, pdMS_TO_TICKS(display->_framePeriodMs));
+    }
+}
+
+void Display::setControls(const controls_t& controls)
+{
+    portENTER_CRITICAL(&_snapshotLock);
+    _snapshot.controls = controls;
+    portEXIT_CRITICAL(&_snapshotLock);
+}
+
+void Display::setJoyStickMacAddress(const uint8_t* joyStickMacAddress)
+{
+    portENTER_CRITICAL(&_snapshotLock);
+    memcpy(_snapshot.joyStickMacAddress, joyStickMacAddress, MAC_ADDRESS_LEN);
+    _snapshot.joyStickMacAddressSet = true;
+    portEXIT_CRITICAL(&_snapshotLock);
+}
+
+void Display::setButton(char button)
+{
+    portENTER_CRITICAL(&_snapshotLock);
+    _snapshot.button = button;
+    portEXIT_CRITICAL(&_snapshotLock);
+}
+
+void Display::formatField(const snapshot_t& snapshot, field_t field, char* text) const
+{
+    const controls_t& controls = snapshot.controls;
+    const uint8_t* jma = snapshot.joyStickMacAddress;
+
+    switch (field) {
+    case FIELD_MY_MAC_1:
+        snprintf(text, FIELD_TEXT_SIZE, "R:%02X:%02X:%02X", _myMacAddress[0], _myMacAddress[1], _myMacAddress[2]);
+        break;
+    case FIELD_MY_MAC_2:
+        snprintf(text, FIELD_TEXT_SIZE, "  %02X:%02X:%02X", _myMacAddress[3], _myMacAddress[4], _myMacAddress[5]);
+        break;
+    case FIELD_JOYSTICK_MAC_1:
+        if (snapshot.joyStickMacAddressSet) {
+            snprintf(text, FIELD_TEXT_SIZE, "J:%02X:%02X:%02X", jma[0], jma[1], jma[2]);
+        } else {
+            text[0] = 0;
+        }
+        break;
+    case FIELD_JOYSTICK_MAC_2:
+        if (snapshot.joyStickMacAddressSet) {
+            snprintf(text, FIELD_TEXT_SIZE, "  %02X:%02X:%02X", jma[3], jma[4], jma[5]);
+        } else {
+            text[0] = 0;
+        }
+        break;
+    case FIELD_THROTTLE:
+        snprintf(text, FIELD_TEXT_SIZE, "T:%6.3f", controls.throttle);
+        break;
+    case FIELD_ROLL:
+        snprintf(text, FIELD_TEXT_SIZE, "R:%6.3f", controls.roll);
+        break;
+    case FIELD_PITCH:
+        snprintf(text, FIELD_TEXT_SIZE, "P:%6.3f", controls.pitch);
+        break;
+    case FIELD_YAW:
+        snprintf(text, FIELD_TEXT_SIZE, "Y:%6.3f", controls.yaw);
+        break;
+    case FIELD_MODES:
+        snprintf(text, FIELD_TEXT_SIZE, "M%d A%d F%d", controls.mode, controls.altMode, controls.flipButton);
+        break;
+    case FIELD_SPEED:
+        snprintf(text, FIELD_TEXT_SIZE, "S%4.0f", controls.speed);
+        break;
+    case FIELD_ANGLE:
+        snprintf(text, FIELD_TEXT_SIZE, "A%4.0f", controls.angle);
+        break;
+    case FIELD_BUTTON:
+        text[0] = snapshot.button;
+        text[1] = 0;
+        break;
+    default:
+        text[0] = 0;
+        break;
+    }
+}
+
+/*!
+Render the current snapshot, redrawing only those fields whose text has changed since the last frame.
+*/
+void Display::renderFrame()
+{
+    const uint32_t startTimeUs = micros();
+
+    snapshot_t snapshot; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+    portENTER_CRITICAL(&_snapshotLock);
+    snapshot = _snapshot;
+    portEXIT_CRITICAL(&_snapshotLock);
+
+    M5.Lcd.startWrite();
+    for (int ii = 0; ii < FIELD_COUNT; ++ii) {
+        char text[FIELD_TEXT_SIZE];
+        formatField(snapshot, static_cast<field_t>(ii), text);
+        if (strcmp(text, _fieldText[ii]) == 0) {
+            continue;
+        }
+        strcpy(_fieldText[ii], text);
+        ++_statistics.fieldsDrawnCount;
+
+        const field_position_t& position = _fieldPositions[ii];
+        if (_canvasCreated) {
+            _canvas.fillRect(position.x, position.y, position.width, _lineHeight, TFT_BLACK);
+            _canvas.setCursor(position.x, position.y);
+            _canvas.print(text);
+            // push only the area of the field from the sprite to the LCD
+            M5.Lcd.setClipRect(position.x, position.y, position.width, _lineHeight);
+            _canvas.pushSprite(0, 0);
+            M5.Lcd.clearClipRect();
+        } else {
+            M5.Lcd.fillRect(position.x, position.y, position.width, _lineHeight, TFT_BLACK);
+            M5.Lcd.setCursor(position.x, position.y);
+            M5.Lcd.print(text);
+        }
+    }
+    M5.Lcd.endWrite();
+
+    ++_statistics.frameCount;
+    _statistics.renderTimeUs = micros() - startTimeUs;
+    if (_statistics.renderTimeUs > _statistics.renderTimeMaxUs) {
+        _statistics.renderTimeMaxUs = _statistics.renderTimeUs;
+    }
+}
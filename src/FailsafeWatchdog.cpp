@@ -0,0 +1,57 @@
+#include "FailsafeWatchdog.h"
+
+
+FailsafeWatchdog::FailsafeWatchdog(clock_ms_t clock) :
+    FailsafeWatchdog(clock, config_t {DEFAULT_TIMEOUT_MS, DEFAULT_HOLD_MS, DEFAULT_RAMP_DOWN_MS})
+    {}
+
+FailsafeWatchdog::FailsafeWatchdog(clock_ms_t clock, const config_t& config) :
+    _clock(clock),
+    _config(config),
+    _lastFedMs(clock())
+    {}
+
+/*!
+Called whenever a valid packet is received.
+*/
+void FailsafeWatchdog::feed()
+{
+    _lastFedMs = _clock();
+    _stage = ACTIVE;
+    _speedScale = 1.0F;
+}
+
+/*!
+Update the stage and speed scale according to the time since the watchdog was last fed.
+
+Returns the new stage.
+*/
+FailsafeWatchdog::stage_t FailsafeWatchdog::update()
+{
+    // unsigned subtraction, so correct when the clock wraps around
+    const uint32_t elapsedMs = _clock() - _lastFedMs;
+
+    if (elapsedMs <= _config.timeoutMs) {
+        _stage = ACTIVE;
+        _speedScale = 1.0F;
+        return _stage;
+    }
+    const uint32_t overdueMs = elapsedMs - _config.timeoutMs;
+    if (overdueMs <= _config.holdMs) {
+        _stage = HOLD;
+        _speedScale = 1.0F;
+        return _stage;
+    }
+    const uint32_t rampMs = overdueMs - _config.holdMs;
+    if (rampMs < _config.rampDownMs) {
+        _stage = RAMP_DOWN;
+        _speedScale = 1.0F - static_cast<float>(rampMs) / static_cast<float>(_config.rampDownMs);
+        return _stage;
+    }
+    if (_stage != STOPPED) {
+        ++_stopCount;
+    }
+    _stage = STOPPED;
+    _speedScale = 0.0F;
+    return _stage;
+}
@@ -0,0 +1,229 @@
+#include "I2C_AsyncQueue.h"
+
+#include <freertos/task.h>
+
+
+I2C_AsyncQueue::I2C_AsyncQueue(I2C_Interface& bus, clock_us_t clock) :
+    _bus(bus),
+    _clock(clock)
+    {}
+
+/*!
+Start the worker task. Tests may instead call `process()` directly.
+*/
+void I2C_AsyncQueue::begin(uint32_t priority, int core)
+{
+    xTaskCreatePinnedToCore(workerTask, "I2C", TASK_STACK_SIZE, this, priority, &_workerTask, core);
+}
+
+void I2C_AsyncQueue::workerTask(void* arg)
+{
+    auto queue = static_cast<I2C_AsyncQueue*>(arg);
+
+    while (true) {
+        // the timeout means that any registers requeued after a failure are retried, even if nothing new is posted
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_TIMEOUT_MS));
+        queue->process();
+    }
+}
+
+#if defined(ESP_PLATFORM)
+void I2C_AsyncQueue::lock() { portENTER_CRITICAL(&_lock); }
+void I2C_AsyncQueue::unlock() { portEXIT_CRITICAL(&_lock); }
+#else
+void I2C_AsyncQueue::lock() { _mutex.lock(); }
+void I2C_AsyncQueue::unlock() { _mutex.unlock(); }
+#endif
+
+uint32_t I2C_AsyncQueue::getDepth()
+{
+    lock();
+    const uint32_t depth = _pendingCount;
+    unlock();
+    return depth;
+}
+
+void I2C_AsyncQueue::resetStatistics()
+{
+    lock();
+    _statistics = statistics_t {};
+    unlock();
+}
+
+/*!
+Post the register values to the worker, and return without waiting for them to be written.
+
+The values are either all posted or, if the table does not have room for them, all written synchronously, so that
+the registers of one frame are never split between the two.
+*/
+uint8_t I2C_AsyncQueue::writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len)
+{
+    const uint32_t startTimeUs = _clock();
+    int indices[MAX_REGISTER_COUNT];
+    bool overflow = len > MAX_REGISTER_COUNT;
+
+    lock();
+    int entryCount = _entryCount;
+    for (size_t ii = 0; ii < len && !overflow; ++ii) {
+        const auto reg = static_cast<uint8_t>(firstRegister + ii);
+        int index = 0;
+        while (index < entryCount && (_entries[index].address != address || _entries[index].reg != reg)) {
+            ++index;
+        }
+        if (index == entryCount) {
+            if (entryCount == MAX_REGISTER_COUNT) {
+                overflow = true;
+                break;
+            }
+            _entries[index] = entry_t { address, reg, 0, false, 0 };
+            ++entryCount;
+        }
+        indices[ii] = index;
+    }
+    if (!overflow) {
+        _entryCount = entryCount;
+        for (size_t ii = 0; ii < len; ++ii) {
+            entry_t& entry = _entries[indices[ii]];
+            if (entry.pending) {
+                ++_statistics.coalescedCount;
+            } else {
+                entry.pending = true;
+                ++_pendingCount;
+            }
+            entry.value = data[ii];
+            entry.postTimeUs = startTimeUs;
+            ++_statistics.postCount;
+        }
+        if (_pendingCount > _statistics.depthMax) {
+            _statistics.depthMax = _pendingCount;
+        }
+    }
+    unlock();
+
+    if (overflow) {
+        // the table only needs to be as large as the number of registers in use, so this should not happen
+        writeSynchronously(address, firstRegister, data, len);
+    } else if (_workerTask != nullptr) {
+        xTaskNotifyGive(_workerTask);
+    }
+
+    const uint32_t blockedUs = _clock() - startTimeUs;
+    lock();
+    if (blockedUs > _statistics.blockedMaxUs) {
+        _statistics.blockedMaxUs = blockedUs;
+    }
+    unlock();
+    return 0;
+}
+
+/*!
+Write the registers on the caller's task, once the worker has finished any batch it has taken, so that the worker neither
+writes older values after these, nor requeues them after a failure.
+*/
+void I2C_AsyncQueue::writeSynchronously(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len)
+{
+    _busMutex.lock();
+    lock();
+    // values still pending for these registers are older than the ones about to be written, so must not be sent after them
+    for (int ii = 0; ii < _entryCount; ++ii) {
+        entry_t& entry = _entries[ii];
+        if (entry.pending && entry.address == address && entry.reg >= firstRegister && entry.reg < firstRegister + len) {
+            entry.pending = false;
+            --_pendingCount;
+        }
+    }
+    ++_statistics.overflowCount;
+    unlock();
+    _bus.writeRegisters(address, firstRegister, data, len);
+    _busMutex.unlock();
+}
+
+/*!
+Take all the pending registers and write them, one transaction for each run of consecutive registers on the same device.
+*/
+void I2C_AsyncQueue::process()
+{
+    entry_t batch[MAX_REGISTER_COUNT];
+    int count = 0;
+
+    _busMutex.lock();
+    lock();
+    for (int ii = 0; ii < _entryCount; ++ii) {
+        if (_entries[ii].pending) {
+            batch[count] = _entries[ii];
+            ++count;
+            _entries[ii].pending = false;
+        }
+    }
+    _pendingCount = 0;
+    unlock();
+
+    // sort by device and register, so that consecutive registers are adjacent
+    for (int ii = 1; ii < count; ++ii) {
+        const entry_t entry = batch[ii];
+        int jj = ii - 1;
+        while (jj >= 0 && (batch[jj].address > entry.address || (batch[jj].address == entry.address && batch[jj].reg > entry.reg))) {
+            batch[jj + 1] = batch[jj];
+            --jj;
+        }
+        batch[jj + 1] = entry;
+    }
+
+    int runStart = 0;
+    for (int ii = 1; ii <= count; ++ii) {
+        if (ii == count || batch[ii].address != batch[runStart].address || batch[ii].reg != batch[ii - 1].reg + 1) {
+            writeRun(&batch[runStart], ii - runStart);
+            runStart = ii;
+        }
+    }
+    _busMutex.unlock();
+}
+
+void I2C_AsyncQueue::writeRun(const entry_t* run, int count)
+{
+    uint8_t data[MAX_REGISTER_COUNT];
+    for (int ii = 0; ii < count; ++ii) {
+        data[ii] = run[ii].value;
+    }
+
+    bool written = false;
+    uint32_t attemptCount = 0;
+    uint32_t errorCount = 0;
+    for (; attemptCount <= MAX_RETRY_COUNT && !written; ++attemptCount) {
+        written = _bus.writeRegisters(run[0].address, run[0].reg, data, count) == 0;
+        if (!written) {
+            ++errorCount;
+        }
+    }
+
+    const uint32_t timeUs = _clock();
+    lock();
+    _statistics.transactionCount += attemptCount;
+    _statistics.retryCount += attemptCount - 1;
+    _statistics.errorCount += errorCount;
+    if (written) {
+        for (int ii = 0; ii < count; ++ii) {
+            const uint32_t latencyUs = timeUs - run[ii].postTimeUs;
+            ++_statistics.latencyCount;
+            _statistics.latencySumUs += latencyUs;
+            if (latencyUs > _statistics.latencyMaxUs) {
+                _statistics.latencyMaxUs = latencyUs;
+            }
+        }
+    } else {
+        ++_statistics.failedCount;
+        // requeue the values, unless a newer value has been posted in the meantime
+        for (int ii = 0; ii < count; ++ii) {
+            for (int jj = 0; jj < _entryCount; ++jj) {
+                entry_t& entry = _entries[jj];
+                if (entry.address == run[ii].address && entry.reg == run[ii].reg && !entry.pending) {
+                    entry.value = run[ii].value;
+                    entry.postTimeUs = run[ii].postTimeUs;
+                    entry.pending = true;
+                    ++_pendingCount;
+                }
+            }
+        }
+    }
+    unlock();
+}
@@ -0,0 +1,17 @@
+#include "I2C_Wire.h"
+#include <Wire.h>
+
+
+I2C_Wire::I2C_Wire(int sdaPin, int sclPin) // NOLINT(hicpp-use-equals-default,modernize-use-equals-default) false positive
+{
+    // initialize I2C
+    Wire.begin(sdaPin, sclPin);
+}
+
+uint8_t I2C_Wire::writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len)
+{
+    Wire.beginTransmission(address);
+    Wire.write(firstRegister);
+    Wire.write(data, len);
+    return Wire.endTransmission();
+}
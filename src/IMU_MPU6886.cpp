@@ -0,0 +1,103 @@
+#include "BusMutex.h"
+#include "IMU_MPU6886.h"
+
+#include <M5Unified.h>
+
+
+IMU_MPU6886::IMU_MPU6886(BusMutex& busMutex, uint32_t sampleRateHz) :
+    _busMutex(busMutex),
+    _sampleRateHz(sampleRateHz)
+    {}
+
+bool IMU_MPU6886::writeRegister(uint8_t reg, uint8_t value)
+{
+    return M5.In_I2C.writeRegister8(I2C_ADDRESS, reg, value, I2C_FREQUENCY);
+}
+
+/*!
+Configure the sample rate, ranges, and FIFO. M5.begin() must have been called first, so that the internal I2C bus is initialized.
+
+Returns false if the MPU6886 did not respond.
+*/
+bool IMU_MPU6886::init()
+{
+    // with the DLPF enabled the internal sample rate is 1kHz, which is divided by 1 + SMPLRT_DIV
+    const uint32_t divider = _sampleRateHz >= 1000 ? 0 : 1000 / _sampleRateHz - 1;
+    _sampleRateHz = 1000 / (divider + 1);
+
+    _busMutex.lock();
+    const bool ok = writeRegister(REGISTER_PWR_MGMT_1, 0x01) // wake, clock from the gyro PLL
+        && writeRegister(REGISTER_SMPLRT_DIV, static_cast<uint8_t>(divider))
+        && writeRegister(REGISTER_CONFIG, CONFIG_FIFO_MODE_STOP_WHEN_FULL | CONFIG_DLPF_176HZ)
+        && writeRegister(REGISTER_GYRO_CONFIG, GYRO_CONFIG_2000DPS)
+        && writeRegister(REGISTER_ACCEL_CONFIG, ACCEL_CONFIG_8G)
+        && writeRegister(REGISTER_FIFO_EN, FIFO_EN_GYRO | FIFO_EN_ACCEL);
+    if (ok) {
+        resetFIFO();
+    }
+    _busMutex.unlock();
+    return ok;
+}
+
+void IMU_MPU6886::resetFIFO()
+{
+    writeRegister(REGISTER_USER_CTRL, USER_CTRL_FIFO_RST);
+    writeRegister(REGISTER_USER_CTRL, USER_CTRL_FIFO_EN);
+}
+
+/*!
+Read the samples, holding the bus mutex for the whole read, so that the FIFO count and the bursts that follow it are consistent.
+*/
+int IMU_MPU6886::readSamples(sample_t* samples, int maxCount)
+{
+    _busMutex.lock();
+    const int readCount = readFIFO(samples, maxCount);
+    _busMutex.unlock();
+    return readCount;
+}
+
+/*!
+Read the FIFO count, and then the samples in bursts of up to MAX_BURST_SAMPLE_COUNT.
+
+The FIFO is set to stop when full, so that a partly overwritten sample cannot misalign the samples that follow.
+If it has filled up, or its count is not a whole number of samples, then it is reset and the samples in it are discarded.
+*/
+int IMU_MPU6886::readFIFO(sample_t* samples, int maxCount)
+{
+    ++_statistics.readCount;
+    uint8_t countBuffer[2];
+    if (!M5.In_I2C.readRegister(I2C_ADDRESS, REGISTER_FIFO_COUNTH, countBuffer, sizeof(countBuffer), I2C_FREQUENCY)) {
+        return 0;
+    }
+    const int fifoCount = ((countBuffer[0] & 0x1F) << 8) | countBuffer[1];
+    if (fifoCount > FIFO_SIZE - SAMPLE_SIZE || fifoCount % SAMPLE_SIZE != 0) {
+        ++_statistics.overflowCount;
+        resetFIFO();
+        return 0;
+    }
+
+    const int available = fifoCount / SAMPLE_SIZE;
+    const int count = available < maxCount ? available : maxCount;
+    int readCount = 0;
+    while (readCount < count) {
+        const int burstCount = count - readCount < MAX_BURST_SAMPLE_COUNT ? count - readCount : MAX_BURST_SAMPLE_COUNT;
+        uint8_t buffer[MAX_BURST_SAMPLE_COUNT * SAMPLE_SIZE];
+        if (!M5.In_I2C.readRegister(I2C_ADDRESS, REGISTER_FIFO_R_W, buffer, burstCount * SAMPLE_SIZE, I2C_FREQUENCY)) {
+            break;
+        }
+        for (int ii = 0; ii < burstCount; ++ii) {
+            const uint8_t* data = &buffer[ii * SAMPLE_SIZE];
+            sample_t& sample = samples[readCount + ii];
+            sample.accX = static_cast<float>(toInt16(&data[0])) * ACC_SCALE;
+            sample.accY = static_cast<float>(toInt16(&data[2])) * ACC_SCALE;
+            sample.accZ = static_cast<float>(toInt16(&data[4])) * ACC_SCALE;
+            // data[6] and data[7] are the temperature
+            sample.gyroX = static_cast<float>(toInt16(&data[8])) * GYRO_SCALE;
+            sample.gyroY = static_cast<float>(toInt16(&data[10])) * GYRO_SCALE;
+            sample.gyroZ = static_cast<float>(toInt16(&data[12])) * GYRO_SCALE;
+        }
+        readCount += burstCount;
+    }
+    _statistics.sampleCount += readCount;
+    return readCount;
+}
@@ -0,0 +1,232 @@
+#include "MotionController.h"
+
+#include <climits>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+
+MotionController::MotionController(RoverC& rover, clock_us_t clock) :
+    MotionController(rover, clock, defaultConfig())
+    {}
+
+MotionController::MotionController(RoverC& rover, clock_us_t clock, const config_t& config) :
+    _rover(rover),
+    _clock(clock),
+    _config(config)
+{
+    clearStatistics();
+}
+
+MotionController::config_t MotionController::defaultConfig()
+{
+    config_t config {};
+    config.periodUs = DEFAULT_PERIOD_US;
+    config.maxInterpolationUs = DEFAULT_MAX_INTERPOLATION_US;
+    for (auto& maxAcceleration : config.maxAcceleration) {
+        maxAcceleration = DEFAULT_MAX_ACCELERATION;
+    }
+    return config;
+}
+
+void MotionController::clearStatistics()
+{
+    _statistics = statistics_t {0, 0, 0, UINT32_MAX, 0, 0, 0, 0, 0, 0, 0, UINT32_MAX, 0, 0};
+}
+
+/*!
+Start the control task. The task should have a higher priority than the control loop, so that it runs on time.
+
+Tests may instead call `update()` directly.
+*/
+void MotionController::begin(uint32_t priority, int core)
+{
+    xTaskCreatePinnedToCore(controlTask, "Motion", TASK_STACK_SIZE, this, priority, nullptr, core);
+}
+
+void MotionController::controlTask(void* arg)
+{
+    auto controller = static_cast<MotionController*>(arg);
+
+    const TickType_t periodTicks = pdMS_TO_TICKS(controller->_config.periodUs / 1000) > 0 ? pdMS_TO_TICKS(controller->_config.periodUs / 1000) : 1;
+    TickType_t previousWakeTime = xTaskGetTickCount();
+    while (true) {
+        controller->update();
+        vTaskDelayUntil(&previousWakeTime, periodTicks);
+    }
+}
+
+/*!
+Run one step of the controller: take any new setpoint, interpolate, correct the yaw rate, mix, limit the slew rate, and write the motor speeds.
+If a stop has been requested, stop the motors instead.
+*/
+void MotionController::update()
+{
+    const uint32_t timeUs = _clock();
+    if (_resetStatisticsRequested.exchange(false)) {
+        clearStatistics();
+    }
+    // the first update uses the configured period, rather than the time since the controller was created
+    const uint32_t elapsedUs = _hasPreviousUpdate ? timeUs - _previousUpdateUs : _config.periodUs;
+    recordTiming(timeUs);
+
+    // a setpoint published before the stop is consumed, so that it is not acted on after the stop
+    const uint32_t receiveTimeUs = consumeSetpoint(timeUs);
+    if (_stopRequested.exchange(false)) {
+        stopWheels();
+    } else {
+        setpoint_t setpoint; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+        interpolate(timeUs, setpoint);
+        if (_yawRateController != nullptr) {
+            // in tank mode the yaw stick drives the servos, and when stopped there is nothing to correct
+            const bool closedLoop = setpoint.controlMode == RoverC::MECANUM_MODE && setpoint.speedScale > 0.0F;
+            setpoint.yaw = _yawRateController->update(setpoint.yaw, static_cast<float>(elapsedUs) * 1.0e-6F, closedLoop);
+        }
+
+        RoverC::actuator_frame_t frame {};
+        _rover.setSpeedScale(setpoint.speedScale);
+        _rover.mix(setpoint.throttle, setpoint.roll, setpoint.pitch, setpoint.yaw, setpoint.controlMode, frame);
+        limitSlew(frame, elapsedUs);
+        _rover.writeActuatorFrame(frame);
+        if (receiveTimeUs != 0) {
+            recordLatency(receiveTimeUs);
+        }
+    }
+
+    const uint32_t updateTimeUs = _clock() - timeUs;
+    if (updateTimeUs > _statistics.updateTimeMaxUs) {
+        _statistics.updateTimeMaxUs = updateTimeUs;
+    }
+    if (updateTimeUs > _config.periodUs) {
+        ++_statistics.overrunCount;
+    }
+}
+
+/*!
+If a new setpoint has been published, start interpolating towards it from the current interpolated value.
+
+The interpolation time is the interval between the last two setpoints, so that the interpolation completes
+as the next setpoint is expected, limited to `maxInterpolationUs` so that a late packet does not slow the response.
+
+Returns the receive time of the new setpoint's packet, or zero if there is no new setpoint or it is not from a packet.
+*/
+uint32_t MotionController::consumeSetpoint(uint32_t timeUs)
+{
+    setpoint_t setpoint; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+    uint32_t setpointTimeUs; // NOLINT(cppcoreguidelines-init-variables)
+    const int len = _setpoints.pop(reinterpret_cast<uint8_t*>(&setpoint), sizeof(setpoint), setpointTimeUs, PacketRingBase::LATEST_WINS); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (len != sizeof(setpoint)) {
+        return 0;
+    }
+
+    if (!_hasSetpoint || setpoint.controlMode != _to.controlMode) {
+        // nothing to interpolate from, or the sticks now have a different meaning, so jump straight to the setpoint
+        _from = setpoint;
+        _interpolationUs = 0;
+    } else {
+        interpolate(timeUs, _from);
+        const uint32_t intervalUs = setpointTimeUs - _previousSetpointUs;
+        _interpolationUs = intervalUs < _config.maxInterpolationUs ? intervalUs : _config.maxInterpolationUs;
+    }
+    _to = setpoint;
+    _interpolationStartUs = timeUs;
+    _previousSetpointUs = setpointTimeUs;
+    _hasSetpoint = true;
+    ++_statistics.setpointCount;
+    return setpoint.receiveTimeUs;
+}
+
+/*!
+Stop the motors at once, bypassing the slew rate limit, and hold a zero setpoint until the next one is published.
+*/
+void MotionController::stopWheels()
+{
+    _to = setpoint_t {0.0F, 0.0F, 0.0F, 0.0F, 0.0F, _to.controlMode, 0};
+    _from = _to;
+    _interpolationUs = 0;
+    for (auto& wheelSpeed : _wheelSpeeds) {
+        wheelSpeed = 0.0F;
+    }
+    _rover.stop();
+}
+
+void MotionController::interpolate(uint32_t timeUs, setpoint_t& setpoint) const
+{
+    const uint32_t elapsedUs = timeUs - _interpolationStartUs;
+    if (elapsedUs >= _interpolationUs) {
+        setpoint = _to;
+        return;
+    }
+    const float t = static_cast<float>(elapsedUs) / static_cast<float>(_interpolationUs);
+    setpoint.throttle = _from.throttle + (_to.throttle - _from.throttle) * t;
+    setpoint.roll = _from.roll + (_to.roll - _from.roll) * t;
+    setpoint.pitch = _from.pitch + (_to.pitch - _from.pitch) * t;
+    setpoint.yaw = _from.yaw + (_to.yaw - _from.yaw) * t;
+    setpoint.speedScale = _from.speedScale + (_to.speedScale - _from.speedScale) * t;
+    setpoint.controlMode = _to.controlMode;
+    setpoint.receiveTimeUs = _to.receiveTimeUs;
+}
+
+/*!
+Limit the change in each wheel's speed to its maximum acceleration over the time since the last update.
+*/
+void MotionController::limitSlew(RoverC::actuator_frame_t& frame, uint32_t elapsedUs)
+{
+    for (int ii = 0; ii < RoverC::MOTOR_COUNT; ++ii) {
+        const auto target = static_cast<float>(frame.motorSpeeds[ii]);
+        const float maxAcceleration = _config.maxAcceleration[ii];
+        if (maxAcceleration <= 0.0F) {
+            _wheelSpeeds[ii] = target;
+            continue;
+        }
+        const float maxStep = maxAcceleration * static_cast<float>(elapsedUs) * 1.0e-6F;
+        float step = target - _wheelSpeeds[ii];
+        if (step > maxStep) {
+            step = maxStep;
+            ++_statistics.slewLimitedCount;
+        } else if (step < -maxStep) {
+            step = -maxStep;
+            ++_statistics.slewLimitedCount;
+        }
+        _wheelSpeeds[ii] += step;
+        frame.motorSpeeds[ii] = static_cast<int8_t>(_wheelSpeeds[ii] < 0.0F ? _wheelSpeeds[ii] - 0.5F : _wheelSpeeds[ii] + 0.5F);
+    }
+}
+
+void MotionController::recordTiming(uint32_t timeUs)
+{
+    if (_hasPreviousUpdate) {
+        const uint32_t periodUs = timeUs - _previousUpdateUs;
+        if (periodUs < _statistics.periodMinUs) {
+            _statistics.periodMinUs = periodUs;
+        }
+        if (periodUs > _statistics.periodMaxUs) {
+            _statistics.periodMaxUs = periodUs;
+        }
+        const uint32_t jitterUs = periodUs > _config.periodUs ? periodUs - _config.periodUs : _config.periodUs - periodUs;
+        if (jitterUs > _statistics.jitterMaxUs) {
+            _statistics.jitterMaxUs = jitterUs;
+        }
+        _statistics.jitterSumUs += jitterUs;
+        ++_statistics.periodCount;
+    }
+    ++_statistics.updateCount;
+    _previousUpdateUs = timeUs;
+    _hasPreviousUpdate = true;
+}
+
+/*!
+Record the latency from the packet being received to its setpoint being written to the RoverC, including any
+wait for this update, the interpolation and mixing, and the time taken to write to, or post to, the bus.
+*/
+void MotionController::recordLatency(uint32_t receiveTimeUs)
+{
+    const uint32_t latencyUs = _clock() - receiveTimeUs;
+    ++_statistics.latencyCount;
+    _statistics.latencySumUs += latencyUs;
+    if (latencyUs < _statistics.latencyMinUs) {
+        _statistics.latencyMinUs = latencyUs;
+    }
+    if (latencyUs > _statistics.latencyMaxUs) {
+        _statistics.latencyMaxUs = latencyUs;
+    }
+}
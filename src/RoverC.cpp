@@ -1,12 +1,19 @@
+#include "I2C_Interface.h"
+#include "Mixer.h"
 #include "RoverC.h"
-#include <Wire.h>
 
+#include <Arduino.h>
+#include <cmath>
+#include <cstring>
 
-RoverC::RoverC() // NOLINT(hicpp-use-equals-default,modernize-use-equals-default) false positive
-{
-    // initialize I2C
-    Wire.begin(SDA_PIN, SCL_PIN);
-}
+
+/*!
+The bus should be initialized before it is passed to the RoverC.
+For the M5StickC the RoverC is on the extended IO port, see SDA_PIN and SCL_PIN.
+*/
+RoverC::RoverC(I2C_Interface& bus) :
+    _bus(bus)
+    {}
 
 void RoverC::stop()
 {
@@ -15,94 +22,191 @@ void RoverC::stop()
 
 void RoverC::setMotorSpeeds(int speedM1, int speedM2, int speedM3, int speedM4)
 {
-    setMotorSpeed(REGISTER_MOTOR_1, speedM1);
-    setMotorSpeed(REGISTER_MOTOR_2, speedM2);
-    setMotorSpeed(REGISTER_MOTOR_3, speedM3);
-    setMotorSpeed(REGISTER_MOTOR_4, speedM4);
+    const actuator_frame_t frame {
+        .motorSpeeds { clipSpeed(speedM1), clipSpeed(speedM2), clipSpeed(speedM3), clipSpeed(speedM4) },
+        .servoAngles { 0, 0 }
+    };
+    writeActuatorFrame(frame, DONT_WRITE_SERVOS);
 }
 
+/*!
+Set a single motor's speed. A register that is not a motor register is ignored, as it has no shadow register.
+*/
+// cppcheck-suppress unusedFunction
 void RoverC::setMotorSpeed(uint8_t motorRegister, int speed)
 {
-    speed = clip(speed, MIN_SPEED, MAX_SPEED);
-
-    Wire.beginTransmission(I2C_ADDRESS);
-    Wire.write(motorRegister);
-    Wire.write(speed);
-    Wire.endTransmission();
+    if (static_cast<unsigned>(motorRegister - REGISTER_MOTOR_1) >= MOTOR_COUNT) {
+        return;
+    }
+    refreshIfDue();
+    const auto value = static_cast<uint8_t>(clipSpeed(speed));
+    writeChangedRegisters(motorRegister, &value, 1, SHADOW_MOTOR_INDEX + motorRegister - REGISTER_MOTOR_1);
 }
 
+/*!
+Set the servo's angle, clipped to the range MIN_SERVO_ANGLE to MAX_SERVO_ANGLE. A servoChannel of SERVO_COUNT or more is ignored.
+*/
 void RoverC::setServoAngle(uint8_t servoChannel, int angle)
 {
-    angle = clip(angle, 0, 90);
-
-    Wire.beginTransmission(I2C_ADDRESS);
-    Wire.write(servoChannel | 0x10);
-    Wire.write(angle);
-    Wire.endTransmission();
+    if (servoChannel >= SERVO_COUNT) {
+        return;
+    }
+    refreshIfDue();
+    const auto value = static_cast<uint8_t>(clip(angle, MIN_SERVO_ANGLE, MAX_SERVO_ANGLE));
+    writeChangedRegisters(servoChannel | REGISTER_SERVO_ANGLE_1, &value, 1, SHADOW_SERVO_INDEX + servoChannel);
 }
 
+/*!
+Set the servo's pulse width, in microseconds, clipped to the range MIN_SERVO_PULSE_US to MAX_SERVO_PULSE_US.
+A servoChannel of SERVO_COUNT or more is ignored.
+
+Each servo has a 16-bit pulse width register, most significant byte first, so both bytes are written in one transaction.
+*/
 // cppcheck-suppress unusedFunction
 void RoverC::setServoPulse(uint8_t servoChannel, uint16_t pulseWidth)
 {
-    pulseWidth = clip(pulseWidth, 500, 2500);
+    static_assert(REGISTER_SERVO_PULSE_2 - REGISTER_SERVO_PULSE_1 == sizeof(uint16_t));
 
-    Wire.beginTransmission(I2C_ADDRESS);
-    Wire.write(servoChannel | 0x20);
-    Wire.write(pulseWidth);
-    Wire.endTransmission();
+    if (servoChannel >= SERVO_COUNT) {
+        return;
+    }
+    const auto width = static_cast<uint16_t>(clip(pulseWidth, MIN_SERVO_PULSE_US, MAX_SERVO_PULSE_US));
+    const uint8_t value[2] { static_cast<uint8_t>(width >> 8U), static_cast<uint8_t>(width & 0xFFU) };
+    writeRegisters(REGISTER_SERVO_PULSE_1 + servoChannel * sizeof(uint16_t), &value[0], sizeof(value));
+    // the pulse width overrides the servo angle, so the shadow angle no longer reflects the servo
+    _shadowValidMask &= ~(1U << (SHADOW_SERVO_INDEX + servoChannel));
 }
 
-void RoverC::move(float throttle, float roll, float pitch, float yaw, control_mode_t control_mode)
+/*!
+Write the motor registers in a single I2C transaction and, optionally, the servo registers in a second transaction.
+
+The RoverC auto-increments the register address, so consecutive registers can be written in one burst.
+Only registers whose values differ from the shadow registers are sent, so an unchanged frame causes no bus traffic.
+The frame values must already be clipped to their valid ranges.
+*/
+void RoverC::writeActuatorFrame(const actuator_frame_t& frame, write_servos_t writeServos)
 {
-    if (control_mode == MECANUM_MODE) {
-        moveMecanumMode(throttle, roll, pitch, yaw);
-    } else {
-        moveTankMode(throttle, roll, pitch, yaw);
+    static_assert(REGISTER_MOTOR_4 - REGISTER_MOTOR_1 + 1 == MOTOR_COUNT);
+    static_assert(REGISTER_SERVO_ANGLE_2 - REGISTER_SERVO_ANGLE_1 + 1 == SERVO_COUNT);
+
+    refreshIfDue();
+    writeChangedRegisters(REGISTER_MOTOR_1, reinterpret_cast<const uint8_t*>(&frame.motorSpeeds[0]), MOTOR_COUNT, SHADOW_MOTOR_INDEX); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (writeServos == WRITE_SERVOS) {
+        writeChangedRegisters(REGISTER_SERVO_ANGLE_1, &frame.servoAngles[0], SERVO_COUNT, SHADOW_SERVO_INDEX);
     }
 }
 
-/*
- motor numbers:
-1 ------ 2
-|        |
-|        |
-|   M5   |
-3 ------ 4
+/*!
+Periodically invalidate the shadow registers, so that all registers are rewritten.
+This is a safety net in case the RoverC has been reset or has missed a write.
 */
+void RoverC::refreshIfDue()
+{
+    const uint32_t timeMs = millis();
+    if (timeMs - _lastRefreshMs >= _refreshIntervalMs) {
+        _lastRefreshMs = timeMs;
+        _shadowValidMask = 0;
+        ++_writeStatistics.refreshCount;
+    }
+}
 
-void RoverC::moveMecanumMode(float throttle, float roll, float pitch, float yaw)
+/*!
+Write the smallest run of consecutive registers that contains all the values that differ from the shadow registers.
+*/
+void RoverC::writeChangedRegisters(uint8_t firstRegister, const uint8_t* data, size_t len, size_t shadowIndex)
 {
-    const int servoAngle = 90 * abs(throttle);
-    setServoAngle(0, servoAngle);
-    setServoAngle(1, servoAngle);
+    size_t first = len;
+    size_t last = 0;
+    for (size_t ii = 0; ii < len; ++ii) {
+        const uint32_t validBit = 1U << (shadowIndex + ii);
+        if ((_shadowValidMask & validBit) == 0 || _shadowRegisters[shadowIndex + ii] != data[ii]) {
+            if (first == len) {
+                first = ii;
+            }
+            last = ii;
+        }
+    }
+    if (first == len) {
+        // nothing has changed
+        _writeStatistics.registerSuppressedCount += len;
+        return;
+    }
 
-    const int speedX = round(roll * MAX_SPEED);
-    const int speedY = round(pitch * MAX_SPEED);
-    const int rotation  = round(yaw * MAX_SPEED);
+    const size_t count = last - first + 1;
+    writeRegisters(firstRegister + first, &data[first], count);
+    memcpy(&_shadowRegisters[shadowIndex + first], &data[first], count);
+    _shadowValidMask |= ((1U << count) - 1) << (shadowIndex + first);
 
-    _speed = (speedX + speedY)/2.0F;
-    _angle = rotation;
+    _writeStatistics.registerWriteCount += count;
+    _writeStatistics.registerSuppressedCount += len - count;
+}
 
-    const int frontLeft  = speedY + speedX + rotation;
-    const int frontRight = speedY - speedX - rotation;
-    const int backLeft   = speedY - speedX + rotation;
-    const int backRight  = speedY + speedX - rotation;
+/*!
+Write `len` bytes to consecutive registers, starting at `firstRegister`, in a single request to the I2C interface.
+*/
+void RoverC::writeRegisters(uint8_t firstRegister, const uint8_t* data, size_t len)
+{
+    _bus.writeRegisters(I2C_ADDRESS, firstRegister, data, len);
 
-    setMotorSpeeds(frontLeft, frontRight, backLeft, backRight);
+    ++_busStatistics.requestCount;
+    _busStatistics.requestByteCount += len + 2; // address byte and register byte, plus the data
 }
 
-void RoverC::moveTankMode(float throttle, [[maybe_unused]] float roll, float pitch, float yaw)
+void RoverC::setFrameServoAngles(actuator_frame_t& frame, int angle)
 {
-    const int speedLeft = round(throttle * MAX_SPEED);
-    const int speedRight = round(pitch * MAX_SPEED);
-    _speed = speedLeft;
-    _angle = speedRight;
-
-    const int servoAngle = 90 * abs(yaw);
     // set both servos, so it doesn't matter which one the user plugged in
-    setServoAngle(0, servoAngle);
-    setServoAngle(1, servoAngle);
+    const auto servoAngle = static_cast<uint8_t>(clip(angle, MIN_SERVO_ANGLE, MAX_SERVO_ANGLE));
+    frame.servoAngles[0] = servoAngle;
+    frame.servoAngles[1] = servoAngle;
+}
 
-    setMotorSpeeds(speedLeft, speedRight, speedLeft, speedRight);
+void RoverC::move(float throttle, float roll, float pitch, float yaw, control_mode_t control_mode)
+{
+    actuator_frame_t frame {};
+    mix(throttle, roll, pitch, yaw, control_mode, frame);
+    writeActuatorFrame(frame);
 }
 
+/*!
+Mix the stick values into an actuator frame, without writing it to the RoverC.
+This allows the caller to shape the motor speeds, for example to limit their rate of change, before calling `writeActuatorFrame()`.
+*/
+void RoverC::mix(float throttle, float roll, float pitch, float yaw, control_mode_t control_mode, actuator_frame_t& frame)
+{
+    if (control_mode == MECANUM_MODE) {
+        mixMecanumMode(throttle, roll, pitch, yaw, frame);
+    } else {
+        mixTankMode(throttle, roll, pitch, yaw, frame);
+    }
+}
+
+/*!
+Mecanum mode: roll moves the Rover sideways, pitch moves it forwards and backwards, and yaw rotates it.
+The mixing is done by `Mixer<MecanumGeometry>`, see Mixer.h for the motor numbering.
+*/
+void RoverC::mixMecanumMode(float throttle, float roll, float pitch, float yaw, actuator_frame_t& frame)
+{
+    setFrameServoAngles(frame, static_cast<int>(90.0F * std::fabs(throttle)));
+
+    const float maxSpeed = _speedScale * MAX_SPEED;
+    _speed = (roll + pitch) * maxSpeed / 2.0F;
+    _angle = yaw * maxSpeed;
+
+    const float inputs[MecanumGeometry::INPUT_COUNT] { roll, pitch, yaw };
+    Mixer<MecanumGeometry>::mix(inputs, frame.motorSpeeds, maxSpeed);
+}
+
+/*!
+Tank mode: throttle drives the left wheels and pitch drives the right wheels.
+*/
+void RoverC::mixTankMode(float throttle, [[maybe_unused]] float roll, float pitch, float yaw, actuator_frame_t& frame)
+{
+    const float maxSpeed = _speedScale * MAX_SPEED;
+    _speed = throttle * maxSpeed;
+    _angle = pitch * maxSpeed;
+
+    setFrameServoAngles(frame, static_cast<int>(90.0F * std::fabs(yaw)));
+
+    const float inputs[TankGeometry::INPUT_COUNT] { throttle, pitch };
+    Mixer<TankGeometry>::mix(inputs, frame.motorSpeeds, maxSpeed);
+}
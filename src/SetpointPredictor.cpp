@@ -0,0 +1,115 @@
+#include "SetpointPredictor.h"
+
+
+SetpointPredictor::SetpointPredictor() :
+    SetpointPredictor(defaultConfig())
+    {}
+
+SetpointPredictor::SetpointPredictor(const config_t& config) :
+    _config(config)
+    {}
+
+SetpointPredictor::config_t SetpointPredictor::defaultConfig()
+{
+    config_t config {};
+    for (auto& axis : config.axes) {
+        axis = axis_config_t { DEFAULT_TREND_GAIN, DEFAULT_MAX_SLOPE_PER_SECOND, DEFAULT_HORIZON_MS, DEFAULT_DECAY_MS };
+    }
+    config.historyWindowMs = DEFAULT_HISTORY_WINDOW_MS;
+    config.lateAfterMs = DEFAULT_LATE_AFTER_MS;
+    return config;
+}
+
+void SetpointPredictor::reset()
+{
+    _sampleCount = 0;
+}
+
+/*!
+Record the values from a packet received at `timeUs`.
+*/
+void SetpointPredictor::addSample(uint32_t timeUs, const values_t& values)
+{
+    _samples[_sampleCount % HISTORY_COUNT] = sample_t { timeUs, values };
+    ++_sampleCount;
+}
+
+/*!
+Least squares estimate of the slope of the axis, in units per second, over the samples in the history window.
+*/
+float SetpointPredictor::slope(int axis) const
+{
+    const uint32_t count = _sampleCount < HISTORY_COUNT ? _sampleCount : static_cast<uint32_t>(HISTORY_COUNT);
+    const uint32_t latestTimeUs = _samples[(_sampleCount - 1) % HISTORY_COUNT].timeUs;
+    const uint32_t windowUs = _config.historyWindowMs * 1000;
+
+    int n = 0;
+    float sumX = 0.0F;
+    float sumY = 0.0F;
+    float sumXX = 0.0F;
+    float sumXY = 0.0F;
+    for (uint32_t ii = 0; ii < count; ++ii) {
+        const sample_t& sample = _samples[(_sampleCount - 1 - ii) % HISTORY_COUNT];
+        const uint32_t ageUs = latestTimeUs - sample.timeUs;
+        if (ageUs > windowUs) {
+            break;
+        }
+        const float x = -static_cast<float>(ageUs) * 1.0e-6F;
+        const float y = sample.values.value[axis];
+        ++n;
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+    const float denominator = static_cast<float>(n) * sumXX - sumX * sumX;
+    if (n < 2 || denominator <= 0.0F) {
+        return 0.0F;
+    }
+    const float slope = (static_cast<float>(n) * sumXY - sumX * sumY) / denominator;
+    const float maxSlope = _config.axes[axis].maxSlopePerSecond;
+    return slope > maxSlope ? maxSlope : slope < -maxSlope ? -maxSlope : slope;
+}
+
+/*!
+Returns true if there are samples, and the next is late at `timeUs`, so that the values should be predicted rather than held.
+*/
+bool SetpointPredictor::isLate(uint32_t timeUs) const
+{
+    if (_sampleCount == 0) {
+        return false;
+    }
+    return timeUs - _samples[(_sampleCount - 1) % HISTORY_COUNT].timeUs >= _config.lateAfterMs * 1000;
+}
+
+bool SetpointPredictor::predict(uint32_t timeUs, values_t& values) const
+{
+    if (_sampleCount == 0) {
+        return false;
+    }
+    const sample_t& latest = _samples[(_sampleCount - 1) % HISTORY_COUNT];
+    const uint32_t ageUs = timeUs - latest.timeUs;
+
+    for (int ii = 0; ii < AXIS_COUNT; ++ii) {
+        const axis_config_t& axis = _config.axes[ii];
+        const uint32_t horizonUs = axis.horizonMs * 1000;
+        const uint32_t extrapolationUs = ageUs < horizonUs ? ageUs : horizonUs;
+
+        const float last = latest.values.value[ii];
+        float value = last + axis.trendGain * slope(ii) * static_cast<float>(extrapolationUs) * 1.0e-6F;
+        // never extrapolate through zero, nor away from it: a released stick is exactly zero after the dead zone
+        if (value * last < 0.0F || last == 0.0F) {
+            value = 0.0F;
+        }
+        value = value > 1.0F ? 1.0F : value < -1.0F ? -1.0F : value;
+
+        if (ageUs > horizonUs) {
+            // smoothstep decay, so the value eases away from its extrapolated value and eases into zero
+            const uint32_t decayUs = axis.decayMs * 1000;
+            const float t = decayUs == 0 ? 1.0F : static_cast<float>(ageUs - horizonUs) / static_cast<float>(decayUs);
+            value *= t >= 1.0F ? 0.0F : 1.0F - t * t * (3.0F - 2.0F * t);
+        }
+        values.value[ii] = value;
+    }
+    return true;
+}
@@ -0,0 +1,145 @@
+#include "Telemetry.h"
+
+
+uint8_t Telemetry::checksum(const uint8_t* frame, int len)
+{
+    uint8_t sum = 0;
+    for (int ii = 0; ii < len; ++ii) {
+        sum += frame[ii];
+    }
+    return sum;
+}
+
+TelemetryEncoder::TelemetryEncoder(uint32_t intervalMs, uint32_t keyframeInterval) :
+    _intervalMs(intervalMs),
+    _keyframeInterval(keyframeInterval)
+    {}
+
+/*!
+Returns true if it is at least `intervalMs` since the last frame was encoded.
+*/
+bool TelemetryEncoder::isDue(uint32_t timeMs) const
+{
+    // unsigned subtraction, so correct when the clock wraps around
+    return _statistics.frameCount == 0 || timeMs - _lastFrameMs >= _intervalMs;
+}
+
+uint8_t* TelemetryEncoder::writeVarint(uint8_t* out, uint32_t value)
+{
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+/*!
+Encode `values` into `frame`, which must be at least MAX_FRAME_SIZE bytes long.
+
+Returns the length of the frame.
+*/
+int TelemetryEncoder::encode(const values_t& values, uint8_t* frame, uint32_t timeMs)
+{
+    const bool keyframe = _keyframeRequested || (_keyframeInterval != 0 && _statistics.frameCount % _keyframeInterval == 0);
+    _keyframeRequested = false;
+
+    uint16_t fieldMask = 0;
+    uint8_t* out = frame + HEADER_SIZE;
+    for (int ii = 0; ii < FIELD_COUNT; ++ii) {
+        // unsigned arithmetic, so the delta wraps rather than overflows, and the decoder wraps it back
+        const int32_t delta = keyframe ? values.value[ii] : static_cast<int32_t>(static_cast<uint32_t>(values.value[ii]) - static_cast<uint32_t>(_previous.value[ii]));
+        if (keyframe || delta != 0) {
+            fieldMask |= static_cast<uint16_t>(1U << ii);
+            out = writeVarint(out, zigzagEncode(delta));
+        }
+    }
+    frame[0] = MAGIC;
+    frame[1] = keyframe ? KEYFRAME_FLAG : 0;
+    frame[2] = _sequence;
+    frame[3] = static_cast<uint8_t>(fieldMask);
+    frame[4] = static_cast<uint8_t>(fieldMask >> 8);
+    const int len = static_cast<int>(out - frame);
+    frame[len] = checksum(frame, len);
+
+    ++_sequence;
+    _previous = values;
+    _lastFrameMs = timeMs;
+
+    ++_statistics.frameCount;
+    if (keyframe) {
+        ++_statistics.keyframeCount;
+    }
+    _statistics.byteCount += len + CHECKSUM_SIZE;
+    _windowByteCount += len + CHECKSUM_SIZE;
+    const uint32_t windowMs = timeMs - _windowStartMs;
+    if (windowMs >= 1000) {
+        _statistics.bytesPerSecond = _windowByteCount * 1000 / windowMs;
+        _windowStartMs = timeMs;
+        _windowByteCount = 0;
+    }
+
+    return len + CHECKSUM_SIZE;
+}
+
+const uint8_t* TelemetryDecoder::readVarint(const uint8_t* in, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 7 * MAX_VARINT_SIZE && in < end; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+/*!
+Decode a telemetry frame, updating the values.
+
+Returns true if the values were updated.
+*/
+bool TelemetryDecoder::decode(const uint8_t* frame, int len)
+{
+    if (len < HEADER_SIZE + CHECKSUM_SIZE || frame[0] != MAGIC || checksum(frame, len - CHECKSUM_SIZE) != frame[len - CHECKSUM_SIZE]) {
+        ++_statistics.rejectedCount;
+        return false;
+    }
+    const bool keyframe = (frame[1] & KEYFRAME_FLAG) != 0;
+    const uint8_t sequence = frame[2];
+    if (!keyframe && (!_synchronized || sequence != static_cast<uint8_t>(_sequence + 1))) {
+        // a frame has been lost, so the deltas cannot be applied
+        _synchronized = false;
+        ++_statistics.unsynchronizedCount;
+        return false;
+    }
+
+    // decode into a copy, so a malformed frame leaves the values unchanged
+    values_t values = _values;
+    const uint16_t fieldMask = static_cast<uint16_t>(frame[3] | (frame[4] << 8));
+    const uint8_t* in = frame + HEADER_SIZE;
+    const uint8_t* end = frame + len - CHECKSUM_SIZE;
+    for (int ii = 0; ii < FIELD_COUNT; ++ii) {
+        if (fieldMask & (1U << ii)) {
+            uint32_t encoded; // NOLINT(cppcoreguidelines-init-variables)
+            in = readVarint(in, end, encoded);
+            if (in == nullptr) {
+                ++_statistics.rejectedCount;
+                return false;
+            }
+            const int32_t delta = zigzagDecode(encoded);
+            values.value[ii] = keyframe ? delta : static_cast<int32_t>(static_cast<uint32_t>(values.value[ii]) + static_cast<uint32_t>(delta));
+        }
+    }
+    if (in != end) {
+        ++_statistics.rejectedCount;
+        return false;
+    }
+
+    _values = values;
+    _sequence = sequence;
+    _synchronized = true;
+    ++_statistics.frameCount;
+    return true;
+}
@@ -0,0 +1,86 @@
+#include "YawRateController.h"
+
+
+YawRateController::YawRateController(IMU_Interface& imu, clock_us_t clock) :
+    YawRateController(imu, clock, defaultConfig())
+    {}
+
+YawRateController::YawRateController(IMU_Interface& imu, clock_us_t clock, const config_t& config) :
+    _imu(imu),
+    _clock(clock),
+    _config(config)
+    {}
+
+YawRateController::config_t YawRateController::defaultConfig()
+{
+    return config_t {
+        .maxYawRateDPS = 360.0F,
+        .kp = 0.5F,
+        .ki = 5.0F,
+        .integralLimit = 0.3F,
+        .rateSign = -1.0F, // the gyro z axis points up, so the clockwise rotation driven by positive rotation reads negative
+        .calibrationSampleCount = 500
+    };
+}
+
+void YawRateController::resetStatistics()
+{
+    _statistics = statistics_t {0, 0, 0, 0, 0, 0};
+}
+
+/*!
+Read the samples buffered by the IMU, and update the gyro bias while calibrating, or the yaw rate once calibrated.
+If there are no new samples then the previous yaw rate is kept.
+*/
+void YawRateController::readIMU()
+{
+    IMU_Interface::sample_t samples[MAX_BATCH_SIZE];
+    const int count = _imu.readSamples(samples, MAX_BATCH_SIZE);
+    if (count == 0) {
+        ++_statistics.emptyBatchCount;
+        return;
+    }
+    _statistics.sampleCount += count;
+
+    float sum = 0.0F;
+    for (int ii = 0; ii < count; ++ii) {
+        sum += samples[ii].gyroZ;
+    }
+    if (!isCalibrated()) {
+        _calibrationSum += sum;
+        _calibrationCount += count;
+        _gyroBiasDPS = _calibrationSum / static_cast<float>(_calibrationCount);
+        return;
+    }
+    _gyroZ_DPS = sum / static_cast<float>(count);
+    _yawRateDPS = (_gyroZ_DPS - _gyroBiasDPS) * _config.rateSign;
+}
+
+float YawRateController::update(float yawCommand, float deltaT, bool closedLoop)
+{
+    const uint32_t startTimeUs = _clock();
+    ++_statistics.updateCount;
+
+    readIMU();
+
+    float rotation = yawCommand;
+    if (closedLoop && isCalibrated()) {
+        // the error is normalized, so that the gains are independent of maxYawRateDPS
+        const float error = (yawCommand * _config.maxYawRateDPS - _yawRateDPS) / _config.maxYawRateDPS;
+        _integral += _config.ki * error * deltaT;
+        _integral = _integral > _config.integralLimit ? _config.integralLimit : _integral < -_config.integralLimit ? -_config.integralLimit : _integral;
+        rotation += _config.kp * error + _integral;
+        rotation = rotation > 1.0F ? 1.0F : rotation < -1.0F ? -1.0F : rotation;
+    } else {
+        _integral = 0.0F;
+    }
+
+    _statistics.cycleTimeUs = _clock() - startTimeUs;
+    if (_statistics.cycleTimeUs > _statistics.cycleTimeMaxUs) {
+        _statistics.cycleTimeMaxUs = _statistics.cycleTimeUs;
+    }
+    if (_statistics.cycleTimeUs > _cycleBudgetUs) {
+        ++_statistics.overBudgetCount;
+    }
+    return rotation;
+}
@@ -1,6 +1,19 @@
+#include "BusMutex.h"
+#include "ConfigStore.h"
+#include "Display.h"
+#include "FailsafeWatchdog.h"
+#include "I2C_AsyncQueue.h"
+#include "I2C_Wire.h"
+#include "IMU_MPU6886.h"
+#include "MotionController.h"
 #include "RoverC.h"
+#include "SetpointPredictor.h"
+#include "Telemetry.h"
+#include "YawRateController.h"
 
 #include <AtomJoyStickReceiver.h>
+#include <ChannelManager.h>
+#include <FleetCodec.h>
 
 #include <HardwareSerial.h>
 #include <M5Unified.h>
@@ -10,11 +23,92 @@
 static constexpr uint8_t JOYSTICK_CHANNEL = 3;
 #endif
 
+// define USE_PACKET_POLLING to busy-poll for packets rather than waiting on the receive signal, for latency comparison
+//#define USE_PACKET_POLLING
+#if !defined(PACKET_WAIT_TIMEOUT_MS)
+static constexpr uint32_t PACKET_WAIT_TIMEOUT_MS = 10;
+#endif
+
+// define USE_PACKET_CAPTURE to capture received packets, the capture is written to the serial port by sending 'c'
+// each record holds as much of a packet as the codec's largest packet, so the capture uses about 18KB either way
+//#define USE_PACKET_CAPTURE
+#if !defined(PACKET_CAPTURE_RECORD_COUNT)
+#if defined(USE_FLEET_MODE)
+static constexpr int PACKET_CAPTURE_RECORD_COUNT = 128; // 140 bytes a record, about 1.3 seconds at 100 frames per second
+#else
+static constexpr int PACKET_CAPTURE_RECORD_COUNT = 512; // 36 bytes a record, about 5 seconds at 100 packets per second
+#endif
+#endif
+
+// define USE_FLEET_MODE to receive fleet frames, in which one transmitter broadcasts a command slot for each rover
+// define FLEET_SLOT_INDEX to use a fixed slot, otherwise the slot is found by this rover's MAC address
+// define FLEET_ID to the id of this rover's fleet, frames from other fleets are rejected
+//#define USE_FLEET_MODE
+#if defined(USE_FLEET_MODE) && !defined(FLEET_SLOT_INDEX)
+#define FLEET_SLOT_INDEX -1
+#endif
+#if defined(USE_FLEET_MODE) && !defined(FLEET_ID)
+#define FLEET_ID 0
+#endif
+#if defined(USE_FLEET_MODE)
+typedef FleetCodec<FLEET_SLOT_INDEX, FLEET_ID> receiver_codec_t;
+#else
+typedef AtomJoyStickCodec receiver_codec_t;
+#endif
+static_assert(static_cast<int>(receiver_codec_t::MAX_PACKET_SIZE) <= static_cast<int>(AtomJoyStickReceiver::MAX_PACKET_SIZE), "the receiver's packet slots must hold the codec's largest packet");
+
+// telemetry is sent back to the joystick at most once every TELEMETRY_INTERVAL_MS, set to zero to disable telemetry
+#if !defined(TELEMETRY_INTERVAL_MS)
+static constexpr uint32_t TELEMETRY_INTERVAL_MS = 100;
+#endif
+
+// define USE_CHANNEL_SURVEY to survey the channels when 'v' is sent over the serial port, and switch to the best one if the joystick agrees
+// this needs a joystick that understands the channel handshake, other joysticks ignore it and the channel is unchanged
+//#define USE_CHANNEL_SURVEY
+#if defined(USE_CHANNEL_SURVEY)
+static const uint8_t surveyChannels[] = { 1, 3, 6, 11, 13 };
+#endif
+
+// define USE_HOLD_ON_PACKET_LOSS to hold the last command when packets are late, rather than extrapolating it, for comparison
+//#define USE_HOLD_ON_PACKET_LOSS
+
+// define USE_YAW_RATE_CONTROL to correct the rotation using the built-in IMU's gyro, so the Rover drives straight when a wheel slips
+// the Rover must be stationary for the first second after switch on, while the gyro bias is measured
+//#define USE_YAW_RATE_CONTROL
+
+// define USE_SYNCHRONOUS_I2C to write to the RoverC directly from the motion controller, rather than through the I2C worker task, for comparison
+//#define USE_SYNCHRONOUS_I2C
+
+// define USE_SYNCHRONOUS_DISPLAY to render the display in the control loop, rather than in the display task, for comparison
+//#define USE_SYNCHRONOUS_DISPLAY
+
 static AtomJoyStickReceiver *atomJoyStickReceiver;
+static ConfigStore *configStore;
+//! The persisted pairing and calibration, updated and saved when the joystick is paired and when the stick bias is measured.
+static ConfigStore::config_t config;
 static RoverC * rover;
+static MotionController *motionController;
+static FailsafeWatchdog *failsafeWatchdog;
+static Display *display;
+#if !defined(USE_SYNCHRONOUS_I2C)
+static I2C_AsyncQueue *i2cQueue;
+#endif
+//! The internal I2C bus is shared by the AXP192, used by M5Unified in the control loop, and the MPU6886, read by the motion task.
+static BusMutex internalBusMutex;
+static TelemetryEncoder telemetryEncoder(TELEMETRY_INTERVAL_MS);
+static SetpointPredictor setpointPredictor;
+#if defined(USE_YAW_RATE_CONTROL)
+static YawRateController *yawRateController;
+#endif
+#if defined(USE_CHANNEL_SURVEY)
+static ChannelManager *channelManager;
+#endif
+#if defined(USE_PACKET_CAPTURE)
+static PacketCaptureBuffer<PACKET_CAPTURE_RECORD_COUNT, receiver_codec_t::MAX_PACKET_SIZE> packetCapture;
+#endif
 
-enum { SCREEN_HEIGHT_M5_STICK_C = 80, SCREEN_HEIGHT_M5_STICK_C_PLUS = 135 };
-static int screenHeight;
+//! The last setpoint sent to the motion controller, reissued with a reduced speed scale while the failsafe ramps down.
+static MotionController::setpoint_t lastSetpoint {0.0F, 0.0F, 0.0F, 0.0F, 1.0F, RoverC::MECANUM_MODE, 0};
 
 #if defined(ATOM_JOYSTICK_MAC_ADDRESS)
 static const uint8_t atomJoyStickMacAddress[ESP_NOW_ETH_ALEN] = ATOM_JOYSTICK_MAC_ADDRESS;
@@ -24,19 +118,25 @@ static const uint8_t *atomJoyStickMacAddress = nullptr;
 
 static uint8_t myMacAddress[ESP_NOW_ETH_ALEN];
 
-static void displayMyMacAddress();
-static void updateScreen(float throttle, float roll, float pitch, float yaw, float speed, float angle);
+static uint32_t displayBlockedMaxUs {0}; //!< the maximum time the control loop has spent updating the display
+
 static void updateButtons();
+static void updateBinding();
+static void updateChannel();
+static void updateConfig();
 static bool updateReceiver();
+static void updateFailsafe();
+static void sendTelemetry();
+static void printStatistics();
 
 
 /*!
 Main program setup:
 1. Initialize the M5
-2. Setup the screen
+2. Setup the screen and the display task
 3. Get and display my MAC address
-4. Initialize the joystick receiver
-5. Initialize the Rover
+4. Load the persisted configuration and initialize the joystick receiver, so a previously paired joystick is registered immediately
+5. Initialize the Rover, the motion controller, and the failsafe watchdog
 */
 void setup()
 {
@@ -49,8 +149,8 @@ void setup()
     M5.Power.setChargeCurrent(360);
 
     M5.Lcd.setRotation(1); // set to default, to find screen height
-    screenHeight = M5.Lcd.height();
-    M5.Lcd.setTextSize(screenHeight == SCREEN_HEIGHT_M5_STICK_C ? 1 : 2);
+    const int screenHeight = M5.Lcd.height();
+    M5.Lcd.setTextSize(screenHeight == Display::SCREEN_HEIGHT_M5_STICK_C ? 1 : 2);
     M5.Lcd.setRotation(0);
 
     // Set WiFi to station mode and disconnect from Access Point if it was previously connected
@@ -60,191 +160,265 @@ void setup()
     WiFi.macAddress(myMacAddress);
     Serial.printf("MAC ADDRESS: %02X:%02X:%02X:%02X:%02X:%02X\r\n", myMacAddress[0], myMacAddress[1], myMacAddress[2], myMacAddress[3], myMacAddress[4], myMacAddress[5]);
 
-    displayMyMacAddress();
+    static Display displayStatic(screenHeight, myMacAddress);
+    display = &displayStatic;
+#if defined(USE_SYNCHRONOUS_DISPLAY)
+    display->renderFrame();
+#else
+    display->begin();
+#endif
+
+    // Holding BtnB down while switching on initiates binding, and so the stored joystick and its calibration are not used.
+    // The button has been held since before the first update, so it is never seen as newly pressed: check its level instead.
+    internalBusMutex.lock();
+    M5.update();
+    internalBusMutex.unlock();
+    const bool bindingRequested = M5.BtnB.isPressed();
+
+    static ConfigStore configStoreStatic("RoverC");
+    configStore = &configStoreStatic;
+    config = ConfigStore::defaultConfig(JOYSTICK_CHANNEL, AtomJoyStickReceiver::DEFAULT_DEAD_ZONE);
+    const ConfigStore::load_result_t loadResult = configStore->load(config);
+    Serial.printf("CONFIG load:%d peer:%d channel:%d bias:%d\r\n", loadResult, config.isPeerSet, config.channel, config.isBiasSet);
+    if (bindingRequested) {
+        // the new joystick's sticks are calibrated afresh, and both are saved once it is bound
+        config.isPeerSet = false;
+        config.isBiasSet = false;
+    }
+    // a joystick MAC address compiled in takes precedence over the stored one
+    const uint8_t* const peerMacAddress = atomJoyStickMacAddress != nullptr ? atomJoyStickMacAddress : config.isPeerSet ? config.peerMacAddress : nullptr; // NOLINT(cppcoreguidelines-init-variables)
 
-    static AtomJoyStickReceiver atomJoyStickReceiverStatic(myMacAddress);
+    static AtomJoyStickReceiver atomJoyStickReceiverStatic(myMacAddress, makePacketCodec<receiver_codec_t>());
     atomJoyStickReceiver = &atomJoyStickReceiverStatic;
-    const esp_err_t err = atomJoyStickReceiver->init(JOYSTICK_CHANNEL, atomJoyStickMacAddress);// NOLINT(cppcoreguidelines-init-variables)
+    const esp_err_t err = atomJoyStickReceiver->init(config.channel, peerMacAddress);// NOLINT(cppcoreguidelines-init-variables)
     Serial.printf("ESP-NOW Ready:%X\r\n", err);
+    atomJoyStickReceiver->setDeadZones(config.deadZone);
+    if (config.isBiasSet) {
+        atomJoyStickReceiver->setBias(config.bias[ConfigStore::THROTTLE], config.bias[ConfigStore::ROLL], config.bias[ConfigStore::PITCH], config.bias[ConfigStore::YAW]);
+    }
+#if defined(USE_PACKET_CAPTURE)
+    atomJoyStickReceiver->getTransceiver().setPacketCapture(&packetCapture);
+#endif
+#if defined(USE_CHANNEL_SURVEY)
+    static ChannelManager channelManagerStatic(atomJoyStickReceiver->getTransceiver(), []() -> uint32_t { return millis(); });
+    channelManager = &channelManagerStatic;
+#endif
 
-    static RoverC roverStatic;
+    static I2C_Wire i2cBus(RoverC::SDA_PIN, RoverC::SCL_PIN);
+#if defined(USE_SYNCHRONOUS_I2C)
+    static RoverC roverStatic(i2cBus);
+#else
+    static I2C_AsyncQueue i2cQueueStatic(i2cBus, []() -> uint32_t { return micros(); });
+    i2cQueue = &i2cQueueStatic;
+    i2cQueue->begin();
+    static RoverC roverStatic(i2cQueueStatic);
+#endif
     rover = &roverStatic;
 
-    if (M5.BtnB.wasPressed()) {
-        // Holding BtnB down while switching on initiates binding.
-        atomJoyStickReceiver->broadcastMyMacAddressForBinding();
+    static MotionController motionControllerStatic(roverStatic, []() -> uint32_t { return micros(); });
+    motionController = &motionControllerStatic;
+#if defined(USE_YAW_RATE_CONTROL)
+    static IMU_MPU6886 imu(internalBusMutex);
+    if (imu.init()) {
+        static YawRateController yawRateControllerStatic(imu, []() -> uint32_t { return micros(); });
+        yawRateController = &yawRateControllerStatic;
+        motionController->setYawRateController(yawRateController);
+    } else {
+        Serial.printf("IMU not found, yaw rate control disabled\r\n");
+    }
+#endif
+    motionController->begin();
+
+    static FailsafeWatchdog failsafeWatchdogStatic([]() -> uint32_t { return millis(); });
+    failsafeWatchdog = &failsafeWatchdogStatic;
+
+    if (bindingRequested) {
+        atomJoyStickReceiver->startBinding();
     }
 }
 
 /*!
 Main program loop:
-1. Check if any buttons were pressed, and act accordingly
-2. Check if any packets have been received and if so send the control values to the Rover and update the screen with those values
-3. Implement a fail safe - if packets have not been received for a while, assume contact has been lost with the joystick and stop the Rover
+1. Check if any buttons were pressed, or statistics requested over the serial port, and act accordingly
+   Step the binding, if it is in progress, it never blocks so the failsafe and display keep running while binding
+2. Wait for a packet to be received, with a timeout so the buttons and the fail safe are still serviced
+3. If a packet has been received send the control values to the Rover and update the screen with those values
+4. Update the failsafe watchdog - if packets have not been received for a while, assume contact has been lost with the joystick and stop the Rover
 */
 void loop()
 {
 
+    // the power button is read from the AXP192, on the internal I2C bus
+    internalBusMutex.lock();
     M5.update(); // Read the keys and update speaker
+    internalBusMutex.unlock();
     updateButtons();
+    updateBinding();
+    updateChannel();
+    if (Serial.available() > 0) {
+        const int command = Serial.read();
+        if (command == 's') {
+            // statistics can also be requested by sending 's' over the serial port
+            printStatistics();
+#if defined(USE_PACKET_CAPTURE)
+        } else if (command == 'c') {
+            packetCapture.dump();
+#endif
+#if defined(USE_CHANNEL_SURVEY)
+        } else if (command == 'v') {
+            if (channelManager->startSurvey(surveyChannels, sizeof(surveyChannels))) {
+                Serial.printf("CHANNEL survey started on channel %d\r\n", channelManager->getHomeChannel());
+            }
+#endif
+        }
+    }
+
+#if !defined(USE_PACKET_POLLING)
+    // sleep until the receive callback signals that a packet has arrived
+    atomJoyStickReceiver->waitForPacket(PACKET_WAIT_TIMEOUT_MS);
+#endif
 
-    static uint32_t failSafeCount {0};
-    ++failSafeCount;
     if (updateReceiver()) {
-        failSafeCount = 0;
-    } else if (failSafeCount > 50) {
-        // we've been around this loop 50 times without a packet, so we seemed to have lost contact with the receiver, so stop the rover.
-        rover->stop();
-        failSafeCount = 0;
+        failsafeWatchdog->feed();
+    } else {
+        updateFailsafe();
     }
+    // send any telemetry or handshake frames held back by the send window
+    atomJoyStickReceiver->getTransceiver().processSendQueue();
 
+#if defined(USE_PACKET_POLLING)
     delayMicroseconds(20);
+#endif
 }
 
 /*!
-Handle any button presses - BtnB initiates pairing.
+No packet has been received, so check how long it is since the last one and respond accordingly:
+hold the last command while the packets are only jittered, then extrapolate it and decay it to zero,
+ramp the speed down, and finally stop the Rover.
+*/
+static void updateFailsafe()
+{
+    const FailsafeWatchdog::stage_t stage = failsafeWatchdog->update();
+    if (stage == FailsafeWatchdog::STOPPED) {
+        // the motors are stopped at once, rather than slew limited, and the shadow registers suppress the repeated writes,
+        // so it is cheap to request the stop every time round the loop
+        motionController->stop();
+        return;
+    }
+#if defined(USE_HOLD_ON_PACKET_LOSS)
+    if (stage == FailsafeWatchdog::ACTIVE) {
+        return;
+    }
+#else
+    // until the packet is late the motion controller holds the last setpoint, and a setpoint published now
+    // would only shorten the interval it interpolates the next packet's setpoint over
+    if (stage == FailsafeWatchdog::ACTIVE && !setpointPredictor.isLate(micros())) {
+        return;
+    }
+#endif
+    MotionController::setpoint_t setpoint = lastSetpoint;
+    // the setpoint is not from a new packet, so is not counted in the packet to motor latency
+    setpoint.receiveTimeUs = 0;
+#if !defined(USE_HOLD_ON_PACKET_LOSS)
+    SetpointPredictor::values_t predicted; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+    if (setpointPredictor.predict(micros(), predicted)) {
+        setpoint.throttle = predicted.value[SetpointPredictor::THROTTLE];
+        setpoint.roll = predicted.value[SetpointPredictor::ROLL];
+        setpoint.pitch = predicted.value[SetpointPredictor::PITCH];
+        setpoint.yaw = predicted.value[SetpointPredictor::YAW];
+    }
+#endif
+    // the watchdog's ramp down remains as a backstop, in case the predictor is tuned with a long horizon
+    setpoint.speedScale = failsafeWatchdog->getSpeedScale();
+    motionController->setSetpoint(setpoint);
+}
+
+/*!
+Handle any button presses - BtnA prints the statistics, BtnB re-broadcasts the binding message.
 */
 static void updateButtons()
 {
     //M5Stick C/CPlus: BtnA, BtnB, BtnPWR
-    static const int posX = (screenHeight == SCREEN_HEIGHT_M5_STICK_C) ? 70 : 120;
-    static const int posY = (screenHeight == SCREEN_HEIGHT_M5_STICK_C) ? 115 : 200;
-
     if (M5.BtnA.wasPressed()) {
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.print('A');
+        display->setButton('A');
     } else if (M5.BtnA.wasReleased()) {
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.printf("  ");
+        printStatistics();
+        display->setButton(' ');
     }
     if (M5.BtnB.wasPressed()) {
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.print('B');
+        display->setButton('B');
     } else if (M5.BtnB.wasReleased()) {
-        // B button initiates binding
-        atomJoyStickReceiver->broadcastMyMacAddressForBinding();
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.printf("  ");
+        // B button re-broadcasts the binding message, for a paired joystick that has restarted and lost the rover.
+        // Once a peer is set packets from any other joystick are not accepted, so binding to a different joystick
+        // needs BtnB held at switch on.
+        atomJoyStickReceiver->startBinding();
+        display->setButton(' ');
     }
     if (M5.BtnPWR.wasPressed()) {
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.print('P');
+        display->setButton('P');
     } else if (M5.BtnPWR.wasReleased()) {
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.printf("  ");
+        display->setButton(' ');
     } else if (M5.BtnPWR.wasDoubleClicked()) {
         // double click of BtnB switches off
-        M5.Lcd.setCursor(posX, posY);
-        M5.Lcd.print('P');
+        display->setButton('P');
+        internalBusMutex.lock();
         M5.Power.powerOff();
+        internalBusMutex.unlock();
     }
 }
 
 /*!
-Utility function to display the Rover's MAC address on the screen.
+Step the binding, if it is in progress, and report the outcome when it completes.
 */
-static void displayMyMacAddress()
+static void updateBinding()
 {
-    constexpr int xPos {5};
-    constexpr int yOffset {5};
-    const int yInc = screenHeight == SCREEN_HEIGHT_M5_STICK_C ? 10 : 20;
-
-    M5.Lcd.setCursor(xPos, yOffset);
-    M5.Lcd.printf("R:%02X:%02X:%02X", myMacAddress[0], myMacAddress[1], myMacAddress[2]);
-    M5.Lcd.setCursor(xPos, yInc + yOffset);
-    M5.Lcd.printf("  %02X:%02X:%02X", myMacAddress[3], myMacAddress[4], myMacAddress[5]);
-}
-
-/*!
-Utility function to display the joystick's MAC address on the screen.
-*/
-static void displayJoyStickMacAddress(const uint8_t *tma)
-{
-    constexpr int xPos {5};
-    constexpr int yOffset {5};
-    const int yInc = screenHeight == SCREEN_HEIGHT_M5_STICK_C ? 10 : 20;
-
-    M5.Lcd.setCursor(xPos, 2 * yInc + yOffset);
-    M5.Lcd.printf("J:%02X:%02X:%02X", tma[0], tma[1], tma[2]);
-    M5.Lcd.setCursor(xPos, 3* yInc + yOffset);
-    M5.Lcd.printf("  %02X:%02X:%02X", tma[3], tma[4], tma[5]);
-}
-
-/*!
-Update the screen for an M5StickC sized screen.
-*/
-static void updateScreen80x160(float throttle, float roll, float pitch, float yaw)
-{
-    constexpr int xPos {5};
-    int yPos {60};
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("T:%6.3f", throttle);
-    yPos += 10;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("R:%6.3f", roll);
-    yPos += 10;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("P:%6.3f", pitch);
-    yPos += 10;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("Y:%6.3f", yaw);
-    yPos += 10;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("M%d A%d F%d", atomJoyStickReceiver->getMode(), atomJoyStickReceiver->getAltMode(), atomJoyStickReceiver->getFlipButton());
-
-    yPos += 25;
-    M5.Lcd.setCursor(0, yPos);
-    M5.Lcd.printf("S%4.0f", rover->getSpeed());
-    M5.Lcd.setCursor(40, yPos);
-    M5.Lcd.printf("A%4.0f", rover->getAngle());
-}
-
-/*!
-Update the screen for an M5StickC PLUS sized screen.
-*/
-static void updateScreen135x240(float throttle, float roll, float pitch, float yaw)
-{
-    constexpr int xPos {5};
-    int yPos {95};
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("T:%6.3f", throttle);
-    yPos += 20;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("R:%6.3f", roll);
-    yPos += 20;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("P:%6.3f", pitch);
-    yPos += 20;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("Y:%6.3f", yaw);
-    yPos += 20;
-    M5.Lcd.setCursor(xPos, yPos);
-    M5.Lcd.printf("M%d A%d F%d", atomJoyStickReceiver->getMode(), atomJoyStickReceiver->getAltMode(), atomJoyStickReceiver->getFlipButton());
-
-    yPos += 50;
-    M5.Lcd.setCursor(0, yPos);
-    M5.Lcd.printf("S%4.0f", rover->getSpeed());
-    M5.Lcd.setCursor(68, yPos);
-    M5.Lcd.printf("A%4.0f", rover->getAngle());
+    if (!atomJoyStickReceiver->getBinding().isBinding()) {
+        return;
+    }
+    const BindingStateMachine::state_t state = atomJoyStickReceiver->updateBinding();
+    if (state == BindingStateMachine::BOUND) {
+        Serial.printf("BINDING bound in %ums\r\n", atomJoyStickReceiver->getBinding().getStatistics().timeToBindMs);
+    } else if (state == BindingStateMachine::TIMED_OUT) {
+        Serial.printf("BINDING timed out\r\n");
+    } else if (state == BindingStateMachine::FAILED) {
+        Serial.printf("BINDING failed\r\n");
+    }
 }
 
 /*!
-Update the screen displaying values received from the joystick, and the Rover's speed and angle.
+Step the channel survey, if it is in progress. When it completes print the scores, and if the channel has changed save it,
+so the rover starts on the new channel after a power cycle.
 */
-static void updateScreen(float throttle, float roll, float pitch, float yaw)
+static void updateChannel()
 {
-    if (screenHeight == SCREEN_HEIGHT_M5_STICK_C) {
-        updateScreen80x160(throttle, roll, pitch, yaw);
-    } else {
-        updateScreen135x240(throttle, roll, pitch, yaw);
+#if defined(USE_CHANNEL_SURVEY)
+    if (!channelManager->isBusy()) {
+        return;
+    }
+    const ChannelManager::state_t state = channelManager->update();
+    if (channelManager->isBusy()) {
+        return;
+    }
+    for (int ii = 0; ii < channelManager->getCandidateCount(); ++ii) {
+        const ChannelManager::channel_score_t& score = channelManager->getScore(ii);
+        Serial.printf("CHANNEL %2d packets:%u jitter:%uus score:%.2f\r\n", score.channel, score.packetCount, score.jitterUs, static_cast<double>(score.score));
+    }
+    const uint8_t channel = atomJoyStickReceiver->getTransceiver().getChannel();
+    Serial.printf("CHANNEL survey %s, channel %d\r\n", state == ChannelManager::SWITCHED ? "switched" : state == ChannelManager::FAILED ? "failed" : "kept", channel);
+    if (state == ChannelManager::SWITCHED) {
+        config.channel = channel;
+        if (!configStore->save(config)) {
+            Serial.printf("CONFIG save failed\r\n");
+        }
     }
+#endif
 }
 
 /*!
 If a packet has been received from the joystick then
 1. Unpack it
 2. Send the stick values to the rover move command
-3. Update the screen with the stick values
+3. Publish the stick values and the Rover's speed and angle to the display
 
 Additionally, if the joystick MAC address has not been displayed yet, display it.
 
@@ -259,7 +433,7 @@ static bool updateReceiver()
         if (atomJoyStickReceiver->isPrimaryPeerMacAddressSet()) {
             joystickAddressDisplayed = true;
             const uint8_t * const tma = atomJoyStickReceiver->getPrimaryPeerMacAddress();// NOLINT(cppcoreguidelines-init-variables)
-            displayJoyStickMacAddress(tma);
+            display->setJoyStickMacAddress(tma);
             Serial.printf("TRANSMIT MAC ADDRESS: %02X:%02X:%02X:%02X:%02X:%02X\r\n", tma[0], tma[1], tma[2], tma[3], tma[4], tma[5]);
         }
     }
@@ -267,20 +441,39 @@ static bool updateReceiver()
     if (!atomJoyStickReceiver->isPacketEmpty()) {
         ++packetCount;
         if (atomJoyStickReceiver->unpackPacket()) {
-            if (packetCount == 5) {
-                // set the JoyStick bias so that the current readings are zero.
+            if (packetCount == 5 && !config.isBiasSet) {
+                // set the JoyStick bias so that the current readings are zero, unless it was restored from the config store
                 atomJoyStickReceiver->setCurrentReadingsToBias();
             }
+            updateConfig();
             const float throttle = atomJoyStickReceiver->getThrottle();
             const float roll = atomJoyStickReceiver->getRoll();
             const float pitch = atomJoyStickReceiver->getPitch();
             const float yaw = atomJoyStickReceiver->getYaw();
             const RoverC::control_mode_t controlMode = atomJoyStickReceiver->getMode() == AtomJoyStickReceiver::MODE_STABLE ? RoverC::MECANUM_MODE : RoverC::TANK_MODE;
 
-            rover->move(throttle, roll, pitch, yaw, controlMode);
-
-            updateScreen(throttle, roll, pitch, yaw);
+            if (controlMode != lastSetpoint.controlMode) {
+                // the sticks now have a different meaning, so the trend is no longer valid
+                setpointPredictor.reset();
+            }
+            setpointPredictor.addSample(atomJoyStickReceiver->getPacketTimeUs(), SetpointPredictor::values_t {{ throttle, roll, pitch, yaw }});
+            // the motion controller records the latency from the packet's receive time to the motor write
+            lastSetpoint = { throttle, roll, pitch, yaw, 1.0F, controlMode, atomJoyStickReceiver->getPacketTimeUs() };
+            motionController->setSetpoint(lastSetpoint);
+
+            const uint32_t displayStartUs = micros();
+            const Display::controls_t controls {
+                .throttle = throttle, .roll = roll, .pitch = pitch, .yaw = yaw,
+                .speed = rover->getSpeed(), .angle = rover->getAngle(),
+                .mode = atomJoyStickReceiver->getMode(), .altMode = atomJoyStickReceiver->getAltMode(), .flipButton = atomJoyStickReceiver->getFlipButton()
+            };
+            display->setControls(controls);
+#if defined(USE_SYNCHRONOUS_DISPLAY)
+            display->renderFrame();
+#endif
+            displayBlockedMaxUs = std::max(displayBlockedMaxUs, micros() - displayStartUs);
 
+            sendTelemetry();
             return true;
         }
         Serial.printf("updateReceiver Bad packet\r\n");
@@ -288,3 +481,154 @@ static bool updateReceiver()
     return false;
 }
 
+/*!
+Save the pairing and the stick bias once they are known, so that after a power cycle the rover reconnects without a binding round.
+
+The config store only writes when the configuration has changed, so in normal running this does no flash writes.
+*/
+static void updateConfig()
+{
+    bool changed = false;
+    if (atomJoyStickReceiver->isPrimaryPeerMacAddressSet()
+        && (!config.isPeerSet || memcmp(config.peerMacAddress, atomJoyStickReceiver->getPrimaryPeerMacAddress(), ConfigStore::MAC_ADDRESS_LENGTH) != 0)) {
+        memcpy(config.peerMacAddress, atomJoyStickReceiver->getPrimaryPeerMacAddress(), ConfigStore::MAC_ADDRESS_LENGTH);
+        config.isPeerSet = true;
+        changed = true;
+    }
+    if (atomJoyStickReceiver->isBiasSet() && !config.isBiasSet) {
+        config.bias[ConfigStore::THROTTLE] = atomJoyStickReceiver->getThrottleBias();
+        config.bias[ConfigStore::ROLL] = atomJoyStickReceiver->getRollBias();
+        config.bias[ConfigStore::PITCH] = atomJoyStickReceiver->getPitchBias();
+        config.bias[ConfigStore::YAW] = atomJoyStickReceiver->getYawBias();
+        config.isBiasSet = true;
+        changed = true;
+    }
+    if (changed && !configStore->save(config)) {
+        Serial.printf("CONFIG save failed\r\n");
+    }
+}
+
+/*!
+Send telemetry to the joystick, if it is due.
+
+This is called just after a command packet has been handled, so the send never delays the handling of a command,
+and the joystick, which has just transmitted, is listening.
+*/
+static void sendTelemetry()
+{
+    if (TELEMETRY_INTERVAL_MS == 0 || !atomJoyStickReceiver->isPrimaryPeerMacAddressSet() || !telemetryEncoder.isDue(millis())) {
+        return;
+    }
+    const LinkStatistics& link = atomJoyStickReceiver->getLinkStatistics();
+    Telemetry::values_t values; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+    values.value[Telemetry::FIELD_SPEED] = static_cast<int32_t>(rover->getSpeed());
+    values.value[Telemetry::FIELD_ANGLE] = static_cast<int32_t>(rover->getAngle());
+    for (int ii = 0; ii < RoverC::MOTOR_COUNT; ++ii) {
+        values.value[Telemetry::FIELD_MOTOR_1 + ii] = rover->getMotorSpeed(ii);
+    }
+    // the battery voltage is quantized to 10mV, so that noise does not defeat the delta encoding
+    internalBusMutex.lock();
+    values.value[Telemetry::FIELD_BATTERY_MILLIVOLTS] = M5.Power.getBatteryVoltage() / 10 * 10;
+    values.value[Telemetry::FIELD_BATTERY_LEVEL] = M5.Power.getBatteryLevel();
+    internalBusMutex.unlock();
+    values.value[Telemetry::FIELD_PACKETS_PER_SECOND] = static_cast<int32_t>(link.getPacketsPerSecond());
+    values.value[Telemetry::FIELD_GAP_COUNT] = static_cast<int32_t>(link.getGapCount());
+    values.value[Telemetry::FIELD_LONGEST_GAP_MS] = static_cast<int32_t>(link.getLongestGapUs() / 1000);
+    values.value[Telemetry::FIELD_CHECKSUM_FAILURE_COUNT] = static_cast<int32_t>(link.getChecksumFailureCount());
+    values.value[Telemetry::FIELD_FAILSAFE_STOP_COUNT] = static_cast<int32_t>(failsafeWatchdog->getStopCount());
+    values.value[Telemetry::FIELD_WRONG_MAC_ADDRESS_COUNT] = static_cast<int32_t>(link.getWrongMacAddressCount());
+    values.value[Telemetry::FIELD_WRONG_LENGTH_COUNT] = static_cast<int32_t>(link.getWrongLengthCount());
+
+    // if a frame was lost then the joystick will wait for the next keyframe, so send one now
+    static uint32_t lostCountPrevious {0};
+    const SendQueue::peer_statistics_t& sendStatistics = atomJoyStickReceiver->getTransceiver().getSendQueue().getPeerStatistics(ESPNOW_Transceiver::PRIMARY_PEER);
+    if (sendStatistics.lostCount != lostCountPrevious) {
+        lostCountPrevious = sendStatistics.lostCount;
+        telemetryEncoder.requestKeyframe();
+    }
+
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    const int len = telemetryEncoder.encode(values, frame, millis());
+    // telemetry is superseded by the next frame, so it is not retried, and control frames take priority over it
+    if (atomJoyStickReceiver->sendData(frame, static_cast<uint16_t>(len), SendQueue::PRIORITY_TELEMETRY, 0) != ESP_OK) {
+        telemetryEncoder.requestKeyframe();
+    }
+}
+
+/*!
+Print the link, packet latency, I2C bus, motion control, failsafe, and display statistics to the serial port, and reset the latency and motion statistics.
+*/
+static void printStatistics()
+{
+    atomJoyStickReceiver->getLinkStatistics().print();
+    atomJoyStickReceiver->getReceiveFilter().print();
+    const PacketRingBase& receivedPackets = atomJoyStickReceiver->getReceivedPackets();
+    Serial.printf("RING overwrites:%u skipped:%u tears:%u\r\n", receivedPackets.getOverwriteCount(), receivedPackets.getSkipCount(), receivedPackets.getTearCount());
+
+#if defined(USE_PACKET_POLLING)
+    Serial.printf("LATENCY(polling) ");
+#else
+    Serial.printf("LATENCY(event) ");
+#endif
+    // from the ESP-NOW receive callback to the motor write, the motion statistics are reset below
+    const MotionController::statistics_t& motion = motionController->getStatistics();
+    if (motion.latencyCount > 0) {
+        Serial.printf("n:%u min:%uus mean:%uus max:%uus\r\n", motion.latencyCount, motion.latencyMinUs,
+            static_cast<uint32_t>(motion.latencySumUs / motion.latencyCount), motion.latencyMaxUs);
+    } else {
+        Serial.printf("no packets\r\n");
+    }
+
+    const RoverC::bus_statistics_t& bus = rover->getBusStatistics();
+    const RoverC::write_statistics_t& writes = rover->getWriteStatistics();
+    Serial.printf("ROVERC I2C requests:%u bytes:%u registers written:%u suppressed:%u refreshes:%u\r\n",
+        bus.requestCount, bus.requestByteCount, writes.registerWriteCount, writes.registerSuppressedCount, writes.refreshCount);
+#if !defined(USE_SYNCHRONOUS_I2C)
+    const I2C_AsyncQueue::statistics_t& queue = i2cQueue->getStatistics();
+    Serial.printf("I2C QUEUE posted:%u coalesced:%u overflows:%u depth:%u max:%u transactions:%u errors:%u retries:%u failed:%u blocked max:%uus\r\n",
+        queue.postCount, queue.coalescedCount, queue.overflowCount, i2cQueue->getDepth(), queue.depthMax,
+        queue.transactionCount, queue.errorCount, queue.retryCount, queue.failedCount, queue.blockedMaxUs);
+    if (queue.latencyCount > 0) {
+        Serial.printf("I2C LATENCY n:%u mean:%uus max:%uus\r\n",
+            queue.latencyCount, static_cast<uint32_t>(queue.latencySumUs / queue.latencyCount), queue.latencyMaxUs);
+    }
+    i2cQueue->resetStatistics();
+#endif
+    if (motion.periodCount > 0) {
+        Serial.printf("MOTION updates:%u setpoints:%u period min:%uus max:%uus jitter mean:%uus max:%uus update max:%uus overruns:%u slew limited:%u\r\n",
+            motion.updateCount, motion.setpointCount, motion.periodMinUs, motion.periodMaxUs,
+            static_cast<uint32_t>(motion.jitterSumUs / motion.periodCount), motion.jitterMaxUs, motion.updateTimeMaxUs, motion.overrunCount, motion.slewLimitedCount);
+    }
+    motionController->resetStatistics();
+#if defined(USE_YAW_RATE_CONTROL)
+    if (yawRateController != nullptr) {
+        const YawRateController::statistics_t& yaw = yawRateController->getStatistics();
+        Serial.printf("YAW rate:%.1fdps bias:%.2fdps updates:%u samples:%u empty:%u cycle:%uus max:%uus over budget:%u\r\n",
+            static_cast<double>(yawRateController->getYawRateDPS()), static_cast<double>(yawRateController->getGyroBiasDPS()),
+            yaw.updateCount, yaw.sampleCount, yaw.emptyBatchCount, yaw.cycleTimeUs, yaw.cycleTimeMaxUs, yaw.overBudgetCount);
+        yawRateController->resetStatistics();
+    }
+#endif
+    const SendQueue& sendQueue = atomJoyStickReceiver->getTransceiver().getSendQueue();
+    const SendQueue::peer_statistics_t& send = sendQueue.getPeerStatistics(ESPNOW_Transceiver::PRIMARY_PEER);
+    Serial.printf("SEND queued:%u sent:%u delivered:%u failed:%u retries:%u expired:%u dropped:%u lost:%u late:%u in flight max:%u no mem:%u unmatched:%u\r\n",
+        send.queuedCount, send.sentCount, send.deliveredCount, send.failedCount, send.retryCount, send.expiredCount, send.droppedCount,
+        send.lostCount, send.lateCount, send.inFlightMax, sendQueue.getNoMemCount(), sendQueue.getUnmatchedCount());
+    if (send.latencyCount > 0) {
+        Serial.printf("SEND LATENCY n:%u mean:%uus max:%uus\r\n",
+            send.latencyCount, static_cast<uint32_t>(send.latencySumUs / send.latencyCount), send.latencyMaxUs);
+    }
+    Serial.printf("FAILSAFE stops:%u\r\n", failsafeWatchdog->getStopCount());
+    Serial.printf("CONFIG writes:%u\r\n", configStore->getWriteCount());
+    const BindingStateMachine::statistics_t& binding = atomJoyStickReceiver->getBinding().getStatistics();
+    Serial.printf("BINDING starts:%u bound:%u timed out:%u failed:%u broadcasts:%u time to bind:%ums max:%ums\r\n",
+        binding.startCount, binding.boundCount, binding.timedOutCount, binding.failedCount, binding.broadcastCount, binding.timeToBindMs, binding.timeToBindMaxMs);
+    const TelemetryEncoder::statistics_t& telemetry = telemetryEncoder.getStatistics();
+    Serial.printf("TELEMETRY frames:%u keyframes:%u bytes:%u bytes/s:%u\r\n",
+        telemetry.frameCount, telemetry.keyframeCount, telemetry.byteCount, telemetry.bytesPerSecond);
+
+    const Display::statistics_t& displayStatistics = display->getStatistics();
+    Serial.printf("DISPLAY frames:%u fields:%u render:%uus max:%uus control loop blocked max:%uus\r\n",
+        displayStatistics.frameCount, displayStatistics.fieldsDrawnCount, displayStatistics.renderTimeUs, displayStatistics.renderTimeMaxUs, displayBlockedMaxUs);
+    displayBlockedMaxUs = 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <HardwareSerial.h>
+#include <esp32-hal.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Fake of the Arduino core, for the native build.
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <esp32-hal.h>
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+
+/*!
+Fake of the serial port, for the native build.
+
+Output is collected, rather than printed, so that tests can check it; set `echo` to also print it.
+Input is queued by the test with `pushInput()`.
+*/
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        append(buffer);
+        return len;
+    }
+    size_t print(const char* text) { append(text); return std::char_traits<char>::length(text); }
+    size_t write(const uint8_t* data, size_t len) { _output.append(reinterpret_cast<const char*>(data), len); return len; } // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    int available(void) const { return static_cast<int>(_input.size()); }
+    int read(void) {
+        if (_input.empty()) {
+            return -1;
+        }
+        const int value = static_cast<unsigned char>(_input.front());
+        _input.pop_front();
+        return value;
+    }
+public:
+    // test functions
+    void pushInput(const char* text) { for (; *text != 0; ++text) { _input.push_back(*text); } }
+    const std::string& getOutput(void) const { return _output; }
+    void clearOutput(void) { _output.clear(); }
+    bool echo {false};
+private:
+    void append(const char* text) {
+        _output += text;
+        if (echo) {
+            fputs(text, stdout);
+        }
+    }
+private:
+    std::string _output;
+    std::deque<char> _input;
+};
+
+inline HardwareSerial Serial;
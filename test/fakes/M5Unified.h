@@ -0,0 +1,233 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#define TFT_BLACK 0x0000U
+#define TFT_WHITE 0xFFFFU
+
+
+/*!
+Fake of the M5GFX display, for the native build.
+
+Nothing is drawn. Instead the pixels written to the panel are counted, so the cost of a frame can be estimated from the SPI clock.
+*/
+class M5GFX {
+public:
+    M5GFX(void) = default;
+    M5GFX(int panelWidth, int panelHeight) : _panelWidth(panelWidth), _panelHeight(panelHeight) {}
+    void setRotation(uint8_t rotation) { _rotation = rotation; }
+    int width(void) const { return (_rotation & 1U) != 0 ? _panelHeight : _panelWidth; }
+    int height(void) const { return (_rotation & 1U) != 0 ? _panelWidth : _panelHeight; }
+    void setTextSize(float size) { _textSize = size; }
+    void setTextColor(uint32_t foreground, uint32_t background) { (void)foreground; (void)background; }
+    void setColorDepth(int bits) { _colorDepth = bits; }
+    void setCursor(int32_t x, int32_t y) { _cursorX = x; _cursorY = y; }
+    void startWrite(void) { ++_writeDepth; }
+    void endWrite(void) { --_writeDepth; }
+    void setClipRect(int32_t x, int32_t y, int32_t w, int32_t h) { _clipX = x; _clipY = y; _clipWidth = w; _clipHeight = h; _clipped = true; }
+    void clearClipRect(void) { _clipped = false; }
+    void fillScreen(uint32_t color) { fillRect(0, 0, width(), height(), color); }
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+        (void)color;
+        if (x < 0 || y < 0 || x + w > width() || y + h > height()) {
+            ++outOfBoundsCount;
+        }
+        pixelCount += static_cast<uint64_t>(w) * static_cast<uint64_t>(h);
+    }
+    size_t print(const char* text) {
+        size_t len = 0;
+        for (; text[len] != 0; ++len) {}
+        // glyphs are 6x8 pixels at text size 1
+        const auto glyphWidth = static_cast<int32_t>(6.0F * _textSize);
+        const auto glyphHeight = static_cast<int32_t>(8.0F * _textSize);
+        if (_cursorX + static_cast<int32_t>(len) * glyphWidth > width() || _cursorY + glyphHeight > height()) {
+            ++outOfBoundsCount;
+        }
+        pixelCount += static_cast<uint64_t>(len) * static_cast<uint64_t>(glyphWidth) * static_cast<uint64_t>(glyphHeight);
+        _cursorX += static_cast<int32_t>(len) * glyphWidth;
+        return len;
+    }
+    size_t print(char c) { const char text[2] { c, 0 }; return print(text); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char text[64];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        return print(text);
+    }
+public:
+    // test functions
+    void setPanelSize(int panelWidth, int panelHeight) { _panelWidth = panelWidth; _panelHeight = panelHeight; }
+    int getWriteDepth(void) const { return _writeDepth; }
+    uint64_t pixelCount {0}; //!< pixels written, for a sprite pixels drawn into it and for the panel pixels sent over SPI
+    uint32_t outOfBoundsCount {0}; //!< draws that extended beyond the edge of the screen
+    bool isClipped(void) const { return _clipped; }
+    int32_t getClipArea(void) const { return _clipWidth * _clipHeight; }
+private:
+    bool _clipped {false};
+    int _panelWidth {80};
+    int _panelHeight {160};
+    uint8_t _rotation {0};
+    float _textSize {1.0F};
+    int _colorDepth {16};
+    int _writeDepth {0};
+    int32_t _cursorX {0};
+    int32_t _cursorY {0};
+    int32_t _clipX {0};
+    int32_t _clipY {0};
+    int32_t _clipWidth {0};
+    int32_t _clipHeight {0};
+};
+
+/*!
+Fake of an off-screen sprite. Pushing it counts the pixels sent to the parent, limited to the parent's clip rectangle.
+*/
+class M5Canvas : public M5GFX {
+public:
+    explicit M5Canvas(M5GFX* parent) : _parent(parent) {}
+    void* createSprite(int32_t w, int32_t h) {
+        if (failCreateSprite) {
+            return nullptr;
+        }
+        setPanelSize(w, h);
+        _spriteArea = w * h;
+        return this;
+    }
+    void deleteSprite(void) { _spriteArea = 0; }
+    void pushSprite(int32_t x, int32_t y) {
+        (void)x;
+        (void)y;
+        _parent->pixelCount += static_cast<uint64_t>(_parent->isClipped() ? _parent->getClipArea() : _spriteArea);
+    }
+    static inline bool failCreateSprite {false};
+private:
+    M5GFX* _parent;
+    int32_t _spriteArea {0};
+};
+
+/*!
+Fake of a button. The test sets the button state, and `M5.update()` works out the edges, as M5Unified does.
+*/
+class Button_Class {
+public:
+    bool isPressed(void) const { return _pressed; }
+    bool wasPressed(void) const { return _wasPressed; }
+    bool wasReleased(void) const { return _wasReleased; }
+    bool wasDoubleClicked(void) const { return false; }
+    void update(void) {
+        _wasPressed = _pressed && !_previous;
+        _wasReleased = !_pressed && _previous;
+        _previous = _pressed;
+    }
+public:
+    // test functions
+    void setPressed(bool pressed) { _pressed = pressed; }
+private:
+    bool _pressed {false};
+    bool _previous {false};
+    bool _wasPressed {false};
+    bool _wasReleased {false};
+};
+
+/*!
+Fake of the AXP192 power management, which is on the internal I2C bus.
+*/
+class Power_Class {
+public:
+    bool begin(void) { return true; }
+    void setChargeCurrent(uint16_t milliAmps) { (void)milliAmps; }
+    void powerOff(void) { ++powerOffCount; }
+    int16_t getBatteryVoltage(void) const { return batteryMilliVolts; }
+    int32_t getBatteryLevel(void) const { return batteryLevel; }
+public:
+    // test values
+    int16_t batteryMilliVolts {4012};
+    int32_t batteryLevel {80};
+    uint32_t powerOffCount {0};
+};
+
+/*!
+Fake of the internal I2C bus, on which the MPU6886 and the AXP192 sit.
+
+Register reads are passed to `readHandler`, if it is set, so that a test can simulate a device; writes are counted.
+Each transaction holds the bus for `busyUs` of real time, and transactions from different threads that overlap are counted,
+so that a test can check that the bus is serialized.
+*/
+class I2C_Class {
+public:
+    typedef bool (*read_handler_t)(uint8_t address, uint8_t reg, uint8_t* data, size_t len);
+public:
+    bool readRegister(uint8_t address, uint8_t reg, uint8_t* data, size_t len, uint32_t frequency) {
+        (void)frequency;
+        beginTransaction();
+        ++readCount;
+        const bool ok = readHandler != nullptr && readHandler(address, reg, data, len);
+        endTransaction();
+        return ok;
+    }
+    bool writeRegister8(uint8_t address, uint8_t reg, uint8_t value, uint32_t frequency) {
+        return writeRegister(address, reg, &value, 1, frequency);
+    }
+    bool writeRegister(uint8_t address, uint8_t reg, const uint8_t* data, size_t len, uint32_t frequency) {
+        (void)address;
+        (void)reg;
+        (void)data;
+        (void)len;
+        (void)frequency;
+        beginTransaction();
+        ++writeCount;
+        endTransaction();
+        return writeResult;
+    }
+public:
+    // test values
+    read_handler_t readHandler {nullptr};
+    bool writeResult {true};
+    std::atomic<uint32_t> readCount {0};
+    std::atomic<uint32_t> writeCount {0};
+    uint32_t busyUs {0};
+    std::atomic<uint32_t> overlapCount {0};
+private:
+    void beginTransaction(void) {
+        if (_activeCount.fetch_add(1) != 0) {
+            ++overlapCount;
+        }
+        if (busyUs > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(busyUs));
+        }
+    }
+    void endTransaction(void) { _activeCount.fetch_sub(1); }
+    std::atomic<int> _activeCount {0};
+};
+
+/*!
+Fake of the M5Unified singleton, for the native build.
+*/
+class M5Unified {
+public:
+    void begin(void) {}
+    void update(void) {
+        BtnA.update();
+        BtnB.update();
+        BtnPWR.update();
+    }
+public:
+    M5GFX Lcd {80, 160}; // M5StickC panel, in portrait orientation
+    M5GFX& Display {Lcd};
+    Button_Class BtnA;
+    Button_Class BtnB;
+    Button_Class BtnPWR;
+    Power_Class Power;
+    I2C_Class In_I2C;
+};
+
+inline M5Unified M5;
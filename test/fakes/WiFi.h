@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <cstring>
+
+enum wifi_mode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+
+/*!
+Fake of the Arduino WiFi class, for the native build. The MAC address is set by the test.
+*/
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t mode) { _mode = mode; return true; }
+    bool disconnect(void) { return true; }
+    uint8_t* macAddress(uint8_t* macAddress) const { memcpy(macAddress, _macAddress, sizeof(_macAddress)); return macAddress; }
+public:
+    // test functions
+    void setMacAddress(const uint8_t* macAddress) { memcpy(_macAddress, macAddress, sizeof(_macAddress)); }
+    wifi_mode_t getMode(void) const { return _mode; }
+private:
+    wifi_mode_t _mode {WIFI_OFF};
+    uint8_t _macAddress[6] {0x24, 0x0A, 0xC4, 0x00, 0x01, 0x02};
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*!
+Fake of the Arduino Wire library, for the native build, which records each transaction rather than driving a bus.
+*/
+class TwoWire {
+public:
+    struct transaction_t {
+        uint8_t address;
+        std::vector<uint8_t> data; //!< the bytes written, starting with the register
+    };
+public:
+    bool begin(int sdaPin, int sclPin, uint32_t frequency=0) { _sdaPin = sdaPin; _sclPin = sclPin; (void)frequency; return true; }
+    void beginTransmission(uint8_t address) { _current = transaction_t { address, {} }; }
+    size_t write(uint8_t value) { _current.data.push_back(value); return 1; }
+    size_t write(const uint8_t* data, size_t len) { _current.data.insert(_current.data.end(), data, data + len); return len; }
+    uint8_t endTransmission(bool sendStop=true) {
+        (void)sendStop;
+        transactions.push_back(_current);
+        return endTransmissionResult;
+    }
+public:
+    // test functions
+    void reset(void) { transactions.clear(); endTransmissionResult = 0; }
+    std::vector<transaction_t> transactions;
+    uint8_t endTransmissionResult {0}; //!< zero for success, otherwise the Arduino error code
+    int getSdaPin(void) const { return _sdaPin; }
+    int getSclPin(void) const { return _sclPin; }
+private:
+    transaction_t _current {};
+    int _sdaPin {-1};
+    int _sclPin {-1};
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+/*!
+Fake of the ESP32 Arduino timing functions, for the native build. On the device these are declared in esp32-hal.h,
+which is included by both Arduino.h and HardwareSerial.h.
+
+Time is simulated: it only moves when a test advances it, or when `delay()` is called, so that tests are deterministic.
+*/
+namespace FakeClock {
+inline std::atomic<uint64_t> timeUs {0};
+inline void setUs(uint64_t us) { timeUs = us; }
+inline void advanceUs(uint64_t us) { timeUs += us; }
+inline void advanceMs(uint64_t ms) { timeUs += ms * 1000; }
+} // namespace FakeClock
+
+inline uint32_t micros(void) { return static_cast<uint32_t>(FakeClock::timeUs); }
+inline uint32_t millis(void) { return static_cast<uint32_t>(FakeClock::timeUs / 1000); }
+inline void delay(uint32_t ms) { FakeClock::advanceMs(ms); }
+inline void delayMicroseconds(uint32_t us) { FakeClock::advanceUs(us); }
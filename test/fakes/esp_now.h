@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// see https://github.com/espressif/esp-idf/blob/v4.4.7/components/esp_wifi/include/esp_now.h
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_ESPNOW_BASE 0x3000
+#define ESP_ERR_ESPNOW_NOT_INIT (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST (ESP_ERR_ESPNOW_BASE + 7)
+
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_KEY_LEN 16
+#define ESP_NOW_MAX_TOTAL_PEER_NUM 20
+#define ESP_NOW_MAX_DATA_LEN 250
+
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP = 1 } wifi_interface_t;
+typedef enum { ESP_NOW_SEND_SUCCESS = 0, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    bool encrypt;
+    void* priv;
+} esp_now_peer_info_t;
+typedef void (*esp_now_recv_cb_t)(const uint8_t* mac_addr, const uint8_t* data, int data_len);
+typedef void (*esp_now_send_cb_t)(const uint8_t* mac_addr, esp_now_send_status_t status);
+
+
+/*!
+Fake of ESP-NOW, for the native build.
+
+Sent frames are recorded. With `loopback` set, each send is completed at once through the registered send callback,
+otherwise the test completes sends with `completeSend()`. The test delivers received frames with `receive()`,
+which calls the registered receive callback, as the WiFi task would.
+*/
+namespace FakeEspNow {
+struct frame_t {
+    uint8_t macAddress[ESP_NOW_ETH_ALEN];
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    int len;
+};
+inline bool initialized {false};
+inline esp_now_recv_cb_t receiveCallback {nullptr};
+inline esp_now_send_cb_t sendCallback {nullptr};
+inline std::vector<esp_now_peer_info_t> peers;
+inline std::vector<frame_t> sentFrames;
+inline esp_err_t sendResult {ESP_OK}; //!< returned by `esp_now_send()`
+inline bool loopback {false};
+inline esp_now_send_status_t loopbackStatus {ESP_NOW_SEND_SUCCESS};
+
+inline void reset(void)
+{
+    initialized = false;
+    receiveCallback = nullptr;
+    sendCallback = nullptr;
+    peers.clear();
+    sentFrames.clear();
+    sendResult = ESP_OK;
+    loopback = false;
+    loopbackStatus = ESP_NOW_SEND_SUCCESS;
+}
+
+inline esp_now_peer_info_t* findPeer(const uint8_t* macAddress)
+{
+    for (auto& peer : peers) {
+        if (memcmp(peer.peer_addr, macAddress, ESP_NOW_ETH_ALEN) == 0) {
+            return &peer;
+        }
+    }
+    return nullptr;
+}
+
+inline void receive(const uint8_t* macAddress, const uint8_t* data, int len)
+{
+    if (receiveCallback != nullptr) {
+        receiveCallback(macAddress, data, len);
+    }
+}
+
+inline void completeSend(const uint8_t* macAddress, esp_now_send_status_t status)
+{
+    if (sendCallback != nullptr) {
+        sendCallback(macAddress, status);
+    }
+}
+} // namespace FakeEspNow
+
+inline esp_err_t esp_now_init(void) { FakeEspNow::initialized = true; return ESP_OK; }
+inline esp_err_t esp_now_deinit(void) { FakeEspNow::initialized = false; return ESP_OK; }
+inline esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) { FakeEspNow::receiveCallback = cb; return ESP_OK; }
+inline esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) { FakeEspNow::sendCallback = cb; return ESP_OK; }
+
+inline esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer)
+{
+    if (!FakeEspNow::initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (FakeEspNow::findPeer(peer->peer_addr) != nullptr) {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    if (FakeEspNow::peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    FakeEspNow::peers.push_back(*peer);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_now_mod_peer(const esp_now_peer_info_t* peer)
+{
+    esp_now_peer_info_t* found = FakeEspNow::findPeer(peer->peer_addr);
+    if (found == nullptr) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *found = *peer;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_now_get_peer(const uint8_t* peer_addr, esp_now_peer_info_t* peer)
+{
+    const esp_now_peer_info_t* found = FakeEspNow::findPeer(peer_addr);
+    if (found == nullptr) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *peer = *found;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_now_send(const uint8_t* peer_addr, const uint8_t* data, size_t len)
+{
+    if (!FakeEspNow::initialized) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (FakeEspNow::findPeer(peer_addr) == nullptr) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    if (data == nullptr || len == 0 || len > ESP_NOW_MAX_DATA_LEN) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (FakeEspNow::sendResult != ESP_OK) {
+        return FakeEspNow::sendResult;
+    }
+    FakeEspNow::frame_t frame {};
+    memcpy(frame.macAddress, peer_addr, ESP_NOW_ETH_ALEN);
+    memcpy(frame.data, data, len);
+    frame.len = static_cast<int>(len);
+    FakeEspNow::sentFrames.push_back(frame);
+    if (FakeEspNow::loopback) {
+        FakeEspNow::completeSend(peer_addr, FakeEspNow::loopbackStatus);
+    }
+    return ESP_OK;
+}
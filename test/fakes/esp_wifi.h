@@ -0,0 +1,38 @@
+#pragma once
+
+#include <esp_now.h>
+
+#include <cstdint>
+
+typedef enum { WIFI_SECOND_CHAN_NONE = 0, WIFI_SECOND_CHAN_ABOVE, WIFI_SECOND_CHAN_BELOW } wifi_second_chan_t;
+
+
+/*!
+Fake of the ESP-IDF WiFi channel functions, for the native build.
+*/
+namespace FakeWiFi {
+inline uint8_t channel {1};
+inline esp_err_t setChannelResult {ESP_OK};
+inline uint32_t setChannelCount {0};
+} // namespace FakeWiFi
+
+inline esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)second;
+    if (primary < 1 || primary > 14) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (FakeWiFi::setChannelResult != ESP_OK) {
+        return FakeWiFi::setChannelResult;
+    }
+    FakeWiFi::channel = primary;
+    ++FakeWiFi::setChannelCount;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second)
+{
+    *primary = FakeWiFi::channel;
+    *second = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <mutex>
+
+// Fake of the FreeRTOS types and critical sections used outside the ESP_PLATFORM sections, for the native build.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void* TaskHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFU
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+//! On the host a critical section is a recursive mutex, as a task may re-enter it.
+struct portMUX_TYPE {
+    std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+
+/*!
+Fake of the FreeRTOS task functions, for the native build.
+
+Tasks are recorded when they are created, but do not run until a test calls `FakeTask::runUntilUs()`,
+so a test that does not use the scheduler steps the task's work directly, for example by calling `Display::renderFrame()`.
+
+`runUntilUs()` is a discrete event scheduler driven by the simulated clock. Each task runs on its own thread, but only one
+thread runs at a time: the test's thread hands the processor to the highest priority task that is ready, and the task hands it
+back when it calls `vTaskDelayUntil()`, `vTaskDelay()` or `ulTaskNotifyTake()`. When no task is ready, the clock is
+advanced to the next wake time. Tasks are not preempted and cores are not modelled, so simulated time only passes when a task
+advances the clock, for example to simulate a slow bus, and then it delays every other task. The schedule is deterministic.
+
+A task blocked when the program exits is left blocked, so the scheduler's state is never destroyed.
+*/
+namespace FakeTask {
+typedef void (*task_function_t)(void*);
+enum { NOT_A_TASK = -1, MAX_TASK_COUNT = 16 };
+enum state_t { CREATED, RUNNING, DELAYED, WAITING_FOR_NOTIFICATION, DELETED };
+struct task_t {
+    task_function_t function;
+    const char* name;
+    void* parameter;
+    UBaseType_t priority;
+    BaseType_t core;
+    state_t state;
+    uint64_t wakeTimeUs;
+    uint32_t notificationCount;
+    uint32_t runCount; //!< number of times the task has been given the processor
+};
+struct scheduler_t {
+    std::mutex mutex;
+    std::condition_variable handover;
+    int running {NOT_A_TASK}; //!< the task that has the processor, or NOT_A_TASK for the test's thread
+};
+inline task_t tasks[MAX_TASK_COUNT] {};
+inline int taskCount {0};
+inline int firstTask {0}; //!< tasks before this were created before the last `reset()`, and are never run again
+inline scheduler_t& scheduler = *new scheduler_t; // NOLINT(cppcoreguidelines-owning-memory)
+inline thread_local int currentTask {NOT_A_TASK};
+
+//! Forget the tasks created so far. Any that have run stay blocked on their threads.
+inline void reset(void) { firstTask = taskCount; }
+
+inline bool isReady(const task_t& task, uint64_t timeUs)
+{
+    switch (task.state) {
+    case CREATED:
+        return true;
+    case DELAYED:
+        return task.wakeTimeUs <= timeUs;
+    case WAITING_FOR_NOTIFICATION:
+        return task.notificationCount > 0 || task.wakeTimeUs <= timeUs;
+    default:
+        return false;
+    }
+}
+
+//! Called by a task when it blocks: hand the processor back to the test's thread, and wait to be given it again.
+inline void block(state_t state, uint64_t wakeTimeUs)
+{
+    const int index = currentTask;
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+    tasks[index].state = state;
+    tasks[index].wakeTimeUs = wakeTimeUs;
+    scheduler.running = NOT_A_TASK;
+    scheduler.handover.notify_all();
+    scheduler.handover.wait(lock, [index] { return scheduler.running == index; });
+}
+
+//! Give the processor to task `index`, starting its thread if it has not yet run, and wait until it blocks.
+inline void run(std::unique_lock<std::mutex>& lock, int index)
+{
+    if (tasks[index].state == CREATED) {
+        std::thread([index]() {
+            currentTask = index;
+            {
+                std::unique_lock<std::mutex> taskLock(scheduler.mutex);
+                scheduler.handover.wait(taskLock, [index] { return scheduler.running == index; });
+            }
+            tasks[index].function(tasks[index].parameter);
+            // a FreeRTOS task must not return, but treat it as deleted if it does
+            const std::lock_guard<std::mutex> taskLock(scheduler.mutex);
+            tasks[index].state = DELETED;
+            scheduler.running = NOT_A_TASK;
+            scheduler.handover.notify_all();
+        }).detach();
+    }
+    tasks[index].state = RUNNING;
+    ++tasks[index].runCount;
+    scheduler.running = index;
+    scheduler.handover.notify_all();
+    scheduler.handover.wait(lock, [] { return scheduler.running == NOT_A_TASK; });
+}
+
+/*!
+Run the tasks until the simulated clock reaches `endTimeUs`, and leave the clock at `endTimeUs`, or later if a task overran it.
+*/
+inline void runUntilUs(uint64_t endTimeUs)
+{
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+    while (true) {
+        const uint64_t timeUs = FakeClock::timeUs;
+        if (timeUs > endTimeUs) {
+            // a task overran the end time
+            return;
+        }
+        int next = NOT_A_TASK;
+        for (int ii = firstTask; ii < taskCount; ++ii) {
+            if (isReady(tasks[ii], timeUs) && (next == NOT_A_TASK || tasks[ii].priority > tasks[next].priority)) {
+                next = ii;
+            }
+        }
+        if (next != NOT_A_TASK) {
+            run(lock, next);
+            continue;
+        }
+        uint64_t wakeTimeUs = endTimeUs;
+        for (int ii = firstTask; ii < taskCount; ++ii) {
+            if ((tasks[ii].state == DELAYED || tasks[ii].state == WAITING_FOR_NOTIFICATION) && tasks[ii].wakeTimeUs < wakeTimeUs) {
+                wakeTimeUs = tasks[ii].wakeTimeUs;
+            }
+        }
+        if (wakeTimeUs > timeUs) {
+            FakeClock::setUs(wakeTimeUs);
+        }
+        if (wakeTimeUs >= endTimeUs) {
+            return;
+        }
+    }
+}
+
+inline void runForUs(uint64_t us) { runUntilUs(FakeClock::timeUs + us); }
+} // namespace FakeTask
+
+inline BaseType_t xTaskCreatePinnedToCore(FakeTask::task_function_t function, const char* name, uint32_t stackDepth, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core)
+{
+    (void)stackDepth;
+    if (FakeTask::taskCount == FakeTask::MAX_TASK_COUNT) {
+        return pdFALSE;
+    }
+    FakeTask::task_t& task = FakeTask::tasks[FakeTask::taskCount];
+    task = FakeTask::task_t { function, name, parameter, priority, core, FakeTask::CREATED, 0, 0, 0 };
+    ++FakeTask::taskCount;
+    if (handle != nullptr) {
+        *handle = &task;
+    }
+    return pdPASS;
+}
+
+inline TickType_t xTaskGetTickCount(void) { return millis(); }
+
+//! Outside a scheduled task the delay advances the clock, as `delay()` does.
+inline void vTaskDelay(TickType_t ticks)
+{
+    if (FakeTask::currentTask == FakeTask::NOT_A_TASK) {
+        delay(ticks);
+        return;
+    }
+    FakeTask::block(FakeTask::DELAYED, FakeClock::timeUs + static_cast<uint64_t>(ticks) * 1000);
+}
+
+/*!
+As on FreeRTOS, if the wake time has already passed then the task is still ready to run. It hands the processor back
+to the scheduler all the same, so that a task that overruns its period cannot keep it past the end of `runUntilUs()`.
+*/
+inline void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t period) // NOLINT(readability-non-const-parameter)
+{
+    *previousWakeTime += period;
+    const uint64_t wakeTimeUs = static_cast<uint64_t>(*previousWakeTime) * 1000;
+    if (FakeTask::currentTask == FakeTask::NOT_A_TASK) {
+        if (wakeTimeUs > FakeClock::timeUs) {
+            FakeClock::setUs(wakeTimeUs);
+        }
+        return;
+    }
+    FakeTask::block(FakeTask::DELAYED, wakeTimeUs);
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    const std::lock_guard<std::mutex> lock(FakeTask::scheduler.mutex);
+    ++static_cast<FakeTask::task_t*>(handle)->notificationCount;
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    const int index = FakeTask::currentTask;
+    if (index == FakeTask::NOT_A_TASK) {
+        return 0;
+    }
+    FakeTask::task_t& task = FakeTask::tasks[index];
+    if (task.notificationCount == 0 && ticksToWait > 0) {
+        const uint64_t wakeTimeUs = ticksToWait == portMAX_DELAY ? UINT64_MAX : FakeClock::timeUs + static_cast<uint64_t>(ticksToWait) * 1000;
+        FakeTask::block(FakeTask::WAITING_FOR_NOTIFICATION, wakeTimeUs);
+    }
+    const std::lock_guard<std::mutex> lock(FakeTask::scheduler.mutex);
+    const uint32_t count = task.notificationCount;
+    if (clearCountOnExit == pdTRUE) {
+        task.notificationCount = 0;
+    } else if (count > 0) {
+        --task.notificationCount;
+    }
+    return count;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+
+/*!
+Minimal benchmark runner for the native build, in the style of Google Benchmark.
+
+The function is run in batches, doubling the batch size, until a batch takes at least `minTimeMs`,
+and the time per iteration of that batch is reported. The function is passed the iteration index.
+*/
+struct benchmark_result_t {
+    uint64_t iterations;
+    double nsPerIteration;
+};
+
+//! Prevent the compiler from optimizing away a value that is only computed for the benchmark.
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename FUNCTION>
+benchmark_result_t runBenchmark(const char* name, FUNCTION function, uint32_t minTimeMs=100)
+{
+    typedef std::chrono::steady_clock clock_t;
+    uint64_t iterations = 1;
+    while (true) {
+        const clock_t::time_point start = clock_t::now();
+        for (uint64_t ii = 0; ii < iterations; ++ii) {
+            function(ii);
+        }
+        const auto elapsedNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count());
+        if (elapsedNs >= static_cast<double>(minTimeMs) * 1.0e6 || iterations >= (1ULL << 40U)) {
+            const benchmark_result_t result { iterations, elapsedNs / static_cast<double>(iterations) };
+            printf("BENCHMARK %-48s %12.1f ns %12llu iterations\n", name, result.nsPerIteration, static_cast<unsigned long long>(iterations));
+            return result;
+        }
+        iterations *= 2;
+    }
+}
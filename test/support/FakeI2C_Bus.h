@@ -0,0 +1,66 @@
+#pragma once
+
+#include <I2C_Interface.h>
+
+#include <Arduino.h>
+#include <cstdint>
+#include <vector>
+
+
+/*!
+Fake I2C bus that records each transaction, for testing the RoverC and the I2C queue without hardware.
+
+`failCount` transactions fail, with error code 4, before the bus starts succeeding.
+Each transaction advances the simulated clock by `transactionTimeUs`, and records the time at which it started.
+*/
+class FakeI2C_Bus : public I2C_Interface {
+public:
+    struct transaction_t {
+        uint8_t address;
+        uint8_t firstRegister;
+        std::vector<uint8_t> data;
+        uint32_t timeUs;
+    };
+    enum { ERROR_OTHER = 4 };
+public:
+    uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override {
+        const uint32_t timeUs = micros();
+        FakeClock::advanceUs(transactionTimeUs);
+        if (failCount > 0) {
+            --failCount;
+            ++errorCount;
+            return ERROR_OTHER;
+        }
+        transactions.push_back(transaction_t { address, firstRegister, std::vector<uint8_t>(data, data + len), timeUs });
+        for (size_t ii = 0; ii < len; ++ii) {
+            registers[static_cast<uint8_t>(firstRegister + ii)] = data[ii];
+        }
+        return 0;
+    }
+    //! Bytes on the bus, counting the address byte and the register byte of each transaction.
+    size_t getByteCount(void) const {
+        size_t count = 0;
+        for (const auto& transaction : transactions) {
+            count += transaction.data.size() + 2;
+        }
+        return count;
+    }
+    /*!
+    Time the transactions would take on a bus clocked at `frequencyHz`: nine clocks for each byte, including its acknowledge,
+    plus a start and a stop condition for each transaction.
+    */
+    uint32_t getBusTimeUs(uint32_t frequencyHz) const {
+        uint64_t clockCount = 0;
+        for (const auto& transaction : transactions) {
+            clockCount += 9 * (transaction.data.size() + 2) + 2;
+        }
+        return static_cast<uint32_t>(clockCount * 1000000 / frequencyHz);
+    }
+    void clear(void) { transactions.clear(); }
+public:
+    std::vector<transaction_t> transactions;
+    uint8_t registers[256] {}; //!< the last value written to each register
+    int failCount {0};
+    int errorCount {0};
+    uint32_t transactionTimeUs {0};
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <PacketCodec.h>
+
+#include <cstdint>
+#include <cstring>
+
+
+/*!
+Build a packet in the M5Stack Atom JoyStick format, addressed to the receiver with `receiverMacAddress`, with a valid checksum.
+
+The pitch is negated, as the codec negates it when decoding.
+*/
+inline void makeAtomJoyStickPacket(const uint8_t* receiverMacAddress, float throttle, float roll, float pitch, float yaw, uint8_t mode, uint8_t* packet)
+{
+    typedef AtomJoyStickCodec codec;
+    memset(packet, 0, codec::PACKET_SIZE);
+    packet[codec::MacAddress3::offset] = receiverMacAddress[3];
+    packet[codec::MacAddress4::offset] = receiverMacAddress[4];
+    packet[codec::MacAddress5::offset] = receiverMacAddress[5];
+    const float negatedPitch = -pitch;
+    memcpy(&packet[codec::Yaw::offset], &yaw, sizeof(float));
+    memcpy(&packet[codec::Throttle::offset], &throttle, sizeof(float));
+    memcpy(&packet[codec::Roll::offset], &roll, sizeof(float));
+    memcpy(&packet[codec::Pitch::offset], &negatedPitch, sizeof(float));
+    packet[codec::Mode::offset] = mode;
+    uint8_t checksum = 0;
+    for (int ii = 0; ii < codec::Checksum::offset; ++ii) {
+        checksum += packet[ii];
+    }
+    packet[codec::Checksum::offset] = checksum;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <ChannelManager.h>
+#include <Radio_Interface.h>
+
+#include <Arduino.h>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+
+/*!
+Simulated lossy channels, with a transmitter that follows the ChannelManager's handshake, for host tests of channel selection.
+
+Each channel has a packet loss probability and a jitter, the peak deviation of each packet's arrival behind the transmitter's period.
+The transmitter sends a packet every `intervalUs` on the channel it is tuned to, and the packet is recorded in the link statistics
+if the receiver is tuned to the same channel and the packet is not lost. Handshake frames are unicast, so are retransmitted
+until acknowledged: one is lost only if all `handshakeAttemptCount` attempts are lost, and a lost SURVEY or SWITCH frame
+leaves the transmitter where it was. As with ESP-NOW, a handshake frame may be sent some time after it is queued: with a nonzero
+`handshakeDelayMs` it goes out on whatever channel the receiver is tuned to when the delay has passed.
+
+`advanceMs()` steps the simulated clock a millisecond at a time, delivering the packets due. The random generator is seeded,
+so runs are repeatable.
+*/
+class SimulatedRadio : public Radio_Interface {
+public:
+    enum { CHANNEL_COUNT = 14 }; // indexed by channel number, channel 0 is unused
+    struct channel_t {
+        float lossProbability;
+        uint32_t jitterUs;
+    };
+public:
+    SimulatedRadio(uint8_t channel, uint32_t intervalUs, uint32_t seed) :
+        _receiverChannel(channel),
+        _transmitterChannel(channel),
+        _intervalUs(intervalUs),
+        _generator(seed),
+        _nextSendUs(FakeClock::timeUs + intervalUs)
+    {
+        scheduleArrival();
+    }
+    // Radio_Interface
+    uint8_t getChannel(void) const override { return _receiverChannel; }
+    bool setChannel(uint8_t channel) override {
+        _receiverChannel = channel;
+        ++setChannelCount;
+        return true;
+    }
+    bool sendToPrimaryPeer(const uint8_t* data, int len) override {
+        ++handshakeCount;
+        if (handshakeDelayMs != 0 && len <= ChannelManager::HANDSHAKE_FRAME_SIZE) {
+            memcpy(_pendingHandshake, data, static_cast<size_t>(len));
+            _pendingHandshakeLen = len;
+            _pendingHandshakeUs = FakeClock::timeUs + static_cast<uint64_t>(handshakeDelayMs) * 1000;
+            return true;
+        }
+        sendHandshake(data, len);
+        return true;
+    }
+    const LinkStatistics& getLinkStatistics(void) const override { return _linkStatistics; }
+public:
+    void advanceMs(uint32_t ms) {
+        for (uint32_t ii = 0; ii < ms; ++ii) {
+            FakeClock::advanceMs(1);
+            const uint64_t timeUs = FakeClock::timeUs;
+            if (_dwellEndUs != 0 && timeUs >= _dwellEndUs) {
+                _transmitterChannel = _dwellReturnChannel;
+                _dwellEndUs = 0;
+            }
+            // the transmitter starts its dwell when the SURVEY frame is sent, so with a delay it returns as the next frame is sent
+            if (_pendingHandshakeLen != 0 && timeUs >= _pendingHandshakeUs) {
+                sendHandshake(_pendingHandshake, _pendingHandshakeLen);
+                _pendingHandshakeLen = 0;
+            }
+            // a packet is lost if either end is on another channel when it arrives
+            while (_nextArrivalUs <= timeUs) {
+                if (_receiverChannel == _transmitterChannel && !isLost(_transmitterChannel)) {
+                    _linkStatistics.recordPacket(static_cast<uint32_t>(_nextArrivalUs));
+                }
+                _nextSendUs += _intervalUs;
+                scheduleArrival();
+            }
+        }
+    }
+    inline uint8_t getTransmitterChannel(void) const { return _transmitterChannel; }
+private:
+    //! Transmit a handshake frame, and its retransmissions, on the receiver's current channel.
+    void sendHandshake(const uint8_t* data, int len) {
+        if (_receiverChannel != _transmitterChannel || transmitterIgnoresHandshake) {
+            return;
+        }
+        for (int ii = 0; ii < handshakeAttemptCount; ++ii) {
+            if (!isLost(_transmitterChannel)) {
+                handleHandshake(data, len);
+                return;
+            }
+        }
+    }
+    void scheduleArrival(void) {
+        const uint32_t jitterUs = channels[_transmitterChannel].jitterUs;
+        _nextArrivalUs = _nextSendUs + (jitterUs == 0 ? 0 : _generator() % (jitterUs + 1));
+    }
+    bool isLost(uint8_t channel) {
+        return std::uniform_real_distribution<float>(0.0F, 1.0F)(_generator) < channels[channel].lossProbability;
+    }
+    void handleHandshake(const uint8_t* data, int len) {
+        if (len != ChannelManager::HANDSHAKE_FRAME_SIZE || data[0] != ChannelManager::HANDSHAKE_MAGIC_0 || data[1] != ChannelManager::HANDSHAKE_MAGIC_1) {
+            return;
+        }
+        const uint8_t channel = data[3];
+        if (data[2] == ChannelManager::HANDSHAKE_SURVEY) {
+            _dwellReturnChannel = _transmitterChannel;
+            _dwellEndUs = FakeClock::timeUs + static_cast<uint64_t>(data[4] | (data[5] << 8U)) * 1000;
+            _transmitterChannel = channel;
+        } else if (data[2] == ChannelManager::HANDSHAKE_SWITCH && !transmitterIgnoresSwitch) {
+            _dwellEndUs = 0;
+            _transmitterChannel = channel;
+        }
+    }
+public:
+    channel_t channels[CHANNEL_COUNT] {};
+    bool transmitterIgnoresHandshake {false};
+    bool transmitterIgnoresSwitch {false};
+    int handshakeAttemptCount {4}; //!< the initial transmission and the retransmissions
+    uint32_t handshakeDelayMs {0}; //!< time from a handshake frame being queued to it being sent
+    int handshakeCount {0};
+    int setChannelCount {0};
+private:
+    uint8_t _receiverChannel;
+    uint8_t _transmitterChannel;
+    uint8_t _pendingHandshake[ChannelManager::HANDSHAKE_FRAME_SIZE] {};
+    int _pendingHandshakeLen {0};
+    uint64_t _pendingHandshakeUs {0};
+    uint8_t _dwellReturnChannel {0};
+    uint64_t _dwellEndUs {0};
+    uint32_t _intervalUs;
+    std::mt19937 _generator;
+    uint64_t _nextSendUs;
+    uint64_t _nextArrivalUs {0};
+    LinkStatistics _linkStatistics;
+};
@@ -0,0 +1,86 @@
+#include <AtomJoyStickReceiver.h>
+#include <Benchmark.h>
+#include <FakeI2C_Bus.h>
+#include <JoyStickPackets.h>
+#include <RoverC.h>
+
+#include <unity.h>
+
+/*
+Benchmarks of the per-packet work on the receive path. The figures are for the host, so are useful for comparing changes,
+rather than as absolute figures for the ESP32.
+*/
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+void setUp(void)
+{
+    FakeEspNow::reset();
+}
+
+void tearDown(void)
+{
+}
+
+static void benchmark_receive_and_unpack_packet(void)
+{
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    TEST_ASSERT_EQUAL(ESP_OK, receiver.init(1, joyStickMacAddress));
+    receiver.setBias(0.0F, 0.0F, 0.0F, 0.0F);
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.1F, 0.2F, 0.3F, 0.4F, 0, packet);
+
+    uint32_t unpackedCount = 0;
+    runBenchmark("receive + unpackPacket", [&](uint64_t) {
+        receiver.getTransceiver().handleReceivedData(joyStickMacAddress, packet, sizeof(packet));
+        unpackedCount += receiver.unpackPacket() ? 1 : 0;
+    });
+    TEST_ASSERT_GREATER_THAN(0, unpackedCount);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 0.3F, receiver.getPitch());
+}
+
+static void benchmark_axis_shaping(void)
+{
+    AtomJoyStickReceiver::axis_shaper_t shaper;
+    shaper.configure(shaping_parameters_t { 0.02F, 0.05F, 0.3F, 20.0F, 100.0F });
+    float value = 0.0F;
+    runBenchmark("axis_shaper_t::apply", [&](uint64_t ii) {
+        value = shaper.apply(static_cast<float>(ii & 0xFFU) / 128.0F - 1.0F);
+        doNotOptimize(value);
+    });
+    TEST_ASSERT_TRUE(value >= -1.0F && value <= 1.0F);
+}
+
+static void benchmark_rover_move(void)
+{
+    // a bus that does nothing, so that only the mixing and shadow register comparison are measured
+    class NullBus : public I2C_Interface {
+    public:
+        uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override {
+            (void)address; (void)firstRegister; (void)data; (void)len;
+            return 0;
+        }
+    };
+    NullBus bus;
+    RoverC rover(bus);
+    runBenchmark("RoverC::move, changing", [&](uint64_t ii) {
+        const float pitch = static_cast<float>(ii & 0xFFU) / 256.0F;
+        rover.move(0.0F, 0.1F, pitch, 0.2F);
+    });
+    runBenchmark("RoverC::move, unchanged", [&](uint64_t) {
+        rover.move(0.0F, 0.1F, 0.5F, 0.2F);
+    });
+    TEST_ASSERT_GREATER_THAN(0, rover.getWriteStatistics().registerSuppressedCount);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(benchmark_receive_and_unpack_packet);
+    RUN_TEST(benchmark_axis_shaping);
+    RUN_TEST(benchmark_rover_move);
+    return UNITY_END();
+}
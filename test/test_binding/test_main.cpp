@@ -0,0 +1,239 @@
+#include <AtomJoyStickReceiver.h>
+#include <BindingStateMachine.h>
+#include <JoyStickPackets.h>
+
+#include <Arduino.h>
+#include <cstring>
+#include <unity.h>
+
+/*
+BindingStateMachine tests, stepped against a simulated clock and a fake transmitter, and binding through
+the AtomJoyStickReceiver with the fake ESP-NOW radio.
+*/
+
+/*!
+Fake transmitter: answers after it has heard `respondAfter` broadcasts, if at all, and can be made to fail the broadcast.
+*/
+struct transmitter_t {
+    int broadcastsHeard;
+    int respondAfter; //!< zero never to respond
+    bool broadcastFails;
+};
+
+static uint32_t clockMs() { return millis(); }
+
+static bool broadcast(const void* context)
+{
+    auto transmitter = static_cast<transmitter_t*>(const_cast<void*>(context)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    if (transmitter->broadcastFails) {
+        return false;
+    }
+    ++transmitter->broadcastsHeard;
+    return true;
+}
+
+static bool isBound(const void* context)
+{
+    const auto transmitter = static_cast<const transmitter_t*>(context);
+    return transmitter->respondAfter > 0 && transmitter->broadcastsHeard >= transmitter->respondAfter;
+}
+
+//! Step the state machine every millisecond, as the main loop would, until binding ends or `maxMs` has passed.
+static BindingStateMachine::state_t run(BindingStateMachine& binding, uint32_t maxMs)
+{
+    for (uint32_t ii = 0; ii < maxMs && binding.isBinding(); ++ii) {
+        FakeClock::advanceMs(1);
+        binding.update();
+    }
+    return binding.getState();
+}
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+static const uint8_t otherJoyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xDD, 0xEE, 0xFF };
+static const uint8_t broadcastMacAddress[ESP_NOW_ETH_ALEN] { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static int broadcastFrameCount()
+{
+    int count = 0;
+    for (const auto& frame : FakeEspNow::sentFrames) {
+        if (memcmp(frame.macAddress, broadcastMacAddress, ESP_NOW_ETH_ALEN) == 0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void setUp(void)
+{
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_binds_when_the_transmitter_responds(void)
+{
+    transmitter_t transmitter { 0, 3, false };
+    BindingStateMachine binding(clockMs, broadcast, isBound, &transmitter);
+    TEST_ASSERT_EQUAL(BindingStateMachine::IDLE, binding.update());
+
+    // the first broadcast is sent at once
+    binding.start(20, 50);
+    TEST_ASSERT_TRUE(binding.isBinding());
+    TEST_ASSERT_EQUAL(1, transmitter.broadcastsHeard);
+    // and no more are sent until the interval has passed
+    FakeClock::advanceMs(49);
+    binding.update();
+    TEST_ASSERT_EQUAL(1, transmitter.broadcastsHeard);
+    FakeClock::advanceMs(1);
+    binding.update();
+    TEST_ASSERT_EQUAL(2, transmitter.broadcastsHeard);
+
+    // the transmitter responds to the third broadcast, and no more are sent
+    TEST_ASSERT_EQUAL(BindingStateMachine::BOUND, run(binding, 1000));
+    TEST_ASSERT_EQUAL(3, transmitter.broadcastsHeard);
+    TEST_ASSERT_EQUAL(3, binding.getBroadcastsSent());
+    const BindingStateMachine::statistics_t& statistics = binding.getStatistics();
+    TEST_ASSERT_EQUAL_UINT32(101, statistics.timeToBindMs); // the response is seen at the update after the third broadcast
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.boundCount);
+    TEST_ASSERT_EQUAL_UINT32(3, statistics.broadcastCount);
+    run(binding, 1000);
+    TEST_ASSERT_EQUAL(3, transmitter.broadcastsHeard);
+}
+
+static void test_times_out_an_interval_after_the_last_broadcast(void)
+{
+    transmitter_t transmitter { 0, 0, false };
+    BindingStateMachine binding(clockMs, broadcast, isBound, &transmitter);
+    const uint32_t startMs = millis();
+    binding.start(5, 50);
+    TEST_ASSERT_EQUAL(BindingStateMachine::TIMED_OUT, run(binding, 10000));
+    TEST_ASSERT_EQUAL(5, transmitter.broadcastsHeard);
+    TEST_ASSERT_EQUAL_UINT32(5 * 50, millis() - startMs);
+    TEST_ASSERT_EQUAL_UINT32(1, binding.getStatistics().timedOutCount);
+    TEST_ASSERT_EQUAL_UINT32(0, binding.getStatistics().boundCount);
+}
+
+static void test_failed_broadcast_ends_binding(void)
+{
+    transmitter_t transmitter { 0, 5, false };
+    BindingStateMachine binding(clockMs, broadcast, isBound, &transmitter);
+    binding.start(20, 50);
+    run(binding, 120);
+    TEST_ASSERT_EQUAL(3, transmitter.broadcastsHeard);
+    transmitter.broadcastFails = true;
+    TEST_ASSERT_EQUAL(BindingStateMachine::FAILED, run(binding, 1000));
+    TEST_ASSERT_EQUAL_UINT32(1, binding.getStatistics().failedCount);
+    TEST_ASSERT_EQUAL_UINT32(3, binding.getStatistics().broadcastCount);
+}
+
+static void test_restart_and_cancel(void)
+{
+    transmitter_t transmitter { 0, 0, false };
+    BindingStateMachine binding(clockMs, broadcast, isBound, &transmitter);
+    binding.start(4, 50);
+    run(binding, 120);
+    TEST_ASSERT_EQUAL(3, binding.getBroadcastsSent());
+    // restarting sends the full count of broadcasts again
+    binding.start(4, 50);
+    TEST_ASSERT_EQUAL(1, binding.getBroadcastsSent());
+    TEST_ASSERT_EQUAL(BindingStateMachine::TIMED_OUT, run(binding, 10000));
+    TEST_ASSERT_EQUAL(3 + 4, transmitter.broadcastsHeard);
+    TEST_ASSERT_EQUAL_UINT32(2, binding.getStatistics().startCount);
+
+    binding.start(4, 50);
+    binding.cancel();
+    TEST_ASSERT_EQUAL(BindingStateMachine::IDLE, binding.getState());
+    run(binding, 1000);
+    TEST_ASSERT_EQUAL(3 + 4 + 1, transmitter.broadcastsHeard);
+    // cancel has no effect once binding has ended
+    binding.start(1, 50);
+    run(binding, 1000);
+    binding.cancel();
+    TEST_ASSERT_EQUAL(BindingStateMachine::TIMED_OUT, binding.getState());
+}
+
+static void test_broadcast_interval_across_the_clock_wrap(void)
+{
+    transmitter_t transmitter { 0, 0, false };
+    BindingStateMachine binding(clockMs, broadcast, isBound, &transmitter);
+    // start 60ms before millis() wraps around
+    FakeClock::setUs((static_cast<uint64_t>(UINT32_MAX) + 1 - 60) * 1000);
+    binding.start(5, 50);
+    TEST_ASSERT_EQUAL(BindingStateMachine::TIMED_OUT, run(binding, 10000));
+    TEST_ASSERT_EQUAL(5, transmitter.broadcastsHeard);
+    TEST_ASSERT_EQUAL_UINT32(5 * 50 - 60, millis());
+}
+
+/*!
+Binding through the receiver: the rover broadcasts its MAC address, the joystick starts sending to it,
+and the first joystick heard becomes the primary peer.
+*/
+static void test_receiver_binds_to_the_first_joystick_heard(void)
+{
+    FakeEspNow::reset();
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    TEST_ASSERT_EQUAL(ESP_OK, receiver.init(1, nullptr));
+    receiver.startBinding(20, 50);
+    TEST_ASSERT_EQUAL(1, broadcastFrameCount());
+    FakeClock::advanceMs(50);
+    receiver.updateBinding();
+    TEST_ASSERT_EQUAL(2, broadcastFrameCount());
+    // the broadcast holds the channel and the rover's MAC address
+    TEST_ASSERT_EQUAL_UINT8(1, FakeEspNow::sentFrames[0].data[0]);
+    TEST_ASSERT_EQUAL_MEMORY(roverMacAddress, &FakeEspNow::sentFrames[0].data[1], ESP_NOW_ETH_ALEN);
+
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.0F, 0.0F, 0.0F, 0.0F, 0, packet);
+    FakeClock::advanceMs(10);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    TEST_ASSERT_EQUAL(BindingStateMachine::BOUND, receiver.updateBinding());
+    TEST_ASSERT_EQUAL_UINT32(60, receiver.getBinding().getStatistics().timeToBindMs);
+    TEST_ASSERT_EQUAL_MEMORY(joyStickMacAddress, receiver.getPrimaryPeerMacAddress(), ESP_NOW_ETH_ALEN);
+
+    // once bound, another joystick does not take over, even if binding is started again
+    receiver.startBinding(2, 50);
+    FakeEspNow::receive(otherJoyStickMacAddress, packet, sizeof(packet));
+    TEST_ASSERT_EQUAL_MEMORY(joyStickMacAddress, receiver.getPrimaryPeerMacAddress(), ESP_NOW_ETH_ALEN);
+}
+
+/*!
+With the peer restored from the config store, binding is only complete when a packet arrives after it started,
+so that a joystick that does not yet know the rover keeps being sent broadcasts.
+*/
+static void test_receiver_with_stored_peer_binds_on_the_next_packet(void)
+{
+    FakeEspNow::reset();
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    TEST_ASSERT_EQUAL(ESP_OK, receiver.init(1, joyStickMacAddress));
+    TEST_ASSERT_TRUE(receiver.isPrimaryPeerMacAddressSet());
+    receiver.startBinding(20, 50);
+    for (int ii = 0; ii < 3; ++ii) {
+        FakeClock::advanceMs(50);
+        TEST_ASSERT_EQUAL(BindingStateMachine::BROADCASTING, receiver.updateBinding());
+    }
+    TEST_ASSERT_EQUAL(4, broadcastFrameCount());
+
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.0F, 0.0F, 0.0F, 0.0F, 0, packet);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    TEST_ASSERT_EQUAL(BindingStateMachine::BOUND, receiver.updateBinding());
+    TEST_ASSERT_EQUAL_UINT32(150, receiver.getBinding().getStatistics().timeToBindMs);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_binds_when_the_transmitter_responds);
+    RUN_TEST(test_times_out_an_interval_after_the_last_broadcast);
+    RUN_TEST(test_failed_broadcast_ends_binding);
+    RUN_TEST(test_restart_and_cancel);
+    RUN_TEST(test_broadcast_interval_across_the_clock_wrap);
+    RUN_TEST(test_receiver_binds_to_the_first_joystick_heard);
+    RUN_TEST(test_receiver_with_stored_peer_binds_on_the_next_packet);
+    return UNITY_END();
+}
@@ -0,0 +1,268 @@
+#include <Benchmark.h>
+#include <ChannelManager.h>
+#include <SimulatedRadio.h>
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <unity.h>
+
+/*
+ChannelManager tests, surveying simulated lossy channels with a transmitter that follows the handshake,
+stepped against a simulated clock.
+*/
+
+enum : uint8_t { HOME_CHANNEL = 1 };
+enum : uint32_t { INTERVAL_US = ChannelManager::DEFAULT_EXPECTED_INTERVAL_US };
+
+static uint32_t clockMs() { return millis(); }
+
+//! Step the radio and the manager every millisecond, as the main loop would, until the survey and any switch have ended.
+static ChannelManager::state_t run(SimulatedRadio& radio, ChannelManager& manager)
+{
+    enum { MAX_MS = 60000 };
+    for (int ii = 0; ii < MAX_MS && manager.isBusy(); ++ii) {
+        radio.advanceMs(1);
+        manager.update();
+    }
+    return manager.getState();
+}
+
+//! Find the score of `channel` in the last survey, or nullptr if it was not surveyed.
+static const ChannelManager::channel_score_t* findScore(const ChannelManager& manager, uint8_t channel)
+{
+    for (int ii = 0; ii < manager.getCandidateCount(); ++ii) {
+        if (manager.getScore(ii).channel == channel) {
+            return &manager.getScore(ii);
+        }
+    }
+    return nullptr;
+}
+
+void setUp(void)
+{
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_score(void)
+{
+    const ChannelManager::config_t config = ChannelManager::defaultConfig();
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, ChannelManager::score(50, 50, 0, config));
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, ChannelManager::score(52, 50, 0, config)); // an early packet does not score above a clean channel
+    TEST_ASSERT_EQUAL_FLOAT(0.5F, ChannelManager::score(25, 50, 0, config));
+    TEST_ASSERT_EQUAL_FLOAT(1.0F - 0.125F, ChannelManager::score(50, 50, INTERVAL_US / 2, config));
+    TEST_ASSERT_EQUAL_FLOAT(1.0F - config.jitterWeight, ChannelManager::score(50, 50, 3 * INTERVAL_US, config));
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, ChannelManager::score(0, 50, 0, config));
+}
+
+static void test_switches_from_a_lossy_home_channel(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 1);
+    radio.channels[HOME_CHANNEL] = { 0.3F, 0 };
+    radio.channels[6] = { 0.1F, 0 };
+    radio.channels[11] = { 0.0F, 0 };
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6, 11 };
+    TEST_ASSERT_TRUE(manager.startSurvey(channels, sizeof(channels)));
+    TEST_ASSERT_TRUE(manager.isBusy());
+    TEST_ASSERT_FALSE(manager.startSurvey(channels, sizeof(channels)));
+    TEST_ASSERT_EQUAL(ChannelManager::SWITCHED, run(radio, manager));
+    TEST_ASSERT_EQUAL_UINT8(11, radio.getChannel());
+    TEST_ASSERT_EQUAL_UINT8(11, radio.getTransmitterChannel());
+
+    const ChannelManager::channel_score_t* home = findScore(manager, HOME_CHANNEL);
+    const ChannelManager::channel_score_t* best = findScore(manager, 11);
+    TEST_ASSERT_UINT32_WITHIN(10, 35, home->packetCount);
+    TEST_ASSERT_UINT32_WITHIN(1, 50, best->packetCount);
+    TEST_ASSERT_FLOAT_WITHIN(0.021F, 1.0F, best->score); // a packet may fall just outside the dwell
+    TEST_ASSERT_TRUE(best->score > findScore(manager, 6)->score);
+}
+
+static void test_keeps_home_channel_within_the_hysteresis(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 2);
+    radio.channels[HOME_CHANNEL] = { 0.04F, 0 };
+    radio.channels[6] = { 0.0F, 0 };
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6 };
+    manager.startSurvey(channels, sizeof(channels));
+    TEST_ASSERT_EQUAL(ChannelManager::KEPT_HOME_CHANNEL, run(radio, manager));
+    TEST_ASSERT_TRUE(findScore(manager, 6)->score > findScore(manager, HOME_CHANNEL)->score);
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getChannel());
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getTransmitterChannel());
+    // one SURVEY frame, and no SWITCH frame
+    TEST_ASSERT_EQUAL(1, radio.handshakeCount);
+}
+
+static void test_transmitter_without_the_handshake_keeps_home_channel(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 3);
+    radio.channels[HOME_CHANNEL] = { 0.5F, 0 };
+    radio.transmitterIgnoresHandshake = true;
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6, 11 };
+    manager.startSurvey(channels, sizeof(channels));
+    TEST_ASSERT_EQUAL(ChannelManager::KEPT_HOME_CHANNEL, run(radio, manager));
+    TEST_ASSERT_EQUAL_UINT32(0, findScore(manager, 6)->packetCount);
+    TEST_ASSERT_EQUAL_UINT32(0, findScore(manager, 11)->packetCount);
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, findScore(manager, 11)->score);
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getChannel());
+}
+
+static void test_switch_not_followed_returns_home(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 4);
+    radio.channels[HOME_CHANNEL] = { 0.2F, 0 };
+    radio.transmitterIgnoresSwitch = true;
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6 };
+    manager.startSurvey(channels, sizeof(channels));
+    const uint32_t surveyStartMs = millis();
+    TEST_ASSERT_EQUAL(ChannelManager::FAILED, run(radio, manager));
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getChannel());
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getTransmitterChannel());
+    // the home channel and the candidate are measured, then the switch settles and times out
+    const ChannelManager::config_t config = ChannelManager::defaultConfig();
+    TEST_ASSERT_UINT32_WITHIN(2, 2 * config.dwellMs + 2 * config.settleMs + config.switchTimeoutMs, millis() - surveyStartMs);
+
+    // a failed switch leaves the manager free to survey again
+    TEST_ASSERT_TRUE(manager.startSurvey(channels, sizeof(channels)));
+}
+
+/*!
+The radio sends each handshake frame some time after it is queued. The receiver stays on the home channel until the SWITCH frame
+has been sent, so the transmitter receives it and follows, rather than the switch timing out.
+*/
+static void test_switch_waits_for_the_queued_handshake(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 7);
+    radio.channels[HOME_CHANNEL] = { 0.3F, 0 };
+    radio.channels[6] = { 0.0F, 0 };
+    radio.handshakeDelayMs = 5;
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6 };
+    manager.startSurvey(channels, sizeof(channels));
+    ChannelManager::state_t state = manager.getState();
+    while (state != ChannelManager::SWITCH_PENDING && manager.isBusy()) {
+        radio.advanceMs(1);
+        state = manager.update();
+    }
+    TEST_ASSERT_EQUAL(ChannelManager::SWITCH_PENDING, state);
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getChannel());
+
+    // the frame is sent on the home channel, and only then does the receiver retune
+    radio.advanceMs(radio.handshakeDelayMs);
+    TEST_ASSERT_EQUAL(ChannelManager::SWITCH_PENDING, manager.update());
+    TEST_ASSERT_EQUAL_UINT8(HOME_CHANNEL, radio.getChannel());
+    TEST_ASSERT_EQUAL_UINT8(6, radio.getTransmitterChannel());
+
+    TEST_ASSERT_EQUAL(ChannelManager::SWITCHED, run(radio, manager));
+    TEST_ASSERT_EQUAL_UINT8(6, radio.getChannel());
+    TEST_ASSERT_EQUAL_UINT8(6, radio.getTransmitterChannel());
+}
+
+/*!
+The jitter is scored over the candidate's dwell alone: a periodic channel surveyed after a jittery home channel scores no jitter,
+although the link's smoothed jitter, which carries over from the home channel and the retune gap, does not fall to zero over the dwell.
+*/
+static void test_jitter_is_measured_over_the_dwell(void)
+{
+    SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, 5);
+    radio.channels[HOME_CHANNEL] = { 0.0F, 4000 };
+    radio.channels[6] = { 0.0F, 0 };
+    ChannelManager manager(radio, clockMs);
+
+    const uint8_t channels[] { 1, 6 };
+    manager.startSurvey(channels, sizeof(channels));
+    run(radio, manager);
+    TEST_ASSERT_TRUE(findScore(manager, HOME_CHANNEL)->jitterUs > 1000);
+    TEST_ASSERT_EQUAL_UINT32(0, findScore(manager, 6)->jitterUs);
+    TEST_ASSERT_TRUE(radio.getLinkStatistics().getJitterUs() > 0);
+}
+
+/*!
+Random surveys of all 13 channels, each with its own loss and jitter. A survey is counted as correct if it ends on a channel
+whose true score is within the hysteresis of the best channel's. All retransmissions of a handshake are sometimes lost, so a few surveys
+keep a poorer channel, or fail to switch.
+*/
+static void test_selection_accuracy(void)
+{
+    enum { SURVEY_COUNT = 50 };
+    const ChannelManager::config_t config = ChannelManager::defaultConfig();
+    std::mt19937 generator(6);
+    std::uniform_real_distribution<float> loss(0.0F, 0.6F);
+    std::uniform_int_distribution<uint32_t> jitter(0, 3000);
+    uint8_t channels[ChannelManager::MAX_CANDIDATE_COUNT];
+    for (int ii = 0; ii < ChannelManager::MAX_CANDIDATE_COUNT; ++ii) {
+        channels[ii] = static_cast<uint8_t>(ii + 1);
+    }
+
+    int correctCount = 0;
+    int switchedCount = 0;
+    for (int survey = 0; survey < SURVEY_COUNT; ++survey) {
+        SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, static_cast<uint32_t>(survey));
+        float bestReceived = 0.0F;
+        for (uint8_t channel : channels) {
+            radio.channels[channel] = { loss(generator), jitter(generator) };
+            bestReceived = std::max(bestReceived, 1.0F - radio.channels[channel].lossProbability);
+        }
+        ChannelManager manager(radio, clockMs);
+        manager.startSurvey(channels, sizeof(channels));
+        if (run(radio, manager) == ChannelManager::SWITCHED) {
+            ++switchedCount;
+        }
+        // the jitter penalty is at most a few hundredths at this jitter, so is allowed for in the margin
+        const float received = 1.0F - radio.channels[radio.getTransmitterChannel()].lossProbability;
+        if (radio.getChannel() == radio.getTransmitterChannel() && received >= bestReceived - config.hysteresis - 0.05F) {
+            ++correctCount;
+        }
+    }
+    printf("SELECTION %d of %d surveys correct, %d switched\n", correctCount, SURVEY_COUNT, switchedCount);
+    TEST_ASSERT_TRUE(correctCount >= SURVEY_COUNT * 8 / 10);
+}
+
+static void test_benchmark_survey(void)
+{
+    const uint8_t channels[] { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+    int switchedCount = 0;
+    const benchmark_result_t result = runBenchmark("13 channel survey, simulated", [&](uint64_t ii) {
+        SimulatedRadio radio(HOME_CHANNEL, INTERVAL_US, static_cast<uint32_t>(ii));
+        radio.channels[HOME_CHANNEL] = { 0.3F, 2000 };
+        radio.channels[9] = { 0.0F, 500 };
+        ChannelManager manager(radio, clockMs);
+        manager.startSurvey(channels, sizeof(channels));
+        if (run(radio, manager) == ChannelManager::SWITCHED) {
+            ++switchedCount;
+        }
+        doNotOptimize(manager.getScore(0).score);
+    });
+    TEST_ASSERT_TRUE(result.nsPerIteration > 0.0);
+    TEST_ASSERT_TRUE(switchedCount > 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_score);
+    RUN_TEST(test_switches_from_a_lossy_home_channel);
+    RUN_TEST(test_keeps_home_channel_within_the_hysteresis);
+    RUN_TEST(test_transmitter_without_the_handshake_keeps_home_channel);
+    RUN_TEST(test_switch_not_followed_returns_home);
+    RUN_TEST(test_switch_waits_for_the_queued_handshake);
+    RUN_TEST(test_jitter_is_measured_over_the_dwell);
+    RUN_TEST(test_selection_accuracy);
+    RUN_TEST(test_benchmark_survey);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+#include <ConfigStore.h>
+
+#include <cstdio>
+#include <cstring>
+#include <unity.h>
+
+/*
+ConfigStore round trips through the host's file, and rejection of records with another version, another size, or a bad checksum.
+*/
+
+static const char* STORE_FILE = "test_config_store.cfg";
+
+static ConfigStore::config_t makeConfig(void)
+{
+    ConfigStore::config_t config = ConfigStore::defaultConfig(6, 0.02F);
+    const uint8_t macAddress[ConfigStore::MAC_ADDRESS_LENGTH] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+    memcpy(config.peerMacAddress, macAddress, sizeof(macAddress));
+    config.isPeerSet = true;
+    config.isBiasSet = true;
+    config.bias[ConfigStore::THROTTLE] = 0.01F;
+    config.bias[ConfigStore::ROLL] = -0.02F;
+    config.bias[ConfigStore::PITCH] = 0.03F;
+    config.bias[ConfigStore::YAW] = -0.04F;
+    return config;
+}
+
+//! Change the byte at `offset` in the stored record, as a firmware update or a corrupted write would.
+static void changeStoredByte(size_t offset, uint8_t mask)
+{
+    FILE* file = std::fopen(STORE_FILE, "r+b");
+    TEST_ASSERT_NOT_NULL(file);
+    std::fseek(file, static_cast<long>(offset), SEEK_SET);
+    const int byte = std::fgetc(file);
+    TEST_ASSERT_TRUE(byte != EOF);
+    std::fseek(file, static_cast<long>(offset), SEEK_SET);
+    std::fputc(byte ^ mask, file);
+    std::fclose(file);
+}
+
+void setUp(void)
+{
+    std::remove(STORE_FILE);
+}
+
+void tearDown(void)
+{
+    std::remove(STORE_FILE);
+}
+
+static void test_save_and_load_round_trip(void)
+{
+    ConfigStore store(STORE_FILE);
+    const ConfigStore::config_t saved = makeConfig();
+    TEST_ASSERT_TRUE(store.save(saved));
+    TEST_ASSERT_EQUAL_UINT32(1, store.getWriteCount());
+
+    // a second store, as after a power cycle
+    ConfigStore reloaded(STORE_FILE);
+    ConfigStore::config_t config = ConfigStore::defaultConfig(1, 0.0F);
+    TEST_ASSERT_EQUAL(ConfigStore::LOADED, reloaded.load(config));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(saved.peerMacAddress, config.peerMacAddress, ConfigStore::MAC_ADDRESS_LENGTH);
+    TEST_ASSERT_EQUAL_UINT8(1, config.isPeerSet);
+    TEST_ASSERT_EQUAL_UINT8(6, config.channel);
+    TEST_ASSERT_EQUAL_UINT8(1, config.isBiasSet);
+    TEST_ASSERT_EQUAL_FLOAT(0.02F, config.deadZone);
+    for (int ii = 0; ii < ConfigStore::AXIS_COUNT; ++ii) {
+        TEST_ASSERT_EQUAL_FLOAT(saved.bias[ii], config.bias[ii]);
+    }
+}
+
+static void test_missing_record_is_not_found(void)
+{
+    ConfigStore store(STORE_FILE);
+    ConfigStore::config_t config = ConfigStore::defaultConfig(1, 0.05F);
+    TEST_ASSERT_EQUAL(ConfigStore::NOT_FOUND, store.load(config));
+    // the defaults are left in place
+    TEST_ASSERT_EQUAL_UINT8(1, config.channel);
+    TEST_ASSERT_EQUAL_UINT8(0, config.isPeerSet);
+}
+
+static void test_other_version_or_size_is_wrong_version(void)
+{
+    // the record starts with a 16 bit version, followed by the 16 bit size of config_t
+    enum { VERSION_OFFSET = 0, SIZE_OFFSET = 2 };
+    ConfigStore store(STORE_FILE);
+    store.save(makeConfig());
+    changeStoredByte(VERSION_OFFSET, 0x02U);
+    ConfigStore::config_t config = ConfigStore::defaultConfig(1, 0.05F);
+    TEST_ASSERT_EQUAL(ConfigStore::WRONG_VERSION, ConfigStore(STORE_FILE).load(config));
+    TEST_ASSERT_EQUAL_UINT8(1, config.channel);
+
+    store.erase();
+    store.save(makeConfig());
+    changeStoredByte(SIZE_OFFSET, 0x04U);
+    TEST_ASSERT_EQUAL(ConfigStore::WRONG_VERSION, ConfigStore(STORE_FILE).load(config));
+    TEST_ASSERT_EQUAL_UINT8(1, config.channel);
+}
+
+static void test_flipped_byte_is_bad_checksum(void)
+{
+    enum { CONFIG_OFFSET = 4 };
+    ConfigStore store(STORE_FILE);
+    store.save(makeConfig());
+    // the first byte of the peer's MAC address
+    changeStoredByte(CONFIG_OFFSET, 0x01U);
+    ConfigStore::config_t config = ConfigStore::defaultConfig(1, 0.05F);
+    TEST_ASSERT_EQUAL(ConfigStore::BAD_CHECKSUM, ConfigStore(STORE_FILE).load(config));
+    TEST_ASSERT_EQUAL_UINT8(0, config.isPeerSet);
+}
+
+static void test_erased_record_is_not_found(void)
+{
+    ConfigStore store(STORE_FILE);
+    store.save(makeConfig());
+    TEST_ASSERT_TRUE(store.erase());
+    ConfigStore::config_t config = ConfigStore::defaultConfig(1, 0.05F);
+    TEST_ASSERT_EQUAL(ConfigStore::NOT_FOUND, store.load(config));
+    TEST_ASSERT_EQUAL(ConfigStore::NOT_FOUND, ConfigStore(STORE_FILE).load(config));
+
+    // after an erase the same configuration is written again
+    TEST_ASSERT_TRUE(store.save(makeConfig()));
+    TEST_ASSERT_EQUAL_UINT32(2, store.getWriteCount());
+    TEST_ASSERT_EQUAL(ConfigStore::LOADED, ConfigStore(STORE_FILE).load(config));
+}
+
+static void test_unchanged_save_is_not_written(void)
+{
+    ConfigStore store(STORE_FILE);
+    ConfigStore::config_t config = makeConfig();
+    TEST_ASSERT_TRUE(store.save(config));
+    TEST_ASSERT_TRUE(store.save(config));
+    TEST_ASSERT_EQUAL_UINT32(1, store.getWriteCount());
+
+    // stale bytes in the reserved field do not count as a change
+    memset(config.reserved, 0xA5, sizeof(config.reserved));
+    TEST_ASSERT_TRUE(store.save(config));
+    TEST_ASSERT_EQUAL_UINT32(1, store.getWriteCount());
+
+    config.channel = 11;
+    TEST_ASSERT_TRUE(store.save(config));
+    TEST_ASSERT_EQUAL_UINT32(2, store.getWriteCount());
+
+    // a loaded configuration is not rewritten either
+    ConfigStore reloaded(STORE_FILE);
+    ConfigStore::config_t loaded = ConfigStore::defaultConfig(1, 0.0F);
+    TEST_ASSERT_EQUAL(ConfigStore::LOADED, reloaded.load(loaded));
+    TEST_ASSERT_TRUE(reloaded.save(loaded));
+    TEST_ASSERT_EQUAL_UINT32(0, reloaded.getWriteCount());
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_save_and_load_round_trip);
+    RUN_TEST(test_missing_record_is_not_found);
+    RUN_TEST(test_other_version_or_size_is_wrong_version);
+    RUN_TEST(test_flipped_byte_is_bad_checksum);
+    RUN_TEST(test_erased_record_is_not_found);
+    RUN_TEST(test_unchanged_save_is_not_written);
+    return UNITY_END();
+}
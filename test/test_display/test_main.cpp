@@ -0,0 +1,190 @@
+#include <Display.h>
+
+#include <Benchmark.h>
+#include <cmath>
+#include <unity.h>
+
+/*
+Display layout and cost, using the fake LCD, which counts the pixels sent to the panel.
+
+The time to send a frame is estimated from the pixel count, at 16 bits per pixel over a 27MHz SPI bus.
+*/
+
+enum { PACKETS_PER_SECOND = 100, FRAMES_PER_SECOND = 10, BITS_PER_PIXEL = 16, SPI_FREQUENCY_MHZ = 27 };
+
+static const uint8_t myMacAddress[6] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[6] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+static uint32_t spiTimeUs(uint64_t pixelCount)
+{
+    return static_cast<uint32_t>(pixelCount * BITS_PER_PIXEL / SPI_FREQUENCY_MHZ);
+}
+
+static void setScreen(int screenHeight)
+{
+    M5.Lcd.setRotation(0);
+    if (screenHeight == Display::SCREEN_HEIGHT_M5_STICK_C) {
+        M5.Lcd.setPanelSize(80, 160);
+        M5.Lcd.setTextSize(1);
+    } else {
+        M5.Lcd.setPanelSize(135, 240);
+        M5.Lcd.setTextSize(2);
+    }
+    M5.Lcd.pixelCount = 0;
+    M5.Lcd.outOfBoundsCount = 0;
+}
+
+static Display::controls_t makeControls(int packet)
+{
+    const float t = static_cast<float>(packet) * 0.05F;
+    return Display::controls_t { std::sin(t), std::cos(t), std::sin(2.0F * t), 0.0F, 100.0F * std::sin(t), 100.0F * std::cos(t), 0, 1, 0 };
+}
+
+void setUp(void)
+{
+    M5Canvas::failCreateSprite = false;
+}
+
+void tearDown(void)
+{
+    M5Canvas::failCreateSprite = false;
+    setScreen(Display::SCREEN_HEIGHT_M5_STICK_C);
+}
+
+static void checkFieldsWithinScreen(int screenHeight)
+{
+    setScreen(screenHeight);
+    // draw directly to the LCD, so the fake checks each field against the edges of the screen
+    M5Canvas::failCreateSprite = true;
+    Display display(screenHeight, myMacAddress);
+    display.begin();
+    display.setJoyStickMacAddress(joyStickMacAddress);
+    display.setButton('P');
+    // the widest text of every field
+    display.setControls(Display::controls_t { -1.0F, -1.0F, -1.0F, -1.0F, -100.0F, -100.0F, 9, 9, 9 });
+    display.renderFrame();
+    // every field is drawn: 4 MAC address lines, 5 stick and mode lines, speed, angle, and button
+    TEST_ASSERT_EQUAL_UINT32(12, display.getStatistics().fieldsDrawnCount);
+    TEST_ASSERT_EQUAL_UINT32(0, M5.Lcd.outOfBoundsCount);
+}
+
+static void test_fields_within_m5_stick_c_screen(void)
+{
+    checkFieldsWithinScreen(Display::SCREEN_HEIGHT_M5_STICK_C);
+}
+
+static void test_fields_within_m5_stick_c_plus_screen(void)
+{
+    checkFieldsWithinScreen(Display::SCREEN_HEIGHT_M5_STICK_C_PLUS);
+}
+
+static void test_frame_rate_is_clamped(void)
+{
+    Display display(Display::SCREEN_HEIGHT_M5_STICK_C, myMacAddress);
+    display.begin(0);
+    TEST_ASSERT_EQUAL_UINT32(1000, display.getFramePeriodMs());
+    display.begin(5000);
+    TEST_ASSERT_EQUAL_UINT32(1, display.getFramePeriodMs());
+    display.begin(FRAMES_PER_SECOND);
+    TEST_ASSERT_EQUAL_UINT32(1000 / FRAMES_PER_SECOND, display.getFramePeriodMs());
+}
+
+static void test_unchanged_fields_are_not_redrawn(void)
+{
+    setScreen(Display::SCREEN_HEIGHT_M5_STICK_C);
+    Display display(Display::SCREEN_HEIGHT_M5_STICK_C, myMacAddress);
+    display.begin();
+    display.setControls(makeControls(0));
+    display.renderFrame();
+    const uint64_t pixelCount = M5.Lcd.pixelCount;
+    const uint32_t fieldsDrawnCount = display.getStatistics().fieldsDrawnCount;
+    display.renderFrame();
+    TEST_ASSERT_EQUAL_UINT32(fieldsDrawnCount, display.getStatistics().fieldsDrawnCount);
+    TEST_ASSERT_TRUE(M5.Lcd.pixelCount == pixelCount);
+}
+
+/*!
+Before: every packet redrew the stick, mode, speed, and angle fields directly on the LCD, in the control loop.
+*/
+static uint64_t redrawAllFieldsPerPacket(int packet, int lineHeight)
+{
+    const Display::controls_t controls = makeControls(packet);
+    const uint64_t startPixelCount = M5.Lcd.pixelCount;
+    int y = 60;
+    M5.Lcd.setCursor(5, y);
+    M5.Lcd.printf("T:%6.3f", controls.throttle);
+    M5.Lcd.setCursor(5, y += lineHeight);
+    M5.Lcd.printf("R:%6.3f", controls.roll);
+    M5.Lcd.setCursor(5, y += lineHeight);
+    M5.Lcd.printf("P:%6.3f", controls.pitch);
+    M5.Lcd.setCursor(5, y += lineHeight);
+    M5.Lcd.printf("Y:%6.3f", controls.yaw);
+    M5.Lcd.setCursor(5, y += lineHeight);
+    M5.Lcd.printf("M%d A%d F%d", controls.mode, controls.altMode, controls.flipButton);
+    M5.Lcd.setCursor(0, 125);
+    M5.Lcd.printf("S%4.0f", controls.speed);
+    M5.Lcd.setCursor(40, 125);
+    M5.Lcd.printf("A%4.0f", controls.angle);
+    return M5.Lcd.pixelCount - startPixelCount;
+}
+
+static void test_render_cost_before_and_after(void)
+{
+    setScreen(Display::SCREEN_HEIGHT_M5_STICK_C);
+    uint64_t beforePixelCount = 0;
+    for (int packet = 0; packet < PACKETS_PER_SECOND; ++packet) {
+        beforePixelCount += redrawAllFieldsPerPacket(packet, 10);
+    }
+    const uint32_t beforeBlockedUs = spiTimeUs(beforePixelCount);
+
+    // after: the control loop publishes a snapshot per packet, and the render task draws the changed fields at the frame rate
+    setScreen(Display::SCREEN_HEIGHT_M5_STICK_C);
+    Display display(Display::SCREEN_HEIGHT_M5_STICK_C, myMacAddress);
+    display.begin(FRAMES_PER_SECOND);
+    display.setJoyStickMacAddress(joyStickMacAddress);
+    display.setControls(makeControls(0));
+    display.renderFrame(); // the static fields are drawn once
+    M5.Lcd.pixelCount = 0;
+    for (int packet = 0; packet < PACKETS_PER_SECOND; ++packet) {
+        display.setControls(makeControls(packet));
+        if (packet % (PACKETS_PER_SECOND / FRAMES_PER_SECOND) == 0) {
+            display.renderFrame();
+        }
+    }
+    const uint32_t afterRenderUs = spiTimeUs(M5.Lcd.pixelCount);
+
+    // with USE_SYNCHRONOUS_DISPLAY the changed fields are rendered per packet, in the control loop
+    M5.Lcd.pixelCount = 0;
+    for (int packet = 0; packet < PACKETS_PER_SECOND; ++packet) {
+        display.setControls(makeControls(packet + 1000));
+        display.renderFrame();
+    }
+    const uint32_t synchronousBlockedUs = spiTimeUs(M5.Lcd.pixelCount);
+
+    const Display::controls_t controls = makeControls(1);
+    const benchmark_result_t setControls = runBenchmark("Display::setControls", [&](uint64_t) {
+        display.setControls(controls);
+    });
+
+    printf("DISPLAY before: %u pixels/packet, %uus SPI per packet, control loop blocked %uus/s\n",
+        static_cast<uint32_t>(beforePixelCount / PACKETS_PER_SECOND), beforeBlockedUs / PACKETS_PER_SECOND, beforeBlockedUs);
+    printf("DISPLAY after:  %uus SPI per frame at %d frames/s in the render task, control loop blocked %uns per packet\n",
+        afterRenderUs / FRAMES_PER_SECOND, FRAMES_PER_SECOND, static_cast<uint32_t>(setControls.nsPerIteration));
+    printf("DISPLAY synchronous: %uus SPI per packet, control loop blocked %uus/s\n",
+        synchronousBlockedUs / PACKETS_PER_SECOND, synchronousBlockedUs);
+
+    TEST_ASSERT_TRUE(afterRenderUs < beforeBlockedUs);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_fields_within_m5_stick_c_screen);
+    RUN_TEST(test_fields_within_m5_stick_c_plus_screen);
+    RUN_TEST(test_frame_rate_is_clamped);
+    RUN_TEST(test_unchanged_fields_are_not_redrawn);
+    RUN_TEST(test_render_cost_before_and_after);
+    return UNITY_END();
+}
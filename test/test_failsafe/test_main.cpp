@@ -0,0 +1,175 @@
+#include <FailsafeWatchdog.h>
+
+#include <unity.h>
+#include <vector>
+
+/*
+FailsafeWatchdog stop timing, checked against a simulated millisecond clock.
+*/
+
+static uint32_t timeMs = 0;
+static uint32_t clockMs() { return timeMs; }
+
+enum { TIMEOUT_MS = FailsafeWatchdog::DEFAULT_TIMEOUT_MS, HOLD_MS = FailsafeWatchdog::DEFAULT_HOLD_MS, RAMP_DOWN_MS = FailsafeWatchdog::DEFAULT_RAMP_DOWN_MS };
+enum { STOP_MS = TIMEOUT_MS + HOLD_MS + RAMP_DOWN_MS };
+
+/*!
+Step the clock 1ms at a time, feeding the watchdog at each of `packetTimesMs`, until `endMs`.
+
+Returns the time at which the watchdog first reached STOPPED, or UINT32_MAX if it did not stop.
+*/
+static uint32_t runPacketPattern(FailsafeWatchdog& watchdog, const std::vector<uint32_t>& packetTimesMs, uint32_t endMs)
+{
+    size_t next = 0;
+    uint32_t stoppedMs = UINT32_MAX;
+    const uint32_t startMs = timeMs;
+    for (uint32_t t = 0; t <= endMs; ++t) {
+        timeMs = startMs + t;
+        if (next < packetTimesMs.size() && packetTimesMs[next] == t) {
+            watchdog.feed();
+            ++next;
+        }
+        if (watchdog.update() == FailsafeWatchdog::STOPPED && stoppedMs == UINT32_MAX) {
+            stoppedMs = t;
+        }
+    }
+    return stoppedMs;
+}
+
+void setUp(void)
+{
+    timeMs = 1000;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_stage_boundaries(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    const uint32_t fedMs = timeMs;
+
+    timeMs = fedMs + TIMEOUT_MS;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::ACTIVE, watchdog.update());
+    timeMs = fedMs + TIMEOUT_MS + 1;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::HOLD, watchdog.update());
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, watchdog.getSpeedScale());
+
+    timeMs = fedMs + TIMEOUT_MS + HOLD_MS;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::HOLD, watchdog.update());
+    timeMs = fedMs + TIMEOUT_MS + HOLD_MS + 1;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::RAMP_DOWN, watchdog.update());
+
+    timeMs = fedMs + TIMEOUT_MS + HOLD_MS + RAMP_DOWN_MS / 2;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::RAMP_DOWN, watchdog.update());
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.5F, watchdog.getSpeedScale());
+
+    timeMs = fedMs + STOP_MS - 1;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::RAMP_DOWN, watchdog.update());
+    TEST_ASSERT_TRUE(watchdog.getSpeedScale() > 0.0F);
+    TEST_ASSERT_EQUAL_UINT32(0, watchdog.getStopCount());
+
+    timeMs = fedMs + STOP_MS;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::STOPPED, watchdog.update());
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, watchdog.getSpeedScale());
+    TEST_ASSERT_EQUAL_UINT32(1, watchdog.getStopCount());
+}
+
+static void test_speed_scale_ramps_monotonically(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    const uint32_t fedMs = timeMs;
+    float previous = 1.0F;
+    for (uint32_t t = 0; t <= STOP_MS; ++t) {
+        timeMs = fedMs + t;
+        watchdog.update();
+        TEST_ASSERT_TRUE(watchdog.getSpeedScale() <= previous);
+        previous = watchdog.getSpeedScale();
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, previous);
+}
+
+static void test_gaps_shorter_than_timeout_never_stop(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    // 10ms packets with bursts of loss, the longest gap being exactly the timeout
+    std::vector<uint32_t> packetTimesMs;
+    for (uint32_t t = 0; t <= 2000; t += 10) {
+        if ((t > 300 && t < 360) || (t > 1000 && t < 1100)) {
+            continue;
+        }
+        packetTimesMs.push_back(t);
+    }
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, runPacketPattern(watchdog, packetTimesMs, 2000));
+    TEST_ASSERT_EQUAL_UINT32(0, watchdog.getStopCount());
+}
+
+static void test_stop_time_after_last_packet(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    const std::vector<uint32_t> packetTimesMs { 0, 10, 20, 30, 137 };
+    const uint32_t stoppedMs = runPacketPattern(watchdog, packetTimesMs, 1000);
+    TEST_ASSERT_EQUAL_UINT32(137 + STOP_MS, stoppedMs);
+    // remaining stopped is counted once
+    TEST_ASSERT_EQUAL_UINT32(1, watchdog.getStopCount());
+}
+
+static void test_gap_during_ramp_down_recovers(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    // a packet arrives part way through the ramp down, and the link is then lost for good
+    const std::vector<uint32_t> packetTimesMs { 0, 350 };
+    const uint32_t stoppedMs = runPacketPattern(watchdog, packetTimesMs, 1000);
+    TEST_ASSERT_EQUAL_UINT32(350 + STOP_MS, stoppedMs);
+    TEST_ASSERT_EQUAL_UINT32(1, watchdog.getStopCount());
+}
+
+static void test_feed_after_stop_restores_full_speed(void)
+{
+    FailsafeWatchdog watchdog(clockMs);
+    timeMs += STOP_MS;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::STOPPED, watchdog.update());
+
+    watchdog.feed();
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::ACTIVE, watchdog.getStage());
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, watchdog.getSpeedScale());
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::ACTIVE, watchdog.update());
+
+    timeMs += STOP_MS;
+    TEST_ASSERT_EQUAL(FailsafeWatchdog::STOPPED, watchdog.update());
+    TEST_ASSERT_EQUAL_UINT32(2, watchdog.getStopCount());
+}
+
+static void test_clock_wraparound(void)
+{
+    timeMs = UINT32_MAX - 50;
+    FailsafeWatchdog watchdog(clockMs);
+    const std::vector<uint32_t> packetTimesMs { 0, 40, 80 };
+    const uint32_t stoppedMs = runPacketPattern(watchdog, packetTimesMs, 1000);
+    TEST_ASSERT_EQUAL_UINT32(80 + STOP_MS, stoppedMs);
+}
+
+static void test_custom_config(void)
+{
+    const FailsafeWatchdog::config_t config { 50, 0, 100 };
+    FailsafeWatchdog watchdog(clockMs, config);
+    const std::vector<uint32_t> packetTimesMs { 0 };
+    TEST_ASSERT_EQUAL_UINT32(150, runPacketPattern(watchdog, packetTimesMs, 500));
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_stage_boundaries);
+    RUN_TEST(test_speed_scale_ramps_monotonically);
+    RUN_TEST(test_gaps_shorter_than_timeout_never_stop);
+    RUN_TEST(test_stop_time_after_last_packet);
+    RUN_TEST(test_gap_during_ramp_down_recovers);
+    RUN_TEST(test_feed_after_stop_restores_full_speed);
+    RUN_TEST(test_clock_wraparound);
+    RUN_TEST(test_custom_config);
+    return UNITY_END();
+}
@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <AtomJoyStickReceiver.h>
+#include <FleetCodec.h>
+#include <PacketCapture.h>
+
+#include <unity.h>
+
+/*
+Fleet codec tests, and a simulation of the airtime used by fleet mode and by one-to-one pairing as the fleet grows.
+*/
+
+enum { MAX_SLOT_COUNT = 15, PACKETS_PER_SECOND = 100, FLEET_ID = 7 };
+
+typedef FleetCodec<FleetCodec<>::ANY_SLOT, FLEET_ID> fleet_codec_t;
+
+static const uint8_t transmitterMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+static void makeRoverMacAddress(int rover, uint8_t* macAddress)
+{
+    const uint8_t base[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x00 };
+    memcpy(macAddress, base, ESP_NOW_ETH_ALEN);
+    macAddress[5] = static_cast<uint8_t>(0x30 + rover);
+}
+
+static int encodeFleetFrame(int slotCount, uint8_t fleetId, uint8_t sequence, uint8_t* packet)
+{
+    fleet_codec_t::slot_command_t commands[MAX_SLOT_COUNT] {};
+    for (int ii = 0; ii < slotCount; ++ii) {
+        uint8_t macAddress[ESP_NOW_ETH_ALEN];
+        makeRoverMacAddress(ii, macAddress);
+        memcpy(commands[ii].macAddressSuffix, &macAddress[3], 3);
+        commands[ii].frame.throttle = static_cast<float>(ii) / MAX_SLOT_COUNT;
+        commands[ii].frame.roll = -0.5F;
+        commands[ii].frame.pitch = 0.25F;
+        commands[ii].frame.yaw = 1.0F;
+        commands[ii].frame.mode = static_cast<uint8_t>(ii & 1);
+        commands[ii].frame.altMode = joystick_frame_t::ALT_MODE_MANUAL;
+    }
+    return fleet_codec_t::encode(packet, fleetId, sequence, commands, slotCount);
+}
+
+/*!
+Airtime of an ESP-NOW frame at the default 1Mbps rate: the 192us long preamble and PLCP header,
+then the 802.11 header, FCS, and vendor specific action frame header, 43 bytes in all, and the payload.
+A unicast frame is acknowledged, a broadcast frame is not. Contention backoff is not included.
+*/
+static uint32_t airtimeUs(int payloadLength, bool unicast)
+{
+    enum { PREAMBLE_US = 192, OVERHEAD_BYTES = 43, SIFS_US = 10, ACK_US = 192 + 14 * 8 };
+    return PREAMBLE_US + static_cast<uint32_t>(OVERHEAD_BYTES + payloadLength) * 8 + (unicast ? SIFS_US + ACK_US : 0);
+}
+
+void setUp(void)
+{
+    FakeEspNow::reset();
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_full_fleet_frame_fits(void)
+{
+    static_assert(fleet_codec_t::frameSize(MAX_SLOT_COUNT) == fleet_codec_t::MAX_PACKET_SIZE);
+    uint8_t packet[fleet_codec_t::frameSize(MAX_SLOT_COUNT)];
+    TEST_ASSERT_EQUAL(126, encodeFleetFrame(MAX_SLOT_COUNT, FLEET_ID, 0, packet));
+    TEST_ASSERT_TRUE(fleet_codec_t::isChecksumValid(packet, sizeof(packet)));
+}
+
+static void test_each_rover_decodes_its_slot(void)
+{
+    uint8_t packet[fleet_codec_t::frameSize(MAX_SLOT_COUNT)];
+    const int len = encodeFleetFrame(MAX_SLOT_COUNT, FLEET_ID, 0, packet);
+    for (int rover = 0; rover < MAX_SLOT_COUNT; ++rover) {
+        uint8_t macAddress[ESP_NOW_ETH_ALEN];
+        makeRoverMacAddress(rover, macAddress);
+        joystick_frame_t frame {};
+        TEST_ASSERT_TRUE(fleet_codec_t::decode(packet, len, macAddress, frame));
+        TEST_ASSERT_FLOAT_WITHIN(1.0F / 127.0F, static_cast<float>(rover) / MAX_SLOT_COUNT, frame.throttle);
+        TEST_ASSERT_FLOAT_WITHIN(1.0F / 127.0F, -0.5F, frame.roll);
+        TEST_ASSERT_EQUAL_FLOAT(1.0F, frame.yaw);
+        TEST_ASSERT_EQUAL_UINT8(rover & 1, frame.mode);
+        TEST_ASSERT_EQUAL_UINT8(joystick_frame_t::ALT_MODE_MANUAL, frame.altMode);
+    }
+    // a rover with no slot
+    uint8_t macAddress[ESP_NOW_ETH_ALEN];
+    makeRoverMacAddress(MAX_SLOT_COUNT, macAddress);
+    TEST_ASSERT_FALSE(fleet_codec_t::isAddressedTo(packet, len, macAddress));
+
+    // by slot index, the MAC address is ignored
+    joystick_frame_t frame {};
+    TEST_ASSERT_TRUE((FleetCodec<3, FLEET_ID>::decode(packet, len, macAddress, frame)));
+    TEST_ASSERT_FLOAT_WITHIN(1.0F / 127.0F, 3.0F / MAX_SLOT_COUNT, frame.throttle);
+    // a slot index beyond the slots in the frame
+    const int shortLen = encodeFleetFrame(4, FLEET_ID, 1, packet);
+    TEST_ASSERT_FALSE((FleetCodec<4, FLEET_ID>::decode(packet, shortLen, macAddress, frame)));
+}
+
+//! Only ALT_MODE_MANUAL is sent as manual, any other altitude mode, including the zero of an unset frame, is sent as auto.
+static void test_alt_mode_other_than_manual_is_sent_as_auto(void)
+{
+    uint8_t macAddress[ESP_NOW_ETH_ALEN];
+    makeRoverMacAddress(0, macAddress);
+    const uint8_t altModes[] { joystick_frame_t::ALT_MODE_MANUAL, joystick_frame_t::ALT_MODE_AUTO, 0, 9 };
+    const uint8_t expected[] { joystick_frame_t::ALT_MODE_MANUAL, joystick_frame_t::ALT_MODE_AUTO, joystick_frame_t::ALT_MODE_AUTO, joystick_frame_t::ALT_MODE_AUTO };
+    for (size_t ii = 0; ii < sizeof(altModes); ++ii) {
+        fleet_codec_t::slot_command_t command {};
+        memcpy(command.macAddressSuffix, &macAddress[3], 3);
+        command.frame.altMode = altModes[ii];
+        uint8_t packet[fleet_codec_t::frameSize(1)];
+        const int len = fleet_codec_t::encode(packet, FLEET_ID, 0, &command, 1);
+        joystick_frame_t frame {};
+        TEST_ASSERT_TRUE(fleet_codec_t::decode(packet, len, macAddress, frame));
+        TEST_ASSERT_EQUAL_UINT8(expected[ii], frame.altMode);
+    }
+}
+
+static void test_frames_from_another_fleet_are_rejected(void)
+{
+    uint8_t packet[fleet_codec_t::frameSize(MAX_SLOT_COUNT)];
+    const int len = encodeFleetFrame(4, FLEET_ID + 1, 0, packet);
+    uint8_t macAddress[ESP_NOW_ETH_ALEN];
+    makeRoverMacAddress(0, macAddress);
+    joystick_frame_t frame {};
+    TEST_ASSERT_TRUE(fleet_codec_t::isChecksumValid(packet, len));
+    TEST_ASSERT_FALSE(fleet_codec_t::isAddressedTo(packet, len, macAddress));
+    TEST_ASSERT_FALSE(fleet_codec_t::decode(packet, len, macAddress, frame));
+    TEST_ASSERT_FALSE((FleetCodec<0, FLEET_ID>::isAddressedTo(packet, len, macAddress)));
+
+    // through the receiver, the frame is rejected by the receive filter and counted as misaddressed
+    static AtomJoyStickReceiver receiver(macAddress, makePacketCodec<fleet_codec_t>());
+    receiver.init(1, transmitterMacAddress);
+    FakeEspNow::receive(transmitterMacAddress, packet, len);
+    TEST_ASSERT_FALSE(receiver.unpackPacket());
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.getLinkStatistics().getWrongMacAddressCount());
+
+    encodeFleetFrame(4, FLEET_ID, 1, packet);
+    FakeEspNow::receive(transmitterMacAddress, packet, len);
+    TEST_ASSERT_TRUE(receiver.unpackPacket());
+}
+
+static void test_full_fleet_frame_is_captured_and_replayed(void)
+{
+    uint8_t macAddress[ESP_NOW_ETH_ALEN];
+    makeRoverMacAddress(MAX_SLOT_COUNT - 1, macAddress);
+    static AtomJoyStickReceiver receiver(macAddress, makePacketCodec<fleet_codec_t>());
+    receiver.init(1, transmitterMacAddress);
+    static PacketCaptureBuffer<4, fleet_codec_t::MAX_PACKET_SIZE> capture;
+    receiver.getTransceiver().setPacketCapture(&capture);
+
+    uint8_t packet[fleet_codec_t::frameSize(MAX_SLOT_COUNT)];
+    const int len = encodeFleetFrame(MAX_SLOT_COUNT, FLEET_ID, 0, packet);
+    FakeEspNow::receive(transmitterMacAddress, packet, len);
+    receiver.getTransceiver().setPacketCapture(nullptr);
+    TEST_ASSERT_TRUE(receiver.unpackPacket());
+    const float throttle = receiver.getThrottleRaw();
+
+    TEST_ASSERT_EQUAL_UINT32(1, capture.getRecordCount());
+    const auto& record = capture.getRecord(0);
+    TEST_ASSERT_EQUAL_UINT8(len, record.len);
+    TEST_ASSERT_EQUAL_MEMORY(packet, record.data, len);
+
+    // the last slot is at the end of the frame, so it is only decoded if the whole frame was captured
+    receiver.resetControls();
+    PacketReplay replay(receiver.getTransceiver(), &record, 1);
+    replay.begin(0);
+    TEST_ASSERT_EQUAL_UINT32(1, replay.update(0));
+    TEST_ASSERT_TRUE(receiver.unpackPacket());
+    TEST_ASSERT_EQUAL_FLOAT(throttle, receiver.getThrottleRaw());
+}
+
+/*!
+Simulate one second of control for fleets of 1 to 15 rovers: in fleet mode one transmitter broadcasts a frame with a slot for every rover,
+in one-to-one pairing each rover's joystick unicasts its own AtomJoyStick packet.
+*/
+static void test_airtime_against_fleet_size(void)
+{
+    printf("FLEET rovers  fleet:frames/s bytes airtime%%   one-to-one:frames/s bytes airtime%%\n");
+    const int fleetSizes[] { 1, 2, 4, 8, 15 };
+    for (int fleetSize : fleetSizes) {
+        uint32_t fleetFrames = 0;
+        uint32_t fleetBytes = 0;
+        uint32_t fleetAirtimeUs = 0;
+        uint32_t pairedFrames = 0;
+        uint32_t pairedBytes = 0;
+        uint32_t pairedAirtimeUs = 0;
+        for (int tick = 0; tick < PACKETS_PER_SECOND; ++tick) {
+            uint8_t packet[fleet_codec_t::frameSize(MAX_SLOT_COUNT)];
+            const int len = encodeFleetFrame(fleetSize, FLEET_ID, static_cast<uint8_t>(tick), packet);
+            ++fleetFrames;
+            fleetBytes += static_cast<uint32_t>(len);
+            fleetAirtimeUs += airtimeUs(len, false);
+            // every rover gets its command from the one frame
+            for (int rover = 0; rover < fleetSize; ++rover) {
+                uint8_t macAddress[ESP_NOW_ETH_ALEN];
+                makeRoverMacAddress(rover, macAddress);
+                joystick_frame_t frame {};
+                TEST_ASSERT_TRUE(fleet_codec_t::decode(packet, len, macAddress, frame));
+            }
+            for (int rover = 0; rover < fleetSize; ++rover) {
+                ++pairedFrames;
+                pairedBytes += AtomJoyStickCodec::PACKET_SIZE;
+                pairedAirtimeUs += airtimeUs(AtomJoyStickCodec::PACKET_SIZE, true);
+            }
+        }
+        printf("FLEET %6d  %14u %5u %7.1f%%   %19u %5u %7.1f%%\n", fleetSize,
+            fleetFrames, fleetBytes, 100.0 * fleetAirtimeUs / 1.0e6, pairedFrames, pairedBytes, 100.0 * pairedAirtimeUs / 1.0e6);
+        TEST_ASSERT_EQUAL_UINT32(PACKETS_PER_SECOND, fleetFrames);
+        TEST_ASSERT_EQUAL_UINT32(PACKETS_PER_SECOND * fleetSize, pairedFrames);
+        if (fleetSize > 1) {
+            TEST_ASSERT_TRUE(fleetAirtimeUs < pairedAirtimeUs);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_full_fleet_frame_fits);
+    RUN_TEST(test_each_rover_decodes_its_slot);
+    RUN_TEST(test_alt_mode_other_than_manual_is_sent_as_auto);
+    RUN_TEST(test_frames_from_another_fleet_are_rejected);
+    RUN_TEST(test_full_fleet_frame_is_captured_and_replayed);
+    RUN_TEST(test_airtime_against_fleet_size);
+    return UNITY_END();
+}
@@ -0,0 +1,259 @@
+#include <FakeI2C_Bus.h>
+#include <I2C_AsyncQueue.h>
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <freertos/task.h>
+#include <thread>
+#include <unity.h>
+
+/*
+I2C_AsyncQueue tests against a fake bus: posts are coalesced and sent in runs, failed runs are retried and requeued,
+and a write the register table has no room for is performed synchronously, in full.
+*/
+
+enum : uint8_t { ROVERC_ADDRESS = 0x38, OTHER_ADDRESS = 0x40 };
+
+static uint32_t clockUs() { return micros(); }
+
+void setUp(void)
+{
+    FakeTask::reset();
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_posts_are_coalesced_and_sent_in_runs(void)
+{
+    FakeI2C_Bus bus;
+    I2C_AsyncQueue queue(bus, clockUs);
+
+    const uint8_t motors[] { 10, 20, 30, 40 };
+    const uint8_t newerMotors[] { 11, 21 };
+    const uint8_t servos[] { 45, 45 };
+    TEST_ASSERT_EQUAL_UINT8(0, queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, sizeof(motors)));
+    queue.writeRegisters(ROVERC_ADDRESS, 0x10, servos, sizeof(servos));
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, newerMotors, sizeof(newerMotors));
+    TEST_ASSERT_EQUAL(0, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT32(6, queue.getDepth());
+
+    queue.process();
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getDepth());
+    // one transaction for the motors and one for the servos, with the latest values
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x00, bus.transactions[0].firstRegister);
+    TEST_ASSERT_EQUAL(4, bus.transactions[0].data.size());
+    TEST_ASSERT_EQUAL_HEX8(0x10, bus.transactions[1].firstRegister);
+    TEST_ASSERT_EQUAL_UINT8(11, bus.registers[0x00]);
+    TEST_ASSERT_EQUAL_UINT8(21, bus.registers[0x01]);
+    TEST_ASSERT_EQUAL_UINT8(30, bus.registers[0x02]);
+
+    const I2C_AsyncQueue::statistics_t& statistics = queue.getStatistics();
+    TEST_ASSERT_EQUAL_UINT32(8, statistics.postCount);
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.coalescedCount);
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.transactionCount);
+    TEST_ASSERT_EQUAL_UINT32(6, statistics.depthMax);
+    TEST_ASSERT_EQUAL_UINT32(6, statistics.latencyCount);
+
+    // nothing pending, nothing sent
+    queue.process();
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+}
+
+static void test_failed_run_is_retried_then_requeued(void)
+{
+    FakeI2C_Bus bus;
+    I2C_AsyncQueue queue(bus, clockUs);
+    const uint8_t motors[] { 10, 20, 30, 40 };
+
+    bus.failCount = 1;
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, sizeof(motors));
+    queue.process();
+    TEST_ASSERT_EQUAL(1, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStatistics().retryCount);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStatistics().failedCount);
+
+    // every attempt fails, so the values are requeued, and a newer value posted in the meantime is not overwritten
+    bus.failCount = I2C_AsyncQueue::MAX_RETRY_COUNT + 1;
+    const uint8_t newerMotors[] { 50, 60, 70, 80 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, newerMotors, sizeof(newerMotors));
+    queue.process();
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStatistics().failedCount);
+    TEST_ASSERT_EQUAL_UINT32(4, queue.getDepth());
+    const uint8_t newestMotor[] { 90 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, newestMotor, sizeof(newestMotor));
+    queue.process();
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT8(90, bus.registers[0x00]);
+    TEST_ASSERT_EQUAL_UINT8(60, bus.registers[0x01]);
+    TEST_ASSERT_EQUAL_UINT32(I2C_AsyncQueue::MAX_RETRY_COUNT + 2, static_cast<uint32_t>(bus.errorCount));
+}
+
+//! Use every entry in the register table, on another device, and leave them pending.
+static void fillTable(I2C_AsyncQueue& queue, int count)
+{
+    for (int ii = 0; ii < count; ++ii) {
+        const auto value = static_cast<uint8_t>(ii);
+        queue.writeRegisters(OTHER_ADDRESS, static_cast<uint8_t>(0x40 + 2 * ii), &value, 1); // not consecutive, so each is its own run
+    }
+}
+
+static void test_overflow_writes_the_whole_frame_synchronously(void)
+{
+    FakeI2C_Bus bus;
+    bus.transactionTimeUs = 300;
+    I2C_AsyncQueue queue(bus, clockUs);
+    // room for two of the four motor registers
+    fillTable(queue, I2C_AsyncQueue::MAX_REGISTER_COUNT - 2);
+    const uint32_t postCount = queue.getStatistics().postCount;
+
+    const uint8_t motors[] { 10, 20, 30, 40 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, sizeof(motors));
+    // the frame is written at once, as a single transaction, and none of it is left queued
+    TEST_ASSERT_EQUAL(1, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(ROVERC_ADDRESS, bus.transactions[0].address);
+    TEST_ASSERT_EQUAL(4, bus.transactions[0].data.size());
+    const I2C_AsyncQueue::statistics_t& statistics = queue.getStatistics();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.overflowCount);
+    TEST_ASSERT_EQUAL_UINT32(postCount, statistics.postCount);
+    TEST_ASSERT_EQUAL_UINT32(I2C_AsyncQueue::MAX_REGISTER_COUNT - 2, queue.getDepth());
+    TEST_ASSERT_EQUAL_UINT32(300, statistics.blockedMaxUs);
+
+    bus.clear();
+    queue.process();
+    TEST_ASSERT_EQUAL(I2C_AsyncQueue::MAX_REGISTER_COUNT - 2, bus.transactions.size());
+    for (const auto& transaction : bus.transactions) {
+        TEST_ASSERT_EQUAL_HEX8(OTHER_ADDRESS, transaction.address);
+    }
+
+    // the two free entries are still free, so a two register frame is queued
+    const uint8_t servos[] { 45, 45 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x10, servos, sizeof(servos));
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.overflowCount);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getDepth());
+}
+
+static void test_overflow_discards_older_pending_values(void)
+{
+    FakeI2C_Bus bus;
+    I2C_AsyncQueue queue(bus, clockUs);
+    const uint8_t oldMotors[] { 1, 2 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, oldMotors, sizeof(oldMotors));
+    fillTable(queue, I2C_AsyncQueue::MAX_REGISTER_COUNT - 2);
+
+    const uint8_t motors[] { 10, 20, 30, 40 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, sizeof(motors));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStatistics().overflowCount);
+    TEST_ASSERT_EQUAL_UINT32(I2C_AsyncQueue::MAX_REGISTER_COUNT - 2, queue.getDepth());
+    queue.process();
+    // the older values are not sent after the newer ones
+    for (const auto& transaction : bus.transactions) {
+        if (transaction.address == ROVERC_ADDRESS) {
+            TEST_ASSERT_EQUAL(4, transaction.data.size());
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT8(10, bus.registers[0x00]);
+    TEST_ASSERT_EQUAL_UINT8(20, bus.registers[0x01]);
+}
+
+/*!
+Bus on which the first transaction fails, and, while it is in progress, another task makes a write the table has no room for.
+*/
+class OverflowDuringBatchBus : public FakeI2C_Bus {
+public:
+    uint8_t writeRegisters(uint8_t address, uint8_t firstRegister, const uint8_t* data, size_t len) override {
+        if (queue != nullptr && !isWriterStarted) {
+            isWriterStarted = true;
+            writer = std::thread([this]() {
+                // the motors and two registers that are not in the full table
+                const uint8_t frame[] { 10, 20, 30, 40, 50, 60 };
+                queue->writeRegisters(ROVERC_ADDRESS, 0x00, frame, sizeof(frame));
+                isWritten = true;
+            });
+            // give the other task time to reach the bus, which it must not do until this batch has been requeued
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            isWrittenDuringBatch = isWritten.load();
+            failCount = I2C_AsyncQueue::MAX_RETRY_COUNT + 1;
+        }
+        return FakeI2C_Bus::writeRegisters(address, firstRegister, data, len);
+    }
+public:
+    I2C_AsyncQueue* queue {nullptr};
+    std::thread writer;
+    bool isWriterStarted {false};
+    std::atomic<bool> isWritten {false};
+    bool isWrittenDuringBatch {false};
+};
+
+static void test_failed_batch_is_not_requeued_over_a_synchronous_write(void)
+{
+    OverflowDuringBatchBus bus;
+    I2C_AsyncQueue queue(bus, clockUs);
+    const uint8_t oldMotors[] { 1, 2, 3, 4 };
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, oldMotors, sizeof(oldMotors));
+    fillTable(queue, I2C_AsyncQueue::MAX_REGISTER_COUNT - 4);
+
+    // the worker takes the batch and fails to write the old values, while another task writes newer ones synchronously
+    bus.queue = &queue;
+    queue.process();
+    bus.writer.join();
+    TEST_ASSERT_FALSE(bus.isWrittenDuringBatch);
+    TEST_ASSERT_TRUE(bus.isWritten);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStatistics().overflowCount);
+    TEST_ASSERT_EQUAL_UINT8(10, bus.registers[0x00]);
+
+    // the old values were requeued before the synchronous write discarded them, so are not sent
+    bus.queue = nullptr;
+    queue.process();
+    TEST_ASSERT_EQUAL_UINT8(10, bus.registers[0x00]);
+    TEST_ASSERT_EQUAL_UINT8(40, bus.registers[0x03]);
+    for (const auto& transaction : bus.transactions) {
+        TEST_ASSERT_FALSE(transaction.address == ROVERC_ADDRESS && transaction.data.size() == 4 && transaction.data[0] == 1);
+    }
+}
+
+static void test_worker_sends_on_notification(void)
+{
+    FakeI2C_Bus bus;
+    bus.transactionTimeUs = 200;
+    I2C_AsyncQueue queue(bus, clockUs);
+    queue.begin();
+    FakeTask::runForUs(1000);
+
+    const uint8_t motors[] { 10, 20, 30, 40 };
+    const uint32_t postTimeUs = micros();
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, sizeof(motors));
+    TEST_ASSERT_EQUAL(0, bus.transactions.size());
+    FakeTask::runForUs(1000);
+    TEST_ASSERT_EQUAL(1, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT32(postTimeUs, bus.transactions[0].timeUs);
+    TEST_ASSERT_EQUAL_UINT32(200, queue.getStatistics().latencyMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStatistics().blockedMaxUs);
+
+    // a requeued run is retried after the idle timeout, without a new post
+    bus.failCount = I2C_AsyncQueue::MAX_RETRY_COUNT + 1;
+    queue.writeRegisters(ROVERC_ADDRESS, 0x00, motors, 1);
+    FakeTask::runForUs(1000);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getDepth());
+    FakeTask::runForUs(I2C_AsyncQueue::IDLE_TIMEOUT_MS * 1000);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getDepth());
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_posts_are_coalesced_and_sent_in_runs);
+    RUN_TEST(test_failed_run_is_retried_then_requeued);
+    RUN_TEST(test_overflow_writes_the_whole_frame_synchronously);
+    RUN_TEST(test_overflow_discards_older_pending_values);
+    RUN_TEST(test_failed_batch_is_not_requeued_over_a_synchronous_write);
+    RUN_TEST(test_worker_sends_on_notification);
+    return UNITY_END();
+}
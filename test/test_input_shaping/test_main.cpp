@@ -0,0 +1,260 @@
+#include <AtomJoyStickReceiver.h>
+#include <Benchmark.h>
+#include <InputShaping.h>
+
+#include <cmath>
+#include <unity.h>
+
+/*
+InputShaping tests: each stage against its closed form, the bias estimator's outlier rejection, the composed chain,
+and a benchmark of the chain against the dead zone formula it replaced.
+*/
+
+typedef AtomJoyStickReceiver::axis_shaper_t axis_shaper_t;
+enum { BIAS_COUNT = 8 }; //!< as the receiver uses
+
+static shaping_parameters_t parameters(float bias, float deadZone, float expo=0.0F, float lowPassCutoffHz=0.0F, float sampleRateHz=0.0F)
+{
+    return shaping_parameters_t { bias, deadZone, expo, lowPassCutoffHz, sampleRateHz };
+}
+
+//! The dead zone formula used before the shaping chain, with two divisions per call.
+static float normalizedControlBefore(float raw, float bias, float deadZone)
+{
+    const float ret = raw - bias;
+    if (ret < -deadZone) {
+        return -(-deadZone - ret) / (bias - deadZone/2 - -1.0F);
+    }
+    if (ret > deadZone) {
+        return (ret - deadZone) / (1.0F - bias - deadZone/2);
+    }
+    return 0.0F;
+}
+
+//! Amplitude of the filter's response to a sine at `frequencyHz`, measured after the filter has settled.
+template <typename FILTER>
+static float sineGain(FILTER& filter, float frequencyHz, float sampleRateHz)
+{
+    const int sampleCount = static_cast<int>(sampleRateHz * 20.0F / frequencyHz);
+    float peak = 0.0F;
+    for (int ii = 0; ii < sampleCount; ++ii) {
+        const float output = filter.apply(std::sin(2.0F * static_cast<float>(M_PI) * frequencyHz * static_cast<float>(ii) / sampleRateHz));
+        if (ii > sampleCount / 2) {
+            peak = std::fmax(peak, std::fabs(output));
+        }
+    }
+    return peak;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_dead_zone_maps_full_travel_to_one_with_an_offset_center(void)
+{
+    ShapingChain<BiasStage, DeadZoneStage> chain;
+    chain.configure(parameters(0.1F, 0.05F));
+
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, chain.apply(1.0F));
+    TEST_ASSERT_EQUAL_FLOAT(-1.0F, chain.apply(-1.0F));
+    // the dead zone is around the center reading, not around zero
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, chain.apply(0.1F));
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, chain.apply(0.149F));
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, chain.apply(0.051F));
+    TEST_ASSERT_TRUE(chain.apply(0.04F) < 0.0F);
+    TEST_ASSERT_TRUE(chain.apply(0.0F) < 0.0F);
+    // continuous at the edges of the dead zone, and monotonic across the whole travel
+    TEST_ASSERT_FLOAT_WITHIN(0.002F, 0.0F, chain.apply(0.151F));
+    float previous = chain.apply(-1.0F);
+    for (int ii = -99; ii <= 100; ++ii) {
+        const float value = chain.apply(static_cast<float>(ii) / 100.0F);
+        TEST_ASSERT_TRUE(value >= previous);
+        previous = value;
+    }
+    // values beyond full travel are clipped
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, chain.apply(1.2F));
+
+    // the formula it replaced did not reach full deflection
+    TEST_ASSERT_TRUE(normalizedControlBefore(1.0F, 0.1F, 0.05F) < 0.99F);
+}
+
+static void test_expo_table_follows_the_curve(void)
+{
+    ExpoStage<AtomJoyStickReceiver::EXPO_LUT_SIZE> expo;
+    expo.configure(parameters(0.0F, 0.0F, 0.6F));
+    for (int ii = 0; ii <= 1000; ++ii) {
+        const float x = static_cast<float>(ii) / 1000.0F;
+        const float curve = 0.4F * x + 0.6F * x * x * x;
+        TEST_ASSERT_FLOAT_WITHIN(0.001F, curve, expo.apply(x));
+        TEST_ASSERT_EQUAL_FLOAT(-expo.apply(x), expo.apply(-x));
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, expo.apply(1.0F));
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, expo.apply(0.0F));
+
+    // no expo is linear
+    expo.configure(parameters(0.0F, 0.0F, 0.0F));
+    TEST_ASSERT_FLOAT_WITHIN(0.00001F, 0.37F, expo.apply(0.37F));
+    TEST_ASSERT_FLOAT_WITHIN(0.00001F, -0.81F, expo.apply(-0.81F));
+}
+
+static void test_one_pole_step_response(void)
+{
+    OnePoleLowPassStage filter;
+    constexpr float sampleRateHz = 1000.0F;
+    constexpr float cutoffHz = 5.0F;
+    filter.configure(parameters(0.0F, 0.0F, 0.0F, cutoffHz, sampleRateHz));
+    // after one time constant the output has risen by 1 - 1/e, to within the discretization, which is fine at this sample rate
+    const int timeConstantSamples = static_cast<int>(std::lround(sampleRateHz / (2.0F * static_cast<float>(M_PI) * cutoffHz)));
+    float output = 0.0F;
+    for (int ii = 0; ii < timeConstantSamples; ++ii) {
+        output = filter.apply(1.0F);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 1.0F - std::exp(-1.0F), output);
+    for (int ii = 0; ii < 1000; ++ii) {
+        output = filter.apply(1.0F);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 1.0F, output);
+
+    // a cutoff of zero passes the input straight through
+    OnePoleLowPassStage disabled;
+    disabled.configure(parameters(0.0F, 0.0F, 0.0F, 0.0F, sampleRateHz));
+    TEST_ASSERT_EQUAL_FLOAT(0.7F, disabled.apply(0.7F));
+}
+
+static void test_biquad_is_butterworth(void)
+{
+    constexpr float sampleRateHz = 100.0F;
+    constexpr float cutoffHz = 5.0F;
+    BiquadLowPassStage filter;
+    filter.configure(parameters(0.0F, 0.0F, 0.0F, cutoffHz, sampleRateHz));
+    // -3dB at the cutoff, and -12dB per octave above it, allowing for the bilinear transform's warping
+    const float cutoffGain = sineGain(filter, cutoffHz, sampleRateHz);
+    const float passbandGain = sineGain(filter, 0.5F, sampleRateHz);
+    const float stopbandGain = sineGain(filter, 4.0F * cutoffHz, sampleRateHz);
+    TEST_ASSERT_FLOAT_WITHIN(0.02F, 0.7071F, cutoffGain);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 1.0F, passbandGain);
+    TEST_ASSERT_TRUE(stopbandGain < 1.0F / 16.0F);
+
+    // unity gain at DC
+    BiquadLowPassStage step;
+    step.configure(parameters(0.0F, 0.0F, 0.0F, cutoffHz, sampleRateHz));
+    float output = 0.0F;
+    for (int ii = 0; ii < 200; ++ii) {
+        output = step.apply(0.5F);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.5F, output);
+
+    // disabled, or with the cutoff at or above the Nyquist frequency, the input is passed straight through
+    BiquadLowPassStage disabled;
+    disabled.configure(parameters(0.0F, 0.0F, 0.0F, 0.0F, sampleRateHz));
+    TEST_ASSERT_EQUAL_FLOAT(0.3F, disabled.apply(0.3F));
+    disabled.configure(parameters(0.0F, 0.0F, 0.0F, sampleRateHz / 2.0F, sampleRateHz));
+    TEST_ASSERT_EQUAL_FLOAT(-0.3F, disabled.apply(-0.3F));
+}
+
+static void test_bias_estimator_rejects_outliers(void)
+{
+    BiasEstimator<BIAS_COUNT> estimator;
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, estimator.estimate());
+    // the stick is knocked while one sample is taken
+    const float samples[] { 0.10F, 0.11F, 0.09F, 0.62F, 0.10F, 0.12F, 0.08F, 0.10F, 0.50F };
+    int count = 0;
+    for (const float sample : samples) {
+        if (estimator.addSample(sample)) {
+            break;
+        }
+        ++count;
+    }
+    TEST_ASSERT_EQUAL(BIAS_COUNT - 1, count);
+    TEST_ASSERT_TRUE(estimator.isComplete());
+    // samples after the estimate is complete are ignored
+    TEST_ASSERT_TRUE(estimator.addSample(0.9F));
+    TEST_ASSERT_EQUAL(BIAS_COUNT, estimator.getCount());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.10F, estimator.estimate());
+
+    estimator.reset();
+    TEST_ASSERT_FALSE(estimator.isComplete());
+    estimator.addSample(-0.2F);
+    TEST_ASSERT_EQUAL_FLOAT(-0.2F, estimator.estimate());
+}
+
+static void test_chain_applies_the_stages_in_order(void)
+{
+    ShapingChain<> empty;
+    empty.configure(parameters(0.5F, 0.5F));
+    TEST_ASSERT_EQUAL_FLOAT(0.25F, empty.apply(0.25F));
+
+    const shaping_parameters_t shaping = parameters(-0.05F, 0.04F, 0.3F, 10.0F, 100.0F);
+    axis_shaper_t chain;
+    chain.configure(shaping);
+    BiasStage bias;
+    DeadZoneStage deadZone;
+    ExpoStage<AtomJoyStickReceiver::EXPO_LUT_SIZE> expo;
+    OnePoleLowPassStage lowPass;
+    bias.configure(shaping);
+    deadZone.configure(shaping);
+    expo.configure(shaping);
+    lowPass.configure(shaping);
+    for (int ii = -50; ii <= 50; ++ii) {
+        const float raw = static_cast<float>(ii) / 50.0F;
+        // the filters have state, so each is applied exactly once
+        const float expected = lowPass.apply(expo.apply(deadZone.apply(bias.apply(raw))));
+        const float shaped = chain.apply(raw);
+        TEST_ASSERT_EQUAL_FLOAT(expected, shaped);
+    }
+}
+
+static void test_benchmark_shaping_against_dead_zone_formula(void)
+{
+    const shaping_parameters_t shaping = parameters(0.03F, 0.02F);
+    float sum = 0.0F;
+    const benchmark_result_t before = runBenchmark("dead zone formula, four axes (before)", [&](uint64_t ii) {
+        const float raw = static_cast<float>(ii & 0xFFU) / 128.0F - 1.0F;
+        for (int axis = 0; axis < 4; ++axis) {
+            sum += normalizedControlBefore(raw, shaping.bias, shaping.deadZone);
+        }
+        doNotOptimize(sum);
+    });
+    ShapingChain<BiasStage, DeadZoneStage> deadZoneChains[4];
+    for (auto& chain : deadZoneChains) {
+        chain.configure(shaping);
+    }
+    const benchmark_result_t deadZone = runBenchmark("bias + dead zone chain, four axes", [&](uint64_t ii) {
+        const float raw = static_cast<float>(ii & 0xFFU) / 128.0F - 1.0F;
+        for (auto& chain : deadZoneChains) {
+            sum += chain.apply(raw);
+        }
+        doNotOptimize(sum);
+    });
+    axis_shaper_t shapers[4];
+    for (auto& shaper : shapers) {
+        shaper.configure(parameters(0.03F, 0.02F, 0.4F, 10.0F, 100.0F));
+    }
+    const benchmark_result_t full = runBenchmark("axis_shaper_t with expo and low-pass, four axes", [&](uint64_t ii) {
+        const float raw = static_cast<float>(ii & 0xFFU) / 128.0F - 1.0F;
+        for (auto& shaper : shapers) {
+            sum += shaper.apply(raw);
+        }
+        doNotOptimize(sum);
+    });
+    TEST_ASSERT_TRUE(before.nsPerIteration > 0.0 && deadZone.nsPerIteration > 0.0 && full.nsPerIteration > 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_dead_zone_maps_full_travel_to_one_with_an_offset_center);
+    RUN_TEST(test_expo_table_follows_the_curve);
+    RUN_TEST(test_one_pole_step_response);
+    RUN_TEST(test_biquad_is_butterworth);
+    RUN_TEST(test_bias_estimator_rejects_outliers);
+    RUN_TEST(test_chain_applies_the_stages_in_order);
+    RUN_TEST(test_benchmark_shaping_against_dead_zone_formula);
+    return UNITY_END();
+}
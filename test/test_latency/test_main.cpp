@@ -0,0 +1,162 @@
+#include <AtomJoyStickReceiver.h>
+#include <FakeI2C_Bus.h>
+#include <JoyStickPackets.h>
+#include <MotionController.h>
+#include <RoverC.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+/*
+Latency from the ESP-NOW receive callback to the packet being unpacked, and on to its setpoint being written to the RoverC's motors,
+with the control loop either waiting on the receive signal, or busy-polling the packet ring with a 20us delay, as it originally did.
+
+A producer thread stands in for the WiFi task, delivering a packet every PACKET_INTERVAL_US through the fake ESP-NOW receive callback.
+The control loop publishes each setpoint with the packet's receive time, and then runs the motion controller's update at once,
+as the control task would if it were woken by the setpoint, so the wait of up to a control period for the next update is not included.
+The latency is measured with the host's steady clock, and the CPU time used by the two threads is reported alongside it.
+These are host figures, the scheduler and timer resolution differ on the ESP32, but they show the difference between the two modes.
+*/
+
+enum { PACKET_COUNT = 200, PACKET_INTERVAL_US = 5000, WAIT_TIMEOUT_MS = 10, POLL_DELAY_US = 20 };
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+//! The steady clock, for the motion controller, and for the fake clock that the receiver stamps packets with.
+static uint32_t steadyClockUs()
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(steady_clock_t::now().time_since_epoch()).count());
+}
+
+struct latency_result_t {
+    uint32_t count;
+    uint32_t skippedCount; //!< packets passed over by the latest wins read, or overwritten, when the consumer was descheduled
+    uint32_t medianUs;
+    uint32_t p99Us;
+    uint32_t maxUs;
+    double cpuPercent;
+    // from the receive callback to the motor write, as measured by the motion controller
+    uint32_t motorCount;
+    uint32_t motorMeanUs;
+    uint32_t motorMaxUs;
+};
+
+enum receive_mode_t { EVENT, POLLING };
+
+static latency_result_t measureLatency(receive_mode_t mode)
+{
+    FakeEspNow::reset();
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    receiver.init(1, joyStickMacAddress);
+    receiver.setPacketEmpty();
+    const PacketRingBase& receivedPackets = receiver.getReceivedPackets();
+    const uint32_t skipCountStart = receivedPackets.getSkipCount() + receivedPackets.getOverwriteCount();
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+    MotionController motionController(rover, steadyClockUs);
+
+    std::vector<steady_clock_t::time_point> sendTimes(PACKET_COUNT);
+    std::atomic<bool> producerDone {false};
+    const std::clock_t cpuStart = std::clock();
+    const steady_clock_t::time_point wallStart = steady_clock_t::now();
+
+    std::thread producer([&]() {
+        steady_clock_t::time_point next = steady_clock_t::now();
+        for (int ii = 0; ii < PACKET_COUNT; ++ii) {
+            next += std::chrono::microseconds(PACKET_INTERVAL_US);
+            std::this_thread::sleep_until(next);
+            uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+            // the throttle carries the packet number, so the latency can be matched to the send time
+            makeAtomJoyStickPacket(roverMacAddress, static_cast<float>(ii), 0.0F, 0.0F, 0.0F, 0, packet);
+            sendTimes[ii] = steady_clock_t::now();
+            FakeClock::setUs(steadyClockUs());
+            FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+        }
+        producerDone = true;
+    });
+
+    std::vector<uint32_t> latenciesUs;
+    latenciesUs.reserve(PACKET_COUNT);
+    while (!producerDone || !receiver.isPacketEmpty()) {
+        if (mode == EVENT) {
+            receiver.waitForPacket(WAIT_TIMEOUT_MS);
+        } else {
+            while (receiver.isPacketEmpty() && !producerDone) {
+                std::this_thread::sleep_for(std::chrono::microseconds(POLL_DELAY_US));
+            }
+        }
+        if (receiver.unpackPacket()) {
+            const steady_clock_t::time_point now = steady_clock_t::now();
+            const auto packetNumber = static_cast<int>(receiver.getThrottleRaw());
+            latenciesUs.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - sendTimes[packetNumber]).count()));
+            motionController.setSetpoint({ 0.0F, receiver.getRollRaw(), receiver.getPitchRaw(), receiver.getYawRaw(), 1.0F, RoverC::MECANUM_MODE, receiver.getPacketTimeUs() });
+            motionController.update();
+        }
+    }
+    producer.join();
+
+    const double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    const double wallSeconds = std::chrono::duration<double>(steady_clock_t::now() - wallStart).count();
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    const auto count = static_cast<uint32_t>(latenciesUs.size());
+    const uint32_t skippedCount = receivedPackets.getSkipCount() + receivedPackets.getOverwriteCount() - skipCountStart;
+    const MotionController::statistics_t& motion = motionController.getStatistics();
+    if (count == 0 || motion.latencyCount == 0) {
+        return latency_result_t { 0, skippedCount, 0, 0, 0, 0.0, 0, 0, 0 };
+    }
+    return latency_result_t { count, skippedCount, latenciesUs[count / 2], latenciesUs[count * 99 / 100], latenciesUs[count - 1], 100.0 * cpuSeconds / wallSeconds,
+        motion.latencyCount, static_cast<uint32_t>(motion.latencySumUs / motion.latencyCount), motion.latencyMaxUs };
+}
+
+static void printResult(const char* name, const latency_result_t& result)
+{
+    printf("LATENCY %-8s n:%u skipped:%u median:%uus p99:%uus max:%uus cpu:%.1f%%, to the motor write mean:%uus max:%uus\n",
+        name, result.count, result.skippedCount, result.medianUs, result.p99Us, result.maxUs, result.cpuPercent, result.motorMeanUs, result.motorMaxUs);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_event_driven_latency(void)
+{
+    const latency_result_t result = measureLatency(EVENT);
+    printResult("event", result);
+    // every packet is either unpacked or, if the control loop was descheduled for longer than a packet interval, passed over for a newer one
+    TEST_ASSERT_EQUAL_UINT32(PACKET_COUNT, result.count + result.skippedCount);
+    TEST_ASSERT_TRUE(result.count > PACKET_COUNT / 2);
+    // every unpacked setpoint is written, and the write comes after the unpack
+    TEST_ASSERT_EQUAL_UINT32(result.count, result.motorCount);
+    TEST_ASSERT_TRUE(result.motorMaxUs >= result.medianUs);
+}
+
+static void test_polling_latency(void)
+{
+    const latency_result_t result = measureLatency(POLLING);
+    printResult("polling", result);
+    TEST_ASSERT_EQUAL_UINT32(PACKET_COUNT, result.count + result.skippedCount);
+    TEST_ASSERT_TRUE(result.count > PACKET_COUNT / 2);
+    TEST_ASSERT_EQUAL_UINT32(result.count, result.motorCount);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_event_driven_latency);
+    RUN_TEST(test_polling_latency);
+    return UNITY_END();
+}
@@ -0,0 +1,200 @@
+#include <LinkStatistics.h>
+
+#include <Benchmark.h>
+#include <cmath>
+#include <cstdio>
+#include <unity.h>
+
+/*
+LinkStatistics fed synthetic arrival times: the inter-arrival histogram, RFC 3550 jitter, gap detection and packets per second,
+and a benchmark of recording a packet.
+*/
+
+enum : uint32_t { START_US = 5000000, INTERVAL_US = 10000 };
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_packets_per_second(void)
+{
+    LinkStatistics statistics;
+    // the packet at START_US opens the window, and the 100th packet after it closes it, one second later
+    for (uint32_t ii = 0; ii <= 100; ++ii) {
+        statistics.recordPacket(START_US + ii * INTERVAL_US);
+        if (ii < 100) {
+            TEST_ASSERT_EQUAL_UINT32(0, statistics.getPacketsPerSecond());
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, statistics.getPacketsPerSecond());
+    TEST_ASSERT_EQUAL_UINT32(101, statistics.getPacketCount());
+
+    // the next window, at half the rate
+    for (uint32_t ii = 1; ii <= 50; ++ii) {
+        statistics.recordPacket(START_US + LinkStatistics::ONE_SECOND_US + ii * 2 * INTERVAL_US);
+    }
+    TEST_ASSERT_EQUAL_UINT32(50, statistics.getPacketsPerSecond());
+}
+
+static void test_histogram_buckets(void)
+{
+    LinkStatistics statistics;
+    TEST_ASSERT_EQUAL_UINT32(0, LinkStatistics::bucketUpperBoundUs(0));
+    TEST_ASSERT_EQUAL_UINT32(1, LinkStatistics::bucketUpperBoundUs(1));
+    TEST_ASSERT_EQUAL_UINT32(1023, LinkStatistics::bucketUpperBoundUs(10));
+
+    // the first packet has no interval
+    uint32_t timeUs = START_US;
+    statistics.recordPacket(timeUs);
+    const uint32_t intervalsUs[] { 0, 1, 512, 1023, 1024, INTERVAL_US, 20000000 };
+    for (uint32_t intervalUs : intervalsUs) {
+        timeUs += intervalUs;
+        statistics.recordPacket(timeUs);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getHistogramBucket(0));
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getHistogramBucket(1));
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.getHistogramBucket(10));
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getHistogramBucket(11));
+    // 10000us is 14 bits
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getHistogramBucket(14));
+    // intervals beyond the last bucket are counted in it
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getHistogramBucket(LinkStatistics::HISTOGRAM_BUCKET_COUNT - 1));
+    uint32_t total = 0;
+    for (int ii = 0; ii < LinkStatistics::HISTOGRAM_BUCKET_COUNT; ++ii) {
+        total += statistics.getHistogramBucket(ii);
+    }
+    TEST_ASSERT_EQUAL_UINT32(sizeof(intervalsUs) / sizeof(intervalsUs[0]), total);
+}
+
+/*!
+The jitter is the RFC 3550 estimate, J += (|D| - J) / 16, where D is the change in the inter-arrival interval.
+*/
+static void test_rfc3550_jitter(void)
+{
+    LinkStatistics statistics;
+    uint32_t timeUs = START_US;
+    // a periodic link has no jitter
+    statistics.recordPacket(timeUs);
+    for (int ii = 1; ii < 50; ++ii) {
+        timeUs += INTERVAL_US;
+        statistics.recordPacket(timeUs);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getJitterUs());
+    TEST_ASSERT_EQUAL_UINT32(48, statistics.getIntervalChangeCount());
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getIntervalChangeSumUs());
+
+    // alternating 9ms and 11ms intervals change by 2ms each packet
+    double jitterUs = 0.0;
+    for (int ii = 0; ii < 100; ++ii) {
+        timeUs += (ii & 1U) ? INTERVAL_US + 1000 : INTERVAL_US - 1000;
+        statistics.recordPacket(timeUs);
+        // the first interval after the periodic ones changes by 1ms
+        const double changeUs = ii == 0 ? 1000.0 : 2000.0;
+        jitterUs += (changeUs - jitterUs) / 16.0;
+        TEST_ASSERT_UINT32_WITHIN(16, static_cast<uint32_t>(std::lround(jitterUs)), statistics.getJitterUs());
+    }
+    TEST_ASSERT_UINT32_WITHIN(20, 2000, statistics.getJitterUs());
+    TEST_ASSERT_EQUAL_UINT32(148, statistics.getIntervalChangeCount());
+    TEST_ASSERT_EQUAL_UINT32(1000 + 99 * 2000, statistics.getIntervalChangeSumUs());
+}
+
+static void test_gap_detection(void)
+{
+    LinkStatistics statistics;
+    uint32_t timeUs = START_US;
+    statistics.recordPacket(timeUs);
+    // an interval at the threshold is not a gap
+    timeUs += LinkStatistics::DEFAULT_GAP_THRESHOLD_US;
+    statistics.recordPacket(timeUs);
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getGapCount());
+
+    timeUs += 250000;
+    statistics.recordPacket(timeUs);
+    timeUs += INTERVAL_US;
+    statistics.recordPacket(timeUs);
+    timeUs += 150000;
+    statistics.recordPacket(timeUs);
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.getGapCount());
+    TEST_ASSERT_EQUAL_UINT32(250000, statistics.getLongestGapUs());
+    TEST_ASSERT_EQUAL_UINT32(150000, statistics.getLastIntervalUs());
+
+    statistics.setGapThresholdUs(5000);
+    timeUs += INTERVAL_US;
+    statistics.recordPacket(timeUs);
+    TEST_ASSERT_EQUAL_UINT32(3, statistics.getGapCount());
+    TEST_ASSERT_EQUAL_UINT32(250000, statistics.getLongestGapUs());
+}
+
+static void test_time_wraps_around(void)
+{
+    LinkStatistics statistics;
+    uint32_t timeUs = UINT32_MAX - 25000;
+    for (int ii = 0; ii <= 100; ++ii) {
+        statistics.recordPacket(timeUs);
+        timeUs += INTERVAL_US;
+    }
+    TEST_ASSERT_EQUAL_UINT32(INTERVAL_US, statistics.getLastIntervalUs());
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getJitterUs());
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getGapCount());
+    TEST_ASSERT_EQUAL_UINT32(100, statistics.getPacketsPerSecond());
+    TEST_ASSERT_EQUAL_UINT32(100, statistics.getHistogramBucket(14));
+}
+
+static void test_reset(void)
+{
+    LinkStatistics statistics;
+    statistics.setGapThresholdUs(5000);
+    statistics.recordPacket(START_US);
+    statistics.recordPacket(START_US + INTERVAL_US);
+    statistics.recordChecksumFailure();
+    statistics.recordWrongMacAddress();
+    statistics.recordWrongLength();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getGapCount());
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getChecksumFailureCount());
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getWrongMacAddressCount());
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.getWrongLengthCount());
+
+    statistics.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getPacketCount());
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getChecksumFailureCount());
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getHistogramBucket(14));
+    // the gap threshold is back to the default
+    statistics.recordPacket(START_US);
+    statistics.recordPacket(START_US + INTERVAL_US);
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.getGapCount());
+}
+
+static void test_benchmark_record_packet(void)
+{
+    LinkStatistics statistics;
+    uint32_t timeUs = START_US;
+    const benchmark_result_t result = runBenchmark("LinkStatistics::recordPacket", [&](uint64_t ii) {
+        // a 10ms period, with up to 1ms of jitter and an occasional gap
+        const auto index = static_cast<uint32_t>(ii);
+        timeUs += INTERVAL_US - 500 + (index * 7919U) % 1000U + ((index & 0x3FFU) == 0x3FFU ? 200000U : 0U);
+        statistics.recordPacket(timeUs);
+        doNotOptimize(statistics);
+    });
+    printf("LINK %u pps, jitter %uus, %u gaps\n", statistics.getPacketsPerSecond(), statistics.getJitterUs(), statistics.getGapCount());
+    TEST_ASSERT_TRUE(result.nsPerIteration > 0.0);
+    TEST_ASSERT_TRUE(statistics.getGapCount() > 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_packets_per_second);
+    RUN_TEST(test_histogram_buckets);
+    RUN_TEST(test_rfc3550_jitter);
+    RUN_TEST(test_gap_detection);
+    RUN_TEST(test_time_wraps_around);
+    RUN_TEST(test_reset);
+    RUN_TEST(test_benchmark_record_packet);
+    return UNITY_END();
+}
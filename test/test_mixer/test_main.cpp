@@ -0,0 +1,193 @@
+#include <Mixer.h>
+
+#include <Benchmark.h>
+#include <cmath>
+#include <unity.h>
+
+/*
+Mixer geometry tests, and a benchmark of the mixer against the hand-coded mecanum mixing it replaced.
+*/
+
+typedef Mixer<MecanumGeometry> MecanumMixer;
+typedef Mixer<TankGeometry> TankMixer;
+typedef Mixer<Omni3Geometry> Omni3Mixer;
+
+// the mixer is usable at compile time
+static constexpr int8_t constexprMecanumFrontLeft()
+{
+    const float inputs[MecanumMixer::INPUT_COUNT] { 0.25F, 0.5F, 0.0F };
+    int8_t speeds[MecanumMixer::OUTPUT_COUNT] {};
+    MecanumMixer::mix(inputs, speeds, 100.0F);
+    return speeds[MecanumGeometry::FRONT_LEFT];
+}
+static_assert(constexprMecanumFrontLeft() == 75, "mixer must be constexpr");
+
+/*!
+The mecanum mixing as it was before the mixer: each wheel rounded in double precision and clipped on its own.
+*/
+static void mixMecanumClipped(float roll, float pitch, float yaw, float maxSpeed, int8_t (&speeds)[4])
+{
+    const auto clipSpeed = [](int speed) { return static_cast<int8_t>(speed < -100 ? -100 : speed > 100 ? 100 : speed); };
+    const int speedX = static_cast<int>(round(roll * maxSpeed));
+    const int speedY = static_cast<int>(round(pitch * maxSpeed));
+    const int rotation = static_cast<int>(round(yaw * maxSpeed));
+    speeds[0] = clipSpeed(speedY + speedX + rotation);
+    speeds[1] = clipSpeed(speedY - speedX - rotation);
+    speeds[2] = clipSpeed(speedY - speedX + rotation);
+    speeds[3] = clipSpeed(speedY + speedX - rotation);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_mecanum_pure_motions(void)
+{
+    float outputs[MecanumMixer::OUTPUT_COUNT] {};
+
+    const float forwards[MecanumMixer::INPUT_COUNT] { 0.0F, 0.5F, 0.0F };
+    MecanumMixer::mix(forwards, outputs);
+    for (float output : outputs) {
+        TEST_ASSERT_EQUAL_FLOAT(0.5F, output);
+    }
+
+    const float sideways[MecanumMixer::INPUT_COUNT] { 0.5F, 0.0F, 0.0F };
+    MecanumMixer::mix(sideways, outputs);
+    TEST_ASSERT_EQUAL_FLOAT(0.5F, outputs[MecanumGeometry::FRONT_LEFT]);
+    TEST_ASSERT_EQUAL_FLOAT(-0.5F, outputs[MecanumGeometry::FRONT_RIGHT]);
+    TEST_ASSERT_EQUAL_FLOAT(-0.5F, outputs[MecanumGeometry::BACK_LEFT]);
+    TEST_ASSERT_EQUAL_FLOAT(0.5F, outputs[MecanumGeometry::BACK_RIGHT]);
+
+    const float rotate[MecanumMixer::INPUT_COUNT] { 0.0F, 0.0F, 0.5F };
+    MecanumMixer::mix(rotate, outputs);
+    TEST_ASSERT_EQUAL_FLOAT(0.5F, outputs[MecanumGeometry::FRONT_LEFT]);
+    TEST_ASSERT_EQUAL_FLOAT(-0.5F, outputs[MecanumGeometry::FRONT_RIGHT]);
+    TEST_ASSERT_EQUAL_FLOAT(0.5F, outputs[MecanumGeometry::BACK_LEFT]);
+    TEST_ASSERT_EQUAL_FLOAT(-0.5F, outputs[MecanumGeometry::BACK_RIGHT]);
+}
+
+static void test_mecanum_full_stick_preserves_direction(void)
+{
+    // full forwards and half sideways: clipping each wheel separately gives 100/100/50/100, and the rover veers
+    const float inputs[MecanumMixer::INPUT_COUNT] { 0.5F, 1.0F, 0.0F };
+    int8_t clipped[4] {};
+    mixMecanumClipped(0.5F, 1.0F, 0.0F, 100.0F, clipped);
+    TEST_ASSERT_EQUAL_INT8(100, clipped[MecanumGeometry::FRONT_LEFT]);
+    TEST_ASSERT_EQUAL_INT8(50, clipped[MecanumGeometry::FRONT_RIGHT]);
+
+    float outputs[MecanumMixer::OUTPUT_COUNT] {};
+    MecanumMixer::mix(inputs, outputs);
+    // the unsaturated outputs are 1.5/0.5/0.5/1.5, so scaling keeps the 3:1 ratio
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, outputs[MecanumGeometry::FRONT_LEFT]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6F, 1.0F / 3.0F, outputs[MecanumGeometry::FRONT_RIGHT]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6F, 1.0F / 3.0F, outputs[MecanumGeometry::BACK_LEFT]);
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, outputs[MecanumGeometry::BACK_RIGHT]);
+}
+
+static void test_outputs_never_saturate(void)
+{
+    float outputs[MecanumMixer::OUTPUT_COUNT] {};
+    for (float x = -1.0F; x <= 1.0F; x += 0.25F) {
+        for (float y = -1.0F; y <= 1.0F; y += 0.25F) {
+            for (float r = -1.0F; r <= 1.0F; r += 0.25F) {
+                const float inputs[MecanumMixer::INPUT_COUNT] { x, y, r };
+                MecanumMixer::mix(inputs, outputs);
+                for (float output : outputs) {
+                    TEST_ASSERT_TRUE(std::fabs(output) <= 1.0F);
+                }
+            }
+        }
+    }
+}
+
+static void test_integer_speeds_round_symmetrically(void)
+{
+    const float inputs[MecanumMixer::INPUT_COUNT] { 0.0F, -0.505F, 0.0F };
+    int8_t speeds[MecanumMixer::OUTPUT_COUNT] {};
+    MecanumMixer::mix(inputs, speeds, 100.0F);
+    TEST_ASSERT_EQUAL_INT8(-51, speeds[MecanumGeometry::FRONT_LEFT]);
+
+    const float full[MecanumMixer::INPUT_COUNT] { 1.0F, 1.0F, 1.0F };
+    MecanumMixer::mix(full, speeds, 100.0F);
+    TEST_ASSERT_EQUAL_INT8(100, speeds[MecanumGeometry::FRONT_LEFT]);
+    TEST_ASSERT_TRUE(speeds[MecanumGeometry::FRONT_RIGHT] >= -100);
+}
+
+static void test_tank_drives_each_side(void)
+{
+    const float inputs[TankMixer::INPUT_COUNT] { 0.75F, -0.25F };
+    int8_t speeds[TankMixer::OUTPUT_COUNT] {};
+    TankMixer::mix(inputs, speeds, 100.0F);
+    TEST_ASSERT_EQUAL_INT8(75, speeds[TankGeometry::FRONT_LEFT]);
+    TEST_ASSERT_EQUAL_INT8(75, speeds[TankGeometry::BACK_LEFT]);
+    TEST_ASSERT_EQUAL_INT8(-25, speeds[TankGeometry::FRONT_RIGHT]);
+    TEST_ASSERT_EQUAL_INT8(-25, speeds[TankGeometry::BACK_RIGHT]);
+}
+
+static void test_omni3_geometry(void)
+{
+    float outputs[Omni3Mixer::OUTPUT_COUNT] {};
+
+    // pure rotation turns all wheels equally
+    const float rotate[Omni3Mixer::INPUT_COUNT] { 0.0F, 0.0F, 0.5F };
+    Omni3Mixer::mix(rotate, outputs);
+    for (float output : outputs) {
+        TEST_ASSERT_EQUAL_FLOAT(0.5F, output);
+    }
+
+    // pure translation has no net rotation: the wheel speeds sum to zero
+    const float translate[Omni3Mixer::INPUT_COUNT] { 0.3F, 0.4F, 0.0F };
+    Omni3Mixer::mix(translate, outputs);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6F, 0.0F, outputs[0] + outputs[1] + outputs[2]);
+    TEST_ASSERT_EQUAL_FLOAT(0.4F, outputs[Omni3Geometry::WHEEL_1]);
+
+    // saturated, the ratios are kept
+    const float full[Omni3Mixer::INPUT_COUNT] { 0.0F, 1.0F, 1.0F };
+    Omni3Mixer::mix(full, outputs);
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, outputs[Omni3Geometry::WHEEL_1]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6F, 0.25F, outputs[Omni3Geometry::WHEEL_2]);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6F, 0.25F, outputs[Omni3Geometry::WHEEL_3]);
+}
+
+static void test_benchmark_mixer_against_clipped(void)
+{
+    int8_t speeds[4] {};
+    const benchmark_result_t clipped = runBenchmark("mecanum clipped per wheel (before)", [&](uint64_t ii) {
+        const float roll = static_cast<float>(ii & 0xFFU) / 255.0F;
+        mixMecanumClipped(roll, 0.5F, -0.25F, 100.0F, speeds);
+        doNotOptimize(speeds);
+    });
+    const benchmark_result_t mixer = runBenchmark("Mixer<MecanumGeometry>::mix (after)", [&](uint64_t ii) {
+        const float roll = static_cast<float>(ii & 0xFFU) / 255.0F;
+        const float inputs[MecanumMixer::INPUT_COUNT] { roll, 0.5F, -0.25F };
+        MecanumMixer::mix(inputs, speeds, 100.0F);
+        doNotOptimize(speeds);
+    });
+    const benchmark_result_t omni3 = runBenchmark("Mixer<Omni3Geometry>::mix", [&](uint64_t ii) {
+        const float roll = static_cast<float>(ii & 0xFFU) / 255.0F;
+        const float inputs[Omni3Mixer::INPUT_COUNT] { roll, 0.5F, -0.25F };
+        int8_t omniSpeeds[Omni3Mixer::OUTPUT_COUNT] {};
+        Omni3Mixer::mix(inputs, omniSpeeds, 100.0F);
+        doNotOptimize(omniSpeeds);
+    });
+    TEST_ASSERT_TRUE(clipped.nsPerIteration > 0.0 && mixer.nsPerIteration > 0.0 && omni3.nsPerIteration > 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_mecanum_pure_motions);
+    RUN_TEST(test_mecanum_full_stick_preserves_direction);
+    RUN_TEST(test_outputs_never_saturate);
+    RUN_TEST(test_integer_speeds_round_symmetrically);
+    RUN_TEST(test_tank_drives_each_side);
+    RUN_TEST(test_omni3_geometry);
+    RUN_TEST(test_benchmark_mixer_against_clipped);
+    return UNITY_END();
+}
@@ -0,0 +1,304 @@
+#include <FakeI2C_Bus.h>
+#include <I2C_AsyncQueue.h>
+#include <MotionController.h>
+#include <RoverC.h>
+
+#include <Arduino.h>
+#include <cstdlib>
+#include <freertos/task.h>
+#include <random>
+#include <unity.h>
+#include <vector>
+
+/*
+MotionController tests: the first tests step `update()` directly, the later ones run the control task,
+and the I2C worker task, on the fake scheduler, and measure when the motor registers are written.
+*/
+
+enum { MOTOR_1 = 0 };
+
+static uint32_t clockUs() { return micros(); }
+
+static MotionController::config_t configWithoutSlewLimit()
+{
+    MotionController::config_t config = MotionController::defaultConfig();
+    for (auto& maxAcceleration : config.maxAcceleration) {
+        maxAcceleration = 0.0F;
+    }
+    return config;
+}
+
+static MotionController::setpoint_t forward(float pitch, uint32_t receiveTimeUs=0)
+{
+    return MotionController::setpoint_t {0.0F, 0.0F, pitch, 0.0F, 1.0F, RoverC::MECANUM_MODE, receiveTimeUs};
+}
+
+static int8_t mixedMotorSpeed(RoverC& rover, float pitch)
+{
+    RoverC::actuator_frame_t frame {};
+    rover.setSpeedScale(1.0F);
+    rover.mix(0.0F, 0.0F, pitch, 0.0F, RoverC::MECANUM_MODE, frame);
+    return frame.motorSpeeds[MOTOR_1];
+}
+
+struct motor_write_t {
+    uint32_t timeUs;
+    int8_t speed;
+};
+
+//! The values written to motor 1, and when they were written.
+static std::vector<motor_write_t> motorWrites(const FakeI2C_Bus& bus)
+{
+    std::vector<motor_write_t> writes;
+    for (const auto& transaction : bus.transactions) {
+        if (transaction.firstRegister == MOTOR_1) {
+            writes.push_back(motor_write_t { transaction.timeUs, static_cast<int8_t>(transaction.data[0]) });
+        }
+    }
+    return writes;
+}
+
+void setUp(void)
+{
+    FakeTask::reset();
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_statistics_reset_does_not_restart_interpolation(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+    MotionController controller(rover, clockUs, configWithoutSlewLimit());
+
+    controller.setSetpoint(forward(0.2F));
+    controller.update();
+    FakeClock::advanceMs(20);
+    controller.setSetpoint(forward(0.2F));
+    controller.update();
+    const int8_t from = mixedMotorSpeed(rover, 0.2F);
+    TEST_ASSERT_EQUAL_INT8(from, rover.getMotorSpeed(MOTOR_1));
+
+    // the reset only takes effect at the next update
+    controller.resetStatistics();
+    TEST_ASSERT_EQUAL_UINT32(2, controller.getStatistics().updateCount);
+
+    FakeClock::advanceMs(20);
+    controller.setSetpoint(forward(0.6F));
+    controller.update();
+    TEST_ASSERT_EQUAL_UINT32(1, controller.getStatistics().updateCount);
+    TEST_ASSERT_EQUAL_UINT32(1, controller.getStatistics().setpointCount);
+    // the new setpoint is interpolated over the 20ms since the previous one, rather than jumped to
+    TEST_ASSERT_EQUAL_INT8(from, rover.getMotorSpeed(MOTOR_1));
+    FakeClock::advanceMs(10);
+    controller.update();
+    const int8_t to = mixedMotorSpeed(rover, 0.6F);
+    TEST_ASSERT_INT_WITHIN(1, (from + to) / 2, rover.getMotorSpeed(MOTOR_1));
+    FakeClock::advanceMs(10);
+    controller.update();
+    TEST_ASSERT_EQUAL_INT8(to, rover.getMotorSpeed(MOTOR_1));
+    // the period across the reset is measured, rather than the first update after it being taken as on time
+    TEST_ASSERT_EQUAL_UINT32(3, controller.getStatistics().periodCount);
+    TEST_ASSERT_EQUAL_UINT32(10000, controller.getStatistics().periodMinUs);
+    TEST_ASSERT_EQUAL_UINT32(20000, controller.getStatistics().periodMaxUs);
+}
+
+static void test_stop_bypasses_the_slew_limit(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+    MotionController controller(rover, clockUs);
+
+    controller.setSetpoint(forward(1.0F));
+    for (int ii = 0; ii < 40; ++ii) {
+        controller.update();
+        FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    }
+    TEST_ASSERT_EQUAL_INT8(mixedMotorSpeed(rover, 1.0F), rover.getMotorSpeed(MOTOR_1));
+    const uint32_t slewLimitedCount = controller.getStatistics().slewLimitedCount;
+
+    // a setpoint published just before the stop is not acted on after it
+    controller.setSetpoint(forward(1.0F));
+    controller.stop();
+    controller.update();
+    for (int motor = 0; motor < RoverC::MOTOR_COUNT; ++motor) {
+        TEST_ASSERT_EQUAL_INT8(0, rover.getMotorSpeed(motor));
+    }
+    TEST_ASSERT_EQUAL_UINT32(slewLimitedCount, controller.getStatistics().slewLimitedCount);
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    TEST_ASSERT_EQUAL_INT8(0, rover.getMotorSpeed(MOTOR_1));
+
+    // the next setpoint is interpolated from rest, and the wheels accelerate at the slew limit
+    controller.setSetpoint(forward(1.0F));
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    TEST_ASSERT_EQUAL_INT8(0, rover.getMotorSpeed(MOTOR_1));
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    const auto maxStep = static_cast<int>(MotionController::DEFAULT_MAX_ACCELERATION * MotionController::DEFAULT_PERIOD_US * 1.0e-6F);
+    TEST_ASSERT_INT_WITHIN(1, maxStep, rover.getMotorSpeed(MOTOR_1));
+}
+
+/*!
+The latency is measured from the packet's receive time to the first write of its setpoint, and only for setpoints from packets.
+*/
+static void test_latency_is_recorded_at_the_motor_write(void)
+{
+    FakeI2C_Bus bus;
+    bus.transactionTimeUs = 200;
+    RoverC rover(bus);
+    MotionController controller(rover, clockUs, configWithoutSlewLimit());
+
+    // received 1.5ms before the update, and written after the 200us motor and servo transactions
+    controller.setSetpoint(forward(0.5F, micros() - 1500));
+    controller.update();
+    const MotionController::statistics_t& statistics = controller.getStatistics();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.latencyCount);
+    TEST_ASSERT_EQUAL_UINT32(1900, statistics.latencyMinUs);
+    TEST_ASSERT_EQUAL_UINT32(1900, statistics.latencyMaxUs);
+
+    // later updates write the same setpoint, but are not counted again
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.latencyCount);
+
+    // a setpoint reissued by the failsafe is not from a packet
+    controller.setSetpoint(forward(0.5F));
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.latencyCount);
+
+    // a setpoint that is stopped before it is written is not counted
+    controller.setSetpoint(forward(0.5F, micros()));
+    controller.stop();
+    controller.update();
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.latencyCount);
+
+    // of two setpoints published between updates, only the latest is counted, its first frame is interpolated from rest
+    // after the stop, so is unchanged and takes no bus time
+    controller.setSetpoint(forward(0.2F, micros() - 4000));
+    controller.setSetpoint(forward(0.3F, micros() - 1000));
+    FakeClock::advanceUs(MotionController::DEFAULT_PERIOD_US);
+    controller.update();
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.latencyCount);
+    TEST_ASSERT_EQUAL_UINT32(1000 + MotionController::DEFAULT_PERIOD_US, statistics.latencyMaxUs);
+    TEST_ASSERT_TRUE(statistics.latencySumUs == 1900 + 6000);
+}
+
+/*!
+Setpoints arrive with radio jitter, between 5ms and 35ms apart, and the stick swings between full forward and full reverse.
+The control task must still update every 5ms, and the motor writes must follow on the same tick, in steps no larger than the slew limit.
+*/
+static void test_task_output_is_periodic_under_radio_jitter(void)
+{
+    FakeI2C_Bus bus;
+    I2C_AsyncQueue queue(bus, clockUs);
+    queue.begin();
+    RoverC rover(queue);
+    MotionController controller(rover, clockUs);
+    controller.begin();
+
+    const uint64_t startUs = FakeClock::timeUs;
+    std::mt19937 generator(16);
+    uint64_t packetTimeUs = startUs;
+    while (packetTimeUs < startUs + 2000000) {
+        FakeTask::runUntilUs(packetTimeUs);
+        const bool reverse = ((packetTimeUs - startUs) / 250000) % 2 == 1;
+        controller.setSetpoint(forward(reverse ? -1.0F : 1.0F));
+        packetTimeUs += 5000 + generator() % 30000;
+    }
+    FakeTask::runUntilUs(packetTimeUs);
+
+    const MotionController::statistics_t& statistics = controller.getStatistics();
+    TEST_ASSERT_UINT32_WITHIN(8, 400, statistics.updateCount);
+    TEST_ASSERT_EQUAL_UINT32(MotionController::DEFAULT_PERIOD_US, statistics.periodMinUs);
+    TEST_ASSERT_EQUAL_UINT32(MotionController::DEFAULT_PERIOD_US, statistics.periodMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.jitterMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.overrunCount);
+    TEST_ASSERT_TRUE(statistics.slewLimitedCount > 0);
+
+    const std::vector<motor_write_t> writes = motorWrites(bus);
+    TEST_ASSERT_TRUE(writes.size() > 100);
+    const auto maxStep = static_cast<int>(MotionController::DEFAULT_MAX_ACCELERATION * MotionController::DEFAULT_PERIOD_US * 1.0e-6F);
+    for (size_t ii = 1; ii < writes.size(); ++ii) {
+        // each write is on an update tick, so the output has no radio jitter
+        TEST_ASSERT_EQUAL_UINT32(0, (writes[ii].timeUs - writes[0].timeUs) % MotionController::DEFAULT_PERIOD_US);
+        const uint32_t ticks = (writes[ii].timeUs - writes[ii - 1].timeUs) / MotionController::DEFAULT_PERIOD_US;
+        TEST_ASSERT_TRUE(std::abs(writes[ii].speed - writes[ii - 1].speed) <= static_cast<int>(ticks) * maxStep + 1);
+    }
+    // the worker writes on the tick the values were posted
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStatistics().latencyMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getDepth());
+}
+
+/*!
+With the RoverC written directly, the bus time is spent in the control task. A bus slower than the period delays every update.
+*/
+static void test_slow_synchronous_bus_shows_as_jitter(void)
+{
+    FakeI2C_Bus bus;
+    bus.transactionTimeUs = 600;
+    RoverC rover(bus);
+    MotionController controller(rover, clockUs);
+    controller.begin();
+    controller.setSetpoint(forward(1.0F));
+    FakeTask::runForUs(100000);
+    // the motors are written every update while accelerating, and the servos once
+    TEST_ASSERT_EQUAL_UINT32(1200, controller.getStatistics().updateTimeMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getStatistics().jitterMaxUs);
+
+    FakeTask::reset();
+    FakeI2C_Bus slowBus;
+    slowBus.transactionTimeUs = 6000;
+    RoverC slowRover(slowBus);
+    MotionController slowController(slowRover, clockUs);
+    slowController.begin();
+    slowController.setSetpoint(forward(1.0F));
+    // the first update also writes the servos, so measure while the motors alone are being written as they accelerate
+    FakeTask::runForUs(30000);
+    slowController.resetStatistics();
+    FakeTask::runForUs(40000);
+    const MotionController::statistics_t& statistics = slowController.getStatistics();
+    TEST_ASSERT_EQUAL_UINT32(statistics.updateCount, statistics.overrunCount);
+    TEST_ASSERT_EQUAL_UINT32(6000, statistics.periodMinUs);
+    TEST_ASSERT_EQUAL_UINT32(6000, statistics.periodMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(1000, statistics.jitterMaxUs);
+}
+
+/*!
+With the I2C worker, the control task only posts the values, so the same bus time is not spent in the update.
+*/
+static void test_queued_bus_time_is_not_spent_in_the_update(void)
+{
+    FakeI2C_Bus bus;
+    bus.transactionTimeUs = 600;
+    I2C_AsyncQueue queue(bus, clockUs);
+    queue.begin();
+    RoverC rover(queue);
+    MotionController controller(rover, clockUs);
+    controller.begin();
+    controller.setSetpoint(forward(1.0F));
+    FakeTask::runForUs(100000);
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getStatistics().updateTimeMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getStatistics().jitterMaxUs);
+    TEST_ASSERT_TRUE(motorWrites(bus).size() > 10);
+    TEST_ASSERT_EQUAL_INT8(mixedMotorSpeed(rover, 1.0F), static_cast<int8_t>(bus.registers[MOTOR_1]));
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_statistics_reset_does_not_restart_interpolation);
+    RUN_TEST(test_stop_bypasses_the_slew_limit);
+    RUN_TEST(test_latency_is_recorded_at_the_motor_write);
+    RUN_TEST(test_task_output_is_periodic_under_radio_jitter);
+    RUN_TEST(test_slow_synchronous_bus_shows_as_jitter);
+    RUN_TEST(test_queued_bus_time_is_not_spent_in_the_update);
+    return UNITY_END();
+}
@@ -0,0 +1,223 @@
+#include <Arduino.h>
+#include <AtomJoyStickReceiver.h>
+#include <PacketCapture.h>
+
+#include <Benchmark.h>
+#include <JoyStickPackets.h>
+#include <cstring>
+#include <unity.h>
+#include <vector>
+
+/*
+Capture and replay round trip: packets captured from the receive path, dumped in the binary format,
+parsed back, and replayed through a second receiver, which must decode the same controls at the same relative times.
+*/
+
+enum { PACKET_COUNT = 50 };
+typedef packet_record_t<AtomJoyStickCodec::MAX_PACKET_SIZE> record_t;
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+static const uint8_t otherMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0x01, 0x02, 0x03 };
+
+struct decoded_t {
+    float throttle;
+    float roll;
+    float pitch;
+    float yaw;
+    uint8_t mode;
+};
+
+static decoded_t decode(const AtomJoyStickReceiver& receiver)
+{
+    return decoded_t { receiver.getThrottleRaw(), receiver.getRollRaw(), receiver.getPitchRaw(), receiver.getYawRaw(), receiver.getMode() };
+}
+
+static void checkDecoded(const decoded_t& expected, const decoded_t& actual)
+{
+    TEST_ASSERT_EQUAL_FLOAT(expected.throttle, actual.throttle);
+    TEST_ASSERT_EQUAL_FLOAT(expected.roll, actual.roll);
+    TEST_ASSERT_EQUAL_FLOAT(expected.pitch, actual.pitch);
+    TEST_ASSERT_EQUAL_FLOAT(expected.yaw, actual.yaw);
+    TEST_ASSERT_EQUAL_UINT8(expected.mode, actual.mode);
+}
+
+/*!
+Parse a dump, as written to the serial port, back into records.
+*/
+static std::vector<record_t> parseDump(const std::string& dump)
+{
+    std::vector<record_t> records;
+    PacketCapture::dump_header_t header {};
+    TEST_ASSERT_TRUE(dump.size() >= sizeof(header));
+    memcpy(&header, dump.data(), sizeof(header));
+    TEST_ASSERT_EQUAL_HEX32(PacketCapture::DUMP_MAGIC, header.magic);
+    TEST_ASSERT_EQUAL_UINT16(PacketCapture::DUMP_VERSION, header.version);
+    TEST_ASSERT_EQUAL_UINT16(sizeof(record_t), header.recordSize);
+    TEST_ASSERT_EQUAL_UINT16(AtomJoyStickCodec::MAX_PACKET_SIZE, header.dataSize);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(header) + header.recordCount * header.recordSize, dump.size());
+    records.resize(header.recordCount);
+    memcpy(records.data(), dump.data() + sizeof(header), header.recordCount * sizeof(record_t));
+    return records;
+}
+
+void setUp(void)
+{
+    FakeEspNow::reset();
+    FakeClock::setUs(1000000);
+    Serial.clearOutput();
+}
+
+void tearDown(void)
+{
+}
+
+static void test_capture_ring_keeps_newest_records_oldest_first(void)
+{
+    static PacketCaptureBuffer<8> capture;
+    capture.clear();
+    uint8_t data[4] {};
+    for (uint32_t ii = 0; ii < 20; ++ii) {
+        data[0] = static_cast<uint8_t>(ii);
+        capture.append(joyStickMacAddress, data, sizeof(data), ii * 10);
+    }
+    TEST_ASSERT_EQUAL_UINT32(8, capture.getRecordCount());
+    for (uint32_t ii = 0; ii < 8; ++ii) {
+        TEST_ASSERT_EQUAL_UINT8(12 + ii, capture.getRecord(ii).data[0]);
+        TEST_ASSERT_EQUAL_UINT32((12 + ii) * 10, capture.getRecord(ii).timeUs);
+        TEST_ASSERT_EQUAL_UINT8(sizeof(data), capture.getRecord(ii).len);
+    }
+
+    capture.setEnabled(false);
+    capture.append(joyStickMacAddress, data, sizeof(data), 0);
+    TEST_ASSERT_EQUAL_UINT8(19, capture.getRecord(7).data[0]);
+    capture.setEnabled(true);
+}
+
+/*!
+A capture of AtomJoyStick packets keeps compact records. A longer packet is truncated to the record's data,
+but its length as received is kept, and the truncated data is replayed.
+*/
+static void test_records_hold_the_codecs_largest_packet(void)
+{
+    static_assert(sizeof(PacketCaptureBuffer<8>::record_t) == 36);
+    static PacketCaptureBuffer<8> capture;
+    capture.clear();
+    TEST_ASSERT_EQUAL_UINT16(36, capture.getRecordSize());
+    TEST_ASSERT_EQUAL_UINT16(AtomJoyStickCodec::PACKET_SIZE, capture.getDataSize());
+
+    uint8_t data[40];
+    for (uint8_t ii = 0; ii < sizeof(data); ++ii) {
+        data[ii] = static_cast<uint8_t>(ii + 1);
+    }
+    capture.append(joyStickMacAddress, data, sizeof(data), 0);
+    const record_t& record = capture.getRecord(0);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(data), record.len);
+    TEST_ASSERT_EQUAL_MEMORY(data, record.data, AtomJoyStickCodec::PACKET_SIZE);
+
+    // a shorter packet clears the rest of its record's data
+    capture.append(joyStickMacAddress, data, 4, 10);
+    TEST_ASSERT_EQUAL_UINT8(0, capture.getRecord(1).data[4]);
+    TEST_ASSERT_EQUAL_UINT8(0, capture.getRecord(1).data[AtomJoyStickCodec::PACKET_SIZE - 1]);
+}
+
+static void test_capture_dump_replay_round_trip(void)
+{
+    static PacketCaptureBuffer<PACKET_COUNT + 10> capture;
+    capture.clear();
+    static AtomJoyStickReceiver recorder(roverMacAddress);
+    recorder.init(1, joyStickMacAddress);
+    recorder.getTransceiver().setPacketCapture(&capture);
+
+    // capture packets at irregular intervals, with a packet from another transmitter, which the receiver rejects, part way through
+    std::vector<decoded_t> expected;
+    std::vector<uint32_t> offsetsUs;
+    const uint32_t startUs = micros();
+    for (int ii = 0; ii < PACKET_COUNT; ++ii) {
+        FakeClock::advanceUs(10000 + static_cast<uint32_t>((ii * 7919) % 3000));
+        uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+        const float value = static_cast<float>(ii) / PACKET_COUNT;
+        makeAtomJoyStickPacket(roverMacAddress, value, -value, 0.5F * value, 1.0F - value, static_cast<uint8_t>(ii & 1U), packet);
+        FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+        TEST_ASSERT_TRUE(recorder.unpackPacket());
+        expected.push_back(decode(recorder));
+        offsetsUs.push_back(micros() - startUs);
+        if (ii == PACKET_COUNT / 2) {
+            FakeClock::advanceUs(100);
+            FakeEspNow::receive(otherMacAddress, packet, sizeof(packet));
+            TEST_ASSERT_FALSE(recorder.unpackPacket());
+        }
+    }
+    recorder.getTransceiver().setPacketCapture(nullptr);
+    TEST_ASSERT_EQUAL_UINT32(PACKET_COUNT + 1, capture.getRecordCount());
+
+    capture.dump();
+    const std::vector<record_t> records = parseDump(Serial.getOutput());
+    TEST_ASSERT_EQUAL_UINT32(PACKET_COUNT + 1, records.size());
+    TEST_ASSERT_EQUAL_MEMORY(otherMacAddress, records[PACKET_COUNT / 2 + 1].macAddress, ESP_NOW_ETH_ALEN);
+
+    // replay at four times the original speed through a second receiver
+    FakeEspNow::reset();
+    static AtomJoyStickReceiver player(roverMacAddress);
+    player.init(1, joyStickMacAddress);
+    PacketReplay replay(player.getTransceiver(), records.data(), static_cast<uint32_t>(records.size()));
+    const float speedFactor = 4.0F;
+    const uint32_t replayStartUs = 5000000;
+    replay.begin(replayStartUs, speedFactor);
+
+    size_t decodedCount = 0;
+    for (uint32_t timeUs = replayStartUs; !replay.isFinished(); timeUs += 100) {
+        if (replay.update(timeUs) == 0 || !player.unpackPacket()) {
+            continue;
+        }
+        TEST_ASSERT_TRUE(decodedCount < expected.size());
+        checkDecoded(expected[decodedCount], decode(player));
+        // each packet is fed within one 100us step of its scaled original time
+        const auto dueUs = static_cast<uint32_t>(static_cast<float>(offsetsUs[decodedCount] - offsetsUs[0]) / speedFactor);
+        TEST_ASSERT_UINT32_WITHIN(100, dueUs, timeUs - replayStartUs);
+        ++decodedCount;
+    }
+    TEST_ASSERT_EQUAL_UINT32(PACKET_COUNT, decodedCount);
+    TEST_ASSERT_EQUAL_UINT32(records.size(), replay.getReplayedCount());
+}
+
+static void test_replay_throughput(void)
+{
+    static PacketCaptureBuffer<PACKET_COUNT> capture;
+    capture.clear();
+    for (int ii = 0; ii < PACKET_COUNT; ++ii) {
+        uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+        makeAtomJoyStickPacket(roverMacAddress, 0.01F * static_cast<float>(ii), 0.0F, 0.0F, 0.0F, 0, packet);
+        capture.append(joyStickMacAddress, packet, sizeof(packet), static_cast<uint32_t>(ii) * 10000);
+    }
+    std::vector<record_t> records;
+    for (uint32_t ii = 0; ii < capture.getRecordCount(); ++ii) {
+        records.push_back(capture.getRecord(ii));
+    }
+
+    static AtomJoyStickReceiver player(roverMacAddress);
+    player.init(1, joyStickMacAddress);
+    PacketReplay replay(player.getTransceiver(), records.data(), static_cast<uint32_t>(records.size()));
+    uint32_t unpackedCount = 0;
+    const benchmark_result_t result = runBenchmark("replay and unpack, per capture of 50", [&](uint64_t) {
+        replay.begin(0);
+        while (!replay.isFinished()) {
+            replay.update(replay.getNextDueTimeUs());
+            unpackedCount += player.unpackPacket() ? 1 : 0;
+        }
+    });
+    printf("REPLAY %.0f packets/s\n", 1.0e9 * PACKET_COUNT / result.nsPerIteration);
+    TEST_ASSERT_TRUE(unpackedCount > 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_capture_ring_keeps_newest_records_oldest_first);
+    RUN_TEST(test_records_hold_the_codecs_largest_packet);
+    RUN_TEST(test_capture_dump_replay_round_trip);
+    RUN_TEST(test_replay_throughput);
+    return UNITY_END();
+}
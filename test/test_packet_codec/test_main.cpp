@@ -0,0 +1,193 @@
+#include <PacketCodec.h>
+
+#include <Benchmark.h>
+#include <JoyStickPackets.h>
+#include <cstring>
+#include <random>
+#include <unity.h>
+
+/*
+AtomJoyStickCodec decode equivalence with the fixed-offset decoding it replaced, and a decode throughput benchmark.
+*/
+
+enum { RANDOM_PACKET_COUNT = 10000 };
+
+static const uint8_t roverMacAddress[6] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+
+/*!
+The decoding as it was before the codec, with the floats read at offsets 3, 7, 11, and 15.
+The original read them through unaligned float pointers, memcpy is used here so that the reference itself is well defined.
+*/
+static bool legacyDecode(const uint8_t* packet, const uint8_t* myMacAddress, joystick_frame_t& frame)
+{
+    uint8_t checksum = 0;
+    for (int ii = 0; ii < 24; ++ii) {
+        checksum += packet[ii];
+    }
+    if (checksum != packet[24]) {
+        return false;
+    }
+    if (packet[0] != myMacAddress[3] || packet[1] != myMacAddress[4] || packet[2] != myMacAddress[5]) {
+        return false;
+    }
+    memcpy(&frame.yaw, &packet[3], sizeof(float));
+    memcpy(&frame.throttle, &packet[7], sizeof(float));
+    memcpy(&frame.roll, &packet[11], sizeof(float));
+    memcpy(&frame.pitch, &packet[15], sizeof(float));
+    frame.pitch = -frame.pitch;
+    frame.armButton = packet[19];
+    frame.flipButton = packet[20];
+    frame.mode = packet[21];
+    frame.altMode = packet[22];
+    frame.proactiveFlag = packet[23];
+    return true;
+}
+
+static bool codecDecode(const packet_codec_t& codec, const uint8_t* packet, int len, joystick_frame_t& frame)
+{
+    return codec.isChecksumValid(packet, len) && codec.isAddressedTo(packet, len, roverMacAddress) && codec.decode(packet, len, roverMacAddress, frame);
+}
+
+//! Compare the floats bitwise, so that NaNs from random packets compare equal.
+static void checkFramesEqual(const joystick_frame_t& expected, const joystick_frame_t& actual)
+{
+    TEST_ASSERT_EQUAL_MEMORY(&expected.yaw, &actual.yaw, sizeof(float));
+    TEST_ASSERT_EQUAL_MEMORY(&expected.throttle, &actual.throttle, sizeof(float));
+    TEST_ASSERT_EQUAL_MEMORY(&expected.roll, &actual.roll, sizeof(float));
+    TEST_ASSERT_EQUAL_MEMORY(&expected.pitch, &actual.pitch, sizeof(float));
+    TEST_ASSERT_EQUAL_UINT8(expected.armButton, actual.armButton);
+    TEST_ASSERT_EQUAL_UINT8(expected.flipButton, actual.flipButton);
+    TEST_ASSERT_EQUAL_UINT8(expected.mode, actual.mode);
+    TEST_ASSERT_EQUAL_UINT8(expected.altMode, actual.altMode);
+    TEST_ASSERT_EQUAL_UINT8(expected.proactiveFlag, actual.proactiveFlag);
+}
+
+static void makeRandomPacket(std::mt19937& generator, uint8_t* packet)
+{
+    for (int ii = 0; ii < AtomJoyStickCodec::PACKET_SIZE; ++ii) {
+        packet[ii] = static_cast<uint8_t>(generator());
+    }
+    // most packets are addressed to the rover with a valid checksum, so that the field decoding is exercised
+    const uint32_t kind = generator() % 8;
+    if (kind != 0) {
+        packet[0] = roverMacAddress[3];
+        packet[1] = roverMacAddress[4];
+        packet[2] = roverMacAddress[5];
+    }
+    if (kind != 1) {
+        uint8_t checksum = 0;
+        for (int ii = 0; ii < AtomJoyStickCodec::Checksum::offset; ++ii) {
+            checksum += packet[ii];
+        }
+        packet[AtomJoyStickCodec::Checksum::offset] = checksum;
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_field_layout(void)
+{
+    static_assert(AtomJoyStickCodec::Yaw::offset == 3 && AtomJoyStickCodec::Throttle::offset == 7);
+    static_assert(AtomJoyStickCodec::Roll::offset == 11 && AtomJoyStickCodec::Pitch::offset == 15);
+    static_assert(AtomJoyStickCodec::ProactiveFlag::offset + AtomJoyStickCodec::ProactiveFlag::size == AtomJoyStickCodec::Checksum::offset);
+    static_assert(AtomJoyStickCodec::Checksum::offset + 1 == AtomJoyStickCodec::PACKET_SIZE);
+    const packet_codec_t codec = makePacketCodec<AtomJoyStickCodec>();
+    TEST_ASSERT_EQUAL_INT(25, codec.packetSize);
+}
+
+static void test_decode_matches_legacy_for_random_packets(void)
+{
+    const packet_codec_t codec = makePacketCodec<AtomJoyStickCodec>();
+    std::mt19937 generator(12345);
+    int decodedCount = 0;
+    for (int ii = 0; ii < RANDOM_PACKET_COUNT; ++ii) {
+        uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+        makeRandomPacket(generator, packet);
+        joystick_frame_t expected {};
+        joystick_frame_t actual {};
+        const bool legacyValid = legacyDecode(packet, roverMacAddress, expected);
+        TEST_ASSERT_EQUAL(legacyValid, codecDecode(codec, packet, sizeof(packet), actual));
+        if (legacyValid) {
+            checkFramesEqual(expected, actual);
+            ++decodedCount;
+        }
+    }
+    // both the accepted and the rejected paths were exercised
+    TEST_ASSERT_TRUE(decodedCount > RANDOM_PACKET_COUNT / 2 && decodedCount < RANDOM_PACKET_COUNT);
+}
+
+static void test_decode_is_alignment_safe(void)
+{
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.25F, -0.5F, 0.75F, -1.0F, 1, packet);
+    // decode from every alignment
+    alignas(8) uint8_t buffer[AtomJoyStickCodec::PACKET_SIZE + 8];
+    for (int offset = 0; offset < 8; ++offset) {
+        memcpy(&buffer[offset], packet, sizeof(packet));
+        joystick_frame_t frame {};
+        TEST_ASSERT_TRUE(AtomJoyStickCodec::decode(&buffer[offset], sizeof(packet), roverMacAddress, frame));
+        TEST_ASSERT_EQUAL_FLOAT(0.25F, frame.throttle);
+        TEST_ASSERT_EQUAL_FLOAT(-0.5F, frame.roll);
+        TEST_ASSERT_EQUAL_FLOAT(0.75F, frame.pitch);
+        TEST_ASSERT_EQUAL_FLOAT(-1.0F, frame.yaw);
+        TEST_ASSERT_EQUAL_UINT8(1, frame.mode);
+    }
+}
+
+static void test_short_packets_are_rejected(void)
+{
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.0F, 0.0F, 0.0F, 0.0F, 0, packet);
+    joystick_frame_t frame {};
+    TEST_ASSERT_FALSE(AtomJoyStickCodec::isChecksumValid(packet, AtomJoyStickCodec::PACKET_SIZE - 1));
+    TEST_ASSERT_FALSE(AtomJoyStickCodec::isAddressedTo(packet, AtomJoyStickCodec::PACKET_SIZE - 1, roverMacAddress));
+    TEST_ASSERT_FALSE(AtomJoyStickCodec::decode(packet, AtomJoyStickCodec::PACKET_SIZE - 1, roverMacAddress, frame));
+    TEST_ASSERT_TRUE(codecDecode(makePacketCodec<AtomJoyStickCodec>(), packet, sizeof(packet), frame));
+}
+
+static void test_benchmark_decode(void)
+{
+    enum { PACKETS = 64 };
+    static uint8_t packets[PACKETS][AtomJoyStickCodec::PACKET_SIZE];
+    for (int ii = 0; ii < PACKETS; ++ii) {
+        makeAtomJoyStickPacket(roverMacAddress, 0.01F * static_cast<float>(ii), 0.0F, 0.5F, -0.5F, 0, packets[ii]);
+    }
+    joystick_frame_t frame {};
+    runBenchmark("fixed offset decode (before)", [&](uint64_t ii) {
+        doNotOptimize(legacyDecode(packets[ii % PACKETS], roverMacAddress, frame));
+        doNotOptimize(frame);
+    });
+    runBenchmark("AtomJoyStickCodec, direct", [&](uint64_t ii) {
+        const uint8_t* packet = packets[ii % PACKETS];
+        doNotOptimize(AtomJoyStickCodec::isChecksumValid(packet, AtomJoyStickCodec::PACKET_SIZE)
+            && AtomJoyStickCodec::isAddressedTo(packet, AtomJoyStickCodec::PACKET_SIZE, roverMacAddress)
+            && AtomJoyStickCodec::decode(packet, AtomJoyStickCodec::PACKET_SIZE, roverMacAddress, frame));
+        doNotOptimize(frame);
+    });
+    const packet_codec_t codec = makePacketCodec<AtomJoyStickCodec>();
+    const benchmark_result_t result = runBenchmark("AtomJoyStickCodec, through packet_codec_t", [&](uint64_t ii) {
+        doNotOptimize(codecDecode(codec, packets[ii % PACKETS], AtomJoyStickCodec::PACKET_SIZE, frame));
+        doNotOptimize(frame);
+    });
+    printf("DECODE %.1f M packets/s through packet_codec_t\n", 1.0e3 / result.nsPerIteration);
+    TEST_ASSERT_TRUE(result.nsPerIteration > 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_field_layout);
+    RUN_TEST(test_decode_matches_legacy_for_random_packets);
+    RUN_TEST(test_decode_is_alignment_safe);
+    RUN_TEST(test_short_packets_are_rejected);
+    RUN_TEST(test_benchmark_decode);
+    return UNITY_END();
+}
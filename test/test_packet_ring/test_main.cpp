@@ -0,0 +1,229 @@
+#include <PacketRing.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unity.h>
+
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_empty_ring(void)
+{
+    PacketRing<4, 8> ring;
+    uint8_t data[8];
+    uint32_t timeUs = 0;
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_EQUAL(0, ring.pop(data, sizeof(data), timeUs, PacketRingBase::DRAIN_ALL));
+    TEST_ASSERT_EQUAL(0, ring.pop(data, sizeof(data), timeUs, PacketRingBase::LATEST_WINS));
+}
+
+static void test_drain_all_returns_packets_in_order(void)
+{
+    PacketRing<4, 8> ring;
+    for (uint8_t ii = 0; ii < 3; ++ii) {
+        const uint8_t packet[2] { ii, static_cast<uint8_t>(ii + 10) };
+        ring.push(packet, sizeof(packet), 100U * ii);
+    }
+    for (uint8_t ii = 0; ii < 3; ++ii) {
+        uint8_t data[8];
+        uint32_t timeUs = 0;
+        TEST_ASSERT_EQUAL(2, ring.pop(data, sizeof(data), timeUs, PacketRingBase::DRAIN_ALL));
+        TEST_ASSERT_EQUAL_UINT8(ii, data[0]);
+        TEST_ASSERT_EQUAL_UINT32(100U * ii, timeUs);
+    }
+    TEST_ASSERT_TRUE(ring.isEmpty());
+}
+
+static void test_latest_wins_skips_older_packets(void)
+{
+    PacketRing<4, 8> ring;
+    for (uint8_t ii = 0; ii < 3; ++ii) {
+        ring.push(&ii, 1, ii);
+    }
+    uint8_t data[8];
+    uint32_t timeUs = 0;
+    TEST_ASSERT_EQUAL(1, ring.pop(data, sizeof(data), timeUs, PacketRingBase::LATEST_WINS));
+    TEST_ASSERT_EQUAL_UINT8(2, data[0]);
+    TEST_ASSERT_EQUAL_UINT32(2, ring.getSkipCount());
+    TEST_ASSERT_TRUE(ring.isEmpty());
+}
+
+static void test_overwrites_are_counted(void)
+{
+    PacketRing<4, 8> ring;
+    for (uint8_t ii = 0; ii < 10; ++ii) {
+        ring.push(&ii, 1, ii);
+    }
+    uint8_t data[8];
+    uint32_t timeUs = 0;
+    TEST_ASSERT_EQUAL(1, ring.pop(data, sizeof(data), timeUs, PacketRingBase::DRAIN_ALL));
+    // the oldest four remaining are 6, 7, 8, 9
+    TEST_ASSERT_EQUAL_UINT8(6, data[0]);
+    TEST_ASSERT_EQUAL_UINT32(6, ring.getOverwriteCount());
+}
+
+static void test_packets_are_truncated_to_the_slot_and_buffer(void)
+{
+    PacketRing<2, 4> ring;
+    const uint8_t packet[6] { 1, 2, 3, 4, 5, 6 };
+    ring.push(packet, sizeof(packet), 0);
+    ring.push(packet, sizeof(packet), 0);
+    uint8_t data[8] {};
+    uint32_t timeUs = 0;
+    TEST_ASSERT_EQUAL(4, ring.pop(data, sizeof(data), timeUs, PacketRingBase::DRAIN_ALL));
+    TEST_ASSERT_EQUAL(2, ring.pop(data, 2, timeUs, PacketRingBase::DRAIN_ALL));
+}
+
+/*
+Stress test: a producer thread pushes packets while the consumer pops them. Every byte of a packet is derived from its packet number,
+so a packet mixing two writes is detected.
+
+With `yieldInterval` zero the producer pushes as fast as it can, which overruns the consumer, as a burst of ESP-NOW packets would.
+Otherwise the producer yields after every `yieldInterval` packets, so that on a machine with few cores the two threads interleave closely.
+Reads that collide with a write, and are retried, are only seen when the threads run on separate cores.
+*/
+enum { STRESS_SLOT_COUNT = 4, STRESS_SLOT_SIZE = 128, STRESS_PACKET_COUNT = 500000 };
+
+static void fillPacket(uint32_t packetNumber, uint8_t* packet)
+{
+    memcpy(packet, &packetNumber, sizeof(packetNumber));
+    for (int ii = sizeof(packetNumber); ii < STRESS_SLOT_SIZE; ++ii) {
+        packet[ii] = static_cast<uint8_t>(packetNumber * 31U + static_cast<uint32_t>(ii));
+    }
+}
+
+static bool isPacketConsistent(const uint8_t* packet, int len, uint32_t timeUs, uint32_t& packetNumber)
+{
+    if (len != STRESS_SLOT_SIZE) {
+        return false;
+    }
+    memcpy(&packetNumber, packet, sizeof(packetNumber));
+    if (timeUs != packetNumber) {
+        return false;
+    }
+    for (int ii = sizeof(packetNumber); ii < STRESS_SLOT_SIZE; ++ii) {
+        if (packet[ii] != static_cast<uint8_t>(packetNumber * 31U + static_cast<uint32_t>(ii))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stress(PacketRingBase::read_mode_t readMode, uint32_t yieldInterval, const char* name)
+{
+    static PacketRing<STRESS_SLOT_COUNT, STRESS_SLOT_SIZE> ring;
+    ring.clear();
+    const uint32_t pushCountStart = ring.getPushCount();
+    const uint32_t overwriteCountStart = ring.getOverwriteCount();
+    const uint32_t skipCountStart = ring.getSkipCount();
+    const uint32_t tearCountStart = ring.getTearCount();
+    std::atomic<bool> producerDone {false};
+
+    const auto startTime = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        uint8_t packet[STRESS_SLOT_SIZE];
+        for (uint32_t ii = 0; ii < STRESS_PACKET_COUNT; ++ii) {
+            fillPacket(ii, packet);
+            ring.push(packet, sizeof(packet), ii);
+            if (yieldInterval != 0 && ii % yieldInterval == 0) {
+                std::this_thread::yield();
+            }
+        }
+        producerDone = true;
+    });
+
+    uint32_t receivedCount = 0;
+    uint32_t tornCount = 0;
+    uint32_t outOfOrderCount = 0;
+    uint32_t previousPacketNumber = 0;
+    bool first = true;
+    uint8_t packet[STRESS_SLOT_SIZE];
+    while (true) {
+        const bool done = producerDone;
+        uint32_t timeUs = 0;
+        const int len = ring.pop(packet, sizeof(packet), timeUs, readMode);
+        if (len == 0) {
+            if (done) {
+                break;
+            }
+            // the control loop would wait for the receive signal here
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t packetNumber = 0;
+        if (!isPacketConsistent(packet, len, timeUs, packetNumber)) {
+            ++tornCount;
+            continue;
+        }
+        if (!first && packetNumber <= previousPacketNumber) {
+            ++outOfOrderCount;
+        }
+        first = false;
+        previousPacketNumber = packetNumber;
+        ++receivedCount;
+    }
+    producer.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    const uint32_t pushCount = ring.getPushCount() - pushCountStart;
+    const uint32_t overwriteCount = ring.getOverwriteCount() - overwriteCountStart;
+    const uint32_t skipCount = ring.getSkipCount() - skipCountStart;
+    const uint32_t tearCount = ring.getTearCount() - tearCountStart;
+    printf("STRESS %-24s pushed:%u received:%u overwritten:%u skipped:%u tears retried:%u  %.2f Mpackets/s pushed, %.2f Mpackets/s received\n",
+        name, pushCount, receivedCount, overwriteCount, skipCount, tearCount,
+        pushCount / seconds * 1.0e-6, receivedCount / seconds * 1.0e-6);
+
+    TEST_ASSERT_EQUAL_UINT32(STRESS_PACKET_COUNT, pushCount);
+    TEST_ASSERT_EQUAL_UINT32(0, tornCount);
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrderCount);
+    TEST_ASSERT_GREATER_THAN(0, receivedCount);
+    // every packet is accounted for: received, or overwritten or skipped before it could be read
+    TEST_ASSERT_EQUAL_UINT32(pushCount, receivedCount + overwriteCount + skipCount);
+    // the last packet is always received, since the consumer drains the ring after the producer has finished
+    TEST_ASSERT_EQUAL_UINT32(STRESS_PACKET_COUNT - 1, previousPacketNumber);
+}
+
+static void test_stress_drain_all_burst(void)
+{
+    stress(PacketRingBase::DRAIN_ALL, 0, "DRAIN_ALL burst");
+}
+
+static void test_stress_drain_all_interleaved(void)
+{
+    stress(PacketRingBase::DRAIN_ALL, 1, "DRAIN_ALL interleaved");
+}
+
+static void test_stress_latest_wins_burst(void)
+{
+    stress(PacketRingBase::LATEST_WINS, 0, "LATEST_WINS burst");
+}
+
+static void test_stress_latest_wins_interleaved(void)
+{
+    stress(PacketRingBase::LATEST_WINS, 1, "LATEST_WINS interleaved");
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_ring);
+    RUN_TEST(test_drain_all_returns_packets_in_order);
+    RUN_TEST(test_latest_wins_skips_older_packets);
+    RUN_TEST(test_overwrites_are_counted);
+    RUN_TEST(test_packets_are_truncated_to_the_slot_and_buffer);
+    RUN_TEST(test_stress_drain_all_burst);
+    RUN_TEST(test_stress_drain_all_interleaved);
+    RUN_TEST(test_stress_latest_wins_burst);
+    RUN_TEST(test_stress_latest_wins_interleaved);
+    return UNITY_END();
+}
@@ -0,0 +1,181 @@
+#include <PeerRegistry.h>
+
+#include <Benchmark.h>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <unity.h>
+
+/*
+PeerRegistry lookups, concurrent adds from two tasks, and a lookup benchmark against a linear scan of the peers.
+*/
+
+enum { MAX_PEER_COUNT = 20 };
+
+static void makeMacAddress(uint32_t n, uint8_t* macAddress)
+{
+    // addresses from the same vendor, as a fleet of M5Stacks would be, differing only in the low bytes
+    macAddress[0] = 0x4C;
+    macAddress[1] = 0x75;
+    macAddress[2] = 0x25;
+    macAddress[3] = static_cast<uint8_t>(n >> 16U);
+    macAddress[4] = static_cast<uint8_t>(n >> 8U);
+    macAddress[5] = static_cast<uint8_t>(n);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_add_find_remove(void)
+{
+    PeerRegistry registry;
+    uint8_t macAddress[6];
+    for (uint32_t ii = 0; ii < MAX_PEER_COUNT; ++ii) {
+        makeMacAddress(ii, macAddress);
+        TEST_ASSERT_TRUE(registry.add(macAddress, static_cast<int>(ii)));
+    }
+    TEST_ASSERT_EQUAL(MAX_PEER_COUNT, registry.getCount());
+    makeMacAddress(3, macAddress);
+    TEST_ASSERT_FALSE(registry.add(macAddress, 30));
+    for (uint32_t ii = 0; ii < MAX_PEER_COUNT; ++ii) {
+        makeMacAddress(ii, macAddress);
+        TEST_ASSERT_EQUAL(static_cast<int>(ii), registry.find(macAddress));
+    }
+    makeMacAddress(MAX_PEER_COUNT, macAddress);
+    TEST_ASSERT_EQUAL(PeerRegistry::NOT_FOUND, registry.find(macAddress));
+
+    // removing a peer leaves the others, whose probe sequences may pass through its slot, findable
+    makeMacAddress(5, macAddress);
+    TEST_ASSERT_TRUE(registry.remove(macAddress));
+    TEST_ASSERT_FALSE(registry.remove(macAddress));
+    TEST_ASSERT_EQUAL(PeerRegistry::NOT_FOUND, registry.find(macAddress));
+    for (uint32_t ii = 0; ii < MAX_PEER_COUNT; ++ii) {
+        if (ii != 5) {
+            makeMacAddress(ii, macAddress);
+            TEST_ASSERT_EQUAL(static_cast<int>(ii), registry.find(macAddress));
+        }
+    }
+    makeMacAddress(5, macAddress);
+    TEST_ASSERT_TRUE(registry.add(macAddress, 5));
+    TEST_ASSERT_EQUAL(MAX_PEER_COUNT, registry.getCount());
+}
+
+static void test_table_full(void)
+{
+    PeerRegistry registry;
+    uint8_t macAddress[6];
+    for (uint32_t ii = 0; ii < PeerRegistry::TABLE_SIZE; ++ii) {
+        makeMacAddress(ii, macAddress);
+        TEST_ASSERT_TRUE(registry.add(macAddress, static_cast<int>(ii & 0x3FU)));
+    }
+    makeMacAddress(PeerRegistry::TABLE_SIZE, macAddress);
+    TEST_ASSERT_FALSE(registry.add(macAddress, 0));
+    TEST_ASSERT_EQUAL(PeerRegistry::NOT_FOUND, registry.find(macAddress));
+}
+
+/*!
+The main task adds peers while the WiFi task repeatedly rebinds the primary peer, removing and adding it, and a reader looks peers up.
+Without the lock both writers could claim the same empty slot, losing a peer, or corrupt the count.
+*/
+static void test_concurrent_adds_from_two_tasks(void)
+{
+    enum { ROUNDS = 200 };
+    for (int round = 0; round < ROUNDS; ++round) {
+        PeerRegistry registry;
+        std::atomic<bool> start {false};
+        std::atomic<bool> done {false};
+        std::atomic<uint32_t> badLookups {0};
+
+        std::thread wifiTask([&]() {
+            while (!start) {}
+            uint8_t macAddress[6];
+            for (uint32_t ii = 0; ii < 8; ++ii) {
+                makeMacAddress(0x10000 + ii, macAddress);
+                registry.add(macAddress, 1);
+                registry.remove(macAddress);
+            }
+            makeMacAddress(0x10000, macAddress);
+            registry.add(macAddress, 1);
+        });
+        std::thread reader([&]() {
+            uint8_t macAddress[6];
+            makeMacAddress(0x20000, macAddress);
+            while (!done) {
+                // a peer that is never added is never found
+                if (registry.find(macAddress) != PeerRegistry::NOT_FOUND) {
+                    ++badLookups;
+                }
+            }
+        });
+        start = true;
+        uint8_t macAddress[6];
+        for (uint32_t ii = 0; ii < MAX_PEER_COUNT - 2; ++ii) {
+            makeMacAddress(ii, macAddress);
+            TEST_ASSERT_TRUE(registry.add(macAddress, static_cast<int>(ii + 2)));
+        }
+        wifiTask.join();
+        done = true;
+        reader.join();
+
+        TEST_ASSERT_EQUAL_UINT32(0, badLookups.load());
+        TEST_ASSERT_EQUAL(MAX_PEER_COUNT - 1, registry.getCount());
+        for (uint32_t ii = 0; ii < MAX_PEER_COUNT - 2; ++ii) {
+            makeMacAddress(ii, macAddress);
+            TEST_ASSERT_EQUAL(static_cast<int>(ii + 2), registry.find(macAddress));
+        }
+        makeMacAddress(0x10000, macAddress);
+        TEST_ASSERT_EQUAL(1, registry.find(macAddress));
+    }
+}
+
+static void test_benchmark_lookup(void)
+{
+    PeerRegistry registry;
+    uint8_t macAddresses[MAX_PEER_COUNT][6];
+    for (uint32_t ii = 0; ii < MAX_PEER_COUNT; ++ii) {
+        makeMacAddress(ii, macAddresses[ii]);
+        registry.add(macAddresses[ii], static_cast<int>(ii));
+    }
+    uint8_t unknown[6];
+    makeMacAddress(0x30000, unknown);
+
+    // before: each received packet was matched by comparing its address with each peer's in turn
+    const auto linearFind = [&](const uint8_t* macAddress) {
+        for (int ii = 0; ii < MAX_PEER_COUNT; ++ii) {
+            if (memcmp(macAddresses[ii], macAddress, 6) == 0) {
+                return ii;
+            }
+        }
+        return static_cast<int>(PeerRegistry::NOT_FOUND);
+    };
+    runBenchmark("linear scan, 20 peers, hit", [&](uint64_t ii) {
+        doNotOptimize(linearFind(macAddresses[ii % MAX_PEER_COUNT]));
+    });
+    runBenchmark("linear scan, 20 peers, miss", [&](uint64_t) {
+        doNotOptimize(linearFind(unknown));
+    });
+    runBenchmark("PeerRegistry::find, 20 peers, hit", [&](uint64_t ii) {
+        doNotOptimize(registry.find(macAddresses[ii % MAX_PEER_COUNT]));
+    });
+    const benchmark_result_t miss = runBenchmark("PeerRegistry::find, 20 peers, miss", [&](uint64_t) {
+        doNotOptimize(registry.find(unknown));
+    });
+    TEST_ASSERT_TRUE(miss.nsPerIteration > 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_add_find_remove);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_concurrent_adds_from_two_tasks);
+    RUN_TEST(test_benchmark_lookup);
+    return UNITY_END();
+}
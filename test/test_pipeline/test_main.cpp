@@ -0,0 +1,229 @@
+#include <JoyStickPackets.h>
+#include <RoverC.h>
+#include <Telemetry.h>
+
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <cstdio>
+#include <esp_now.h>
+#include <freertos/task.h>
+#include <unity.h>
+
+/*
+Runs the application's setup() and loop(), from main.cpp, against the fakes.
+The application's state persists from one test to the next, so the tests run in order, as one session.
+*/
+void setup();
+void loop();
+
+static const char* CONFIG_STORE_FILE = "RoverC"; //!< the config store's file on the host, named after its NVS namespace
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+static void receivePacket(float throttle, float roll, float pitch, float yaw)
+{
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, throttle, roll, pitch, yaw, 0, packet);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+}
+
+//! The last values written to the RoverC's motor registers, by the motion control task through the I2C worker task.
+static const TwoWire::transaction_t* lastMotorWrite()
+{
+    enum { ROVER_C_ADDRESS = 0x38, REGISTER_MOTOR_1 = 0x00 };
+    const TwoWire::transaction_t* last = nullptr;
+    for (const auto& transaction : Wire.transactions) {
+        if (transaction.address == ROVER_C_ADDRESS && transaction.data[0] == REGISTER_MOTOR_1) {
+            last = &transaction;
+        }
+    }
+    return last;
+}
+
+static int countFramesSentTo(const uint8_t* macAddress)
+{
+    int count = 0;
+    for (const auto& frame : FakeEspNow::sentFrames) {
+        if (memcmp(frame.macAddress, macAddress, ESP_NOW_ETH_ALEN) == 0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void setUp(void)
+{
+    Serial.clearOutput();
+}
+
+void tearDown(void)
+{
+    std::remove(CONFIG_STORE_FILE);
+}
+
+static void test_setup(void)
+{
+    std::remove(CONFIG_STORE_FILE); // left by an aborted run, so the rover starts unpaired
+    FakeEspNow::reset();
+    FakeEspNow::loopback = true;
+    FakeClock::setUs(1000000);
+    WiFi.setMacAddress(roverMacAddress);
+
+    setup();
+    TEST_ASSERT_TRUE(FakeEspNow::initialized);
+    TEST_ASSERT_NOT_NULL(FakeEspNow::receiveCallback);
+    TEST_ASSERT_NOT_NULL(FakeEspNow::sendCallback);
+    TEST_ASSERT_TRUE(Serial.getOutput().find("MAC ADDRESS: 24:0A:C4:11:22:33") != std::string::npos);
+    // only the broadcast peer, until a joystick is paired
+    TEST_ASSERT_EQUAL(1, FakeEspNow::peers.size());
+}
+
+static void test_first_packet_pairs_and_is_unpacked(void)
+{
+    receivePacket(0.0F, 0.0F, 0.5F, 0.0F);
+    FakeClock::advanceMs(10);
+    loop();
+    TEST_ASSERT_EQUAL(2, FakeEspNow::peers.size());
+    TEST_ASSERT_TRUE(Serial.getOutput().find("TRANSMIT MAC ADDRESS: 4C:75:25:AA:BB:CC") != std::string::npos);
+    TEST_ASSERT_TRUE(Serial.getOutput().find("Bad packet") == std::string::npos);
+}
+
+static void test_telemetry_is_sent_to_the_joystick(void)
+{
+    for (int ii = 0; ii < 30; ++ii) {
+        receivePacket(0.0F, 0.1F, 0.5F, 0.0F);
+        loop();
+        FakeTask::runForUs(10000);
+    }
+    // 300ms at one frame every 100ms
+    const int count = countFramesSentTo(joyStickMacAddress);
+    TEST_ASSERT_GREATER_OR_EQUAL(3, count);
+    TEST_ASSERT_LESS_OR_EQUAL(4, count);
+    TEST_ASSERT_EQUAL_UINT8('T', FakeEspNow::sentFrames.back().data[0]);
+}
+
+static void test_statistics_command(void)
+{
+    Serial.pushInput("s");
+    loop();
+    const std::string& output = Serial.getOutput();
+    // one motor write for each packet that the motion task picked up
+    TEST_ASSERT_TRUE(output.find("LATENCY(event) n:30 ") != std::string::npos);
+    TEST_ASSERT_TRUE(output.find("SEND queued:") != std::string::npos);
+    TEST_ASSERT_TRUE(output.find("FAILSAFE stops:0") != std::string::npos);
+}
+
+static void test_rejected_packets_are_reported_in_telemetry(void)
+{
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.0F, 0.1F, 0.5F, 0.0F, 0, packet);
+    packet[AtomJoyStickCodec::Checksum::offset] ^= 0xFFU;
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    const uint8_t otherRoverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x44, 0x55, 0x66 };
+    makeAtomJoyStickPacket(otherRoverMacAddress, 0.0F, 0.1F, 0.5F, 0.0F, 0, packet);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet) - 1);
+    for (int ii = 0; ii < 30; ++ii) {
+        receivePacket(0.0F, 0.1F, 0.5F, 0.0F);
+        FakeClock::advanceMs(10);
+        loop();
+    }
+
+    TelemetryDecoder decoder;
+    for (const auto& frame : FakeEspNow::sentFrames) {
+        if (memcmp(frame.macAddress, joyStickMacAddress, ESP_NOW_ETH_ALEN) == 0 && frame.data[0] == Telemetry::MAGIC) {
+            decoder.decode(frame.data, frame.len);
+        }
+    }
+    TEST_ASSERT_TRUE(decoder.isSynchronized());
+    TEST_ASSERT_EQUAL_INT32(1, decoder.getValue(Telemetry::FIELD_CHECKSUM_FAILURE_COUNT));
+    TEST_ASSERT_EQUAL_INT32(1, decoder.getValue(Telemetry::FIELD_WRONG_MAC_ADDRESS_COUNT));
+    TEST_ASSERT_EQUAL_INT32(1, decoder.getValue(Telemetry::FIELD_WRONG_LENGTH_COUNT));
+
+    Serial.pushInput("s");
+    loop();
+    TEST_ASSERT_TRUE(Serial.getOutput().find("checksum failures:1 wrong MAC:1 wrong length:1") != std::string::npos);
+}
+
+static void test_motors_follow_the_sticks(void)
+{
+    Wire.reset();
+    for (int ii = 0; ii < 30; ++ii) {
+        receivePacket(0.0F, 0.0F, 1.0F, 0.0F);
+        loop();
+        FakeTask::runForUs(10000);
+    }
+    const TwoWire::transaction_t* motorWrite = lastMotorWrite();
+    TEST_ASSERT_NOT_NULL(motorWrite);
+    TEST_ASSERT_EQUAL(1 + RoverC::MOTOR_COUNT, motorWrite->data.size());
+    for (int motor = 0; motor < RoverC::MOTOR_COUNT; ++motor) {
+        TEST_ASSERT_TRUE(static_cast<int8_t>(motorWrite->data[1 + motor]) > 50);
+    }
+}
+
+static void test_lost_link_stops_the_failsafe(void)
+{
+    receivePacket(0.0F, 0.0F, 1.0F, 0.0F);
+    loop();
+    FakeTask::runForUs(100000);
+    TEST_ASSERT_TRUE(lastMotorWrite()->data[1] != 0);
+    // each pass waits up to 10ms of real time for a packet, so the simulated clock is advanced by 10ms each pass
+    for (int ii = 0; ii < 150; ++ii) {
+        FakeTask::runForUs(10000);
+        loop();
+    }
+    FakeTask::runForUs(10000);
+    Serial.pushInput("s");
+    loop();
+    TEST_ASSERT_TRUE(Serial.getOutput().find("FAILSAFE stops:1") != std::string::npos);
+    for (int motor = 0; motor < RoverC::MOTOR_COUNT; ++motor) {
+        TEST_ASSERT_EQUAL_UINT8(0, lastMotorWrite()->data[1 + motor]);
+    }
+}
+
+/*!
+Between jittered packets the loop runs without a packet, and the failsafe is updated. Until a packet is late
+the last setpoint is held, so only the packets publish setpoints to the motion controller.
+*/
+static void test_jittered_packets_publish_one_setpoint_each(void)
+{
+    // the motion statistics are reset by the control task at its next update
+    Serial.pushInput("s");
+    loop();
+    FakeTask::runForUs(5000);
+
+    const uint32_t gapsMs[] { 10, 15, 8, 20, 12, 10, 18, 9, 22, 10 };
+    for (const auto gapMs : gapsMs) {
+        FakeTask::runForUs(gapMs * 500);
+        loop();
+        FakeTask::runForUs(gapMs * 500);
+        receivePacket(0.0F, 0.0F, 1.0F, 0.0F);
+        loop();
+    }
+    FakeTask::runForUs(5000);
+    Serial.clearOutput();
+    Serial.pushInput("s");
+    loop();
+    const std::string& output = Serial.getOutput();
+    const size_t motion = output.find("MOTION ");
+    TEST_ASSERT_TRUE(motion != std::string::npos);
+    TEST_ASSERT_TRUE(output.find("setpoints:10 ", motion) != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_setup);
+    RUN_TEST(test_first_packet_pairs_and_is_unpacked);
+    RUN_TEST(test_telemetry_is_sent_to_the_joystick);
+    RUN_TEST(test_statistics_command);
+    RUN_TEST(test_rejected_packets_are_reported_in_telemetry);
+    RUN_TEST(test_motors_follow_the_sticks);
+    RUN_TEST(test_lost_link_stops_the_failsafe);
+    RUN_TEST(test_jittered_packets_publish_one_setpoint_each);
+    return UNITY_END();
+}
@@ -0,0 +1,154 @@
+#include <Arduino.h>
+#include <AtomJoyStickReceiver.h>
+#include <ReceiveFilter.h>
+
+#include <Benchmark.h>
+#include <JoyStickPackets.h>
+#include <unity.h>
+
+/*
+ReceiveFilter stages and counts, the rejects reaching the link statistics, and the per-frame cost of the receive path.
+*/
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t otherRoverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x44, 0x55, 0x66 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+static int stageCallCount = 0;
+
+static ReceiveFilter::reason_t acceptStage(const void* context, const uint8_t* macAddress, const uint8_t* data, int len)
+{
+    (void)context;
+    (void)macAddress;
+    (void)data;
+    (void)len;
+    ++stageCallCount;
+    return ReceiveFilter::ACCEPTED;
+}
+
+static ReceiveFilter::reason_t rejectShortStage(const void* context, const uint8_t* macAddress, const uint8_t* data, int len)
+{
+    (void)macAddress;
+    (void)data;
+    ++stageCallCount;
+    return len < *static_cast<const int*>(context) ? ReceiveFilter::REJECTED_LENGTH : ReceiveFilter::ACCEPTED;
+}
+
+static AtomJoyStickReceiver& boundReceiver()
+{
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    FakeEspNow::reset();
+    receiver.init(1, joyStickMacAddress);
+    receiver.getTransceiver().getLinkStatistics().reset();
+    return receiver;
+}
+
+void setUp(void)
+{
+    stageCallCount = 0;
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_stages_run_in_order_until_rejected(void)
+{
+    ReceiveFilter filter;
+    static const int minimumLength = 4;
+    TEST_ASSERT_TRUE(filter.addStage(rejectShortStage, &minimumLength));
+    TEST_ASSERT_TRUE(filter.addStage(acceptStage, nullptr));
+    const uint8_t data[8] {};
+
+    TEST_ASSERT_EQUAL(ReceiveFilter::ACCEPTED, filter.check(joyStickMacAddress, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(2, stageCallCount);
+    TEST_ASSERT_EQUAL(ReceiveFilter::REJECTED_LENGTH, filter.check(joyStickMacAddress, data, 2));
+    TEST_ASSERT_EQUAL(3, stageCallCount);
+
+    TEST_ASSERT_EQUAL_UINT32(1, filter.getCount(ReceiveFilter::ACCEPTED));
+    TEST_ASSERT_EQUAL_UINT32(1, filter.getCount(ReceiveFilter::REJECTED_LENGTH));
+    TEST_ASSERT_EQUAL_UINT32(1, filter.getRejectedCount());
+}
+
+static void test_stage_count_is_bounded(void)
+{
+    ReceiveFilter filter;
+    for (int ii = 0; ii < ReceiveFilter::MAX_STAGE_COUNT; ++ii) {
+        TEST_ASSERT_TRUE(filter.addStage(acceptStage, nullptr));
+    }
+    TEST_ASSERT_FALSE(filter.addStage(acceptStage, nullptr));
+    filter.clearStages();
+    TEST_ASSERT_TRUE(filter.addStage(acceptStage, nullptr));
+}
+
+static void test_rejects_are_counted_in_link_statistics(void)
+{
+    AtomJoyStickReceiver& receiver = boundReceiver();
+    uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+
+    makeAtomJoyStickPacket(roverMacAddress, 0.5F, 0.0F, 0.0F, 0.0F, 0, packet);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    TEST_ASSERT_TRUE(receiver.unpackPacket());
+
+    packet[AtomJoyStickCodec::Checksum::offset] ^= 0x01U;
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    makeAtomJoyStickPacket(otherRoverMacAddress, 0.5F, 0.0F, 0.0F, 0.0F, 0, packet);
+    FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+    FakeEspNow::receive(joyStickMacAddress, packet, AtomJoyStickCodec::PACKET_SIZE - 1);
+
+    // rejected packets never reach the ring
+    TEST_ASSERT_TRUE(receiver.isPacketEmpty());
+    const LinkStatistics& link = receiver.getLinkStatistics();
+    TEST_ASSERT_EQUAL_UINT32(2, link.getChecksumFailureCount());
+    TEST_ASSERT_EQUAL_UINT32(1, link.getWrongMacAddressCount());
+    TEST_ASSERT_EQUAL_UINT32(1, link.getWrongLengthCount());
+    const ReceiveFilter& filter = receiver.getReceiveFilter();
+    TEST_ASSERT_EQUAL_UINT32(link.getChecksumFailureCount(), filter.getCount(ReceiveFilter::REJECTED_CHECKSUM));
+    TEST_ASSERT_EQUAL_UINT32(link.getWrongMacAddressCount(), filter.getCount(ReceiveFilter::REJECTED_ADDRESS));
+    TEST_ASSERT_EQUAL_UINT32(link.getWrongLengthCount(), filter.getCount(ReceiveFilter::REJECTED_LENGTH));
+}
+
+static void test_benchmark_per_frame_cost(void)
+{
+    AtomJoyStickReceiver& receiver = boundReceiver();
+    ESPNOW_Transceiver& transceiver = receiver.getTransceiver();
+    uint8_t good[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(roverMacAddress, 0.5F, 0.0F, 0.0F, 0.0F, 0, good);
+    uint8_t badChecksum[AtomJoyStickCodec::PACKET_SIZE];
+    memcpy(badChecksum, good, sizeof(good));
+    badChecksum[AtomJoyStickCodec::Checksum::offset] ^= 0x01U;
+    uint8_t wrongAddress[AtomJoyStickCodec::PACKET_SIZE];
+    makeAtomJoyStickPacket(otherRoverMacAddress, 0.5F, 0.0F, 0.0F, 0.0F, 0, wrongAddress);
+
+    runBenchmark("receive accepted frame, and unpack", [&](uint64_t) {
+        transceiver.handleReceivedData(joyStickMacAddress, good, sizeof(good));
+        doNotOptimize(receiver.unpackPacket());
+    });
+    runBenchmark("receive accepted frame, filter and copy only", [&](uint64_t) {
+        transceiver.handleReceivedData(joyStickMacAddress, good, sizeof(good));
+    });
+    runBenchmark("receive frame rejected by length", [&](uint64_t) {
+        transceiver.handleReceivedData(joyStickMacAddress, good, sizeof(good) - 1);
+    });
+    runBenchmark("receive frame rejected by checksum", [&](uint64_t) {
+        transceiver.handleReceivedData(joyStickMacAddress, badChecksum, sizeof(badChecksum));
+    });
+    runBenchmark("receive frame rejected by address", [&](uint64_t) {
+        transceiver.handleReceivedData(joyStickMacAddress, wrongAddress, sizeof(wrongAddress));
+    });
+    TEST_ASSERT_TRUE(receiver.getLinkStatistics().getChecksumFailureCount() > 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_stages_run_in_order_until_rejected);
+    RUN_TEST(test_stage_count_is_bounded);
+    RUN_TEST(test_rejects_are_counted_in_link_statistics);
+    RUN_TEST(test_benchmark_per_frame_cost);
+    return UNITY_END();
+}
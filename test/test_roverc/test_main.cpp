@@ -0,0 +1,212 @@
+#include <FakeI2C_Bus.h>
+#include <I2C_Wire.h>
+#include <RoverC.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <cstdio>
+#include <unity.h>
+
+
+void setUp(void)
+{
+    FakeClock::setUs(0);
+    Wire.reset();
+}
+
+void tearDown(void)
+{
+}
+
+static void test_move_writes_motors_and_servos_in_two_bursts(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.move(0.5F, 0.0F, 1.0F, 0.0F);
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x38, bus.transactions[0].address);
+    TEST_ASSERT_EQUAL_HEX8(0x00, bus.transactions[0].firstRegister);
+    TEST_ASSERT_EQUAL(RoverC::MOTOR_COUNT, bus.transactions[0].data.size());
+    TEST_ASSERT_EQUAL_HEX8(0x10, bus.transactions[1].firstRegister);
+    TEST_ASSERT_EQUAL(RoverC::SERVO_COUNT, bus.transactions[1].data.size());
+    // full pitch is full speed forwards on every wheel
+    for (int ii = 0; ii < RoverC::MOTOR_COUNT; ++ii) {
+        TEST_ASSERT_EQUAL_INT8(100, rover.getMotorSpeed(ii));
+        TEST_ASSERT_EQUAL_INT8(100, bus.registers[ii]);
+    }
+    TEST_ASSERT_EQUAL_UINT8(45, bus.registers[0x10]);
+    TEST_ASSERT_EQUAL_UINT8(45, bus.registers[0x11]);
+    TEST_ASSERT_EQUAL_UINT32(2, rover.getBusStatistics().requestCount);
+    TEST_ASSERT_EQUAL_UINT32(bus.getByteCount(), rover.getBusStatistics().requestByteCount);
+}
+
+static void test_unchanged_frame_is_suppressed(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.move(0.0F, 0.2F, 0.4F, 0.0F);
+    bus.clear();
+    rover.move(0.0F, 0.2F, 0.4F, 0.0F);
+    TEST_ASSERT_EQUAL(0, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT32(RoverC::MOTOR_COUNT + RoverC::SERVO_COUNT, rover.getWriteStatistics().registerSuppressedCount);
+
+    // only the changed run of registers is written
+    RoverC::actuator_frame_t frame {{ 20, 60, 0, 0 }, { 0, 0 }};
+    rover.writeActuatorFrame(frame, RoverC::DONT_WRITE_SERVOS);
+    bus.clear();
+    frame.motorSpeeds[1] = 61;
+    frame.motorSpeeds[2] = 1;
+    rover.writeActuatorFrame(frame, RoverC::DONT_WRITE_SERVOS);
+    TEST_ASSERT_EQUAL(1, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x01, bus.transactions[0].firstRegister);
+    TEST_ASSERT_EQUAL(2, bus.transactions[0].data.size());
+}
+
+static void test_shadow_registers_are_refreshed(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.move(0.0F, 0.0F, 0.5F, 0.0F);
+    bus.clear();
+    FakeClock::advanceMs(RoverC::DEFAULT_REFRESH_INTERVAL_MS);
+    rover.move(0.0F, 0.0F, 0.5F, 0.0F);
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+    TEST_ASSERT_EQUAL_UINT32(1, rover.getWriteStatistics().refreshCount);
+}
+
+static void test_stop_zeroes_the_motors(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.move(0.0F, 0.0F, 1.0F, 0.0F);
+    rover.stop();
+    for (int ii = 0; ii < RoverC::MOTOR_COUNT; ++ii) {
+        TEST_ASSERT_EQUAL_INT8(0, bus.registers[ii]);
+    }
+}
+
+static void test_servo_pulse_is_written_as_16_bits(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.setServoPulse(0, 1500);
+    rover.setServoPulse(1, 3000);
+    TEST_ASSERT_EQUAL(2, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x20, bus.transactions[0].firstRegister);
+    TEST_ASSERT_EQUAL(2, bus.transactions[0].data.size());
+    TEST_ASSERT_EQUAL_HEX8(1500 >> 8, bus.registers[0x20]);
+    TEST_ASSERT_EQUAL_HEX8(1500 & 0xFF, bus.registers[0x21]);
+    // clipped to the maximum pulse width
+    TEST_ASSERT_EQUAL_HEX8(0x22, bus.transactions[1].firstRegister);
+    TEST_ASSERT_EQUAL_HEX8(RoverC::MAX_SERVO_PULSE_US >> 8, bus.registers[0x22]);
+    TEST_ASSERT_EQUAL_HEX8(RoverC::MAX_SERVO_PULSE_US & 0xFF, bus.registers[0x23]);
+}
+
+static void test_out_of_range_channels_are_ignored(void)
+{
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+
+    rover.move(0.0F, 0.0F, 0.5F, 0.0F);
+    bus.clear();
+    rover.setServoAngle(RoverC::SERVO_COUNT, 30);
+    rover.setServoAngle(0xFF, 30);
+    rover.setServoPulse(RoverC::SERVO_COUNT, 1500);
+    TEST_ASSERT_EQUAL(0, bus.transactions.size());
+    // the shadow registers are untouched, so an unchanged frame is still suppressed
+    rover.move(0.0F, 0.0F, 0.5F, 0.0F);
+    TEST_ASSERT_EQUAL(0, bus.transactions.size());
+
+    rover.setServoAngle(RoverC::SERVO_COUNT - 1, 30);
+    TEST_ASSERT_EQUAL(1, bus.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x11, bus.transactions[0].firstRegister);
+}
+
+/*!
+Bus time for one control update, compared with the original code, which wrote each motor and servo register in its own transaction.
+*/
+static void test_bus_time_per_update(void)
+{
+    enum { STANDARD_MODE_HZ = 100000, FAST_MODE_HZ = 400000, ROVER_ADDRESS = 0x38 };
+    FakeI2C_Bus bus;
+    RoverC rover(bus);
+    RoverC::actuator_frame_t frame {};
+    rover.mix(0.0F, 0.3F, 0.6F, 0.1F, RoverC::MECANUM_MODE, frame);
+
+    // original: one transaction per register
+    for (uint8_t ii = 0; ii < RoverC::MOTOR_COUNT; ++ii) {
+        bus.writeRegisters(ROVER_ADDRESS, ii, reinterpret_cast<const uint8_t*>(&frame.motorSpeeds[ii]), 1); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+    for (uint8_t ii = 0; ii < RoverC::SERVO_COUNT; ++ii) {
+        bus.writeRegisters(ROVER_ADDRESS, 0x10 + ii, &frame.servoAngles[ii], 1);
+    }
+    const size_t perRegisterTransactions = bus.transactions.size();
+    const uint32_t perRegisterUs = bus.getBusTimeUs(STANDARD_MODE_HZ);
+    const uint32_t perRegisterFastUs = bus.getBusTimeUs(FAST_MODE_HZ);
+
+    // burst: motors and servos in two transactions
+    bus.clear();
+    rover.writeActuatorFrame(frame);
+    const size_t burstTransactions = bus.transactions.size();
+    const uint32_t burstUs = bus.getBusTimeUs(STANDARD_MODE_HZ);
+    const uint32_t burstFastUs = bus.getBusTimeUs(FAST_MODE_HZ);
+
+    // burst with the shadow registers: the next update changes only the motor speeds
+    bus.clear();
+    frame.motorSpeeds[0] = static_cast<int8_t>(frame.motorSpeeds[0] + 1);
+    frame.motorSpeeds[3] = static_cast<int8_t>(frame.motorSpeeds[3] - 1);
+    rover.writeActuatorFrame(frame);
+    const size_t shadowTransactions = bus.transactions.size();
+    const uint32_t shadowUs = bus.getBusTimeUs(STANDARD_MODE_HZ);
+    const uint32_t shadowFastUs = bus.getBusTimeUs(FAST_MODE_HZ);
+
+    printf("I2C per update   transactions  100kHz  400kHz\n");
+    printf("  per register   %12u  %4uus  %4uus\n", static_cast<unsigned>(perRegisterTransactions), perRegisterUs, perRegisterFastUs);
+    printf("  burst          %12u  %4uus  %4uus\n", static_cast<unsigned>(burstTransactions), burstUs, burstFastUs);
+    printf("  burst + shadow %12u  %4uus  %4uus\n", static_cast<unsigned>(shadowTransactions), shadowUs, shadowFastUs);
+
+    TEST_ASSERT_EQUAL(6, perRegisterTransactions);
+    TEST_ASSERT_EQUAL(2, burstTransactions);
+    TEST_ASSERT_EQUAL(1, shadowTransactions);
+    TEST_ASSERT_LESS_THAN(perRegisterUs * 6 / 10, burstUs);
+    TEST_ASSERT_LESS_THAN(burstUs, shadowUs);
+}
+
+static void test_wire_bus_writes_register_then_data(void)
+{
+    I2C_Wire bus(RoverC::SDA_PIN, RoverC::SCL_PIN);
+    TEST_ASSERT_EQUAL(RoverC::SDA_PIN, Wire.getSdaPin());
+    TEST_ASSERT_EQUAL(RoverC::SCL_PIN, Wire.getSclPin());
+
+    const uint8_t data[] { 1, 2, 3 };
+    TEST_ASSERT_EQUAL(0, bus.writeRegisters(0x38, 0x10, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(1, Wire.transactions.size());
+    TEST_ASSERT_EQUAL_HEX8(0x38, Wire.transactions[0].address);
+    const uint8_t expected[] { 0x10, 1, 2, 3 };
+    TEST_ASSERT_EQUAL(sizeof(expected), Wire.transactions[0].data.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, Wire.transactions[0].data.data(), sizeof(expected));
+
+    Wire.endTransmissionResult = 2; // address NACK
+    TEST_ASSERT_EQUAL(2, bus.writeRegisters(0x38, 0x00, data, 1));
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_move_writes_motors_and_servos_in_two_bursts);
+    RUN_TEST(test_unchanged_frame_is_suppressed);
+    RUN_TEST(test_shadow_registers_are_refreshed);
+    RUN_TEST(test_stop_zeroes_the_motors);
+    RUN_TEST(test_servo_pulse_is_written_as_16_bits);
+    RUN_TEST(test_out_of_range_channels_are_ignored);
+    RUN_TEST(test_bus_time_per_update);
+    RUN_TEST(test_wire_bus_writes_register_then_data);
+    return UNITY_END();
+}
@@ -0,0 +1,395 @@
+#include <AtomJoyStickReceiver.h>
+#include <Benchmark.h>
+#include <JoyStickPackets.h>
+#include <MotionController.h>
+#include <RoverC.h>
+#include <RoverC_Simulator.h>
+#include <YawRateController.h>
+
+#include <Arduino.h>
+#include <cmath>
+#include <cstdio>
+#include <esp_now.h>
+#include <random>
+#include <unity.h>
+
+/*
+RoverC_Simulator tests: the kinematics and motor lag against closed form values, the IMU FIFO, and scripted runs of
+the receiver, RoverC, MotionController and YawRateController stack against the simulated chassis, with slipping wheels and mismatched motors.
+*/
+
+static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+
+static uint32_t clockUs() { return micros(); }
+
+static float degrees(float radians) { return radians * 180.0F / static_cast<float>(M_PI); }
+
+//! Advance the simulator and the fake clock together.
+static void advance(RoverC_Simulator& simulator, uint32_t durationUs)
+{
+    simulator.advance(durationUs);
+    FakeClock::advanceUs(durationUs);
+}
+
+//! The receiver, paired with the joystick, with the stick bias already set, as after binding.
+static AtomJoyStickReceiver& boundReceiver()
+{
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    FakeEspNow::reset();
+    receiver.init(1, joyStickMacAddress);
+    receiver.resetControls();
+    receiver.setBias(0.0F, 0.0F, 0.0F, 0.0F);
+    return receiver;
+}
+
+struct sticks_t {
+    float roll;
+    float pitch;
+    float yaw;
+};
+
+static sticks_t sticks(float roll, float pitch, float yaw)
+{
+    return sticks_t { roll, pitch, yaw };
+}
+
+/*!
+The control stack on the simulated chassis, stepped a period at a time as the control task would run it.
+The sticks are sent as joystick packets, received through ESP-NOW and unpacked into setpoints as the main loop does.
+The yaw rate controller uses its default configuration, as on the Rover.
+*/
+struct stack_t {
+    explicit stack_t(const RoverC_Simulator::config_t& config) :
+        receiver(boundReceiver()),
+        simulator(config),
+        rover(simulator),
+        motionController(rover, clockUs),
+        yawRateController(simulator, clockUs)
+        {}
+    //! Hold the Rover stationary until the gyro bias is calibrated.
+    void calibrate() {
+        motionController.setYawRateController(&yawRateController);
+        while (!yawRateController.isCalibrated()) {
+            step();
+        }
+    }
+    void step() {
+        motionController.update();
+        advance(simulator, MotionController::DEFAULT_PERIOD_US);
+    }
+    //! Receive a packet with the sticks and, if it unpacks, publish its setpoint.
+    void receive(const sticks_t& sticks) {
+        uint8_t packet[AtomJoyStickCodec::PACKET_SIZE];
+        makeAtomJoyStickPacket(roverMacAddress, 0.0F, sticks.roll, sticks.pitch, sticks.yaw, AtomJoyStickReceiver::MODE_STABLE, packet);
+        FakeEspNow::receive(joyStickMacAddress, packet, sizeof(packet));
+        if (receiver.unpackPacket()) {
+            const RoverC::control_mode_t controlMode = receiver.getMode() == AtomJoyStickReceiver::MODE_STABLE ? RoverC::MECANUM_MODE : RoverC::TANK_MODE;
+            motionController.setSetpoint({ receiver.getThrottle(), receiver.getRoll(), receiver.getPitch(), receiver.getYaw(), 1.0F, controlMode, receiver.getPacketTimeUs() });
+        }
+    }
+    //! Hold the sticks for `durationUs`, sending a packet every `packetIntervalUs`, as the joystick would.
+    void drive(const sticks_t& sticks, uint32_t durationUs, uint32_t packetIntervalUs=10000) {
+        uint32_t nextPacketUs = 0;
+        for (uint32_t timeUs = 0; timeUs < durationUs; timeUs += MotionController::DEFAULT_PERIOD_US) {
+            if (timeUs >= nextPacketUs) {
+                receive(sticks);
+                nextPacketUs += packetIntervalUs;
+            }
+            step();
+        }
+    }
+    AtomJoyStickReceiver& receiver;
+    RoverC_Simulator simulator;
+    RoverC rover;
+    MotionController motionController;
+    YawRateController yawRateController;
+};
+
+void setUp(void)
+{
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_forward_drive_follows_the_motor_lag(void)
+{
+    RoverC_Simulator simulator;
+    RoverC rover(simulator);
+    const RoverC_Simulator::config_t& config = simulator.getConfig();
+
+    rover.move(0.0F, 0.0F, 1.0F, 0.0F);
+    for (int wheel = 0; wheel < RoverC_Simulator::MOTOR_COUNT; ++wheel) {
+        TEST_ASSERT_EQUAL_INT8(100, simulator.getMotorRegister(wheel));
+    }
+    // after one time constant the wheels are at 63% of full speed
+    const auto timeConstantUs = static_cast<uint32_t>(config.motorTimeConstantS * 1.0e6F);
+    advance(simulator, timeConstantUs);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, config.maxWheelSpeedMPS * (1.0F - std::exp(-1.0F)), simulator.getWheelSpeedMPS(RoverC_Simulator::FRONT_LEFT));
+
+    // after a second the Rover is at full speed, and has covered the distance less the lag
+    advance(simulator, 1000000 - timeConstantUs);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, config.maxWheelSpeedMPS, simulator.getForwardSpeedMPS());
+    TEST_ASSERT_FLOAT_WITHIN(0.005F, config.maxWheelSpeedMPS * (1.0F - config.motorTimeConstantS), simulator.getPose().y);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.0F, simulator.getPose().x);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.0F, simulator.getPose().heading);
+    TEST_ASSERT_EQUAL_UINT32(1000000, simulator.getTimeUs());
+}
+
+static void test_strafe_and_rotation_directions(void)
+{
+    RoverC_Simulator simulator;
+    RoverC rover(simulator);
+    const RoverC_Simulator::config_t& config = simulator.getConfig();
+
+    // full roll strafes to the right, without turning
+    rover.move(0.0F, 1.0F, 0.0F, 0.0F);
+    advance(simulator, 1000000);
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, config.maxWheelSpeedMPS, simulator.getSidewaysSpeedMPS());
+    TEST_ASSERT_TRUE(simulator.getPose().x > 0.4F);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.0F, simulator.getPose().y);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.0F, simulator.getPose().heading);
+
+    // full yaw turns clockwise, at the wheel speed divided by the sum of the half wheelbase and half track
+    simulator.reset();
+    rover.move(0.0F, 0.0F, 0.0F, 1.0F);
+    advance(simulator, 1000000);
+    const float yawRateDPS = -degrees(config.maxWheelSpeedMPS / (config.halfWheelbaseM + config.halfTrackM));
+    TEST_ASSERT_FLOAT_WITHIN(0.5F, yawRateDPS, simulator.getYawRateDPS());
+    TEST_ASSERT_TRUE(simulator.getPose().heading < 0.0F);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 0.0F, simulator.getForwardSpeedMPS());
+}
+
+static void test_imu_fifo_reports_the_yaw_rate_and_overflows(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    config.gyroBiasDPS = 2.0F;
+    RoverC_Simulator simulator(config);
+    RoverC rover(simulator);
+    rover.move(0.0F, 0.0F, 0.0F, 0.5F);
+    advance(simulator, 1000000);
+    IMU_Interface::sample_t samples[RoverC_Simulator::IMU_FIFO_SIZE];
+    while (simulator.readSamples(samples, RoverC_Simulator::IMU_FIFO_SIZE) > 0) {}
+    TEST_ASSERT_EQUAL_UINT32(500 - RoverC_Simulator::IMU_FIFO_SIZE, simulator.getStatistics().imuOverflowCount);
+
+    // 10ms at 500Hz is five samples, reading the yaw rate plus the bias
+    advance(simulator, 10000);
+    TEST_ASSERT_EQUAL(5, simulator.readSamples(samples, RoverC_Simulator::IMU_FIFO_SIZE));
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, simulator.getYawRateDPS() + 2.0F, samples[4].gyroZ);
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, samples[4].accZ);
+    TEST_ASSERT_EQUAL(0, simulator.readSamples(samples, RoverC_Simulator::IMU_FIFO_SIZE));
+}
+
+static void test_bus_writes_are_counted_and_other_devices_nacked(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    config.transactionTimeUs = 250;
+    RoverC_Simulator simulator(config);
+    RoverC rover(simulator);
+    rover.move(0.5F, 0.0F, 1.0F, 0.0F);
+    // the motors and the servos, but only the motor registers are modelled
+    TEST_ASSERT_EQUAL_UINT32(2, simulator.getStatistics().transactionCount);
+    TEST_ASSERT_EQUAL_UINT32(RoverC_Simulator::MOTOR_COUNT, simulator.getStatistics().registerWriteCount);
+    TEST_ASSERT_EQUAL_UINT32(500, static_cast<uint32_t>(simulator.getStatistics().busTimeUs));
+
+    const uint8_t value = 0;
+    TEST_ASSERT_EQUAL_UINT8(2, simulator.writeRegisters(0x40, 0x00, &value, 1));
+    TEST_ASSERT_EQUAL_UINT32(2, simulator.getStatistics().transactionCount);
+}
+
+/*!
+One front wheel slips, so driving forwards the Rover veers. The yaw rate controller sees the rotation and corrects it.
+*/
+static void test_yaw_rate_control_corrects_a_slipping_wheel(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    config.traction[RoverC_Simulator::FRONT_LEFT] = 0.7F;
+    config.gyroBiasDPS = 1.5F;
+    config.gyroNoiseDPS = 3.0F;
+
+    stack_t openLoop(config);
+    openLoop.drive(sticks(0.0F, 0.6F, 0.0F), 3000000);
+    const float openLoopDriftDegrees = degrees(openLoop.simulator.getPose().heading);
+
+    stack_t closedLoop(config);
+    closedLoop.calibrate();
+    TEST_ASSERT_FLOAT_WITHIN(0.2F, 1.5F, closedLoop.yawRateController.getGyroBiasDPS());
+    closedLoop.drive(sticks(0.0F, 0.6F, 0.0F), 3000000);
+    const float closedLoopDriftDegrees = degrees(closedLoop.simulator.getPose().heading);
+
+    printf("SIMULATOR heading drift after 3s, open loop:%.1fdeg closed loop:%.1fdeg\n", static_cast<double>(openLoopDriftDegrees), static_cast<double>(closedLoopDriftDegrees));
+    // the left wheel slips, so the Rover veers left, counterclockwise
+    TEST_ASSERT_TRUE(openLoopDriftDegrees > 20.0F);
+    TEST_ASSERT_TRUE(std::fabs(closedLoopDriftDegrees) < openLoopDriftDegrees / 3.0F);
+    TEST_ASSERT_FLOAT_WITHIN(2.0F, 0.0F, closedLoop.yawRateController.getYawRateDPS());
+    // the closed loop Rover still drives forwards
+    TEST_ASSERT_TRUE(closedLoop.simulator.getPose().y > 0.5F);
+}
+
+/*!
+With the default configuration the controller's sign matches the chassis: the wheels all slip, so open loop the Rover
+turns slower than the yaw stick asks, and closed loop it turns at the commanded rate, clockwise, rather than running away.
+*/
+static void test_default_config_closes_the_yaw_loop(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    for (int wheel = 0; wheel < RoverC_Simulator::MOTOR_COUNT; ++wheel) {
+        config.traction[wheel] = 0.8F;
+    }
+
+    stack_t openLoop(config);
+    openLoop.drive(sticks(0.0F, 0.0F, 0.2F), 2000000);
+    const float openLoopDPS = openLoop.simulator.getYawRateDPS();
+
+    stack_t closedLoop(config);
+    closedLoop.calibrate();
+    closedLoop.drive(sticks(0.0F, 0.0F, 0.2F), 2000000);
+    const float closedLoopDPS = closedLoop.simulator.getYawRateDPS();
+    const float commandedDPS = closedLoop.receiver.getYaw() * YawRateController::defaultConfig().maxYawRateDPS;
+
+    printf("SIMULATOR yaw rate commanded:%.1fdps open loop:%.1fdps closed loop:%.1fdps\n",
+        static_cast<double>(commandedDPS), static_cast<double>(openLoopDPS), static_cast<double>(closedLoopDPS));
+    TEST_ASSERT_TRUE(commandedDPS > 30.0F);
+    TEST_ASSERT_TRUE(openLoopDPS < 0.0F && -openLoopDPS < commandedDPS * 0.9F);
+    TEST_ASSERT_FLOAT_WITHIN(3.0F, -commandedDPS, closedLoopDPS);
+    TEST_ASSERT_FLOAT_WITHIN(3.0F, commandedDPS, closedLoop.yawRateController.getYawRateDPS());
+}
+
+static void test_runs_are_repeatable(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    config.gyroNoiseDPS = 5.0F;
+    config.motorGain[RoverC_Simulator::BACK_RIGHT] = 0.9F;
+    stack_t first(config);
+    first.calibrate();
+    first.drive(sticks(0.3F, 0.5F, 0.1F), 1000000);
+
+    FakeClock::setUs(1000000);
+    stack_t second(config);
+    second.calibrate();
+    second.drive(sticks(0.3F, 0.5F, 0.1F), 1000000);
+    TEST_ASSERT_EQUAL_FLOAT(first.simulator.getPose().x, second.simulator.getPose().x);
+    TEST_ASSERT_EQUAL_FLOAT(first.simulator.getPose().y, second.simulator.getPose().y);
+    TEST_ASSERT_EQUAL_FLOAT(first.simulator.getPose().heading, second.simulator.getPose().heading);
+}
+
+enum { SCRIPT_STEP_COUNT = 3, SCRIPT_STEP_US = 1000000 };
+//! Forwards, then strafing right, then diagonally forwards and right, with the yaw stick centered throughout.
+static const sticks_t script[SCRIPT_STEP_COUNT] { { 0.0F, 0.8F, 0.0F }, { 0.8F, 0.0F, 0.0F }, { 0.5F, 0.5F, 0.0F } };
+
+struct tracking_error_t {
+    float positionM; //!< the largest distance from the reference pose at the end of a step of the script
+    float headingDegrees; //!< the heading error at the end of the script
+};
+
+//! Drive the script, recording the pose at the end of each step.
+static void driveScript(stack_t& stack, RoverC_Simulator::pose_t* poses)
+{
+    for (int ii = 0; ii < SCRIPT_STEP_COUNT; ++ii) {
+        stack.drive(script[ii], SCRIPT_STEP_US);
+        poses[ii] = stack.simulator.getPose();
+    }
+}
+
+static tracking_error_t trackingError(const RoverC_Simulator::pose_t* poses, const RoverC_Simulator::pose_t* reference)
+{
+    tracking_error_t error { 0.0F, std::fabs(degrees(poses[SCRIPT_STEP_COUNT - 1].heading)) };
+    for (int ii = 0; ii < SCRIPT_STEP_COUNT; ++ii) {
+        error.positionM = std::fmax(error.positionM, std::hypot(poses[ii].x - reference[ii].x, poses[ii].y - reference[ii].y));
+    }
+    return error;
+}
+
+/*!
+Scripted runs over randomly mismatched chassis. The pose at the end of each step of the script is compared with that of
+a perfectly matched chassis, so the score is how far the Rover is from where the driver steered it, rather than its heading alone.
+Heading drift shows up as position error, as does the distance lost to slipping wheels, which the yaw rate controller
+does not correct: it keeps the heading, but a Rover on poorly gripping wheels still falls short.
+*/
+static void test_scripted_runs_track_the_reference_trajectory(void)
+{
+    enum { RUN_COUNT = 100 };
+    std::mt19937 generator(20);
+    std::uniform_real_distribution<float> traction(0.6F, 1.0F);
+    std::uniform_real_distribution<float> gain(0.9F, 1.1F);
+
+    RoverC_Simulator::pose_t reference[SCRIPT_STEP_COUNT];
+    stack_t matched(RoverC_Simulator::defaultConfig());
+    driveScript(matched, reference);
+    // the script covers about a metre
+    TEST_ASSERT_TRUE(reference[SCRIPT_STEP_COUNT - 1].x > 0.4F && reference[SCRIPT_STEP_COUNT - 1].y > 0.4F);
+
+    tracking_error_t openLoopMax {};
+    tracking_error_t closedLoopMax {};
+    tracking_error_t openLoopSum {};
+    tracking_error_t closedLoopSum {};
+    RoverC_Simulator::pose_t poses[SCRIPT_STEP_COUNT];
+    for (int run = 0; run < RUN_COUNT; ++run) {
+        RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+        for (int wheel = 0; wheel < RoverC_Simulator::MOTOR_COUNT; ++wheel) {
+            config.traction[wheel] = traction(generator);
+            config.motorGain[wheel] = gain(generator);
+        }
+        config.gyroNoiseDPS = 2.0F;
+
+        stack_t openLoop(config);
+        driveScript(openLoop, poses);
+        const tracking_error_t openLoopError = trackingError(poses, reference);
+        openLoopMax.positionM = std::fmax(openLoopMax.positionM, openLoopError.positionM);
+        openLoopMax.headingDegrees = std::fmax(openLoopMax.headingDegrees, openLoopError.headingDegrees);
+        openLoopSum.positionM += openLoopError.positionM;
+        openLoopSum.headingDegrees += openLoopError.headingDegrees;
+
+        stack_t closedLoop(config);
+        closedLoop.calibrate();
+        driveScript(closedLoop, poses);
+        const tracking_error_t closedLoopError = trackingError(poses, reference);
+        closedLoopMax.positionM = std::fmax(closedLoopMax.positionM, closedLoopError.positionM);
+        closedLoopMax.headingDegrees = std::fmax(closedLoopMax.headingDegrees, closedLoopError.headingDegrees);
+        closedLoopSum.positionM += closedLoopError.positionM;
+        closedLoopSum.headingDegrees += closedLoopError.headingDegrees;
+    }
+    printf("SIMULATOR %d runs, position error open loop mean:%.3fm max:%.3fm, closed loop mean:%.3fm max:%.3fm\n", RUN_COUNT,
+        static_cast<double>(openLoopSum.positionM / RUN_COUNT), static_cast<double>(openLoopMax.positionM),
+        static_cast<double>(closedLoopSum.positionM / RUN_COUNT), static_cast<double>(closedLoopMax.positionM));
+    printf("SIMULATOR %d runs, heading error open loop mean:%.1fdeg max:%.1fdeg, closed loop mean:%.1fdeg max:%.1fdeg\n", RUN_COUNT,
+        static_cast<double>(openLoopSum.headingDegrees / RUN_COUNT), static_cast<double>(openLoopMax.headingDegrees),
+        static_cast<double>(closedLoopSum.headingDegrees / RUN_COUNT), static_cast<double>(closedLoopMax.headingDegrees));
+    TEST_ASSERT_TRUE(closedLoopSum.positionM < openLoopSum.positionM * 0.75F);
+    TEST_ASSERT_TRUE(closedLoopMax.positionM < openLoopMax.positionM);
+    TEST_ASSERT_TRUE(closedLoopSum.headingDegrees < openLoopSum.headingDegrees / 3.0F);
+}
+
+//! A simulated second of the closed loop stack, which must run much faster than real time.
+static void benchmark_simulated_second(void)
+{
+    RoverC_Simulator::config_t config = RoverC_Simulator::defaultConfig();
+    config.traction[RoverC_Simulator::BACK_LEFT] = 0.8F;
+    stack_t stack(config);
+    stack.calibrate();
+    const benchmark_result_t result = runBenchmark("simulated second, closed loop", [&stack](uint64_t) {
+        stack.drive(sticks(0.2F, 0.5F, 0.1F), 1000000);
+        doNotOptimize(stack.simulator.getPose());
+    });
+    TEST_ASSERT_TRUE(result.nsPerIteration < 1.0e8);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_forward_drive_follows_the_motor_lag);
+    RUN_TEST(test_strafe_and_rotation_directions);
+    RUN_TEST(test_imu_fifo_reports_the_yaw_rate_and_overflows);
+    RUN_TEST(test_bus_writes_are_counted_and_other_devices_nacked);
+    RUN_TEST(test_yaw_rate_control_corrects_a_slipping_wheel);
+    RUN_TEST(test_default_config_closes_the_yaw_loop);
+    RUN_TEST(test_runs_are_repeatable);
+    RUN_TEST(test_scripted_runs_track_the_reference_trajectory);
+    RUN_TEST(benchmark_simulated_second);
+    return UNITY_END();
+}
@@ -0,0 +1,330 @@
+#include <AtomJoyStickReceiver.h>
+#include <Benchmark.h>
+#include <SendQueue.h>
+
+#include <Arduino.h>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+#include <unity.h>
+
+/*
+SendQueue tests against a simulated radio, which completes each peer's sends in order after a delay, and can be made
+to refuse sends, to fail them, to lose their completions, or to complete them late.
+*/
+
+static uint32_t clockUs() { return micros(); }
+
+/*!
+Simulated radio: holds each accepted frame in one of `bufferCount` buffers until its completion is due.
+*/
+struct radio_t {
+    struct send_t {
+        int peerIndex;
+        uint8_t firstByte;
+        uint64_t completeUs;
+        bool success;
+        bool completionLost;
+    };
+    SendQueue* queue;
+    std::deque<send_t> inFlight;
+    std::vector<send_t> sent;
+    int bufferCount;
+    uint32_t completionDelayUs;
+    SendQueue::send_result_t result; //!< returned instead of sending, unless SEND_OK
+    float failProbability;
+    float completionLossProbability;
+    std::mt19937 generator;
+    void advanceUs(uint64_t us) {
+        const uint64_t endUs = FakeClock::timeUs + us;
+        while (!inFlight.empty() && inFlight.front().completeUs <= endUs) {
+            const send_t send = inFlight.front();
+            inFlight.pop_front();
+            const uint64_t timeUs = FakeClock::timeUs;
+            FakeClock::setUs(send.completeUs > timeUs ? send.completeUs : timeUs);
+            if (!send.completionLost) {
+                queue->onSendComplete(send.peerIndex, send.success);
+            }
+        }
+        FakeClock::setUs(endUs);
+    }
+};
+
+static SendQueue::send_result_t sendFrame(const void* context, int peerIndex, const uint8_t* data, int len)
+{
+    (void)len;
+    auto radio = static_cast<radio_t*>(const_cast<void*>(context)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    if (radio->result != SendQueue::SEND_OK) {
+        return radio->result;
+    }
+    if (static_cast<int>(radio->inFlight.size()) >= radio->bufferCount) {
+        return SendQueue::SEND_NO_MEM;
+    }
+    std::uniform_real_distribution<float> random(0.0F, 1.0F);
+    const radio_t::send_t send {
+        peerIndex, data[0], FakeClock::timeUs + radio->completionDelayUs,
+        random(radio->generator) >= radio->failProbability, random(radio->generator) < radio->completionLossProbability
+    };
+    radio->inFlight.push_back(send);
+    radio->sent.push_back(send);
+    return SendQueue::SEND_OK;
+}
+
+//! A radio with buffers to spare, that completes every send 2ms after it is made. Its queue is set once the queue is constructed.
+static radio_t makeRadio(void)
+{
+    return radio_t { nullptr, {}, {}, 8, 2000, SendQueue::SEND_OK, 0.0F, 0.0F, std::mt19937(1) };
+}
+
+static bool enqueue(SendQueue& queue, int peerIndex, uint8_t id, SendQueue::priority_t priority, uint32_t retryDeadlineUs)
+{
+    const uint8_t frame[] { id, 0, 0, 0 };
+    return queue.enqueue(peerIndex, frame, sizeof(frame), priority, retryDeadlineUs);
+}
+
+void setUp(void)
+{
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_window_and_priority(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+
+    // the window of two fills at once, the rest wait, and control frames are sent ahead of older telemetry
+    enqueue(queue, 0, 1, SendQueue::PRIORITY_TELEMETRY, 0);
+    enqueue(queue, 0, 2, SendQueue::PRIORITY_TELEMETRY, 0);
+    enqueue(queue, 0, 3, SendQueue::PRIORITY_TELEMETRY, 0);
+    enqueue(queue, 0, 4, SendQueue::PRIORITY_CONTROL, 0);
+    TEST_ASSERT_EQUAL(2, radio.sent.size());
+    TEST_ASSERT_EQUAL(4, queue.getQueuedCount());
+
+    radio.advanceUs(2000);
+    queue.process();
+    TEST_ASSERT_EQUAL(4, radio.sent.size());
+    TEST_ASSERT_EQUAL_UINT8(4, radio.sent[2].firstByte);
+    TEST_ASSERT_EQUAL_UINT8(3, radio.sent[3].firstByte);
+    radio.advanceUs(2000);
+    TEST_ASSERT_EQUAL(0, queue.getQueuedCount());
+
+    const SendQueue::peer_statistics_t& statistics = queue.getPeerStatistics(0);
+    TEST_ASSERT_EQUAL_UINT32(4, statistics.deliveredCount);
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.inFlightMax);
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.lostCount);
+    TEST_ASSERT_EQUAL_UINT32(2000 + 2000, statistics.latencyMaxUs);
+}
+
+static void test_no_mem_keeps_the_frame_queued(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.bufferCount = 1;
+
+    enqueue(queue, 0, 1, SendQueue::PRIORITY_CONTROL, 0);
+    enqueue(queue, 0, 2, SendQueue::PRIORITY_CONTROL, 0);
+    TEST_ASSERT_EQUAL(1, radio.sent.size());
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getNoMemCount());
+    radio.advanceUs(2000);
+    queue.process();
+    TEST_ASSERT_EQUAL(2, radio.sent.size());
+    radio.advanceUs(2000);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getPeerStatistics(0).deliveredCount);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getPeerStatistics(0).lostCount);
+}
+
+/*!
+A frame the radio refuses outright is retried, at the next call to `process()`, until its deadline, as a failed completion is.
+*/
+static void test_send_error_is_retried_until_the_deadline(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.result = SendQueue::SEND_ERROR;
+
+    enqueue(queue, 0, 1, SendQueue::PRIORITY_CONTROL, 10000);
+    enqueue(queue, 0, 2, SendQueue::PRIORITY_TELEMETRY, 0);
+    const SendQueue::peer_statistics_t& statistics = queue.getPeerStatistics(0);
+    // the frame with no deadline is lost, the other waits for the next call
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getQueuedCount());
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.lostCount);
+    const uint32_t failedCount = statistics.failedCount;
+    queue.process();
+    TEST_ASSERT_EQUAL_UINT32(failedCount + 1, statistics.failedCount);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getQueuedCount());
+
+    radio.advanceUs(5000);
+    radio.result = SendQueue::SEND_OK;
+    queue.process();
+    radio.advanceUs(2000);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.deliveredCount);
+    TEST_ASSERT_EQUAL_UINT8(1, radio.sent[0].firstByte);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.lostCount);
+
+    // after the deadline the frame is expired
+    radio.result = SendQueue::SEND_ERROR;
+    enqueue(queue, 0, 3, SendQueue::PRIORITY_CONTROL, 10000);
+    for (int ii = 0; ii < 20; ++ii) {
+        radio.advanceUs(1000);
+        queue.process();
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getQueuedCount());
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.expiredCount);
+    TEST_ASSERT_EQUAL_UINT32(2, statistics.lostCount);
+}
+
+/*!
+A completion that arrives after its frame has timed out is matched to that frame, not to the next frame in flight.
+*/
+static void test_late_completion_is_not_taken_for_the_next_frame(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.completionDelayUs = SendQueue::IN_FLIGHT_TIMEOUT_US + 50000;
+
+    enqueue(queue, 0, 1, SendQueue::PRIORITY_CONTROL, 0);
+    radio.completionDelayUs = 1000;
+    radio.advanceUs(SendQueue::IN_FLIGHT_TIMEOUT_US + 1);
+    queue.process();
+    const SendQueue::peer_statistics_t& statistics = queue.getPeerStatistics(0);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.failedCount);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.lostCount);
+
+    // the next frame is sent, and completes after the late completion of the first
+    enqueue(queue, 0, 2, SendQueue::PRIORITY_CONTROL, 0);
+    radio.inFlight.back().completeUs = radio.inFlight.front().completeUs + 1000;
+    radio.advanceUs(60000);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.lateCount);
+    TEST_ASSERT_EQUAL_UINT32(1, statistics.deliveredCount);
+    // the latency is that of the second frame, not the time since the first was queued
+    TEST_ASSERT_UINT32_WITHIN(10, 51000, statistics.latencyMaxUs);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getUnmatchedCount());
+}
+
+static void test_lost_completion_releases_the_window(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.completionLossProbability = 1.0F;
+
+    enqueue(queue, 0, 1, SendQueue::PRIORITY_CONTROL, 0);
+    enqueue(queue, 0, 2, SendQueue::PRIORITY_CONTROL, 0);
+    enqueue(queue, 0, 3, SendQueue::PRIORITY_CONTROL, 0);
+    TEST_ASSERT_EQUAL(2, radio.sent.size());
+    radio.completionLossProbability = 0.0F;
+    // the timed out frames hold the window until their completions are assumed lost
+    radio.advanceUs(SendQueue::IN_FLIGHT_TIMEOUT_US + 1);
+    queue.process();
+    TEST_ASSERT_EQUAL(2, radio.sent.size());
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getPeerStatistics(0).lostCount);
+    radio.advanceUs(SendQueue::COMPLETION_TIMEOUT_US - SendQueue::IN_FLIGHT_TIMEOUT_US);
+    queue.process();
+    TEST_ASSERT_EQUAL(3, radio.sent.size());
+    radio.advanceUs(2000);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getPeerStatistics(0).deliveredCount);
+}
+
+static void test_full_size_frame(void)
+{
+    FakeEspNow::reset();
+    static const uint8_t roverMacAddress[ESP_NOW_ETH_ALEN] { 0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33 };
+    static const uint8_t joyStickMacAddress[ESP_NOW_ETH_ALEN] { 0x4C, 0x75, 0x25, 0xAA, 0xBB, 0xCC };
+    static AtomJoyStickReceiver receiver(roverMacAddress);
+    TEST_ASSERT_EQUAL(ESP_OK, receiver.init(1, joyStickMacAddress));
+
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN + 1] {};
+    frame[ESP_NOW_MAX_DATA_LEN - 1] = 0xA5;
+    TEST_ASSERT_EQUAL(ESP_OK, receiver.sendData(frame, ESP_NOW_MAX_DATA_LEN));
+    TEST_ASSERT_EQUAL(1, FakeEspNow::sentFrames.size());
+    TEST_ASSERT_EQUAL(ESP_NOW_MAX_DATA_LEN, FakeEspNow::sentFrames[0].len);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, FakeEspNow::sentFrames[0].data[ESP_NOW_MAX_DATA_LEN - 1]);
+    // a frame ESP-NOW cannot send is refused as an invalid argument, not as a full queue
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, receiver.sendData(frame, ESP_NOW_MAX_DATA_LEN + 1));
+    TEST_ASSERT_EQUAL(1, FakeEspNow::sentFrames.size());
+}
+
+/*!
+Ten simulated seconds of control frames at 100Hz and telemetry at 50Hz, with failed sends, lost completions, and completions
+that arrive after the in-flight timeout. Every frame offered to the queue is accounted for exactly once, as delivered or lost.
+*/
+static void test_simulated_lossy_link(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.bufferCount = 4;
+    radio.failProbability = 0.2F;
+    radio.completionLossProbability = 0.002F;
+    std::mt19937 generator(2);
+    std::uniform_int_distribution<uint32_t> delayUs(500, 3000);
+
+    uint32_t acceptedCount = 0;
+    for (int ms = 0; ms < 10000; ++ms) {
+        if (ms % 10 == 0 && enqueue(queue, 0, 1, SendQueue::PRIORITY_CONTROL, 20000)) {
+            ++acceptedCount;
+        }
+        if (ms % 20 == 5 && enqueue(queue, 0, 2, SendQueue::PRIORITY_TELEMETRY, 0)) {
+            ++acceptedCount;
+        }
+        // occasionally a completion is held up past the in-flight timeout
+        radio.completionDelayUs = ms % 500 == 0 ? SendQueue::IN_FLIGHT_TIMEOUT_US + 20000 : delayUs(generator);
+        queue.process();
+        radio.advanceUs(1000);
+    }
+    radio.advanceUs(SendQueue::COMPLETION_TIMEOUT_US + 1000);
+    queue.process();
+    radio.advanceUs(SendQueue::COMPLETION_TIMEOUT_US + 1000);
+    queue.process();
+
+    const SendQueue::peer_statistics_t& statistics = queue.getPeerStatistics(0);
+    printf("SIMULATION queued:%u delivered:%u lost:%u expired:%u dropped:%u retries:%u late:%u\n",
+        statistics.queuedCount, statistics.deliveredCount, statistics.lostCount, statistics.expiredCount, statistics.droppedCount, statistics.retryCount, statistics.lateCount);
+    TEST_ASSERT_EQUAL_UINT32(acceptedCount, statistics.queuedCount);
+    TEST_ASSERT_EQUAL(0, queue.getQueuedCount());
+    // a frame refused by a full queue is lost without being queued
+    TEST_ASSERT_EQUAL_UINT32(1000 + 500, statistics.deliveredCount + statistics.lostCount);
+    TEST_ASSERT_TRUE(statistics.retryCount > 0);
+    TEST_ASSERT_TRUE(statistics.lateCount > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getUnmatchedCount());
+    TEST_ASSERT_TRUE(statistics.deliveredCount > statistics.queuedCount * 8 / 10);
+}
+
+static void test_benchmark_send_and_complete(void)
+{
+    radio_t radio = makeRadio();
+    SendQueue queue(clockUs, sendFrame, &radio);
+    radio.queue = &queue;
+    radio.completionDelayUs = 0;
+    const benchmark_result_t result = runBenchmark("enqueue, send and complete a frame", [&](uint64_t ii) {
+        enqueue(queue, 0, static_cast<uint8_t>(ii), SendQueue::PRIORITY_CONTROL, 0);
+        radio.advanceUs(1);
+    });
+    TEST_ASSERT_TRUE(result.nsPerIteration > 0.0);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getPeerStatistics(0).lostCount);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_window_and_priority);
+    RUN_TEST(test_no_mem_keeps_the_frame_queued);
+    RUN_TEST(test_send_error_is_retried_until_the_deadline);
+    RUN_TEST(test_late_completion_is_not_taken_for_the_next_frame);
+    RUN_TEST(test_lost_completion_releases_the_window);
+    RUN_TEST(test_full_size_frame);
+    RUN_TEST(test_simulated_lossy_link);
+    RUN_TEST(test_benchmark_send_and_complete);
+    return UNITY_END();
+}
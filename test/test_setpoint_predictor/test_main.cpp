@@ -0,0 +1,198 @@
+#include <SetpointPredictor.h>
+
+#include <cmath>
+#include <cstdint>
+#include <unity.h>
+#include <vector>
+
+/*
+SetpointPredictor tests: packet arrival patterns, with jitter and with loss, are replayed against the predictor
+a millisecond at a time, as the control loop would run it: the last values are held until a packet is late, and then predicted.
+*/
+
+struct replay_t {
+    std::vector<float> output; //!< the pitch value sent to the motion controller, for each millisecond
+    std::vector<bool> predicted; //!< whether that value was predicted
+    int predictionCount;
+};
+
+//! The stick ramps from zero to full in 500ms.
+static float ramp(uint32_t timeMs)
+{
+    return timeMs >= 500 ? 1.0F : static_cast<float>(timeMs) / 500.0F;
+}
+
+static SetpointPredictor::values_t pitchValues(float pitch)
+{
+    return SetpointPredictor::values_t {{ 0.0F, 0.0F, pitch, 0.0F }};
+}
+
+/*!
+Replay packets that arrive after each of the `gapsMs`, starting at time zero, and continue for `tailMs` after the last one.
+*/
+static replay_t replay(SetpointPredictor& predictor, const std::vector<uint32_t>& gapsMs, uint32_t tailMs, float (*stick)(uint32_t))
+{
+    uint32_t endMs = tailMs;
+    for (const auto gapMs : gapsMs) {
+        endMs += gapMs;
+    }
+    replay_t result {};
+    float held = 0.0F;
+    uint32_t nextPacketMs = 0;
+    size_t gapIndex = 0;
+    bool packetsRemain = true;
+    for (uint32_t timeMs = 0; timeMs <= endMs; ++timeMs) {
+        const uint32_t timeUs = timeMs * 1000;
+        bool predicted = false;
+        if (packetsRemain && timeMs == nextPacketMs) {
+            held = stick(timeMs);
+            predictor.addSample(timeUs, pitchValues(held));
+            if (gapIndex < gapsMs.size()) {
+                nextPacketMs += gapsMs[gapIndex];
+                ++gapIndex;
+            } else {
+                packetsRemain = false;
+            }
+        } else if (predictor.isLate(timeUs)) {
+            SetpointPredictor::values_t values {};
+            TEST_ASSERT_TRUE(predictor.predict(timeUs, values));
+            held = values.value[SetpointPredictor::PITCH];
+            predicted = true;
+            ++result.predictionCount;
+        }
+        result.output.push_back(held);
+        result.predicted.push_back(predicted);
+    }
+    return result;
+}
+
+//! The largest change from one millisecond to the next, for the predicted values.
+static float maxPredictedStep(const replay_t& result)
+{
+    float maxStep = 0.0F;
+    for (size_t ii = 1; ii < result.output.size(); ++ii) {
+        if (result.predicted[ii]) {
+            maxStep = std::fmax(maxStep, std::fabs(result.output[ii] - result.output[ii - 1]));
+        }
+    }
+    return maxStep;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_not_late_without_samples_or_before_the_threshold(void)
+{
+    SetpointPredictor predictor;
+    TEST_ASSERT_FALSE(predictor.isLate(1000000));
+    predictor.addSample(1000000, pitchValues(0.5F));
+    const uint32_t lateAfterUs = SetpointPredictor::DEFAULT_LATE_AFTER_MS * 1000;
+    TEST_ASSERT_FALSE(predictor.isLate(1000000 + lateAfterUs - 1));
+    TEST_ASSERT_TRUE(predictor.isLate(1000000 + lateAfterUs));
+    // the clock wraps around
+    predictor.addSample(UINT32_MAX - 1000, pitchValues(0.5F));
+    TEST_ASSERT_FALSE(predictor.isLate(5000));
+    TEST_ASSERT_TRUE(predictor.isLate(lateAfterUs));
+}
+
+static void test_jittered_packets_are_held_not_predicted(void)
+{
+    SetpointPredictor predictor;
+    const std::vector<uint32_t> gapsMs { 10, 12, 8, 15, 9, 20, 11, 7, 24, 10, 3, 17, 10, 22, 10, 10, 14, 6, 19, 10 };
+    const replay_t result = replay(predictor, gapsMs, 0, ramp);
+    TEST_ASSERT_EQUAL(0, result.predictionCount);
+}
+
+static void test_single_and_double_losses(void)
+{
+    SetpointPredictor predictor;
+    // packets every 10ms, with one lost packet and then two lost packets in a row
+    const std::vector<uint32_t> gapsMs { 10, 10, 10, 20, 10, 10, 30, 10, 10 };
+    const replay_t result = replay(predictor, gapsMs, 0, ramp);
+    // only the double loss is late, from 25ms to 29ms after the last packet
+    TEST_ASSERT_EQUAL(5, result.predictionCount);
+    TEST_ASSERT_TRUE(maxPredictedStep(result) < 0.03F);
+    // the prediction follows the ramp, rather than holding the last value
+    TEST_ASSERT_TRUE(result.output[99] > result.output[90]);
+    TEST_ASSERT_TRUE(result.output[99] < ramp(100));
+}
+
+/*!
+A 300ms outage while the stick is ramping: the value is extrapolated along the ramp for the horizon,
+then eased to zero over the decay time, without any step and without crossing zero.
+*/
+static void test_burst_loss_extrapolates_then_decays(void)
+{
+    SetpointPredictor predictor;
+    const std::vector<uint32_t> gapsMs { 10, 10, 10, 10, 10, 10, 10, 10, 10, 10 };
+    const replay_t result = replay(predictor, gapsMs, 300, ramp);
+    const uint32_t lastPacketMs = 100;
+    const float last = ramp(lastPacketMs);
+    const SetpointPredictor::axis_config_t& axis = predictor.getConfig().axes[SetpointPredictor::PITCH];
+
+    TEST_ASSERT_EQUAL(300 - SetpointPredictor::DEFAULT_LATE_AFTER_MS + 1, result.predictionCount);
+    TEST_ASSERT_TRUE(maxPredictedStep(result) < 0.03F);
+    // the ramp's slope is 2 per second, and half of it is extrapolated
+    const float extrapolated = last + axis.trendGain * 2.0F * static_cast<float>(axis.horizonMs) * 1.0e-3F;
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, extrapolated, result.output[lastPacketMs + axis.horizonMs]);
+    for (uint32_t timeMs = lastPacketMs; timeMs < result.output.size(); ++timeMs) {
+        TEST_ASSERT_TRUE(result.output[timeMs] >= 0.0F);
+        TEST_ASSERT_TRUE(result.output[timeMs] <= extrapolated + 0.001F);
+        if (timeMs > lastPacketMs + axis.horizonMs) {
+            TEST_ASSERT_TRUE(result.output[timeMs] <= result.output[timeMs - 1]);
+        }
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, result.output[lastPacketMs + axis.horizonMs + axis.decayMs]);
+}
+
+static void test_release_is_not_predicted_to_reverse(void)
+{
+    SetpointPredictor predictor;
+    // the stick is released from 0.1 towards zero as fast as it can be, and then the packets are lost
+    const std::vector<uint32_t> gapsMs { 10, 10, 10 };
+    const replay_t result = replay(predictor, gapsMs, 200, [](uint32_t timeMs) { return 0.1F - static_cast<float>(timeMs) * 0.003F; });
+    for (const float value : result.output) {
+        TEST_ASSERT_TRUE(value >= 0.0F);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, result.output.back());
+
+    // the dead zone stage outputs exactly zero once the stick is released, so the last sample before the loss is zero
+    SetpointPredictor released;
+    const replay_t releasedResult = replay(released, gapsMs, 200, [](uint32_t timeMs) { return timeMs >= 30 ? 0.0F : 0.6F - static_cast<float>(timeMs) * 0.02F; });
+    TEST_ASSERT_EQUAL_FLOAT(0.0F, releasedResult.output[30]);
+    for (const float value : releasedResult.output) {
+        TEST_ASSERT_TRUE(value >= 0.0F);
+    }
+}
+
+static void test_recovery_after_loss_stops_prediction(void)
+{
+    SetpointPredictor predictor;
+    const std::vector<uint32_t> gapsMs { 10, 10, 80, 10, 10, 10 };
+    const replay_t result = replay(predictor, gapsMs, 0, ramp);
+    TEST_ASSERT_EQUAL(80 - SetpointPredictor::DEFAULT_LATE_AFTER_MS, result.predictionCount);
+    // the packets after the outage are passed straight through
+    for (uint32_t timeMs = 100; timeMs <= 130; timeMs += 10) {
+        TEST_ASSERT_FALSE(result.predicted[timeMs]);
+        TEST_ASSERT_EQUAL_FLOAT(ramp(timeMs), result.output[timeMs]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_not_late_without_samples_or_before_the_threshold);
+    RUN_TEST(test_jittered_packets_are_held_not_predicted);
+    RUN_TEST(test_single_and_double_losses);
+    RUN_TEST(test_burst_loss_extrapolates_then_decays);
+    RUN_TEST(test_release_is_not_predicted_to_reverse);
+    RUN_TEST(test_recovery_after_loss_stops_prediction);
+    return UNITY_END();
+}
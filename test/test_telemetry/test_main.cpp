@@ -0,0 +1,305 @@
+#include <Telemetry.h>
+
+#include <Benchmark.h>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unity.h>
+
+/*
+Telemetry encode and decode round trips, loss and resynchronization, rejection of corrupt frames,
+and an encode and decode benchmark.
+*/
+
+static void checkValues(const Telemetry::values_t& expected, const Telemetry::values_t& actual)
+{
+    for (int ii = 0; ii < Telemetry::FIELD_COUNT; ++ii) {
+        TEST_ASSERT_EQUAL_INT32(expected.value[ii], actual.value[ii]);
+    }
+}
+
+static Telemetry::values_t makeValues(int32_t base)
+{
+    Telemetry::values_t values {};
+    for (int ii = 0; ii < Telemetry::FIELD_COUNT; ++ii) {
+        values.value[ii] = base + ii;
+    }
+    return values;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_keyframe_round_trip_with_extreme_values(void)
+{
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+    Telemetry::values_t values = makeValues(-3);
+    values.value[Telemetry::FIELD_SPEED] = INT32_MIN;
+    values.value[Telemetry::FIELD_ANGLE] = INT32_MAX;
+    values.value[Telemetry::FIELD_BATTERY_MILLIVOLTS] = 4010;
+
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    const int len = encoder.encode(values, frame, 0);
+    TEST_ASSERT_TRUE(len <= Telemetry::MAX_FRAME_SIZE);
+    TEST_ASSERT_EQUAL_UINT8(Telemetry::MAGIC, frame[0]);
+    TEST_ASSERT_EQUAL_UINT8(Telemetry::KEYFRAME_FLAG, frame[1]);
+    TEST_ASSERT_TRUE(decoder.decode(frame, len));
+    TEST_ASSERT_TRUE(decoder.isSynchronized());
+    checkValues(values, decoder.getValues());
+
+    // the deltas from the extremes wrap, and are wrapped back by the decoder
+    values.value[Telemetry::FIELD_SPEED] = INT32_MAX;
+    values.value[Telemetry::FIELD_ANGLE] = INT32_MIN;
+    const int deltaLen = encoder.encode(values, frame, 100);
+    TEST_ASSERT_EQUAL_UINT8(0, frame[1]);
+    TEST_ASSERT_TRUE(decoder.decode(frame, deltaLen));
+    checkValues(values, decoder.getValues());
+}
+
+static void test_unchanged_values_give_an_empty_delta_frame(void)
+{
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+    const Telemetry::values_t values = makeValues(100);
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    TEST_ASSERT_TRUE(decoder.decode(frame, encoder.encode(values, frame, 0)));
+
+    const int len = encoder.encode(values, frame, 100);
+    TEST_ASSERT_EQUAL(Telemetry::HEADER_SIZE + Telemetry::CHECKSUM_SIZE, len);
+    TEST_ASSERT_TRUE(decoder.decode(frame, len));
+    checkValues(values, decoder.getValues());
+
+    // one small change is a single varint byte
+    Telemetry::values_t changed = values;
+    changed.value[Telemetry::FIELD_MOTOR_2] += 5;
+    const int changedLen = encoder.encode(changed, frame, 200);
+    TEST_ASSERT_EQUAL(Telemetry::HEADER_SIZE + 1 + Telemetry::CHECKSUM_SIZE, changedLen);
+    TEST_ASSERT_TRUE(decoder.decode(frame, changedLen));
+    checkValues(changed, decoder.getValues());
+}
+
+static void test_lost_frame_waits_for_keyframe(void)
+{
+    TelemetryEncoder encoder(100, 0); // no periodic keyframes
+    TelemetryDecoder decoder;
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    TEST_ASSERT_TRUE(decoder.decode(frame, encoder.encode(makeValues(0), frame, 0)));
+
+    encoder.encode(makeValues(10), frame, 100); // lost
+    const Telemetry::values_t afterLoss = makeValues(20);
+    TEST_ASSERT_FALSE(decoder.decode(frame, encoder.encode(afterLoss, frame, 200)));
+    TEST_ASSERT_FALSE(decoder.isSynchronized());
+    TEST_ASSERT_FALSE(decoder.decode(frame, encoder.encode(makeValues(30), frame, 300)));
+    TEST_ASSERT_EQUAL_UINT32(2, decoder.getStatistics().unsynchronizedCount);
+    // the values are left as they were before the loss
+    checkValues(makeValues(0), decoder.getValues());
+
+    encoder.requestKeyframe();
+    const Telemetry::values_t resynchronized = makeValues(40);
+    TEST_ASSERT_TRUE(decoder.decode(frame, encoder.encode(resynchronized, frame, 400)));
+    TEST_ASSERT_TRUE(decoder.isSynchronized());
+    checkValues(resynchronized, decoder.getValues());
+    TEST_ASSERT_TRUE(decoder.decode(frame, encoder.encode(makeValues(41), frame, 500)));
+    checkValues(makeValues(41), decoder.getValues());
+}
+
+static void test_periodic_keyframes(void)
+{
+    TelemetryEncoder encoder(100, 4);
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    for (uint32_t ii = 0; ii < 12; ++ii) {
+        encoder.encode(makeValues(static_cast<int32_t>(ii)), frame, ii * 100);
+        TEST_ASSERT_EQUAL_UINT8(ii % 4 == 0 ? Telemetry::KEYFRAME_FLAG : 0, frame[1]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, encoder.getStatistics().keyframeCount);
+}
+
+static void test_corrupt_frames_are_rejected(void)
+{
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE + 1];
+    const Telemetry::values_t values = makeValues(1000);
+    const int len = encoder.encode(values, frame, 0);
+
+    uint8_t corrupt[Telemetry::MAX_FRAME_SIZE + 1];
+    memcpy(corrupt, frame, sizeof(frame));
+    corrupt[Telemetry::HEADER_SIZE] ^= 0x01U;
+    TEST_ASSERT_FALSE(decoder.decode(corrupt, len));
+    TEST_ASSERT_FALSE(decoder.decode(frame, Telemetry::HEADER_SIZE));
+    memcpy(corrupt, frame, sizeof(frame));
+    corrupt[0] = 'X';
+    TEST_ASSERT_FALSE(decoder.decode(corrupt, len));
+
+    // a field mask promising more fields than the frame holds, with the checksum fixed up
+    memcpy(corrupt, frame, sizeof(frame));
+    corrupt[len - 2] |= 0x80U; // the last varint now runs into the checksum
+    corrupt[len - 1] = 0;
+    for (int ii = 0; ii < len - 1; ++ii) {
+        corrupt[len - 1] = static_cast<uint8_t>(corrupt[len - 1] + corrupt[ii]);
+    }
+    TEST_ASSERT_FALSE(decoder.decode(corrupt, len));
+
+    // a trailing byte after the last field, with the checksum fixed up
+    memcpy(corrupt, frame, sizeof(frame));
+    corrupt[len - 1] = 0;
+    corrupt[len] = 0;
+    for (int ii = 0; ii < len; ++ii) {
+        corrupt[len] = static_cast<uint8_t>(corrupt[len] + corrupt[ii]);
+    }
+    TEST_ASSERT_FALSE(decoder.decode(corrupt, len + 1));
+
+    TEST_ASSERT_EQUAL_UINT32(5, decoder.getStatistics().rejectedCount);
+    TEST_ASSERT_FALSE(decoder.isSynchronized());
+    TEST_ASSERT_TRUE(decoder.decode(frame, len));
+    checkValues(values, decoder.getValues());
+}
+
+static void test_rate_limit_and_bytes_per_second(void)
+{
+    TelemetryEncoder encoder(100);
+    TEST_ASSERT_TRUE(encoder.isDue(0));
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    uint32_t byteCount = 0;
+    for (uint32_t timeMs = 0; timeMs <= 1000; timeMs += 10) {
+        if (encoder.isDue(timeMs)) {
+            byteCount += static_cast<uint32_t>(encoder.encode(makeValues(static_cast<int32_t>(timeMs)), frame, timeMs));
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(11, encoder.getStatistics().frameCount);
+    TEST_ASSERT_EQUAL_UINT32(byteCount, encoder.getStatistics().byteCount);
+    TEST_ASSERT_EQUAL_UINT32(byteCount, encoder.getStatistics().bytesPerSecond);
+    // wraps around
+    TelemetryEncoder wrapping(100);
+    wrapping.encode(makeValues(0), frame, UINT32_MAX - 50);
+    TEST_ASSERT_FALSE(wrapping.isDue(20));
+    TEST_ASSERT_TRUE(wrapping.isDue(49));
+}
+
+/*!
+A random walk of the values over a lossy link: whenever the decoder accepts a frame its values are those encoded,
+and after a loss it is resynchronized by the next keyframe, including across the sequence number wrapping.
+*/
+static void test_random_walk_over_lossy_link(void)
+{
+    TelemetryEncoder encoder(100, 10);
+    TelemetryDecoder decoder;
+    std::mt19937 generator(2024);
+    Telemetry::values_t values = makeValues(0);
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    int lostCount = 0;
+    int sinceLoss = 0;
+    for (uint32_t ii = 0; ii < 2000; ++ii) {
+        for (auto& value : values.value) {
+            if (generator() % 3 == 0) {
+                value += static_cast<int32_t>(generator() % 2001) - 1000;
+            }
+        }
+        const int len = encoder.encode(values, frame, ii * 100);
+        if (generator() % 10 == 0) {
+            ++lostCount;
+            sinceLoss = 0;
+            continue;
+        }
+        ++sinceLoss;
+        if (decoder.decode(frame, len)) {
+            checkValues(values, decoder.getValues());
+        } else {
+            // only delta frames after a loss are dropped, and at most until the next keyframe
+            TEST_ASSERT_EQUAL_UINT8(0, frame[1]);
+            TEST_ASSERT_TRUE(sinceLoss < 10);
+        }
+    }
+    TEST_ASSERT_TRUE(lostCount > 100);
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getStatistics().rejectedCount);
+}
+
+/*!
+A stream of values as the rover reports them: the speed and angle change every frame and the motors follow them,
+the battery voltage falls slowly, the packet rate wanders around 100 and the error counters rarely change.
+*/
+static void makeStream(Telemetry::values_t* stream, int count)
+{
+    std::mt19937 generator(15);
+    Telemetry::values_t values {};
+    values.value[Telemetry::FIELD_BATTERY_MILLIVOLTS] = 4100;
+    values.value[Telemetry::FIELD_BATTERY_LEVEL] = 90;
+    for (int ii = 0; ii < count; ++ii) {
+        values.value[Telemetry::FIELD_SPEED] = std::max(-100, std::min(100, values.value[Telemetry::FIELD_SPEED] + static_cast<int32_t>(generator() % 21) - 10));
+        values.value[Telemetry::FIELD_ANGLE] = std::max(-100, std::min(100, values.value[Telemetry::FIELD_ANGLE] + static_cast<int32_t>(generator() % 11) - 5));
+        for (int motor = 0; motor < 4; ++motor) {
+            const int32_t sign = (motor & 1U) ? -1 : 1;
+            values.value[Telemetry::FIELD_MOTOR_1 + motor] = values.value[Telemetry::FIELD_SPEED] + sign * values.value[Telemetry::FIELD_ANGLE] / 2;
+        }
+        if (ii % 50 == 49) {
+            values.value[Telemetry::FIELD_BATTERY_MILLIVOLTS] -= 10;
+        }
+        values.value[Telemetry::FIELD_PACKETS_PER_SECOND] = 98 + static_cast<int32_t>(generator() % 5);
+        if (generator() % 20 == 0) {
+            ++values.value[Telemetry::FIELD_GAP_COUNT];
+            values.value[Telemetry::FIELD_LONGEST_GAP_MS] = std::max(values.value[Telemetry::FIELD_LONGEST_GAP_MS], static_cast<int32_t>(generator() % 60));
+        }
+        stream[ii] = values;
+    }
+}
+
+static void test_benchmark_encode_and_decode(void)
+{
+    // a multiple of the keyframe interval, so that the stream restarts on a keyframe
+    enum { STREAM_SIZE = 20 * TelemetryEncoder::DEFAULT_KEYFRAME_INTERVAL };
+    static Telemetry::values_t stream[STREAM_SIZE];
+    makeStream(stream, STREAM_SIZE);
+
+    TelemetryEncoder encoder;
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+    runBenchmark("TelemetryEncoder::encode, rover values", [&](uint64_t ii) {
+        doNotOptimize(encoder.encode(stream[ii % STREAM_SIZE], frame, static_cast<uint32_t>(ii) * TelemetryEncoder::DEFAULT_INTERVAL_MS));
+        doNotOptimize(frame);
+    });
+
+    TelemetryEncoder streamEncoder;
+    static uint8_t frames[STREAM_SIZE][Telemetry::MAX_FRAME_SIZE];
+    int lengths[STREAM_SIZE];
+    int byteCount = 0;
+    for (int ii = 0; ii < STREAM_SIZE; ++ii) {
+        lengths[ii] = streamEncoder.encode(stream[ii], frames[ii], static_cast<uint32_t>(ii) * TelemetryEncoder::DEFAULT_INTERVAL_MS);
+        byteCount += lengths[ii];
+    }
+    printf("TELEMETRY %.1f bytes per frame, %d bytes per frame uncompressed\n",
+        static_cast<double>(byteCount) / STREAM_SIZE, static_cast<int>(sizeof(Telemetry::values_t)));
+
+    TelemetryDecoder decoder;
+    const benchmark_result_t result = runBenchmark("TelemetryDecoder::decode, rover values", [&](uint64_t ii) {
+        const uint64_t index = ii % STREAM_SIZE;
+        doNotOptimize(decoder.decode(frames[index], lengths[index]));
+    });
+    TEST_ASSERT_TRUE(result.nsPerIteration > 0.0);
+    // every frame is decoded, in sequence or after the keyframe that restarts the stream
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getStatistics().rejectedCount);
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getStatistics().unsynchronizedCount);
+    checkValues(stream[(result.iterations - 1) % STREAM_SIZE], decoder.getValues());
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_keyframe_round_trip_with_extreme_values);
+    RUN_TEST(test_unchanged_values_give_an_empty_delta_frame);
+    RUN_TEST(test_lost_frame_waits_for_keyframe);
+    RUN_TEST(test_periodic_keyframes);
+    RUN_TEST(test_corrupt_frames_are_rejected);
+    RUN_TEST(test_rate_limit_and_bytes_per_second);
+    RUN_TEST(test_random_walk_over_lossy_link);
+    RUN_TEST(test_benchmark_encode_and_decode);
+    return UNITY_END();
+}
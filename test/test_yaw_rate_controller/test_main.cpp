@@ -0,0 +1,234 @@
+#include <BusMutex.h>
+#include <IMU_Interface.h>
+#include <IMU_MPU6886.h>
+#include <YawRateController.h>
+
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unity.h>
+
+/*
+YawRateController tests against a simulated IMU, and a check that the MPU6886 reads hold the internal bus mutex.
+*/
+
+/*!
+Simulated IMU: each read returns the samples accumulated at the sample rate since the previous read,
+with the gyro z reading minus the yaw rate, plus a fixed bias and uniform noise. As on the Rover, the gyro z axis points up,
+so the clockwise rotation driven by a positive rotation term reads negative. Each read advances the clock by `readTimeUs`.
+*/
+class FakeIMU : public IMU_Interface {
+public:
+    enum { SAMPLE_RATE_HZ = 500 };
+public:
+    int readSamples(sample_t* samples, int maxCount) override {
+        const uint64_t timeUs = FakeClock::timeUs;
+        int count = static_cast<int>((timeUs - _lastReadUs) * SAMPLE_RATE_HZ / 1000000);
+        count = count < maxCount ? count : maxCount;
+        _lastReadUs += static_cast<uint64_t>(count) * 1000000 / SAMPLE_RATE_HZ;
+        std::uniform_real_distribution<float> noise(-noiseDPS, noiseDPS);
+        for (int ii = 0; ii < count; ++ii) {
+            samples[ii] = sample_t { 0.0F, 0.0F, 1.0F, 0.0F, 0.0F, -yawRateDPS + biasDPS + noise(_generator) };
+        }
+        FakeClock::advanceUs(readTimeUs);
+        return count;
+    }
+    uint32_t getSampleRateHz(void) const override { return SAMPLE_RATE_HZ; }
+    void start(void) { _lastReadUs = FakeClock::timeUs; }
+public:
+    float yawRateDPS {0.0F};
+    float biasDPS {0.0F};
+    float noiseDPS {0.0F};
+    uint32_t readTimeUs {0};
+private:
+    uint64_t _lastReadUs {0};
+    std::mt19937 _generator {18};
+};
+
+enum { PERIOD_US = 5000 };
+static constexpr float DELTA_T = PERIOD_US * 1.0e-6F;
+
+static uint32_t clockUs() { return micros(); }
+
+static void calibrate(YawRateController& controller)
+{
+    while (!controller.isCalibrated()) {
+        FakeClock::advanceUs(PERIOD_US);
+        controller.update(0.0F, DELTA_T, false);
+    }
+}
+
+/*!
+Drive the Rover for `durationUs` with the yaw command held, where the chassis turns at `efficiency` of the rate the rotation
+term asks for, because the wheels slip, and responds with a 50ms time constant. Returns the final yaw rate.
+*/
+static float drive(YawRateController& controller, FakeIMU& imu, float yawCommand, float efficiency, bool closedLoop, uint32_t durationUs)
+{
+    const float maxYawRateDPS = YawRateController::defaultConfig().maxYawRateDPS;
+    for (uint32_t timeUs = 0; timeUs < durationUs; timeUs += PERIOD_US) {
+        FakeClock::advanceUs(PERIOD_US);
+        const float rotation = controller.update(yawCommand, DELTA_T, closedLoop);
+        const float targetDPS = rotation * maxYawRateDPS * efficiency;
+        imu.yawRateDPS += (targetDPS - imu.yawRateDPS) * DELTA_T / 0.05F;
+    }
+    return imu.yawRateDPS;
+}
+
+void setUp(void)
+{
+    FakeClock::setUs(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_calibration_measures_the_gyro_bias(void)
+{
+    FakeIMU imu;
+    imu.biasDPS = 3.0F;
+    imu.noiseDPS = 1.0F;
+    imu.start();
+    YawRateController controller(imu, clockUs);
+    TEST_ASSERT_FALSE(controller.isCalibrated());
+    calibrate(controller);
+    TEST_ASSERT_FLOAT_WITHIN(0.1F, 3.0F, controller.getGyroBiasDPS());
+    TEST_ASSERT_TRUE(controller.getStatistics().sampleCount >= YawRateController::defaultConfig().calibrationSampleCount);
+
+    // once calibrated the bias is removed from the measured rate
+    imu.yawRateDPS = 90.0F;
+    FakeClock::advanceUs(PERIOD_US);
+    controller.update(0.0F, DELTA_T, false);
+    TEST_ASSERT_FLOAT_WITHIN(1.0F, 90.0F, controller.getYawRateDPS());
+}
+
+static void test_empty_batch_keeps_the_previous_rate(void)
+{
+    FakeIMU imu;
+    imu.start();
+    YawRateController controller(imu, clockUs);
+    calibrate(controller);
+    imu.yawRateDPS = 45.0F;
+    FakeClock::advanceUs(PERIOD_US);
+    controller.update(0.0F, DELTA_T, false);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 45.0F, controller.getYawRateDPS());
+
+    const uint32_t emptyBatchCount = controller.getStatistics().emptyBatchCount;
+    imu.yawRateDPS = 0.0F;
+    controller.update(0.0F, DELTA_T, false); // no time has passed, so there are no new samples
+    TEST_ASSERT_EQUAL_UINT32(emptyBatchCount + 1, controller.getStatistics().emptyBatchCount);
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 45.0F, controller.getYawRateDPS());
+}
+
+static void test_closed_loop_corrects_for_wheel_slip(void)
+{
+    FakeIMU imu;
+    imu.biasDPS = -2.0F;
+    imu.noiseDPS = 2.0F;
+    imu.start();
+    YawRateController controller(imu, clockUs);
+    calibrate(controller);
+
+    // a quarter of full yaw asks for 90dps, but with 70% efficiency open loop only gives 63dps
+    const float openLoopDPS = drive(controller, imu, 0.25F, 0.7F, false, 1000000);
+    TEST_ASSERT_FLOAT_WITHIN(1.0F, 63.0F, openLoopDPS);
+    const float closedLoopDPS = drive(controller, imu, 0.25F, 0.7F, true, 2000000);
+    TEST_ASSERT_FLOAT_WITHIN(2.0F, 90.0F, closedLoopDPS);
+
+    // releasing the stick, the closed loop brings the Rover back to zero rate
+    const float releasedDPS = drive(controller, imu, 0.0F, 0.7F, true, 2000000);
+    TEST_ASSERT_FLOAT_WITHIN(2.0F, 0.0F, releasedDPS);
+}
+
+static void test_slow_imu_read_is_over_budget(void)
+{
+    FakeIMU imu;
+    imu.start();
+    YawRateController controller(imu, clockUs);
+    controller.update(0.0F, DELTA_T, false);
+    TEST_ASSERT_EQUAL_UINT32(0, controller.getStatistics().overBudgetCount);
+    imu.readTimeUs = YawRateController::DEFAULT_CYCLE_BUDGET_US + 500;
+    controller.update(0.0F, DELTA_T, false);
+    TEST_ASSERT_EQUAL_UINT32(1, controller.getStatistics().overBudgetCount);
+    TEST_ASSERT_EQUAL_UINT32(imu.readTimeUs, controller.getStatistics().cycleTimeMaxUs);
+}
+
+//! The MPU6886's FIFO always holds two samples.
+static bool readMPU6886(uint8_t address, uint8_t reg, uint8_t* data, size_t len)
+{
+    (void)address;
+    if (reg == 0x72) { // FIFO_COUNTH
+        data[0] = 0;
+        data[1] = 28;
+    } else {
+        memset(data, 0, len);
+    }
+    return true;
+}
+
+/*!
+The motion task reads the IMU while the control loop reads the AXP192 power management, on the same bus.
+With both holding the bus mutex the transactions never overlap, without it in the control loop they do.
+*/
+static void test_imu_reads_hold_the_bus_mutex(void)
+{
+    M5.In_I2C.readHandler = readMPU6886;
+    M5.In_I2C.busyUs = 50;
+    BusMutex busMutex;
+    IMU_MPU6886 imu(busMutex);
+    TEST_ASSERT_TRUE(imu.init());
+
+    enum { AXP192_ADDRESS = 0x34, REGISTER_BATTERY_VOLTAGE = 0x78, READ_COUNT = 200 };
+    auto readPower = [&busMutex](bool lock) {
+        uint8_t data[2];
+        for (int ii = 0; ii < READ_COUNT; ++ii) {
+            if (lock) {
+                busMutex.lock();
+            }
+            M5.In_I2C.readRegister(AXP192_ADDRESS, REGISTER_BATTERY_VOLTAGE, data, sizeof(data), 400000);
+            if (lock) {
+                busMutex.unlock();
+            }
+            std::this_thread::yield();
+        }
+    };
+    int sampleCount = 0;
+    auto readIMU = [&imu, &sampleCount]() {
+        IMU_Interface::sample_t samples[4];
+        for (int ii = 0; ii < READ_COUNT; ++ii) {
+            sampleCount += imu.readSamples(samples, 4);
+            std::this_thread::yield();
+        }
+    };
+
+    M5.In_I2C.overlapCount = 0;
+    std::thread motionTask(readIMU);
+    readPower(true);
+    motionTask.join();
+    TEST_ASSERT_EQUAL(2 * READ_COUNT, sampleCount);
+    TEST_ASSERT_EQUAL_UINT32(0, M5.In_I2C.overlapCount);
+
+    std::thread unlockedMotionTask(readIMU);
+    readPower(false);
+    unlockedMotionTask.join();
+    TEST_ASSERT_TRUE(M5.In_I2C.overlapCount > 0);
+
+    M5.In_I2C.readHandler = nullptr;
+    M5.In_I2C.busyUs = 0;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_calibration_measures_the_gyro_bias);
+    RUN_TEST(test_empty_batch_keeps_the_previous_rate);
+    RUN_TEST(test_closed_loop_corrects_for_wheel_slip);
+    RUN_TEST(test_slow_imu_read_is_over_budget);
+    RUN_TEST(test_imu_reads_hold_the_bus_mutex);
+    return UNITY_END();
+}